@@ -10,29 +10,51 @@ fi
 
 echo "Building Linux $CONFIG configuration..."
 
+# Library sources (without extension)
+LIB_SOURCES="EasyMidiLib EasyMidiLib_linuxAlsa EasyMidiLibClock EasyMidiLibMtc EasyMidiLibMerge EasyMidiLibPool EasyMidiLibDispatch EasyMidiLibStats EasyMidiLibTrace EasyMidiLibRealtime EasyMidiLibLog EasyMidiLibSmf EasyMidiLibSmfPlayer EasyMidiLibSmfRecorder EasyMidiLibCapture EasyMidiLibRetroBuffer EasyMidiLibEventIndex EasyMidiLibUmp EasyMidiLibMpe EasyMidiLibBroadcast EasyMidiLibShm"
+
+# Sources built as C++20 (coroutines)
+LIB_SOURCES_CXX20="EasyMidiLibAsync"
+
+# Test apps built as C++20 (without extension), run after the build, no MIDI hardware needed
+TEST_SOURCES_CXX20="EasyMidiLibAsyncTest"
+
+# Benchmark apps (without extension), one program each
+BENCH_SOURCES="EasyMidiLibBenchClock EasyMidiLibBenchOpen EasyMidiLibBenchJitter EasyMidiLibBenchSmf EasyMidiLibBenchIndex EasyMidiLibBenchUmp EasyMidiLibBenchRealtime"
+
 # Create directories
 mkdir -p lib/linux/x64/$CONFIG
 mkdir -p bin/$CONFIG
 mkdir -p _intermediate/$CONFIG
 
 if [ "$CONFIG" = "Debug" ]; then
-    # Debug build
-    echo "Compiling library (Debug)..."
-    clang++ -c -g -O0 -Iinclude src/EasyMidiLib.cpp -o _intermediate/Debug/EasyMidiLib.o
-    clang++ -c -g -O0 -Iinclude src/EasyMidiLib_linuxAlsa.cpp -o _intermediate/Debug/EasyMidiLib_linuxAlsa.o
-    ar rcs lib/linux/x64/Debug/libEasyMidiLib.a _intermediate/Debug/EasyMidiLib.o _intermediate/Debug/EasyMidiLib_linuxAlsa.o
-    
-    echo "Compiling test app (Debug)..."
-    clang++ -g -O0 -Iinclude src/EasyMidiLibTest.cpp lib/linux/x64/Debug/libEasyMidiLib.a -lasound -lpthread -o bin/Debug/EasyMidiLibTest
+    FLAGS="-std=c++17 -g -O0"
 else
-    # Release build
-    echo "Compiling library (Release)..."
-    clang++ -c -O2 -Iinclude src/EasyMidiLib.cpp -o _intermediate/Release/EasyMidiLib.o
-    clang++ -c -O2 -Iinclude src/EasyMidiLib_linuxAlsa.cpp -o _intermediate/Release/EasyMidiLib_linuxAlsa.o
-    ar rcs lib/linux/x64/Release/libEasyMidiLib.a _intermediate/Release/EasyMidiLib.o _intermediate/Release/EasyMidiLib_linuxAlsa.o
-    
-    echo "Compiling test app (Release)..."
-    clang++ -O2 -Iinclude src/EasyMidiLibTest.cpp lib/linux/x64/Release/libEasyMidiLib.a -lasound -lpthread -o bin/Release/EasyMidiLibTest
+    FLAGS="-std=c++17 -O2"
 fi
 
-echo "Linux $CONFIG build completed!"
\ No newline at end of file
+echo "Compiling library ($CONFIG)..."
+OBJECTS=""
+for SRC in $LIB_SOURCES $LIB_SOURCES_CXX20; do
+    case " $LIB_SOURCES_CXX20 " in *" $SRC "*) STD="-std=c++20" ;; *) STD="" ;; esac
+    clang++ -c $FLAGS $STD -Iinclude src/$SRC.cpp -o _intermediate/$CONFIG/$SRC.o || exit 1
+    OBJECTS="$OBJECTS _intermediate/$CONFIG/$SRC.o"
+done
+rm -f lib/linux/x64/$CONFIG/libEasyMidiLib.a
+ar rcs lib/linux/x64/$CONFIG/libEasyMidiLib.a $OBJECTS
+
+echo "Compiling test app ($CONFIG)..."
+clang++ $FLAGS -Iinclude src/EasyMidiLibTest.cpp lib/linux/x64/$CONFIG/libEasyMidiLib.a -lasound -lpthread -lrt -o bin/$CONFIG/EasyMidiLibTest
+
+echo "Compiling and running tests ($CONFIG)..."
+for SRC in $TEST_SOURCES_CXX20; do
+    clang++ $FLAGS -std=c++20 -Iinclude src/$SRC.cpp lib/linux/x64/$CONFIG/libEasyMidiLib.a -lasound -lpthread -lrt -o bin/$CONFIG/$SRC || exit 1
+    bin/$CONFIG/$SRC || exit 1
+done
+
+echo "Compiling benchmarks ($CONFIG)..."
+for SRC in $BENCH_SOURCES; do
+    clang++ $FLAGS -Iinclude src/$SRC.cpp lib/linux/x64/$CONFIG/libEasyMidiLib.a -lasound -lpthread -lrt -o bin/$CONFIG/$SRC || exit 1
+done
+
+echo "Linux $CONFIG build completed!"
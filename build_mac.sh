@@ -10,49 +10,55 @@ fi
 
 echo "Building macOS $CONFIG configuration..."
 
+# Library sources (without extension)
+LIB_SOURCES="EasyMidiLib_macCoreMidi EasyMidiLib EasyMidiLibClock EasyMidiLibMtc EasyMidiLibMerge EasyMidiLibPool EasyMidiLibDispatch EasyMidiLibStats EasyMidiLibTrace EasyMidiLibRealtime EasyMidiLibLog EasyMidiLibSmf EasyMidiLibSmfPlayer EasyMidiLibSmfRecorder EasyMidiLibCapture EasyMidiLibRetroBuffer EasyMidiLibEventIndex EasyMidiLibUmp EasyMidiLibMpe EasyMidiLibBroadcast EasyMidiLibShm"
+
+# Sources built as C++20 (coroutines)
+LIB_SOURCES_CXX20="EasyMidiLibAsync"
+
+# Test apps built as C++20 (without extension), run after the build, no MIDI hardware needed
+TEST_SOURCES_CXX20="EasyMidiLibAsyncTest"
+
+# Benchmark apps (without extension), one program each
+BENCH_SOURCES="EasyMidiLibBenchClock EasyMidiLibBenchOpen EasyMidiLibBenchJitter EasyMidiLibBenchSmf EasyMidiLibBenchIndex EasyMidiLibBenchUmp EasyMidiLibBenchRealtime"
+
 # Create directories
 mkdir -p lib/mac/universal/$CONFIG
 mkdir -p bin/mac/universal/$CONFIG
 mkdir -p _intermediate/$CONFIG
 
 if [ "$CONFIG" = "Debug" ]; then
-    # Debug build - ARM64
-    echo "Compiling library for ARM64 (Debug)..."
-    clang++ -c -g -O0 -arch arm64 -Iinclude src/EasyMidiLib_macCoreMidi.cpp -o _intermediate/Debug/EasyMidiLib_macCoreMidi_arm64.o
-    clang++ -c -g -O0 -arch arm64 -Iinclude src/EasyMidiLib.cpp -o _intermediate/Debug/EasyMidiLib_arm64.o
-    
-    # Debug build - x86_64
-    echo "Compiling library for x86_64 (Debug)..."
-    clang++ -c -g -O0 -arch x86_64 -Iinclude src/EasyMidiLib_macCoreMidi.cpp -o _intermediate/Debug/EasyMidiLib_macCoreMidi_x86_64.o
-    clang++ -c -g -O0 -arch x86_64 -Iinclude src/EasyMidiLib.cpp -o _intermediate/Debug/EasyMidiLib_x86_64.o
-    
-    # Create universal library using libtool
-    libtool -static -o lib/mac/universal/Debug/libEasyMidiLib.a _intermediate/Debug/EasyMidiLib_macCoreMidi_arm64.o _intermediate/Debug/EasyMidiLib_arm64.o _intermediate/Debug/EasyMidiLib_macCoreMidi_x86_64.o _intermediate/Debug/EasyMidiLib_x86_64.o
-    
-    echo "Compiling test app (Debug)..."
-    clang++ -g -O0 -arch arm64 -arch x86_64 -Iinclude src/EasyMidiLibTest.cpp lib/mac/universal/Debug/libEasyMidiLib.a -framework CoreMIDI -framework CoreFoundation -o bin/mac/universal/Debug/EasyMidiLibTest
-    
-    # Clean up intermediate files (optional - you can keep them in _intermediate/)
-    # rm _intermediate/Debug/EasyMidiLib_arm64.o _intermediate/Debug/EasyMidiLib_x86_64.o
+    FLAGS="-std=c++17 -g -O0"
 else
-    # Release build - ARM64
-    echo "Compiling library for ARM64 (Release)..."
-    clang++ -c -O2 -arch arm64 -Iinclude src/EasyMidiLib_macCoreMidi.cpp -o _intermediate/Release/EasyMidiLib_macCoreMidi_arm64.o
-    clang++ -c -O2 -arch arm64 -Iinclude src/EasyMidiLib.cpp -o _intermediate/Release/EasyMidiLib_arm64.o
-    
-    # Release build - x86_64
-    echo "Compiling library for x86_64 (Release)..."
-    clang++ -c -O2 -arch x86_64 -Iinclude src/EasyMidiLib_macCoreMidi.cpp -o _intermediate/Release/EasyMidiLib_macCoreMidi_x86_64.o
-    clang++ -c -O2 -arch x86_64 -Iinclude src/EasyMidiLib.cpp -o _intermediate/Release/EasyMidiLib_x86_64.o
-    
-    # Create universal library using libtool
-    libtool -static -o lib/mac/universal/Release/libEasyMidiLib.a _intermediate/Release/EasyMidiLib_macCoreMidi_arm64.o _intermediate/Release/EasyMidiLib_arm64.o _intermediate/Release/EasyMidiLib_macCoreMidi_x86_64.o _intermediate/Release/EasyMidiLib_x86_64.o
-    
-    echo "Compiling test app (Release)..."
-    clang++ -O2 -arch arm64 -arch x86_64 -Iinclude src/EasyMidiLibTest.cpp lib/mac/universal/Release/libEasyMidiLib.a -framework CoreMIDI -framework CoreFoundation -o bin/mac/universal/Release/EasyMidiLibTest
-    
-    # Clean up intermediate files (optional - you can keep them in _intermediate/)
-    # rm _intermediate/Release/EasyMidiLib_arm64.o _intermediate/Release/EasyMidiLib_x86_64.o
+    FLAGS="-std=c++17 -O2"
 fi
 
-echo "macOS $CONFIG build completed!"
\ No newline at end of file
+# Build every source for ARM64 and x86_64
+OBJECTS=""
+for ARCH in arm64 x86_64; do
+    echo "Compiling library for $ARCH ($CONFIG)..."
+    for SRC in $LIB_SOURCES $LIB_SOURCES_CXX20; do
+        case " $LIB_SOURCES_CXX20 " in *" $SRC "*) STD="-std=c++20" ;; *) STD="" ;; esac
+        clang++ -c $FLAGS $STD -arch $ARCH -Iinclude src/$SRC.cpp -o _intermediate/$CONFIG/${SRC}_$ARCH.o || exit 1
+        OBJECTS="$OBJECTS _intermediate/$CONFIG/${SRC}_$ARCH.o"
+    done
+done
+
+# Create universal library using libtool
+libtool -static -o lib/mac/universal/$CONFIG/libEasyMidiLib.a $OBJECTS
+
+echo "Compiling test app ($CONFIG)..."
+clang++ $FLAGS -arch arm64 -arch x86_64 -Iinclude src/EasyMidiLibTest.cpp lib/mac/universal/$CONFIG/libEasyMidiLib.a -framework CoreMIDI -framework CoreFoundation -o bin/mac/universal/$CONFIG/EasyMidiLibTest
+
+echo "Compiling and running tests ($CONFIG)..."
+for SRC in $TEST_SOURCES_CXX20; do
+    clang++ $FLAGS -std=c++20 -arch arm64 -arch x86_64 -Iinclude src/$SRC.cpp lib/mac/universal/$CONFIG/libEasyMidiLib.a -framework CoreMIDI -framework CoreFoundation -o bin/mac/universal/$CONFIG/$SRC || exit 1
+    bin/mac/universal/$CONFIG/$SRC || exit 1
+done
+
+echo "Compiling benchmarks ($CONFIG)..."
+for SRC in $BENCH_SOURCES; do
+    clang++ $FLAGS -arch arm64 -arch x86_64 -Iinclude src/$SRC.cpp lib/mac/universal/$CONFIG/libEasyMidiLib.a -framework CoreMIDI -framework CoreFoundation -o bin/mac/universal/$CONFIG/$SRC || exit 1
+done
+
+echo "macOS $CONFIG build completed!"
@@ -2,12 +2,20 @@
 #define _EASYMIDILIB_H
 
 #include <string>
+#include <vector>
 #include <cstdint>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include "EasyMidiLibLog.h"
 
 //--------------------------------------------------------------------------------------------------------------------------
 
 struct EasyMidiLibDevice        ;
+struct EasyMidiLibEvent         ;
 class  EasyMidiLibListener      ;
+class  EasyMidiLibInputTap      ;
 
 //--------------------------------------------------------------------------------------------------------------------------
 // Main control
@@ -17,6 +25,43 @@ bool        EasyMidiLib_init         ( EasyMidiLibListener* listener=0 );
 bool        EasyMidiLib_update       ( );
 void        EasyMidiLib_done         ( );
 const char* EasyMidiLib_getLastError ( );
+uint64_t    EasyMidiLib_getTimestamp ( ); // monotonic nanoseconds, same time base as the input timestamps
+
+// The Begin open/close variants run on a small worker pool so many ports can come up in parallel. Requests for the same
+// device run in order. 'done' (optional) and the listener deviceOpen/deviceClose run on the worker thread; the future
+// carries the same result. EasyMidiLib_done() waits for the queued requests.
+
+void        EasyMidiLib_setWorkerThreads ( size_t count ); // default 4, applies the next time the pool starts
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Real-time options for the library's own threads
+//
+// Set them before EasyMidiLib_init, they apply to the threads started afterwards. The ALSA input and enumeration threads,
+// the dispatch and worker pools and the clock, MTC and merge threads each have a role. SCHED_FIFO/SCHED_RR priorities are
+// 1-99 and need CAP_SYS_NICE or an rtprio limit on Linux; Windows maps them to thread priorities. The affinity mask is
+// Linux and Windows only. A setting that can't be applied leaves the thread as it was and is reported by
+// EasyMidiLib_getRealtimeError(); the library keeps working.
+//
+// EasyMidiLib_lockMemory locks the current and future pages of the process (mlockall), thread stacks included, and makes
+// the devices found afterwards pre-fault 'prefaultBytes' of their input buffers.
+//--------------------------------------------------------------------------------------------------------------------------
+
+enum class EasyMidiLibThreadRole : uint8_t
+{ Input, Enumeration, Dispatch, Worker, Timing };
+
+enum class EasyMidiLibSchedPolicy : uint8_t
+{ Default, Fifo, RoundRobin };
+
+struct EasyMidiLibThreadConfig
+{
+    EasyMidiLibSchedPolicy policy   = EasyMidiLibSchedPolicy::Default;
+    int                    priority = 0;
+    uint64_t               affinity = 0; // CPU mask, bit n = CPU n, 0 = any
+};
+
+void        EasyMidiLib_setThreadConfig  ( EasyMidiLibThreadRole role, const EasyMidiLibThreadConfig& config );
+bool        EasyMidiLib_lockMemory       ( size_t prefaultBytes=65536 ); // false if mlockall failed, see getRealtimeError
+const char* EasyMidiLib_getRealtimeError ( );                            // "" while every setting applied
 
 //--------------------------------------------------------------------------------------------------------------------------
 // Enumeration
@@ -40,6 +85,65 @@ bool EasyMidiLib_inputOpen  ( size_t enumIndex            , void* userPtrParam=0
 bool EasyMidiLib_inputOpen  ( const EasyMidiLibDevice* dev, void* userPtrParam=0, int64_t userIntParam=0 );
 void EasyMidiLib_inputClose ( const EasyMidiLibDevice* dev );
 
+std::future<bool> EasyMidiLib_inputBeginOpen  ( const EasyMidiLibDevice* dev, std::function<void(const EasyMidiLibDevice*,bool,const std::string&)> done=nullptr, void* userPtrParam=0, int64_t userIntParam=0 );
+std::future<void> EasyMidiLib_inputBeginClose ( const EasyMidiLibDevice* dev, std::function<void(const EasyMidiLibDevice*)> done=nullptr );
+
+// Bytes the listener leaves unconsumed wait in a per device queue bounded by 'capacity' (1 MB by default, keep it above
+// the largest expected SysEx). When the listener leaves more than that, whole messages are dropped, the oldest or the
+// newest ones. Block only applies to data processed on a dispatch thread (Thread or Pool mode, or a deferred device):
+// the thread waits up to 'blockTimeout' ns for the listener to make room, offering it the queue again each time
+// EasyMidiLib_inputQueueReady is called for the device (and once at the timeout). The device input thread never waits,
+// so in Inline mode Block drops like DropNewest. With a dispatch thread, the bytes the input thread hands over wait in a
+// second buffer with the same capacity: when the dispatcher falls behind, DropOldest drops the oldest reads from it, the
+// other policies the new ones, and the next message after a gap is resynchronized. Both count in 'droppedBytes'.
+
+enum class EasyMidiLibOverflowPolicy : uint8_t
+{ DropOldest, DropNewest, Block };
+
+struct EasyMidiLibQueueStats
+{
+    uint64_t capacity    ; // bytes
+    uint64_t size        ; // bytes waiting for the listener
+    uint64_t highWater   ; // largest size reached
+    uint64_t overflows   ; // times the capacity was exceeded
+    uint64_t droppedBytes; // bytes discarded (always whole messages)
+    uint64_t blockedNs   ; // time the input thread waited with the Block policy
+};
+
+void EasyMidiLib_setDefaultInputQueueLimit ( size_t capacity, EasyMidiLibOverflowPolicy policy, uint64_t blockTimeout=100000000 ); // devices found later
+void EasyMidiLib_setInputQueueLimit        ( const EasyMidiLibDevice* dev, size_t capacity, EasyMidiLibOverflowPolicy policy, uint64_t blockTimeout=100000000 );
+bool EasyMidiLib_getInputQueueStats        ( const EasyMidiLibDevice* dev, EasyMidiLibQueueStats& stats );
+void EasyMidiLib_resetInputQueueStats      ( const EasyMidiLibDevice* dev ); // high-water mark and counters
+void EasyMidiLib_inputQueueReady           ( const EasyMidiLibDevice* dev ); // the listener can take more (Block policy)
+
+// Where deviceInData, the processing helpers and the taps run. Inline: on the device input thread. Thread: on one
+// dispatcher thread. Pool: on 'poolThreads' threads (0: one per core) that steal work from each other. Each device is
+// processed by one thread at a time and in arrival order, but in Pool mode the listener is called for different devices
+// at the same time (the running status and controller aggregation of processInData are kept per device). Don't change
+// the mode from a callback.
+
+enum class EasyMidiLibDispatchMode : uint8_t
+{ Inline, Thread, Pool };
+
+void                    EasyMidiLib_setDispatchMode ( EasyMidiLibDispatchMode mode, size_t poolThreads=0 );
+EasyMidiLibDispatchMode EasyMidiLib_getDispatchMode ( );
+
+// Callback watchdog: with a budget set, deviceInData and each processing helper it runs are timed and the ones going
+// over it are reported to the listener callbackOverBudget. With 'offload' the device is also moved to deferred dispatch:
+// its data goes through the dispatch pool from then on, even in Inline mode, so the input thread keeps reading. A
+// watchdog thread also flags a deviceInData or deviceInUmp call still running past the budget: it logs a warning and,
+// with 'offload', defers the device right away; the listener gets callbackOverBudget once the call returns.
+
+void EasyMidiLib_setCallbackBudget   ( uint64_t budgetNs, bool offload=false ); // 0: off (default)
+void EasyMidiLib_setDispatchDeferred ( const EasyMidiLibDevice* dev, bool deferred );
+bool EasyMidiLib_isDispatchDeferred  ( const EasyMidiLibDevice* dev );
+
+// Input taps: the delivering threads read the tap list without locking. Taps can be added and removed from any thread,
+// their own callbacks included; once removeInputTap returns the tap is not called anymore.
+
+void EasyMidiLib_addInputTap    ( EasyMidiLibInputTap* tap );
+void EasyMidiLib_removeInputTap ( EasyMidiLibInputTap* tap );
+
 //--------------------------------------------------------------------------------------------------------------------------
 // Output
 //--------------------------------------------------------------------------------------------------------------------------
@@ -48,8 +152,15 @@ bool EasyMidiLib_outputOpen  ( size_t enumIndex            , void* userPtrParam=
 bool EasyMidiLib_outputOpen  ( const EasyMidiLibDevice* dev, void* userPtrParam=0, int64_t userIntParam=0 );
 void EasyMidiLib_outputClose ( const EasyMidiLibDevice* dev );
 
+std::future<bool> EasyMidiLib_outputBeginOpen  ( const EasyMidiLibDevice* dev, std::function<void(const EasyMidiLibDevice*,bool,const std::string&)> done=nullptr, void* userPtrParam=0, int64_t userIntParam=0 );
+std::future<void> EasyMidiLib_outputBeginClose ( const EasyMidiLibDevice* dev, std::function<void(const EasyMidiLibDevice*)> done=nullptr );
+
 bool EasyMidiLib_outputSend  ( const EasyMidiLibDevice* dev, const uint8_t* data, size_t size );
 
+bool EasyMidiLib_outputSendControlChange14 ( const EasyMidiLibDevice* dev, uint8_t channel, uint8_t controller, uint16_t value );
+bool EasyMidiLib_outputSendRpn             ( const EasyMidiLibDevice* dev, uint8_t channel, uint16_t parameter , uint16_t value );
+bool EasyMidiLib_outputSendNrpn            ( const EasyMidiLibDevice* dev, uint8_t channel, uint16_t parameter , uint16_t value );
+
 //--------------------------------------------------------------------------------------------------------------------------
 // EasyMidiLibDevice
 //--------------------------------------------------------------------------------------------------------------------------
@@ -64,7 +175,36 @@ struct EasyMidiLibDevice
     void*       userPtrParam   ;
     int64_t     userIntParam   ;
     const void* internalHandler;
+    void*       internalState  ;
+
+};
 
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibEvent (one complete timestamped message, running status expanded)
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibEvent
+{
+    uint64_t                 timestamp;
+    const EasyMidiLibDevice* device   ;
+    const uint8_t*           sysex    ; // complete SysEx (F0..F7), only valid during the callback that delivers it
+    uint32_t                 size     ;
+    uint8_t                  msg[4]   ; // short messages
+
+    const uint8_t*           data     ( ) const { return sysex ? sysex : msg; }
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibInputTap (receives every input message as events, before the listener, from the thread delivering input)
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibInputTap
+{
+    public:
+
+        virtual ~EasyMidiLibInputTap ( ) { }
+
+        virtual void inputEvents ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count ) = 0;
 };
 
 //--------------------------------------------------------------------------------------------------------------------------
@@ -101,6 +241,19 @@ enum class EasyMidiLibCC : uint8_t
 , LocalControl=122, AllNotesOff=123, OmniOff=124, OmniOn=125, MonoModeOn=126, PolyModeOn=127
 };
 
+// Protocol of the UMP channel voice messages (EasyMidiLibUmp.h): MIDI 1.0 (message type 2) or MIDI 2.0 (message type 4)
+
+enum class EasyMidiLibUmpProtocol : uint8_t
+{ Midi1, Midi2 };
+
+// Subscription type bits: one per channel message kind (bits 0-6) and one per system status byte (bit 16+low nibble)
+
+inline uint32_t EasyMidiLib_subscriptionBit ( uint8_t status ) { return status>=0xF0 ? 1u<<(16+(status & 0x0F)) : 1u<<((status>>4) & 7); }
+
+static const uint32_t EASYMIDILIB_SUBSCRIBE_ALL      = 0xFFFFFFFF;
+static const uint32_t EASYMIDILIB_SUBSCRIBE_CHANNEL  = 0x0000007F;
+static const uint32_t EASYMIDILIB_SUBSCRIBE_REALTIME = 0xFF000000;
+
 //--------------------------------------------------------------------------------------------------------------------------
 // EasyMidiLibListener
 //--------------------------------------------------------------------------------------------------------------------------
@@ -114,61 +267,179 @@ class EasyMidiLibListener
         virtual ~EasyMidiLibListener()                                                 { }
 
 
+        // The default handlers log at Info level through EasyMidiLib_log (EasyMidiLibLog.h), only when verbose
         void            setVerbose         ( bool verbose )                            { m_verbose = verbose; }
         bool            getVerbose         ( bool verbose ) const                      { return m_verbose;    }
 
 
+        // Input context (valid while deviceInData and the processing helpers run in a library thread)
+
+        const EasyMidiLibDevice* getInDevice    ( ) const;
+        uint64_t                 getInTimestamp ( ) const;
+
+
         // Library
 
-        virtual void    libInit            ( )                                         { printf("listener -> libInit()\n"); }
-        virtual void    libDone            ( )                                         { printf("listener -> libDone()\n"); }
+        virtual void    libInit            ( )                                         { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Library, "listener -> libInit()" ); }
+        virtual void    libDone            ( )                                         { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Library, "listener -> libDone()" ); }
 
 
         // Device
 
-        virtual void    deviceConnected    ( const EasyMidiLibDevice* d )              { printf("listener -> %s deviceConnected %s (%s)\n"   , d->isInput?"in":"out", d->name.c_str(), d->id.c_str() ); }
-        virtual void    deviceReconnected  ( const EasyMidiLibDevice* d )              { printf("listener -> %s deviceReconnected %s (%s)\n" , d->isInput?"in":"out", d->name.c_str(), d->id.c_str() ); }
-        virtual void    deviceDisconnected ( const EasyMidiLibDevice* d )              { printf("listener -> %s deviceDisconnected %s (%s)\n", d->isInput?"in":"out", d->name.c_str(), d->id.c_str() ); }
-        virtual void    deviceOpen         ( const EasyMidiLibDevice* d )              { printf("listener -> %s deviceOpen %s (%s)\n"        , d->isInput?"in":"out", d->name.c_str(), d->id.c_str() ); }
-        virtual void    deviceClose        ( const EasyMidiLibDevice* d )              { printf("listener -> %s deviceClosed %s (%s)\n"      , d->isInput?"in":"out", d->name.c_str(), d->id.c_str() ); }
+        virtual void    deviceConnected    ( const EasyMidiLibDevice* d )              { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Device, "listener -> %s deviceConnected %s (%s)", d->isInput?"in":"out", d->name, d->id ); }
+        virtual void    deviceReconnected  ( const EasyMidiLibDevice* d )              { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Device, "listener -> %s deviceReconnected %s (%s)", d->isInput?"in":"out", d->name, d->id ); }
+        virtual void    deviceDisconnected ( const EasyMidiLibDevice* d )              { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Device, "listener -> %s deviceDisconnected %s (%s)", d->isInput?"in":"out", d->name, d->id ); }
+        virtual void    deviceOpen         ( const EasyMidiLibDevice* d )              { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Device, "listener -> %s deviceOpen %s (%s)", d->isInput?"in":"out", d->name, d->id ); }
+        virtual void    deviceClose        ( const EasyMidiLibDevice* d )              { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Device, "listener -> %s deviceClosed %s (%s)", d->isInput?"in":"out", d->name, d->id ); }
+
+        // A listener callback took longer than the EasyMidiLib_setCallbackBudget budget ('handler' is deviceInData or the
+        // processing helper, e.g. "noteOn"); called right after it, on the same thread
+        virtual void    callbackOverBudget ( const EasyMidiLibDevice* d, const char* handler, uint64_t durationNs ) { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Warning, EasyMidiLibLogCategory::Library, "listener -> %s callbackOverBudget %s (%s) %s took %.3f ms", d->isInput?"in":"out", d->name, d->id, handler, durationNs/1e6 ); }
 
         virtual void deviceOutData ( const EasyMidiLibDevice* d, const uint8_t* data, size_t dataSize )
         { 
-            printf("listener -> %s deviceOutData %s (%s)\n    "      , d->isInput?"in":"out", d->name.c_str(), d->id.c_str() );
-            for ( size_t i=0; i!=dataSize; i++  )
-                 printf ( "%02X ", data[i] );
-            printf ("\n");
+            if ( m_verbose )
+                EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Output, "listener -> %s deviceOutData %s (%s)\n    %s", d->isInput?"in":"out", d->name, d->id, EasyMidiLibLogBytes{data, dataSize} );
         }
 
         virtual size_t deviceInData ( const EasyMidiLibDevice* d, const uint8_t* data, size_t dataSize )
         { 
-            printf("listener -> %s deviceInData %s (%s)\n    "      , d->isInput?"in":"out", d->name.c_str(), d->id.c_str() );
-            for ( size_t i=0; i!=dataSize; i++  )
-                 printf ( "%02X ", data[i] );
-            printf ("\n");
+            if ( m_verbose )
+                EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "listener -> %s deviceInData %s (%s)\n    %s", d->isInput?"in":"out", d->name, d->id, EasyMidiLibLogBytes{data, dataSize} );
 
             return processInData ( data, dataSize );
         }
 
         
+        // UMP input (optional): the input is framed and translated by the library and delivered here as Universal MIDI
+        // Packets instead of going to deviceInData; the byte queue isn't used meanwhile
+
+        void            setUmpInput        ( bool enable, EasyMidiLibUmpProtocol protocol=EasyMidiLibUmpProtocol::Midi2 ) { m_umpInput = enable; m_umpProtocol = protocol; }
+        bool            getUmpInput        ( ) const                                   { return m_umpInput;    }
+        EasyMidiLibUmpProtocol getUmpProtocol ( ) const                                { return m_umpProtocol; }
+
+        virtual void    deviceInUmp        ( const EasyMidiLibDevice* d, const uint32_t* words, size_t count )
+        {
+            if ( m_verbose )
+                EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "listener -> %s deviceInUmp %s (%s) %zu words", d->isInput?"in":"out", d->name, d->id, count );
+        }
+
+
+        // Subscriptions (optional): the message types (EasyMidiLib_subscriptionBit of the status) and channels the
+        // processing helpers are called for, for one device or by default (dev 0). Real-time bytes left out are stripped
+        // from the input before deviceInData sees it, the other messages are skipped by processInData. Input taps and
+        // UMP input get everything.
+
+        bool            setSubscription    ( uint32_t types, uint16_t channels, const EasyMidiLibDevice* dev=0 ); // false when too many devices
+        uint32_t        getSubscribedTypes ( const EasyMidiLibDevice* dev=0 ) const     { return (uint32_t)subscriptionMask(dev); }
+        uint16_t        getSubscribedChannels ( const EasyMidiLibDevice* dev=0 ) const  { return (uint16_t)(subscriptionMask(dev)>>32); }
+        uint64_t        getFilteredMessages( ) const                                { return m_filteredMessages; }
+        uint64_t        getFilteredBytes   ( ) const                                { return m_filteredBytes;    }
+
+        
         // Processing helper
 
         virtual size_t  processInData     ( const uint8_t* data, size_t dataSize );
-        virtual void    noteOn            ( uint8_t channel, EasyMidiLibNote note, uint8_t velocity )       { printf("noteOn ch:%d note:%d vel:%d\n", channel, (int)note, velocity);         }
-        virtual void    noteOff           ( uint8_t channel, EasyMidiLibNote note, uint8_t velocity )       { printf("noteOff ch:%d note:%d vel:%d\n", channel, (int)note, velocity);        }
-        virtual void    programChange     ( uint8_t channel, uint8_t program )                              { printf("programChange ch:%d prog:%d\n", channel, program);                     }
-        virtual void    controlChange     ( uint8_t channel, EasyMidiLibCC controller, uint8_t value )      { printf("controlChange ch:%d cc:%d val:%d\n", channel, (int)controller, value); }
-        virtual void    pitchBend         ( uint8_t channel, uint16_t value )                               { printf("pitchBend ch:%d val:%d\n", channel, value);                            }
-        virtual void    channelPressure   ( uint8_t channel, uint8_t pressure )                             { printf("channelPressure ch:%d press:%d\n", channel, pressure);                 }
-        virtual void    polyPressure      ( uint8_t channel, EasyMidiLibNote note, uint8_t pressure )       { printf("polyPressure ch:%d note:%d press:%d\n", channel, (int)note, pressure); }
-        virtual void    systemExclusive   ( const uint8_t* data, size_t size )                              { printf("systemExclusive size:%zu\n", size);                                    }
-        virtual void    systemCommon      ( EasyMidiLibSysCommonMsg msg, const uint8_t* data, size_t size ) { printf("systemCommon msg:0x%02X\n", (int)msg);                                 }
-        virtual void    systemRealtime    ( EasyMidiLibSysRealtimeMsg msg )                                 { printf("systemRealtime msg:0x%02X\n", (int)msg);                               }
+        virtual void    noteOn            ( uint8_t channel, EasyMidiLibNote note, uint8_t velocity )       { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "noteOn ch:%d note:%d vel:%d", channel, (int)note, velocity ); }
+        virtual void    noteOff           ( uint8_t channel, EasyMidiLibNote note, uint8_t velocity )       { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "noteOff ch:%d note:%d vel:%d", channel, (int)note, velocity ); }
+        virtual void    programChange     ( uint8_t channel, uint8_t program )                              { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "programChange ch:%d prog:%d", channel, program ); }
+        virtual void    controlChange     ( uint8_t channel, EasyMidiLibCC controller, uint8_t value )      { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "controlChange ch:%d cc:%d val:%d", channel, (int)controller, value ); }
+        virtual void    pitchBend         ( uint8_t channel, uint16_t value )                               { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "pitchBend ch:%d val:%d", channel, value ); }
+        virtual void    channelPressure   ( uint8_t channel, uint8_t pressure )                             { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "channelPressure ch:%d press:%d", channel, pressure ); }
+        virtual void    polyPressure      ( uint8_t channel, EasyMidiLibNote note, uint8_t pressure )       { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "polyPressure ch:%d note:%d press:%d", channel, (int)note, pressure ); }
+        virtual void    systemExclusive   ( const uint8_t* data, size_t size )                              { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "systemExclusive size:%zu", size ); }
+        virtual void    systemCommon      ( EasyMidiLibSysCommonMsg msg, const uint8_t* data, size_t size ) { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "systemCommon msg:0x%02X", (int)msg ); }
+        virtual void    systemRealtime    ( EasyMidiLibSysRealtimeMsg msg )                                 { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "systemRealtime msg:0x%02X", (int)msg ); }
+
+
+        // Controller aggregation (optional): 14 bit controllers (0-31 with their LSB at 32-63) and RPN/NRPN sequences
+        // are delivered as one event per change instead of one controlChange per byte pair. A 14 bit value is reported
+        // on its MSB until an LSB has been seen for that controller, then on the LSB (for RPN/NRPN data entry, until an
+        // LSB has been seen since the parameter was selected).
+
+        void            setControllerAggregation ( bool cc14, bool rpn )                                    { m_aggregateCC14 = cc14; m_aggregateRpn = rpn; }
+        virtual void    controlChange14   ( uint8_t channel, uint8_t controller, uint16_t value )           { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "controlChange14 ch:%d cc:%d val:%d", channel, controller, value ); }
+        virtual void    rpnChange         ( uint8_t channel, uint16_t parameter, uint16_t value )           { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "rpnChange ch:%d param:%d val:%d", channel, parameter, value ); }
+        virtual void    nrpnChange        ( uint8_t channel, uint16_t parameter, uint16_t value )           { if ( m_verbose ) EasyMidiLib_log ( EasyMidiLibLogLevel::Info, EasyMidiLibLogCategory::Input, "nrpnChange ch:%d param:%d val:%d", channel, parameter, value ); }
+
+    private:
+
+        static const size_t MAX_SUBSCRIPTIONS = 64;
+
+        struct Subscription
+        {
+            std::atomic<const EasyMidiLibDevice*> device;
+            std::atomic<uint64_t>                 mask;     // channels<<32 | types
+        };
+
+        struct ChannelControllers
+        {
+            uint8_t     msb[32]      ;  // last MSB of the 14 bit controllers
+            uint32_t    lsbSeen      ;  // bit per controller, an LSB has been received
+            uint8_t     paramType    ;  // 0 none, 1 RPN, 2 NRPN
+            uint8_t     paramMsb     ;
+            uint8_t     paramLsb     ;
+            uint8_t     dataMsb      ;
+            uint8_t     dataLsb      ;
+            bool        dataLsbSeen  ;
+        };
+
+        // processInData state: kept per device while called from a library thread (devices may be processed
+        // concurrently in Pool mode), in the listener otherwise
+        struct ParserState
+        {
+            uint8_t             status;
+            ChannelControllers  channels[16];
+        };
+
+        friend struct   EasyMidiLibDeviceState;
+        friend void     EasyMidiLib_processInData ( EasyMidiLibListener* listener, const EasyMidiLibDevice* dev, const uint8_t* data, size_t dataSize, uint64_t timestamp );
+
+        ParserState&    parserState          ( );
+        void            processControlChange ( ParserState& parser, uint8_t channel, uint8_t controller, uint8_t value );
+        uint64_t        subscriptionMask     ( const EasyMidiLibDevice* dev ) const;
+        const uint8_t*  filterRealtime       ( const EasyMidiLibDevice* dev, const uint8_t* data, size_t& dataSize, std::vector<uint8_t>& filtered );
+
+        bool                    m_verbose         = true;
+        bool                    m_aggregateCC14   = false;
+        bool                    m_aggregateRpn    = false;
+        bool                    m_umpInput        = false;
+        EasyMidiLibUmpProtocol  m_umpProtocol     = EasyMidiLibUmpProtocol::Midi2;
+        ParserState             m_parser          = {};
+
+        std::mutex              m_subscriptionsMutex;
+        Subscription            m_subscriptions[MAX_SUBSCRIPTIONS] = {};
+        std::atomic<size_t>     m_subscriptionCount   {0};
+        std::atomic<uint64_t>   m_defaultSubscription {0x0000FFFFFFFFFFFFull};
+        std::atomic<uint64_t>   m_filteredMessages    {0};
+        std::atomic<uint64_t>   m_filteredBytes       {0};
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibOutputBatch (builds several messages with running status and sends them with a single call)
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibOutputBatch
+{
+    public:
+
+        void            clear             ( )                                                               { m_data.clear(); m_status = 0; }
+        bool            send              ( const EasyMidiLibDevice* dev );
+
+        const uint8_t*  data              ( ) const                                                         { return m_data.data(); }
+        size_t          size              ( ) const                                                         { return m_data.size(); }
+
+        void            addMessage        ( uint8_t status, uint8_t data1 );
+        void            addMessage        ( uint8_t status, uint8_t data1, uint8_t data2 );
+        void            addControlChange  ( uint8_t channel, uint8_t controller, uint8_t value );
+        void            addControlChange14( uint8_t channel, uint8_t controller, uint16_t value );
+        void            addRpn            ( uint8_t channel, uint16_t parameter, uint16_t value, bool sendNull=false );
+        void            addNrpn           ( uint8_t channel, uint16_t parameter, uint16_t value, bool sendNull=false );
 
     private:
 
-        uint8_t         m_status  = 0;
-        bool            m_verbose = true;
+        std::vector<uint8_t> m_data;
+        uint8_t              m_status = 0;
 };
 
 //------------------------------------------------------------------------------------------------------------------------
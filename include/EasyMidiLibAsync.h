@@ -0,0 +1,156 @@
+#ifndef _EASYMIDILIB_ASYNC_H
+#define _EASYMIDILIB_ASYNC_H
+
+#include "EasyMidiLib.h"
+#include "EasyMidiLibPool.h"
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Coroutine layer (C++20)
+//
+//     EasyMidiLibAsyncInput in ( dev, &myExecutor );
+//     if ( co_await EasyMidiLib_inputOpenAsync(dev, &myExecutor) )
+//         for ( ;; )
+//         {
+//             EasyMidiLibEventBatch batch = co_await in.nextEvents();
+//             if ( batch.empty() )
+//                 break;                       // close() was called
+//             ...
+//         }
+//
+// A waiting coroutine is handed to the executor straight from the thread that produced the result (the thread delivering
+// the device input for events, once the input taps have returned), without any queue or thread switch in between. The
+// default inline executor resumes it right there, so like a listener callback it holds up that device while it runs.
+//
+// An EasyMidiLibAsyncInput must not be destroyed while a coroutine waits on it: close() it and let the waiter resume
+// first (the destructor leaves a waiter suspended, and asserts in debug builds).
+//--------------------------------------------------------------------------------------------------------------------------
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+#include <coroutine>
+#include <mutex>
+#include <vector>
+
+class EasyMidiLibExecutor
+{
+    public:
+
+        virtual ~EasyMidiLibExecutor ( ) { }
+        virtual void execute ( std::coroutine_handle<> handle ) = 0;
+};
+
+EasyMidiLibExecutor* EasyMidiLib_getInlineExecutor ( );
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Batch of received events; the SysEx payloads are kept in the device pool until the batch is destroyed
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibEventBatch
+{
+    public:
+
+        EasyMidiLibEventBatch  ( ) { }
+        EasyMidiLibEventBatch  ( EasyMidiLibEventBatch&& other ) noexcept   : m_events(std::move(other.m_events)) { }
+        EasyMidiLibEventBatch& operator= ( EasyMidiLibEventBatch&& other ) noexcept;
+        ~EasyMidiLibEventBatch ( )                                          { clear(); }
+
+        void                    clear      ( );
+        bool                    empty      ( ) const                        { return m_events.empty(); }
+        size_t                  size       ( ) const                        { return m_events.size();  }
+        const EasyMidiLibEvent* data       ( ) const                        { return m_events.data();  }
+        const EasyMidiLibEvent* begin      ( ) const                        { return m_events.data();  }
+        const EasyMidiLibEvent* end        ( ) const                        { return m_events.data()+m_events.size(); }
+        const EasyMidiLibEvent& operator[] ( size_t i ) const               { return m_events[i];      }
+
+    private:
+
+        friend class EasyMidiLibAsyncInput;
+        std::vector<EasyMidiLibEvent> m_events;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Awaitable input of one device (one waiting coroutine at a time)
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibAsyncInput : public EasyMidiLibInputTap
+{
+    public:
+
+        class NextEvents
+        {
+            public:
+
+                bool                  await_ready   ( )                                 { return m_input->take ( m_batch, m_maxEvents ); }
+                bool                  await_suspend ( std::coroutine_handle<> handle )  { return m_input->wait ( this, handle ); }
+                EasyMidiLibEventBatch await_resume  ( )                                 { return std::move(m_batch); }
+
+            private:
+
+                friend class EasyMidiLibAsyncInput;
+                NextEvents ( EasyMidiLibAsyncInput* input, size_t maxEvents ) : m_input(input), m_maxEvents(maxEvents) { }
+
+                EasyMidiLibAsyncInput* m_input;
+                size_t                 m_maxEvents;
+                EasyMidiLibEventBatch  m_batch;
+        };
+
+        EasyMidiLibAsyncInput ( const EasyMidiLibDevice* dev, EasyMidiLibExecutor* executor=0 );
+        ~EasyMidiLibAsyncInput( );                                                                                   // no coroutine waiting
+
+        NextEvents               nextEvents  ( size_t maxEvents=0 )         { return NextEvents ( this, maxEvents ); }  // 0: everything queued
+        void                     close       ( );                                                                      // resumes a waiter with an empty batch
+        bool                     isClosed    ( ) const;
+        const EasyMidiLibDevice* getDevice   ( ) const                      { return m_dev; }
+
+        // EasyMidiLibInputTap
+
+        void                     inputEvents ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count ) override;
+
+    private:
+
+        bool                     take        ( EasyMidiLibEventBatch& batch, size_t maxEvents );
+        bool                     wait        ( NextEvents* awaiter, std::coroutine_handle<> handle );
+
+        const EasyMidiLibDevice*      m_dev;
+        EasyMidiLibExecutor*          m_executor;
+        mutable std::mutex            m_mutex;
+        std::vector<EasyMidiLibEvent> m_queue;
+        size_t                        m_queueHead = 0;
+        bool                          m_closed    = false;
+        NextEvents*                   m_waiter    = 0;
+        std::coroutine_handle<>       m_waiterHandle;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+// co_await EasyMidiLib_inputOpenAsync(dev) -> bool, the open runs on the library worker pool; like EasyMidiLib_inputOpen()
+// it fails for a device already open
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibOpenAwaitable
+{
+    public:
+
+        EasyMidiLibOpenAwaitable ( const EasyMidiLibDevice* dev, EasyMidiLibExecutor* executor, void* userPtrParam, int64_t userIntParam )
+            : m_dev(dev), m_executor(executor), m_userPtrParam(userPtrParam), m_userIntParam(userIntParam) { }
+
+        bool                     await_ready   ( );
+        bool                     await_suspend ( std::coroutine_handle<> handle );
+        bool                     await_resume  ( ) const                    { return m_result; }
+
+    private:
+
+        const EasyMidiLibDevice* m_dev;
+        EasyMidiLibExecutor*     m_executor;
+        void*                    m_userPtrParam;
+        int64_t                  m_userIntParam;
+        bool                     m_result = false;
+};
+
+inline EasyMidiLibOpenAwaitable EasyMidiLib_inputOpenAsync ( const EasyMidiLibDevice* dev, EasyMidiLibExecutor* executor=0, void* userPtrParam=0, int64_t userIntParam=0 )
+{ return EasyMidiLibOpenAwaitable ( dev, executor, userPtrParam, userIntParam ); }
+
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_ASYNC_H
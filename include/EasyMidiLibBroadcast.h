@@ -0,0 +1,131 @@
+#ifndef _EASYMIDILIB_BROADCAST_H
+#define _EASYMIDILIB_BROADCAST_H
+
+#include "EasyMidiLib.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibBroadcastRing
+//
+// Single producer, many consumers ring of input events (disruptor style). The producer is the ring itself as an input
+// tap of one device or of all of them (the taps are called one at a time), or whoever calls publish(). Every event
+// gets a sequence number; each EasyMidiLibBroadcastReader keeps its own cursor and reads batches at its own pace, so a
+// slow consumer never holds back the producer or the other readers. A reader that falls more than the ring capacity
+// behind skips to the oldest event still there and gets the count in the batch 'lost' field instead.
+//
+// Slots and SysEx words are overwritten in place like in EasyMidiLibRetroBuffer: the producer announces what it is
+// about to overwrite and a reader drops whatever was announced while it was copying.
+//--------------------------------------------------------------------------------------------------------------------------
+
+enum class EasyMidiLibWaitStrategy : uint8_t
+{ BusySpin, Yield, Sleep, Block };
+
+struct EasyMidiLibBroadcastBatch
+{
+    std::vector<EasyMidiLibEvent> events;    // 'sysex' points into 'data'
+    std::vector<uint8_t>          data;
+    uint64_t                      first;     // sequence number of events[0]
+    uint64_t                      lost;      // events overwritten before this reader got them, skipped just before
+};
+
+class EasyMidiLibBroadcastRing : public EasyMidiLibInputTap
+{
+    public:
+
+        EasyMidiLibBroadcastRing ( size_t events=65536, size_t sysexBytes=1<<20 );
+        virtual ~EasyMidiLibBroadcastRing ( );
+
+        // Input tap of 'dev', or of every input when 0
+
+        void                        start            ( const EasyMidiLibDevice* dev=0 );
+        void                        stop             ( );
+
+        // Single producer (don't call while started)
+
+        void                        publish          ( const EasyMidiLibEvent* events, size_t count );
+
+        uint64_t                    getPublished     ( ) const                       { return m_published; }  // next sequence number
+        uint64_t                    getDropped       ( ) const                       { return m_dropped;   }  // SysEx bigger than the ring
+        size_t                      getCapacity      ( ) const                       { return m_slotCount; }
+
+        void                        wake             ( );                            // makes the blocked reads return
+
+        // EasyMidiLibInputTap
+
+        void                        inputEvents      ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count ) override;
+
+    private:
+
+        friend class EasyMidiLibBroadcastReader;
+
+        struct Slot
+        {
+            std::atomic<uint64_t>                 timestamp;
+            std::atomic<const EasyMidiLibDevice*> device;
+            std::atomic<uint64_t>                 packed;     // SysEx flag and size in the high half, short message in the low half
+            std::atomic<uint64_t>                 sysex;      // byte position of the SysEx data
+        };
+
+        std::unique_ptr<Slot[]>                  m_slots;
+        std::unique_ptr<std::atomic<uint64_t>[]> m_words;
+        size_t                                   m_slotCount;     // power of two
+        size_t                                   m_wordCount;     // power of two
+        uint64_t                                 m_sysexHead    = 0;
+
+        std::atomic<uint64_t>                    m_published    {0};
+        std::atomic<uint64_t>                    m_claimed      {0};
+        std::atomic<uint64_t>                    m_sysexClaimed {0};
+        std::atomic<uint64_t>                    m_dropped      {0};
+
+        std::mutex                               m_waitMutex;
+        std::condition_variable                  m_waitCondition;
+        std::atomic<size_t>                      m_waiters      {0};
+        std::atomic<uint64_t>                    m_wakeups      {0};
+
+        const EasyMidiLibDevice*                 m_device       = 0;
+        bool                                     m_started      = false;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibBroadcastReader (one per consumer thread, starts at the next event published)
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibBroadcastReader
+{
+    public:
+
+        EasyMidiLibBroadcastReader ( EasyMidiLibBroadcastRing& ring, EasyMidiLibWaitStrategy wait=EasyMidiLibWaitStrategy::Block, size_t batchSize=256 );
+
+        void                        setWaitStrategy  ( EasyMidiLibWaitStrategy wait, uint64_t sleepNs=100000 ) { m_wait = wait; m_sleepNs = sleepNs; }
+
+        // Fills 'batch' with up to batchSize events, waiting up to 'timeoutNs' when there is none (0 polls). Returns the
+        // number of events, 0 on timeout or wake().
+
+        size_t                      read             ( EasyMidiLibBroadcastBatch& batch, uint64_t timeoutNs );
+
+        void                        seek             ( uint64_t sequence )           { m_cursor = sequence; }
+        uint64_t                    getCursor        ( ) const                       { return m_cursor; }
+        uint64_t                    getLag           ( ) const                       { return m_ring.m_published-m_cursor; }
+        uint64_t                    getLost          ( ) const                       { return m_lost; }
+
+    private:
+
+        bool                        wait             ( uint64_t timeoutNs );
+        size_t                      copy             ( EasyMidiLibBroadcastBatch& batch, uint64_t published );
+
+        EasyMidiLibBroadcastRing&                m_ring;
+        EasyMidiLibWaitStrategy                  m_wait;
+        uint64_t                                 m_sleepNs      = 100000;
+        size_t                                   m_batchSize;
+        uint64_t                                 m_cursor;
+        uint64_t                                 m_lost         = 0;
+        std::vector<uint64_t>                    m_positions;     // SysEx ring position of the batch events, UINT64_MAX for none
+        std::vector<size_t>                      m_offsets;       // their offset in the batch data
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_BROADCAST_H
@@ -0,0 +1,208 @@
+#ifndef _EASYMIDILIB_CAPTURE_H
+#define _EASYMIDILIB_CAPTURE_H
+
+#include "EasyMidiLib.h"
+#include "EasyMidiLibClock.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Raw input capture and replay
+//
+// While started, the capture records every chunk of bytes the backends receive, exactly as received, with its device
+// and nanosecond timestamp (unlike an SMF recording, nothing is parsed or quantized). The file is a sequence of
+// fixed size segments; the input path appends records into the mapped current segment under a short lock, and a
+// background thread keeps a ring of the next segments mapped ahead and unmaps the finished ones, so capturing never
+// waits on file I/O. Data that finds no mapped segment ready is dropped and counted. Build the library with
+// EASYMIDILIB_CAPTURE=0 to compile the hook out.
+//
+// File layout (integers little endian, varints LEB128):
+//   header    "EMLCAP1\0", u32 version, u32 segment size, u64 start timestamp, u64 reserved (start of segment 0)
+//   segment   index record first: 0x03, u64 timestamp base, u64 data records before it
+//   device    0x01, varint device number, u8 isInput, varint+bytes name, varint+bytes id (before its first data)
+//   data      0x02, varint device number, zigzag varint timestamp delta, varint size, bytes
+//   padding   0x00 up to the end of the segment
+// Each timestamp is a delta from the previous record's (the index base at a segment start), so any segment can be
+// decoded on its own once the device records have been read.
+//--------------------------------------------------------------------------------------------------------------------------
+
+#ifndef EASYMIDILIB_CAPTURE
+#define EASYMIDILIB_CAPTURE 1
+#endif
+
+bool     EasyMidiLib_captureStart   ( const char* path, size_t segmentSize=1<<20 ); // false if the file can't be created
+void     EasyMidiLib_captureStop    ( );                                            // unmaps and trims the file
+bool     EasyMidiLib_isCapturing    ( );
+uint64_t EasyMidiLib_captureDropped ( );                                            // bytes lost in the current capture
+
+// Writes a list of events sorted by timestamp (a snapshot) as a capture file, one data record per event
+
+bool     EasyMidiLib_captureWrite   ( const char* path, const EasyMidiLibEvent* events, size_t count, size_t segmentSize=1<<20 );
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibCaptureFile (memory mapped reader)
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibCaptureDevice
+{
+    std::string name    ;
+    std::string id      ;
+    bool        isInput ;
+};
+
+struct EasyMidiLibCaptureRecord
+{
+    uint64_t       timestamp ;
+    uint32_t       device    ; // index in getDevices()
+    const uint8_t* data      ; // points into the mapping
+    size_t         size      ;
+};
+
+class EasyMidiLibCaptureFile;
+
+class EasyMidiLibCaptureIterator
+{
+    public:
+
+        EasyMidiLibCaptureIterator ( ) { }
+
+        bool                        next             ( EasyMidiLibCaptureRecord& record ); // false at the end
+
+    private:
+
+        friend class EasyMidiLibCaptureFile;
+
+        bool                        readVarInt       ( uint64_t& value );
+        bool                        startSegment     ( size_t segment );
+
+        const EasyMidiLibCaptureFile* m_file      = 0;
+        size_t                        m_segment   = 0;
+        const uint8_t*                m_pos       = 0;
+        const uint8_t*                m_end       = 0;
+        uint64_t                      m_timestamp = 0;
+};
+
+class EasyMidiLibCaptureFile
+{
+    public:
+
+        struct Segment
+        {
+            uint64_t timestamp;   // index record base
+            uint64_t records;     // data records before the segment
+        };
+
+        EasyMidiLibCaptureFile ( ) { }
+        ~EasyMidiLibCaptureFile ( ) { close(); }
+
+        EasyMidiLibCaptureFile ( const EasyMidiLibCaptureFile& ) = delete;
+        EasyMidiLibCaptureFile& operator= ( const EasyMidiLibCaptureFile& ) = delete;
+
+        bool                        open             ( const char* path ); // maps the file and reads the devices and index
+        void                        close            ( );
+        bool                        isOpen           ( ) const              { return m_data!=0; }
+        const char*                 getLastError     ( ) const              { return m_lastError.c_str(); }
+
+        uint64_t                    getStartTime     ( ) const              { return m_startTime; }
+        uint64_t                    getEndTime       ( ) const              { return m_endTime;   }
+        uint64_t                    getRecordCount   ( ) const              { return m_records;   }
+        uint64_t                    getByteCount     ( ) const              { return m_bytes;     } // MIDI bytes
+        const std::vector<EasyMidiLibCaptureDevice>& getDevices  ( ) const { return m_devices;   }
+        const std::vector<Segment>&                  getSegments ( ) const { return m_segments;  }
+
+        // All the records, or the records from the segment holding 'timestamp' on (binary search of the index)
+
+        EasyMidiLibCaptureIterator  records          ( ) const;
+        EasyMidiLibCaptureIterator  recordsFrom      ( uint64_t timestamp ) const;
+
+    private:
+
+        friend class EasyMidiLibCaptureIterator;
+
+        bool                        parse            ( );
+        bool                        fail             ( const char* error )  { m_lastError = error; return false; }
+
+        const uint8_t*                           m_data        = 0;
+        size_t                                   m_size        = 0;
+        size_t                                   m_segmentSize = 0;
+        uint64_t                                 m_startTime   = 0;
+        uint64_t                                 m_endTime     = 0;
+        uint64_t                                 m_records     = 0;
+        uint64_t                                 m_bytes       = 0;
+        std::vector<EasyMidiLibCaptureDevice>    m_devices;         // by device number
+        std::vector<Segment>                     m_segments;
+        std::string                              m_lastError;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibCaptureReplay
+//
+// Feeds a capture back into the input path (EasyMidiLib_deliverInData, so the dispatch mode applies, then
+// EasyMidiLib_processInData and the listener's deviceInData) with the original chunking. Each captured device is
+// replayed on a stand-in input device owned by the replay unless mapped to a real one. RealTime keeps the original
+// spacing from the start point (the jitter stats measure it), AsFastAsPossible sends back to back, which makes a
+// capture a repeatable load for benchmarks. Stand-in devices get no deviceOpen/deviceClose calls.
+//--------------------------------------------------------------------------------------------------------------------------
+
+enum class EasyMidiLibCaptureReplayMode
+{
+    RealTime         ,
+    AsFastAsPossible ,
+};
+
+struct EasyMidiLibCaptureReplayStats
+{
+    uint64_t records   ;
+    uint64_t bytes     ;
+    uint64_t elapsedNs ; // of the last run
+};
+
+class EasyMidiLibCaptureReplay
+{
+    public:
+
+        EasyMidiLibCaptureReplay ( );
+        ~EasyMidiLibCaptureReplay ( );
+
+        bool                          load             ( const EasyMidiLibCaptureFile* file ); // the file must stay open while loaded
+        void                          unload           ( );
+
+        void                          mapDevice        ( uint32_t device, const EasyMidiLibDevice* dev ); // 0 goes back to the stand-in
+        const EasyMidiLibDevice*      getDevice        ( uint32_t device ) const;                          // where 'device' is replayed
+
+        // run() replays on the calling thread and returns at the end or on stop(); start() runs it on its own thread
+
+        bool                          run              ( EasyMidiLibListener* listener, EasyMidiLibCaptureReplayMode mode, uint64_t from=0 );
+        bool                          start            ( EasyMidiLibListener* listener, EasyMidiLibCaptureReplayMode mode, uint64_t from=0 );
+        void                          stop             ( );
+        bool                          isRunning        ( ) const                                         { return m_running; }
+
+        void                          setSpinTime      ( uint64_t ns )                                   { m_spinTime = ns; }
+
+        EasyMidiLibCaptureReplayStats getStats         ( ) const;
+        EasyMidiLibClockJitterStats   getJitterStats   ( ) const                                         { return m_jitter.get(); }
+        void                          resetJitterStats ( )                                               { m_jitter.reset();      }
+
+    private:
+
+        struct StandIn;
+
+        void                          replay           ( EasyMidiLibListener* listener, EasyMidiLibCaptureReplayMode mode, uint64_t from );
+
+        const EasyMidiLibCaptureFile*            m_file          = 0;
+        std::vector<std::unique_ptr<StandIn>>    m_standIns;
+        std::vector<const EasyMidiLibDevice*>    m_targets;
+
+        std::thread                              m_thread;
+        std::atomic<bool>                        m_running       {false};
+        std::atomic<uint64_t>                    m_spinTime      {200000};
+        std::atomic<uint64_t>                    m_records       {0};
+        std::atomic<uint64_t>                    m_bytes         {0};
+        std::atomic<uint64_t>                    m_elapsedNs     {0};
+        EasyMidiLibJitterMeter                   m_jitter;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_CAPTURE_H
@@ -0,0 +1,138 @@
+#ifndef _EASYMIDILIB_CLOCK_H
+#define _EASYMIDILIB_CLOCK_H
+
+#include "EasyMidiLib.h"
+#include <atomic>
+#include <thread>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibClockFollower
+//
+// Follows an incoming MIDI clock (0xF8 at 24 ppqn plus Start/Continue/Stop) using a second order delay locked loop that
+// filters the transport jitter of the timestamps. Feed it from the input thread with listener->getInTimestamp(), read it
+// from any thread (getters are wait-free for the reader and never block the input thread).
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibClockState
+{
+    bool    running     ;
+    bool    locked      ;
+    double  tempo       ; // beats per minute, 0 if not locked
+    double  beatPosition; // quarter notes since Start, or the resume position while stopped
+};
+
+class EasyMidiLibClockFollower
+{
+    public:
+
+        EasyMidiLibClockFollower ( double bandwidthHz=1.0 );
+
+        void                  setBandwidth     ( double bandwidthHz );
+        void                  reset            ( );
+
+        // Input (single producer, normally the thread running the listener)
+
+        void                  process          ( EasyMidiLibSysRealtimeMsg msg, uint64_t timestamp );
+        void                  setSongPosition  ( uint16_t sixteenths );
+
+        // Output (any thread, lock free)
+
+        EasyMidiLibClockState getState         ( uint64_t now ) const;
+        double                getBeatPosition  ( uint64_t now ) const;
+        double                getTempo         ( ) const;
+        bool                  isRunning        ( ) const;
+        bool                  isLocked         ( ) const;
+
+    private:
+
+        void                  publish          ( );
+
+        // Loop state (producer only)
+
+        double                m_bandwidth   = 1.0;
+        bool                  m_running     = false;
+        bool                  m_locked      = false;
+        int64_t               m_ticks       = -1;   // index of the last tick counted while running
+        uint64_t              m_lastTick    = 0;    // raw timestamp of the last tick
+        uint32_t              m_seenTicks   = 0;    // ticks since the loop was (re)started
+        double                m_t0          = 0.0;  // filtered time of the last tick
+        double                m_t1          = 0.0;  // predicted time of the next tick
+        double                m_period      = 0.0;  // filtered tick period
+
+        // Published snapshot (seqlock)
+
+        std::atomic<uint32_t> m_seq         {0};
+        std::atomic<bool>     m_pubRunning  {false};
+        std::atomic<bool>     m_pubLocked   {false};
+        std::atomic<int64_t>  m_pubTicks    {-1};
+        std::atomic<double>   m_pubT0       {0.0};
+        std::atomic<double>   m_pubT1       {0.0};
+        std::atomic<double>   m_pubPeriod   {0.0};
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibClockGenerator
+//
+// Sends MIDI clock to an output device from its own thread. Every tick has an absolute deadline derived from the tempo,
+// so scheduling errors never accumulate; the thread sleeps until shortly before the deadline and spins the rest.
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibClockJitterStats
+{
+    uint64_t ticks    ;
+    int64_t  minLate  ; // ns the send was issued after its deadline
+    int64_t  maxLate  ;
+    double   meanLate ;
+    double   stdDevLate;
+};
+
+class EasyMidiLibJitterMeter
+{
+    public:
+
+        void                        add            ( int64_t late );    // single writer (the sending thread)
+        EasyMidiLibClockJitterStats get            ( ) const;
+        void                        reset          ( );
+
+    private:
+
+        std::atomic<uint64_t>       m_ticks        {0};
+        std::atomic<int64_t>        m_min          {0};
+        std::atomic<int64_t>        m_max          {0};
+        std::atomic<double>         m_sum          {0.0};
+        std::atomic<double>         m_sumSq        {0.0};
+};
+
+class EasyMidiLibClockGenerator
+{
+    public:
+
+        EasyMidiLibClockGenerator ( );
+        ~EasyMidiLibClockGenerator( );
+
+        bool                        start            ( const EasyMidiLibDevice* dev, double bpm, bool sendStart=true );
+        void                        stop             ( bool sendStop=true );
+        bool                        isRunning        ( ) const                      { return m_running; }
+
+        void                        setTempo         ( double bpm );
+        double                      getTempo         ( ) const                      { return m_tempo;   }
+        void                        setSpinTime      ( uint64_t ns )                { m_spinTime = ns;  }
+
+        EasyMidiLibClockJitterStats getJitterStats   ( ) const                      { return m_jitter.get(); }
+        void                        resetJitterStats ( )                            { m_jitter.reset();      }
+
+    private:
+
+        void                        threadFunc       ( );
+
+        const EasyMidiLibDevice*    m_dev          = 0;
+        std::thread                 m_thread;
+        std::atomic<bool>           m_running      {false};
+        std::atomic<double>         m_tempo        {120.0};
+        std::atomic<uint64_t>       m_spinTime     {200000};
+        EasyMidiLibJitterMeter      m_jitter;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_CLOCK_H
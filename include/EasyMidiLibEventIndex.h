@@ -0,0 +1,85 @@
+#ifndef _EASYMIDILIB_EVENTINDEX_H
+#define _EASYMIDILIB_EVENTINDEX_H
+
+#include "EasyMidiLib.h"
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibEventIndex
+//
+// Block index over a recorded array of events sorted by timestamp (a retro snapshot, a decoded capture...). The events
+// are summarized in blocks of BLOCK_EVENTS, and the blocks in groups of GROUP_BLOCKS: time span, channels, message
+// types and note range. A query finds its first block by binary search on time, skips the groups and blocks its
+// filters can't match and checks the events of the others one by one. The matches come back as spans of consecutive
+// events pointing into the indexed array, which must stay alive and unchanged while the index is used.
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Message type bits: one per channel message kind (EasyMidiLibMsg) and one for all system messages
+
+inline uint8_t EasyMidiLib_eventTypeBit ( EasyMidiLibMsg msg ) { return (uint8_t)(1<<(((uint8_t)msg>>4)-8)); }
+
+static const uint8_t EASYMIDILIB_EVENT_SYSTEM = 0x80;
+static const uint8_t EASYMIDILIB_EVENT_NOTES  = 0x03;   // note off and note on
+static const uint8_t EASYMIDILIB_EVENT_ALL    = 0xFF;
+
+struct EasyMidiLibEventQuery
+{
+    uint64_t                 from     = 0;
+    uint64_t                 to       = UINT64_MAX;              // exclusive
+    uint16_t                 channels = 0xFFFF;                  // bit per channel, channel messages only
+    uint8_t                  types    = EASYMIDILIB_EVENT_ALL;
+    uint8_t                  noteMin  = 0;                       // note off, note on and poly pressure only
+    uint8_t                  noteMax  = 127;
+    const EasyMidiLibDevice* device   = 0;                       // any when 0
+};
+
+struct EasyMidiLibEventSpan
+{
+    const EasyMidiLibEvent* begin;
+    const EasyMidiLibEvent* end;
+
+    size_t                  size ( ) const { return end-begin; }
+};
+
+class EasyMidiLibEventIndex
+{
+    public:
+
+        static const size_t BLOCK_EVENTS = 256;
+        static const size_t GROUP_BLOCKS = 64;
+
+        void                        build            ( const EasyMidiLibEvent* events, size_t count );
+        void                        clear            ( );
+
+        // Appends the matching runs to 'spans', returns the number of matching events
+
+        size_t                      query            ( const EasyMidiLibEventQuery& query, std::vector<EasyMidiLibEventSpan>& spans ) const;
+        bool                        matches          ( const EasyMidiLibEventQuery& query, const EasyMidiLibEvent& event ) const;
+
+        size_t                      getEventCount    ( ) const                   { return m_count; }
+        size_t                      getBlockCount    ( ) const                   { return m_blocks.size(); }
+
+    private:
+
+        struct Summary
+        {
+            uint64_t first;      // timestamps
+            uint64_t last;
+            uint16_t channels;
+            uint8_t  types;
+            uint8_t  noteMin;    // 127/0 when no note message
+            uint8_t  noteMax;
+        };
+
+        static void                 add              ( Summary& summary, const EasyMidiLibEvent& event );
+        static void                 merge            ( Summary& summary, const Summary& other );
+        static bool                 mayMatch         ( const EasyMidiLibEventQuery& query, const Summary& summary );
+
+        const EasyMidiLibEvent*                  m_events      = 0;
+        size_t                                   m_count       = 0;
+        std::vector<Summary>                     m_blocks;
+        std::vector<Summary>                     m_groups;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_EVENTINDEX_H
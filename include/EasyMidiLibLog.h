@@ -0,0 +1,153 @@
+#ifndef _EASYMIDILIB_LOG_H
+#define _EASYMIDILIB_LOG_H
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <functional>
+#include <type_traits>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Asynchronous logging
+//
+// EasyMidiLib_log doesn't format: it copies the format pointer and the raw arguments into a lock free ring and a
+// background writer formats them and hands the text to the sink (stdout by default). A level or category that is off
+// costs one relaxed load. The format must outlive the writer (a string literal); string arguments are copied. Messages
+// that find the ring full are dropped and counted. Supported arguments: integers, enums, floating point, pointers,
+// C strings, std::string and EasyMidiLibLogBytes (written as hex whatever the conversion).
+//--------------------------------------------------------------------------------------------------------------------------
+
+enum class EasyMidiLibLogLevel : uint8_t
+{
+    Off     ,
+    Error   ,
+    Warning ,
+    Info    ,
+    Debug   ,
+};
+
+enum class EasyMidiLibLogCategory : uint32_t
+{
+    Library = 1<<0,    // init, done, callback budget
+    Device  = 1<<1,    // connect, disconnect, open, close
+    Input   = 1<<2,    // incoming data and the decoded messages
+    Output  = 1<<3,    // outgoing data
+    Backend = 1<<4,    // platform notifications
+    All     = 0xFFFFFFFF,
+};
+
+struct EasyMidiLibLogBytes
+{
+    const uint8_t* data;
+    size_t         size;
+};
+
+typedef std::function<void(EasyMidiLibLogLevel level, EasyMidiLibLogCategory category, const char* text)> EasyMidiLibLogSink;
+
+void                EasyMidiLib_setLogLevel      ( EasyMidiLibLogLevel level ); // this level and the ones above, default Info
+EasyMidiLibLogLevel EasyMidiLib_getLogLevel      ( );
+void                EasyMidiLib_setLogCategories ( uint32_t mask );             // EasyMidiLibLogCategory bits, default All
+uint32_t            EasyMidiLib_getLogCategories ( );
+void                EasyMidiLib_setLogSink       ( EasyMidiLibLogSink sink );   // 0: stdout; called on the writer thread
+void                EasyMidiLib_logFlush         ( );                           // returns once everything logged so far is written
+uint64_t            EasyMidiLib_logDropped       ( );
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Record captured by EasyMidiLib_log
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibLogRecord
+{
+    enum Type : uint8_t { Signed, Unsigned, Double, Pointer, String, Bytes };
+
+    static const size_t MAX_ARGS = 8;
+    static const size_t TEXT     = 184;
+
+    const char*            format;
+    EasyMidiLibLogCategory category;
+    EasyMidiLibLogLevel    level;
+    uint8_t                count;
+    uint8_t                textUsed;
+    uint8_t                types [MAX_ARGS];
+    uint64_t               values[MAX_ARGS];  // strings and bytes: offset<<8 | size in 'text'
+    char                   text  [TEXT];
+
+    void addText ( Type type, const void* data, size_t size )
+    {
+        size_t room = TEXT-textUsed;
+        size    = size<255 ? size : 255;
+        size    = size<room ? size : room;
+        memcpy ( text+textUsed, data, size );
+        types [count] = type;
+        values[count] = (uint64_t)textUsed<<8 | size;
+        textUsed     += (uint8_t)size;
+    }
+
+    template<typename T> void add ( const T& value )
+    {
+        if ( count==MAX_ARGS )
+            return;
+
+        if constexpr ( std::is_same<T,EasyMidiLibLogBytes>::value )
+            addText ( Bytes, value.data, value.size );
+        else if constexpr ( std::is_same<T,std::string>::value )
+            addText ( String, value.data(), value.size() );
+        else if constexpr ( std::is_same<typename std::decay<T>::type,const char*>::value || std::is_same<typename std::decay<T>::type,char*>::value )
+            addText ( String, value ? value : "(null)", value ? strlen(value) : 6 );
+        else if constexpr ( std::is_enum<T>::value )
+        {
+            types [count] = std::is_signed<typename std::underlying_type<T>::type>::value ? Signed : Unsigned;
+            values[count] = (uint64_t)value;
+        }
+        else if constexpr ( std::is_floating_point<T>::value )
+        {
+            double d = value;
+            types [count] = Double;
+            memcpy ( &values[count], &d, sizeof(d) );
+        }
+        else if constexpr ( std::is_pointer<T>::value )
+        {
+            types [count] = Pointer;
+            values[count] = (uint64_t)(uintptr_t)value;
+        }
+        else
+        {
+            static_assert ( std::is_integral<T>::value, "EasyMidiLib_log: unsupported argument type" );
+            types [count] = std::is_signed<T>::value ? Signed : Unsigned;
+            values[count] = (uint64_t)(int64_t)value;
+        }
+
+        count++;
+    }
+};
+
+extern std::atomic<uint32_t> EasyMidiLib_logMasks[5];  // per level: the enabled categories
+void                         EasyMidiLib_logPush ( const EasyMidiLibLogRecord& record );
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+inline bool EasyMidiLib_logEnabled ( EasyMidiLibLogLevel level, EasyMidiLibLogCategory category )
+{
+    return ( EasyMidiLib_logMasks[(int)level].load(std::memory_order_relaxed) & (uint32_t)category ) != 0;
+}
+
+template<typename... Args> void EasyMidiLib_log ( EasyMidiLibLogLevel level, EasyMidiLibLogCategory category, const char* format, const Args&... args )
+{
+    if ( !EasyMidiLib_logEnabled(level, category) )
+        return;
+
+    EasyMidiLibLogRecord record;
+    record.format   = format;
+    record.category = category;
+    record.level    = level;
+    record.count    = 0;
+    record.textUsed = 0;
+    ( record.add(args), ... );
+
+    EasyMidiLib_logPush ( record );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_LOG_H
@@ -0,0 +1,85 @@
+#ifndef _EASYMIDILIB_MERGE_H
+#define _EASYMIDILIB_MERGE_H
+
+#include "EasyMidiLib.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <map>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibMergedStream
+//
+// Merges the input of every opened device into one sequence ordered by timestamp. Each device queues its events on its
+// own input thread; the consumer side does a k-way heap merge of the device queues and only releases events older than
+// the reorder window, so a device delivering a little late still lands in order. Events are handed to mergedEvents() in
+// batches from EasyMidiLib_update(), from a dedicated thread or from explicit poll() calls.
+//
+// The Update and Thread deliveries call mergedEvents() until stop() returns, so a started stream must be stopped before
+// its consumer goes away: the destructor of the derived class calls stop() (asserted in debug builds).
+//--------------------------------------------------------------------------------------------------------------------------
+
+enum class EasyMidiLibMergeDelivery : uint8_t
+{ Manual, Update, Thread };
+
+struct EasyMidiLibMergeStats
+{
+    uint64_t merged ; // events delivered
+    uint64_t late   ; // events that arrived after newer ones were already delivered (window too small)
+    uint64_t pending; // events waiting for the window
+};
+
+class EasyMidiLibMergedStream : public EasyMidiLibInputTap
+{
+    public:
+
+        EasyMidiLibMergedStream ( );
+        virtual ~EasyMidiLibMergedStream ( );                        // stop() first, from the derived destructor
+
+        bool                  start        ( EasyMidiLibMergeDelivery delivery=EasyMidiLibMergeDelivery::Update, uint64_t reorderWindow=2000000, size_t batchSize=256 );
+        void                  stop         ( );   // delivers whatever is still queued
+        bool                  isStarted    ( ) const                    { return m_started; }
+
+        size_t                poll         ( bool flushAll=false );
+        EasyMidiLibMergeStats getStats     ( ) const;
+
+        // Consumer
+
+        virtual void          mergedEvents ( const EasyMidiLibEvent* events, size_t count ) = 0;
+
+        // EasyMidiLibInputTap
+
+        void                  inputEvents  ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count ) override;
+
+    private:
+
+        struct Source;
+        struct UpdateHook;
+
+        void                  threadFunc   ( );
+        void                  deliver      ( );
+
+        std::atomic<bool>                        m_started       {false};
+        EasyMidiLibMergeDelivery                 m_delivery      = EasyMidiLibMergeDelivery::Update;
+        uint64_t                                 m_reorderWindow = 2000000;
+        size_t                                   m_batchSize     = 256;
+
+        mutable std::mutex                       m_sourcesMutex;
+        std::map<const EasyMidiLibDevice*,std::unique_ptr<Source>> m_sources;
+
+        std::mutex                               m_pollMutex;
+        std::vector<EasyMidiLibEvent>            m_batch;         // SysEx payloads owned by the device pools
+        uint64_t                                 m_lastTimestamp = 0;
+        std::atomic<uint64_t>                    m_merged        {0};
+        std::atomic<uint64_t>                    m_late          {0};
+
+        std::unique_ptr<UpdateHook>              m_updateHook;
+        std::thread                              m_thread;
+        std::atomic<bool>                        m_threadRunning {false};
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_MERGE_H
@@ -0,0 +1,123 @@
+#ifndef _EASYMIDILIB_MPE_H
+#define _EASYMIDILIB_MPE_H
+
+#include "EasyMidiLib.h"
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibMpe
+//
+// MIDI Polyphonic Expression receiver. The zones come from the MPE Configuration Message (RPN 6 on channel 1 for the
+// lower zone, on channel 16 for the upper one) or from setZones(). Pitch bend, channel pressure, poly pressure and CC74
+// received on a member channel are applied to the notes playing on it; pitch bend on the manager channel moves every
+// note of the zone. The bend ranges default to 48 semitones on the members and 2 on the manager, changed by RPN 0.
+// Channels outside the zones are handled like single member channels with a 2 semitone range.
+//
+// Voices live in a fixed table indexed by channel and note, so nothing is allocated or looked up while notes play. The
+// callbacks report each change as it happens; voicesBlock() follows every processed block with the final state of the
+// voices changed in it (ended ones included, with active false). Feed it with process() or as an input tap of one
+// device; the callbacks and getters run on the thread feeding it.
+//--------------------------------------------------------------------------------------------------------------------------
+
+enum class EasyMidiLibMpeZone : uint8_t
+{ None, Lower, Upper };
+
+enum class EasyMidiLibMpeExpression : uint8_t
+{ Pitch, Pressure, Timbre };
+
+struct EasyMidiLibMpeVoice
+{
+    uint64_t           id;               // increases with every note on, tells a reused slot apart
+    uint64_t           timestamp;        // last change
+    EasyMidiLibMpeZone zone;
+    uint8_t            channel;
+    uint8_t            note;
+    uint8_t            velocity;         // note on
+    uint8_t            releaseVelocity;  // note off
+    bool               active;
+    float              pitch;            // fractional note number, bends applied
+    float              bend;             // member channel bend in semitones
+    float              pressure;         // 0-1
+    float              timbre;           // 0-1, CC74
+};
+
+class EasyMidiLibMpe : public EasyMidiLibInputTap
+{
+    public:
+
+        static const size_t MAX_VOICES = 16*128;
+
+        EasyMidiLibMpe ( );
+        virtual ~EasyMidiLibMpe ( );
+
+        // Zones: member channel count (0 disables the zone). A zone taking channels of the other one shrinks it.
+
+        void                        setZones         ( uint8_t lowerMembers, uint8_t upperMembers );
+        uint8_t                     getZoneMembers   ( EasyMidiLibMpeZone zone ) const;
+        EasyMidiLibMpeZone          getChannelZone   ( uint8_t channel ) const           { return m_channels[channel & 0x0F].zone; }
+        void                        reset            ( );                                // ends the voices, keeps the zones
+
+        // Input: process() a block of events, or start() as an input tap of 'dev'
+
+        void                        process          ( const EasyMidiLibEvent* events, size_t count );
+        void                        start            ( const EasyMidiLibDevice* dev );
+        void                        stop             ( );
+
+        const EasyMidiLibMpeVoice&  getVoice         ( uint8_t channel, uint8_t note ) const { return m_voices[(channel & 0x0F)*128+(note & 0x7F)]; }
+        size_t                      getActiveVoices  ( ) const                           { return m_activeCount; }
+
+        // Callbacks
+
+        virtual void                noteStart        ( const EasyMidiLibMpeVoice& voice ) { }
+        virtual void                noteExpression   ( const EasyMidiLibMpeVoice& voice, EasyMidiLibMpeExpression expression ) { }
+        virtual void                noteEnd          ( const EasyMidiLibMpeVoice& voice ) { }
+        virtual void                voicesBlock      ( const EasyMidiLibMpeVoice* voices, size_t count ) { }
+        virtual void                zonesChanged     ( uint8_t lowerMembers, uint8_t upperMembers ) { }
+
+        // EasyMidiLibInputTap
+
+        void                        inputEvents      ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count ) override;
+
+    private:
+
+        struct Channel
+        {
+            EasyMidiLibMpeZone zone;
+            bool               manager;
+            uint8_t            paramMsb;     // RPN selected, 127 when none
+            uint8_t            paramLsb;
+            float              bendRange;    // semitones
+            float              bend;         // -1 to 1
+            float              pressure;
+            float              timbre;
+            uint8_t            voices;       // active notes on the channel
+        };
+
+        void                        configureZones   ( uint8_t lowerMembers, uint8_t upperMembers );
+        void                        controlChange    ( uint8_t channel, uint8_t controller, uint8_t value, uint64_t timestamp );
+        void                        noteOn           ( uint8_t channel, uint8_t note, uint8_t velocity, uint64_t timestamp );
+        void                        noteOff          ( uint8_t channel, uint8_t note, uint8_t velocity, uint64_t timestamp );
+        void                        allNotesOff      ( uint8_t channel, uint64_t timestamp );
+        void                        channelExpression( uint8_t channel, EasyMidiLibMpeExpression expression, uint64_t timestamp );
+        void                        updateVoice      ( EasyMidiLibMpeVoice& voice, EasyMidiLibMpeExpression expression, uint64_t timestamp );
+        void                        touch            ( size_t index );
+        float                       zoneBend         ( uint8_t channel ) const;
+
+        Channel                                  m_channels[16];
+        EasyMidiLibMpeVoice                      m_voices[MAX_VOICES];
+        uint16_t                                 m_active[MAX_VOICES];       // indices of the playing voices
+        uint16_t                                 m_activePos[MAX_VOICES];    // position in m_active
+        uint16_t                                 m_changed[MAX_VOICES];      // indices changed in the current block
+        bool                                     m_dirty[MAX_VOICES];
+        EasyMidiLibMpeVoice                      m_block[MAX_VOICES];
+        size_t                                   m_activeCount  = 0;
+        size_t                                   m_changedCount = 0;
+        uint64_t                                 m_nextId       = 1;
+        uint8_t                                  m_lowerMembers = 0;
+        uint8_t                                  m_upperMembers = 0;
+        const EasyMidiLibDevice*                 m_device       = 0;
+        bool                                     m_started      = false;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_MPE_H
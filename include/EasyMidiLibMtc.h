@@ -0,0 +1,137 @@
+#ifndef _EASYMIDILIB_MTC_H
+#define _EASYMIDILIB_MTC_H
+
+#include "EasyMidiLib.h"
+#include "EasyMidiLibClock.h"
+#include <atomic>
+#include <thread>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// MIDI Time Code
+//--------------------------------------------------------------------------------------------------------------------------
+
+enum class EasyMidiLibMtcRate : uint8_t
+{ Fps24=0, Fps25=1, Fps2997Drop=2, Fps30=3 };
+
+struct EasyMidiLibTimecode
+{
+    uint8_t            hours  ;
+    uint8_t            minutes;
+    uint8_t            seconds;
+    uint8_t            frames ;
+    EasyMidiLibMtcRate rate   ;
+};
+
+double              EasyMidiLibMtc_getFrameRate     ( EasyMidiLibMtcRate rate );                 // 24, 25, 29.97 or 30
+int64_t             EasyMidiLibMtc_timecodeToFrames ( const EasyMidiLibTimecode& tc );           // frames since 00:00:00:00
+EasyMidiLibTimecode EasyMidiLibMtc_framesToTimecode ( int64_t frames, EasyMidiLibMtcRate rate ); // wraps at 24h
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibMtcDecoder
+//
+// Assembles quarter frames (0xF1) and full frame SysEx into a position. Between quarter frames the position is
+// extrapolated from their timestamps using the measured quarter frame period, so varispeed and reverse play are followed.
+// Feed it from the input thread (systemCommon / systemExclusive with getInTimestamp()), read it from any thread.
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibMtcState
+{
+    bool                locked   ; // a position is known (full sequence or full frame received)
+    bool                running  ; // quarter frames are arriving in sequence
+    int                 direction; // +1 forward, -1 reverse, 0 stopped
+    double              speed    ; // measured speed relative to the nominal frame rate
+    double              frames   ; // extrapolated position in frames
+    double              seconds  ; // same position in seconds
+    EasyMidiLibTimecode timecode ; // same position as timecode
+};
+
+class EasyMidiLibMtcDecoder
+{
+    public:
+
+        EasyMidiLibMtcDecoder ( );
+
+        void                  setDropoutTimeout   ( uint64_t ns )   { m_dropoutTimeout = ns; }
+        void                  reset               ( );
+
+        // Input (single producer, normally the thread running the listener)
+
+        void                  processQuarterFrame ( uint8_t data, uint64_t timestamp );
+        bool                  processSysEx        ( const uint8_t* data, size_t size, uint64_t timestamp );
+
+        // Output (any thread, lock free)
+
+        EasyMidiLibMtcState   getState            ( uint64_t now ) const;
+        double                getPosition         ( uint64_t now ) const;
+
+    private:
+
+        void                  publish             ( );
+
+        // Decoder state (producer only)
+
+        std::atomic<uint64_t> m_dropoutTimeout    {100000000};
+        uint8_t               m_pieces[8]       = {};
+        int                   m_lastPiece       = -1;
+        int                   m_seqDirection    = 0;
+        int                   m_seqCount        = 0;
+        bool                  m_locked          = false;
+        bool                  m_synced          = false;
+        EasyMidiLibMtcRate    m_rate            = EasyMidiLibMtcRate::Fps25;
+        double                m_anchorFrames    = 0.0;    // position at the last quarter frame
+        uint64_t              m_anchorTime      = 0;
+        uint64_t              m_lastQfTime      = 0;
+        double                m_qfPeriod        = 0.0;    // smoothed ns between quarter frames
+
+        // Published snapshot (seqlock)
+
+        std::atomic<uint32_t> m_seq             {0};
+        std::atomic<bool>     m_pubLocked       {false};
+        std::atomic<bool>     m_pubSynced       {false};
+        std::atomic<int>      m_pubDirection    {0};
+        std::atomic<uint8_t>  m_pubRate         {1};
+        std::atomic<double>   m_pubFrames       {0.0};
+        std::atomic<uint64_t> m_pubAnchorTime   {0};
+        std::atomic<double>   m_pubQfPeriod     {0.0};
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibMtcGenerator
+//
+// Sends quarter frames to an output device from its own thread, each one at an absolute deadline (a quarter of a frame
+// apart at the true frame rate, 1001/120000 s for 29.97 drop frame).
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibMtcGenerator
+{
+    public:
+
+        EasyMidiLibMtcGenerator ( );
+        ~EasyMidiLibMtcGenerator( );
+
+        bool                        start            ( const EasyMidiLibDevice* dev, const EasyMidiLibTimecode& from, bool sendFullFrame=true );
+        void                        stop             ( );
+        bool                        isRunning        ( ) const                      { return m_running; }
+
+        EasyMidiLibTimecode         getTimecode      ( ) const;
+        void                        setSpinTime      ( uint64_t ns )                { m_spinTime = ns;  }
+
+        EasyMidiLibClockJitterStats getJitterStats   ( ) const                      { return m_jitter.get(); }
+        void                        resetJitterStats ( )                            { m_jitter.reset();      }
+
+    private:
+
+        void                        threadFunc       ( );
+
+        const EasyMidiLibDevice*    m_dev          = 0;
+        EasyMidiLibMtcRate          m_rate         = EasyMidiLibMtcRate::Fps25;
+        std::thread                 m_thread;
+        std::atomic<bool>           m_running      {false};
+        std::atomic<int64_t>        m_frame        {0};
+        std::atomic<uint64_t>       m_spinTime     {200000};
+        EasyMidiLibJitterMeter      m_jitter;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_MTC_H
@@ -0,0 +1,75 @@
+#ifndef _EASYMIDILIB_POOL_H
+#define _EASYMIDILIB_POOL_H
+
+#include "EasyMidiLib.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibPool
+//
+// Slab allocator with power of two size classes (32 bytes to 64 KB) used to keep SysEx payloads and event batches past
+// the callback that received them. Freed blocks go back to their size class through a lock free list, so after warm-up
+// allocating and releasing never touches the heap. Requests above the largest class fall back to malloc.
+//
+// alloc() must be called from one thread at a time (each input device has its own pool, used from its input thread);
+// release() can be called from any thread. Blocks must be released before their pool is destroyed, which for the device
+// pools happens in EasyMidiLib_done().
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibPoolStats
+{
+    uint64_t allocs    ; // successful alloc calls
+    uint64_t releases  ; // release calls
+    uint64_t inUse     ; // blocks currently handed out
+    uint64_t slabs     ; // slabs taken from the heap
+    uint64_t slabBytes ; // bytes held by those slabs
+    uint64_t heapAllocs; // requests above the largest size class
+};
+
+class EasyMidiLibPool
+{
+    public:
+
+        EasyMidiLibPool ( );
+        ~EasyMidiLibPool( );
+
+        EasyMidiLibPool ( const EasyMidiLibPool& ) = delete;
+        EasyMidiLibPool& operator= ( const EasyMidiLibPool& ) = delete;
+
+        void*                alloc        ( size_t size );
+        static void          release      ( const void* ptr );
+
+        // Helpers
+
+        uint8_t*             copy         ( const void* data, size_t size );
+        EasyMidiLibEvent     retain       ( const EasyMidiLibEvent& event );                        // copies the SysEx payload, if any
+        static void          release      ( const EasyMidiLibEvent& event )                         { if ( event.sysex ) release ( event.sysex ); }
+        EasyMidiLibEvent*    retainEvents ( const EasyMidiLibEvent* events, size_t count );         // one block with the events and their payloads
+
+        EasyMidiLibPoolStats getStats     ( ) const;
+
+    private:
+
+        struct Block;
+        struct SizeClass;
+
+        static const int             CLASSES = 12;
+
+        std::unique_ptr<SizeClass[]> m_classes;     // CLASSES size classes plus the heap fallback
+        std::vector<void*>           m_slabs;
+        std::atomic<uint64_t>        m_allocs      {0};
+        std::atomic<uint64_t>        m_releases    {0};
+        std::atomic<uint64_t>        m_slabCount   {0};
+        std::atomic<uint64_t>        m_slabBytes   {0};
+        std::atomic<uint64_t>        m_heapAllocs  {0};
+};
+
+// Pool of an input device, valid while the library is initialized
+
+EasyMidiLibPool* EasyMidiLib_getInputPool ( const EasyMidiLibDevice* dev );
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_POOL_H
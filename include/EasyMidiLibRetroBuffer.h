@@ -0,0 +1,84 @@
+#ifndef _EASYMIDILIB_RETROBUFFER_H
+#define _EASYMIDILIB_RETROBUFFER_H
+
+#include "EasyMidiLib.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibRetroBuffer
+//
+// Always-on retroactive recording ("record what I just played"). As an input tap it keeps the latest events of each
+// added device in a fixed ring allocated by addDevice(); the input path only copies into it and overwrites the oldest
+// events without locks or allocation. snapshot() copies the last seconds out of every ring while the input goes on,
+// merged by timestamp, ready for EasyMidiLibSmfRecorder::write() or EasyMidiLib_captureWrite().
+//
+// Each ring is a seqlock: the input thread announces the slots and SysEx bytes it is about to overwrite before writing
+// them, and a snapshot discards whatever was announced while it was copying, so it never returns a torn event. The
+// capacity is set in events and SysEx bytes, or in seconds of input at the full MIDI 1.0 wire rate (3125 bytes/s, a
+// faster USB stream holds proportionally less time).
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibRetroSnapshot
+{
+    std::vector<EasyMidiLibEvent> events; // sorted by timestamp, 'sysex' points into 'data'
+    std::vector<uint8_t>          data;
+};
+
+class EasyMidiLibRetroBuffer : public EasyMidiLibInputTap
+{
+    public:
+
+        static const size_t MAX_DEVICES = 256;
+        static const size_t WIRE_RATE   = 3125;    // bytes per second on a MIDI 1.0 cable
+
+        EasyMidiLibRetroBuffer ( );
+        virtual ~EasyMidiLibRetroBuffer ( );
+
+        // Capacity of the rings added afterwards (default 60 seconds)
+
+        void                        setCapacity      ( size_t events, size_t sysexBytes );
+        void                        setSeconds       ( double seconds )              { setCapacity ( (size_t)(seconds*WIRE_RATE), (size_t)(seconds*WIRE_RATE) ); }
+
+        // start() adds every opened input and begins filling the rings, devices opened later are added here
+
+        bool                        addDevice        ( const EasyMidiLibDevice* dev );
+        void                        start            ( );
+        void                        stop             ( );                            // the rings keep their content
+        bool                        isRunning        ( ) const                       { return m_running; }
+        void                        clear            ( );                            // while stopped
+
+        // The events of the last 'ns' nanoseconds (of one device, or all when 0), from any thread
+
+        void                        snapshot         ( EasyMidiLibRetroSnapshot& snapshot, uint64_t ns, const EasyMidiLibDevice* dev=0 ) const;
+
+        bool                        saveSmf          ( const char* path, uint64_t ns, uint16_t ticksPerQuarter=960 ) const;
+        bool                        saveCapture      ( const char* path, uint64_t ns ) const;
+
+        uint64_t                    getOverwritten   ( ) const                       { return m_overwritten; } // events pushed out
+        uint64_t                    getDropped       ( ) const                       { return m_dropped;     } // device not added, SysEx too big
+
+        // EasyMidiLibInputTap
+
+        void                        inputEvents      ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count ) override;
+
+    private:
+
+        struct Ring;
+
+        std::mutex                               m_devicesMutex;
+        std::atomic<const EasyMidiLibDevice*>    m_devices[MAX_DEVICES] = {};
+        std::unique_ptr<Ring>                    m_rings[MAX_DEVICES];
+        std::atomic<size_t>                      m_deviceCount   {0};
+        size_t                                   m_events        = 60*WIRE_RATE;
+        size_t                                   m_sysexBytes    = 60*WIRE_RATE;
+
+        std::atomic<bool>                        m_running       {false};
+        std::atomic<uint64_t>                    m_overwritten   {0};
+        std::atomic<uint64_t>                    m_dropped       {0};
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_RETROBUFFER_H
@@ -0,0 +1,123 @@
+#ifndef _EASYMIDILIB_SHM_H
+#define _EASYMIDILIB_SHM_H
+
+#include "EasyMidiLib.h"
+#include "EasyMidiLibBroadcast.h"
+#include <memory>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Shared memory publication of the input
+//
+// Rawmidi ports are opened by one process only. EasyMidiLibShmPublisher, an input tap of one device or of all of them,
+// writes their events into a named shared memory ring (POSIX shm_open, a named file mapping on Windows) so other
+// processes of the machine can read the same input with EasyMidiLibShmClient, with no broker in between.
+//
+// The ring works like EasyMidiLibBroadcastRing but is position independent: events carry a device number, and the
+// device names and ids are in a table ahead of the slots. The client maps it read-only and reads batches with plain
+// memory loads, no system call per event; while there is nothing to read it polls with its wait strategy (Block sleeps
+// like Sleep, there is no cross-process wake up). A client that falls more than the ring capacity behind skips ahead and
+// gets the count in the batch 'lost' field. Timestamps are the publisher's EasyMidiLib_getTimestamp() nanoseconds, a
+// monotonic clock shared by every process of the machine.
+//
+// Layout (native byte order): 128 byte header, MAX_DEVICES device entries of 256 bytes, the slots (timestamp, packed
+// message, SysEx position, device number, 8 bytes each) and the SysEx words.
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibShmPublisher : public EasyMidiLibInputTap
+{
+    public:
+
+        static const size_t MAX_DEVICES = 64;
+
+        EasyMidiLibShmPublisher ( );
+        virtual ~EasyMidiLibShmPublisher ( );
+
+        // Creates the shared memory (replacing one left by a publisher that died) and starts publishing 'dev', or every
+        // input when 0. false with getLastError() when it can't be created or another publisher uses the name.
+
+        bool                        start            ( const char* name, const EasyMidiLibDevice* dev=0, size_t events=65536, size_t sysexBytes=1<<20 );
+        void                        stop             ( );                            // the attached clients see isClosed()
+        bool                        isRunning        ( ) const                       { return m_shared!=0; }
+
+        uint64_t                    getPublished     ( ) const;
+        uint64_t                    getDropped       ( ) const                       { return m_dropped; }  // SysEx bigger than the ring, device table full
+        const char*                 getLastError     ( ) const                       { return m_lastError.c_str(); }
+
+        // EasyMidiLibInputTap
+
+        void                        inputEvents      ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count ) override;
+
+    private:
+
+        friend class EasyMidiLibShmClient;
+
+        struct Shared;
+
+        bool                        fail             ( const char* error );
+        uint32_t                    deviceNumber     ( const EasyMidiLibDevice* dev );
+
+        Shared*                                  m_shared       = 0;
+        std::string                              m_name;
+        std::string                              m_lastError;
+        const EasyMidiLibDevice*                 m_device       = 0;
+        const EasyMidiLibDevice*                 m_devices[MAX_DEVICES] = {};
+        size_t                                   m_deviceCount  = 0;
+        uint64_t                                 m_sysexHead    = 0;
+        std::atomic<uint64_t>                    m_dropped      {0};
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibShmClient (read-only, one per consumer thread, starts at the next event published)
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibShmClient
+{
+    public:
+
+        EasyMidiLibShmClient ( );
+        ~EasyMidiLibShmClient ( );
+
+        bool                        open             ( const char* name, EasyMidiLibWaitStrategy wait=EasyMidiLibWaitStrategy::Sleep, size_t batchSize=256 );
+        void                        close            ( );
+        bool                        isOpen           ( ) const                       { return m_shared!=0; }
+        bool                        isClosed         ( ) const;                      // the publisher stopped
+        const char*                 getLastError     ( ) const                       { return m_lastError.c_str(); }
+
+        void                        setWaitStrategy  ( EasyMidiLibWaitStrategy wait, uint64_t sleepNs=100000 ) { m_wait = wait; m_sleepNs = sleepNs; }
+
+        // Fills 'batch' with up to batchSize events, waiting up to 'timeoutNs' when there is none (0 polls). Returns the
+        // number of events, 0 on timeout or when the publisher stopped. The event devices are local stand-ins named after
+        // the publisher's devices.
+
+        size_t                      read             ( EasyMidiLibBroadcastBatch& batch, uint64_t timeoutNs );
+
+        void                        seek             ( uint64_t sequence )           { m_cursor = sequence; }
+        uint64_t                    getCursor        ( ) const                       { return m_cursor; }
+        uint64_t                    getLag           ( ) const;
+        uint64_t                    getLost          ( ) const                       { return m_lost; }
+
+        size_t                      getDeviceCount   ( ) const                       { return m_devices.size(); }
+        const EasyMidiLibDevice*    getDevice        ( size_t i ) const              { return i<m_devices.size() ? m_devices[i].get() : 0; }
+
+    private:
+
+        bool                        fail             ( const char* error );
+        size_t                      copy             ( EasyMidiLibBroadcastBatch& batch, uint64_t published );
+        void                        updateDevices    ( );
+
+        const EasyMidiLibShmPublisher::Shared*   m_shared       = 0;
+        size_t                                   m_mappedSize   = 0;
+        std::string                              m_lastError;
+        EasyMidiLibWaitStrategy                  m_wait         = EasyMidiLibWaitStrategy::Sleep;
+        uint64_t                                 m_sleepNs      = 100000;
+        size_t                                   m_batchSize    = 256;
+        uint64_t                                 m_cursor       = 0;
+        uint64_t                                 m_lost         = 0;
+        std::vector<uint64_t>                    m_positions;     // SysEx ring position of the batch events, UINT64_MAX for none
+        std::vector<size_t>                      m_offsets;       // their offset in the batch data
+        std::vector<std::unique_ptr<EasyMidiLibDevice>> m_devices;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_SHM_H
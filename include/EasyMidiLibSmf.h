@@ -0,0 +1,164 @@
+#ifndef _EASYMIDILIB_SMF_H
+#define _EASYMIDILIB_SMF_H
+
+#include "EasyMidiLib.h"
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Standard MIDI File reader (format 0, 1 and 2)
+//
+// The file is memory mapped and read in place: iterators walk the track chunks, decode the delta times as they go and
+// hand out pointers into the mapping for SysEx and meta payloads, so nothing is copied or allocated per event. open()
+// validates every track once and collects the tempo changes into a tempo map with the microsecond offset of each change
+// already summed, so tick <-> time conversions are a binary search. Iterators and the pointers they return are valid
+// until the file is closed.
+//
+// Format 0 and 1 files have one tempo map, merged from every track. In a format 2 file each track is a sequence of its
+// own, with its own tempo map: the tempo functions take the track, which the other formats ignore.
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibSmfEvent
+{
+    uint64_t       tick   ; // absolute, in file ticks
+    uint16_t       track  ;
+    uint8_t        status ; // 0x80-0xEF channel message, 0xF0/0xF7 SysEx, 0xFF meta
+    uint8_t        meta   ; // meta type (status 0xFF)
+    uint8_t        msg[3] ; // channel message with running status expanded
+    uint32_t       size   ; // channel message: 2 or 3 bytes in 'msg'. SysEx/meta: payload bytes
+    const uint8_t* payload; // SysEx (after the F0/F7) and meta payload, inside the mapped file
+
+    const uint8_t* data      ( ) const { return status<0xF0 ? msg : payload; }
+    bool           isChannel ( ) const { return status<0xF0; }
+    bool           isSysEx   ( ) const { return status==0xF0 || status==0xF7; }
+    bool           isMeta    ( ) const { return status==0xFF; }
+};
+
+struct EasyMidiLibSmfTempo
+{
+    uint64_t tick          ;
+    uint64_t micros        ; // time of 'tick' from the start of the file
+    uint32_t microsPerBeat ; // from this tick on
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibSmfTrackIterator (one track, in file order)
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibSmfTrackIterator
+{
+    public:
+
+        EasyMidiLibSmfTrackIterator ( )                                             { }
+        EasyMidiLibSmfTrackIterator ( const uint8_t* pos, const uint8_t* end, uint16_t track, uint64_t tick=0, uint8_t running=0 )
+                                    : m_pos(pos), m_end(end), m_tick(tick), m_track(track), m_running(running) { }
+
+        bool            next        ( EasyMidiLibSmfEvent& event ); // false at the end of the track or on malformed data
+        bool            failed      ( ) const                       { return m_failed;  }
+
+        // State before the next event, enough to resume from here later
+
+        uint64_t        getTick     ( ) const                       { return m_tick;    }
+        const uint8_t*  getPosition ( ) const                       { return m_pos;     }
+        const uint8_t*  getEnd      ( ) const                       { return m_end;     }
+        uint16_t        getTrack    ( ) const                       { return m_track;   }
+        uint8_t         getRunning  ( ) const                       { return m_running; }
+
+    private:
+
+        bool            readVarLen  ( uint32_t& value );
+        bool            fail        ( );
+
+        const uint8_t*  m_pos     = 0;
+        const uint8_t*  m_end     = 0;
+        uint64_t        m_tick    = 0;
+        uint16_t        m_track   = 0;
+        uint8_t         m_running = 0;
+        bool            m_failed  = false;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibSmfIterator (several tracks merged in tick order, ties in track order)
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibSmfIterator
+{
+    public:
+
+        void            addTrack    ( const EasyMidiLibSmfTrackIterator& track ); // add in track order, ties go to the first added
+        bool            next        ( EasyMidiLibSmfEvent& event );
+
+    private:
+
+        bool            before      ( size_t a, size_t b ) const;
+
+        std::vector<EasyMidiLibSmfTrackIterator> m_tracks;
+        std::vector<EasyMidiLibSmfEvent>         m_pending; // next event of each track
+        std::vector<size_t>                      m_heap;    // tracks with a pending event
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibSmfFile
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibSmfFile
+{
+    public:
+
+        EasyMidiLibSmfFile ( )                                              { }
+        ~EasyMidiLibSmfFile ( )                                             { close(); }
+
+        EasyMidiLibSmfFile ( const EasyMidiLibSmfFile& ) = delete;
+        EasyMidiLibSmfFile& operator= ( const EasyMidiLibSmfFile& ) = delete;
+
+        bool                        open              ( const char* path );
+        bool                        openMemory        ( const uint8_t* data, size_t size ); // not copied, must outlive the reader
+        void                        close             ( );
+        bool                        isOpen            ( ) const             { return m_data!=0; }
+        const char*                 getLastError      ( ) const             { return m_lastError.c_str(); }
+
+        uint16_t                    getFormat         ( ) const             { return m_format;        }
+        size_t                      getTrackCount     ( ) const             { return m_tracks.size(); }
+        uint16_t                    getDivision       ( ) const             { return m_division;      } // raw header value
+        uint64_t                    getLengthTicks    ( ) const             { return m_lengthTicks;   } // last event of any track
+        uint64_t                    getLengthMicros   ( ) const;                                        // longest track
+
+        // Tempo map (tempo changes of every track, or of 'track' in format 2; 120 bpm until the first one). SMPTE
+        // divisions have a fixed rate.
+
+        const std::vector<EasyMidiLibSmfTempo>& getTempoMap ( size_t track=0 ) const;
+        uint64_t                    ticksToMicros     ( uint64_t tick, size_t track=0 ) const;
+        uint32_t                    getMicrosPerBeat  ( uint64_t tick, size_t track=0 ) const;
+        uint64_t                    microsToTicks     ( uint64_t micros, size_t track=0 ) const;
+
+        // Lazy iterators: events() merges every track (format 0/1), events(i) walks one track
+
+        EasyMidiLibSmfIterator      events            ( ) const;
+        EasyMidiLibSmfIterator      events            ( size_t track ) const;
+        EasyMidiLibSmfTrackIterator track             ( size_t track ) const;
+
+    private:
+
+        struct Chunk
+        {
+            const uint8_t* begin;
+            const uint8_t* end;
+            uint64_t       lengthTicks;
+        };
+
+        bool                        parse             ( );
+        bool                        fail              ( const char* error );
+
+        const uint8_t*                                m_data        = 0;
+        size_t                                        m_size        = 0;
+        void*                                         m_mapping     = 0;   // set when the file was mapped by open()
+        uint16_t                                      m_format      = 0;
+        uint16_t                                      m_division    = 0;
+        uint64_t                                      m_lengthTicks = 0;
+        double                                        m_smpteTick   = 0.0; // microseconds per tick, SMPTE divisions only
+        std::vector<Chunk>                            m_tracks;
+        std::vector<std::vector<EasyMidiLibSmfTempo>> m_tempoMaps; // one, or one per track in format 2
+        std::string                                   m_lastError;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_SMF_H
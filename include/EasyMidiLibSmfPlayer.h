@@ -0,0 +1,118 @@
+#ifndef _EASYMIDILIB_SMFPLAYER_H
+#define _EASYMIDILIB_SMFPLAYER_H
+
+#include "EasyMidiLibSmf.h"
+#include "EasyMidiLibClock.h"
+#include <atomic>
+#include <thread>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibSmfPlayer
+//
+// Plays an EasyMidiLibSmfFile to output devices from its own thread. Tracks are merged lazily (EasyMidiLibSmfIterator)
+// and every tick gets an absolute deadline from the tempo map, so tempo changes never accumulate drift. The events of a
+// tick are gathered into one buffer per device as soon as the tick enters the lookahead window; the thread then sleeps
+// until shortly before the deadline, spins the rest and sends each buffer with one EasyMidiLib_outputSend. While nothing
+// is due it sleeps in lookahead steps, which bounds how long stop() and seek() wait for it.
+//
+// Seeking converts the time with the tempo map and resumes each track from the last index checkpoint (one every
+// CHECKPOINT_EVENTS events) before the target; program and controller changes before the target are not chased. The
+// jitter stats measure each batch send against its deadline.
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibSmfTransport
+{
+    bool     playing      ;
+    bool     looping      ;
+    uint64_t tick         ;
+    uint64_t micros       ;
+    uint64_t lengthMicros ;
+    double   tempo        ; // beats per minute at the position
+};
+
+class EasyMidiLibSmfPlayer
+{
+    public:
+
+        static const size_t CHECKPOINT_EVENTS = 256;
+
+        EasyMidiLibSmfPlayer ( );
+        ~EasyMidiLibSmfPlayer ( );
+
+        bool                        load             ( const EasyMidiLibSmfFile* file ); // the file must stay open while loaded; format 0 or 1
+        void                        unload           ( );
+
+        // Routing: a track goes to its own output if it has one, to the default output otherwise. Track outputs are
+        // set once the file is loaded and reset by load(); both can change while playing.
+
+        void                        setOutput        ( const EasyMidiLibDevice* dev )               { m_defaultOutput = dev; }
+        void                        setTrackOutput   ( size_t track, const EasyMidiLibDevice* dev ); // ignored for a track the file hasn't
+
+        // Transport (not from the player thread)
+
+        bool                        play             ( );
+        void                        stop             ( bool silence=true ); // keeps the position; all notes off and sustain off
+        bool                        seekMicros       ( uint64_t micros );
+        bool                        seekTicks        ( uint64_t tick );
+        void                        setLooping       ( bool looping )                               { m_looping = looping; }
+        bool                        isPlaying        ( ) const                                      { return m_playing;    }
+        EasyMidiLibSmfTransport     getTransport     ( ) const;
+
+        void                        setLookahead     ( uint64_t ns )                                { m_lookahead = ns; }
+        void                        setSpinTime      ( uint64_t ns )                                { m_spinTime  = ns; }
+
+        EasyMidiLibClockJitterStats getJitterStats   ( ) const                                      { return m_jitter.get(); }
+        void                        resetJitterStats ( )                                            { m_jitter.reset();      }
+
+    private:
+
+        struct Checkpoint
+        {
+            uint64_t       tick;
+            const uint8_t* pos;
+            uint8_t        running;
+        };
+
+        struct Batch
+        {
+            const EasyMidiLibDevice* dev;
+            std::vector<uint8_t>     data;
+        };
+
+        typedef std::atomic<const EasyMidiLibDevice*> Output;
+
+        void                        threadFunc       ( );
+        void                        setAnchor        ( uint64_t clock, uint64_t micros );
+        void                        getAnchor        ( uint64_t& clock, uint64_t& micros ) const;
+        void                        position         ( uint64_t tick );
+        bool                        gather           ( uint64_t& tick ); // next tick's events into m_batches
+        const EasyMidiLibDevice*    outputOf         ( uint16_t track ) const;
+        void                        silence          ( );
+
+        const EasyMidiLibSmfFile*                m_file          = 0;
+        std::vector<std::vector<Checkpoint>>     m_checkpoints;   // per track
+        std::vector<Output>                      m_trackOutputs;  // sized by load()
+        Output                                   m_defaultOutput {0};
+
+        // Player thread state
+
+        EasyMidiLibSmfIterator                   m_events;
+        EasyMidiLibSmfEvent                      m_next;
+        bool                                     m_hasNext       = false;
+        std::vector<Batch>                       m_batches;
+
+        std::thread                              m_thread;
+        std::atomic<bool>                        m_playing       {false};
+        std::atomic<bool>                        m_looping       {false};
+        std::atomic<uint64_t>                    m_lookahead     {20000000};
+        std::atomic<uint64_t>                    m_spinTime      {200000};
+        std::atomic<uint64_t>                    m_startClock    {0};     // timestamp matching m_startMicros while playing
+        std::atomic<uint64_t>                    m_startMicros   {0};
+        std::atomic<uint32_t>                    m_startSequence {0};     // odd while the two above are being written
+        std::atomic<uint64_t>                    m_positionTick  {0};     // while stopped
+        EasyMidiLibJitterMeter                   m_jitter;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_SMFPLAYER_H
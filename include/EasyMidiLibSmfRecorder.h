@@ -0,0 +1,108 @@
+#ifndef _EASYMIDILIB_SMFRECORDER_H
+#define _EASYMIDILIB_SMFRECORDER_H
+
+#include "EasyMidiLib.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <cstdio>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibSmfRecorder
+//
+// Records the input of many devices to a Standard MIDI File while they play. As an input tap it copies each event into
+// a preallocated lock free ring of its device (one producer, the thread delivering that device): the tap doesn't
+// allocate, lock or touch the file, the tap list is read without locking either, and events that find their ring full
+// are dropped and counted. A writer thread drains the rings every few ms, merges them by timestamp (events younger than
+// the reorder window wait for the next pass), encodes them with running status and writes large blocks sequentially.
+//
+// The file is format 0: one track at 120 bpm, with a MIDI port meta event (FF 21) whenever the source device changes;
+// addDevice() order gives the port numbers. The track length is patched in when the recording stops.
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibSmfRecorderStats
+{
+    uint64_t events       ; // encoded
+    uint64_t dropped      ; // ring full or device not added
+    uint64_t late         ; // arrived after newer events were written, recorded at the current time
+    uint64_t bytesWritten ;
+};
+
+class EasyMidiLibSmfRecorder : public EasyMidiLibInputTap
+{
+    public:
+
+        static const size_t MAX_DEVICES = 256;
+
+        EasyMidiLibSmfRecorder ( );
+        virtual ~EasyMidiLibSmfRecorder ( );
+
+        // Devices are added before or while recording (the ring is allocated here), start() adds every opened input
+
+        bool                        addDevice        ( const EasyMidiLibDevice* dev );
+        void                        setRingSize      ( size_t bytes )                   { m_ringSize = bytes; } // per device, default 1 MB
+
+        bool                        start            ( const char* path, uint16_t ticksPerQuarter=960, uint64_t reorderWindow=5000000 );
+        bool                        stop             ( );   // writes what is left, false on a write error
+        bool                        isRecording      ( ) const                          { return m_recording; }
+        const char*                 getLastError     ( ) const                          { return m_lastError.c_str(); }
+
+        EasyMidiLibSmfRecorderStats getStats         ( ) const;
+
+        // Writes a list of events sorted by timestamp (a snapshot) in the same format, while not recording
+
+        bool                        write            ( const char* path, const EasyMidiLibEvent* events, size_t count, uint16_t ticksPerQuarter=960 );
+
+        // EasyMidiLibInputTap
+
+        void                        inputEvents      ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count ) override;
+
+    private:
+
+        struct Ring;
+        struct Record;
+
+        bool                        openFile         ( const char* path, uint16_t ticksPerQuarter );
+        bool                        closeFile        ( );
+        void                        threadFunc       ( );
+        void                        drain            ( uint64_t cutoff );
+        void                        encode           ( const Record& record );
+        void                        writeVarLen      ( uint32_t value );
+        bool                        writeBlock       ( );
+
+        // Devices (lock free lookup from the input path)
+
+        std::mutex                               m_devicesMutex;
+        std::atomic<const EasyMidiLibDevice*>    m_devices[MAX_DEVICES] = {};
+        std::unique_ptr<Ring>                    m_rings[MAX_DEVICES];
+        std::atomic<size_t>                      m_deviceCount   {0};
+        size_t                                   m_ringSize      = 1<<20;
+
+        // Writer
+
+        FILE*                                    m_file          = 0;
+        long                                     m_trackStart    = 0;     // offset of the MTrk length
+        uint64_t                                 m_startTime     = 0;
+        uint64_t                                 m_reorderWindow = 5000000;
+        double                                   m_ticksPerNs    = 0.0;
+        uint64_t                                 m_lastTick      = 0;
+        uint8_t                                  m_running       = 0;
+        int                                      m_port          = -1;
+        std::vector<Record>                      m_pending;
+        std::vector<uint8_t>                     m_pendingData;
+        std::vector<uint8_t>                     m_block;
+        bool                                     m_writeFailed   = false;
+        std::string                              m_lastError;
+
+        std::thread                              m_thread;
+        std::atomic<bool>                        m_recording     {false};
+        std::atomic<uint64_t>                    m_events        {0};
+        std::atomic<uint64_t>                    m_dropped       {0};
+        std::atomic<uint64_t>                    m_late          {0};
+        std::atomic<uint64_t>                    m_bytesWritten  {0};
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_SMFRECORDER_H
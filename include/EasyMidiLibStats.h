@@ -0,0 +1,72 @@
+#ifndef _EASYMIDILIB_STATS_H
+#define _EASYMIDILIB_STATS_H
+
+#include "EasyMidiLib.h"
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Timing and throughput instrumentation
+//
+// Off until EasyMidiLib_setStatsEnabled(true); then each delivery and send costs a couple of timestamps and relaxed
+// atomic adds. Build the library with EASYMIDILIB_STATS=0 to compile the instrumentation out entirely.
+//--------------------------------------------------------------------------------------------------------------------------
+
+#ifndef EASYMIDILIB_STATS
+#define EASYMIDILIB_STATS 1
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibHistogram: log buckets, 8 linear sub-buckets per power of two (values within 12.5%), 0 to 2^64-1
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibHistogram
+{
+    public:
+
+        static const size_t BUCKETS = 496;
+
+        uint64_t        getCount       ( ) const                { return m_count; }
+        uint64_t        getMin         ( ) const                { return m_min;   }
+        uint64_t        getMax         ( ) const                { return m_max;   }
+        double          getMean        ( ) const                { return m_count ? (double)m_sum/m_count : 0.0; }
+        uint64_t        getPercentile  ( double percent ) const; // highest value of the bucket reaching 'percent' (0-100)
+        uint64_t        getBucketCount ( size_t bucket ) const  { return m_buckets[bucket]; }
+
+        static size_t   bucketOf       ( uint64_t value );
+        static uint64_t bucketLowest   ( size_t bucket );
+        static uint64_t bucketHighest  ( size_t bucket );
+
+    private:
+
+        friend struct EasyMidiLibHistogramRecorder;
+
+        uint64_t m_buckets[BUCKETS] = {};
+        uint64_t m_count            = 0;
+        uint64_t m_sum              = 0;
+        uint64_t m_min              = 0;
+        uint64_t m_max              = 0;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibStats
+{
+    uint64_t             elapsedNs        ; // since the first data or the last reset
+    uint64_t             bytes            ; // received (inputs) or sent (outputs)
+    uint64_t             messages         ; // a SysEx counts as one
+    double               bytesPerSecond   ;
+    double               messagesPerSecond;
+    uint64_t             queueHighWater   ; // inputs, see EasyMidiLibQueueStats
+    EasyMidiLibHistogram latency          ; // inputs: data received -> listener deviceInData (ns)
+    EasyMidiLibHistogram callback         ; // inputs: deviceInData duration (ns)
+    EasyMidiLibHistogram write            ; // outputs: EasyMidiLib_outputSend duration, including the drain (ns)
+    EasyMidiLibHistogram enumeration      ; // library wide: device scan duration (ns)
+};
+
+void EasyMidiLib_setStatsEnabled ( bool enabled );
+bool EasyMidiLib_getStatsEnabled ( );
+bool EasyMidiLib_getStats        ( const EasyMidiLibDevice* dev, EasyMidiLibStats& stats ); // false if compiled out
+void EasyMidiLib_resetStats      ( const EasyMidiLibDevice* dev );                          // 0: enumeration only
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_STATS_H
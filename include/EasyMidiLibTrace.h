@@ -0,0 +1,26 @@
+#ifndef _EASYMIDILIB_TRACE_H
+#define _EASYMIDILIB_TRACE_H
+
+#include "EasyMidiLib.h"
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Pipeline tracing in Chrome trace event JSON (chrome://tracing, ui.perfetto.dev)
+//
+// While started, the library records read, deliver, process, callback, send, drain and enumerate spans per device and
+// thread. Each thread writes into its own lock free ring of 'eventsPerThread' events (sized on the thread's first event)
+// and a background thread moves them to the file, so recording costs two timestamps and a small copy. Events that find
+// their ring full are dropped and counted. Build the library with EASYMIDILIB_TRACE=0 to compile the hooks out.
+//--------------------------------------------------------------------------------------------------------------------------
+
+#ifndef EASYMIDILIB_TRACE
+#define EASYMIDILIB_TRACE 1
+#endif
+
+bool     EasyMidiLib_traceStart   ( const char* path, size_t eventsPerThread=16384 ); // false if the file can't be created
+void     EasyMidiLib_traceStop    ( );                                               // flushes and closes the file
+bool     EasyMidiLib_isTracing    ( );
+uint64_t EasyMidiLib_traceDropped ( );                                               // events lost in the current trace
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_TRACE_H
@@ -0,0 +1,61 @@
+#ifndef _EASYMIDILIB_UMP_H
+#define _EASYMIDILIB_UMP_H
+
+#include "EasyMidiLib.h"
+
+//--------------------------------------------------------------------------------------------------------------------------
+// MIDI 2.0 Universal MIDI Packets
+//
+// UMP streams are arrays of 32 bit words; the message type in the top 4 bits of a packet's first word gives its size.
+// EasyMidiLib_eventsToUmp translates MIDI 1.0 events to packets: channel voice messages to message type 2 (MIDI 1.0
+// protocol) or 4 (MIDI 2.0 protocol, values upscaled with the min-center-max rule), system messages to type 1 and SysEx
+// to type 3 packets. EasyMidiLibUmpDecoder goes back, downscaling type 4 values; RPN and NRPN packets become their
+// controller sequences and a program change with a valid bank gets its bank select in front. MIDI 1.0 controller
+// sequences are translated as plain controllers.
+//
+// Both directions are table driven loops over whole batches, with no allocation once the output vectors have grown.
+//--------------------------------------------------------------------------------------------------------------------------
+
+enum class EasyMidiLibUmpType : uint8_t
+{ Utility=0x0, System=0x1, Midi1ChannelVoice=0x2, Data64=0x3, Midi2ChannelVoice=0x4, Data128=0x5 };
+
+inline EasyMidiLibUmpType EasyMidiLib_umpType  ( uint32_t word ) { return (EasyMidiLibUmpType)(word>>28); }
+inline size_t             EasyMidiLib_umpWords ( uint32_t word ) { static const uint8_t words[16] = { 1,1,1,2,2,4,1,1,2,2,2,3,3,4,4,4 }; return words[word>>28]; }
+
+// Min-center-max value scaling between resolutions (e.g. 7 bit velocity to 16 bits), as the MIDI 2.0 translation rules
+
+uint32_t EasyMidiLib_umpScaleUp   ( uint32_t value, uint8_t srcBits, uint8_t dstBits );
+uint32_t EasyMidiLib_umpScaleDown ( uint32_t value, uint8_t srcBits, uint8_t dstBits );
+
+// Appends the packets of 'count' events to 'words' and returns the number of words appended. Incomplete or unknown
+// messages are skipped.
+
+size_t   EasyMidiLib_eventsToUmp  ( const EasyMidiLibEvent* events, size_t count, EasyMidiLibUmpProtocol protocol, std::vector<uint32_t>& words, uint8_t group=0 );
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibUmpDecoder (UMP to MIDI 1.0 events, keeps SysEx split across calls)
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibUmpDecoder
+{
+    public:
+
+        // Appends the events of the packets in 'words' and returns the number of words used (a packet cut at the end is
+        // left for the next call). SysEx events point into the decoder, valid until the next call.
+
+        size_t                      decode           ( const uint32_t* words, size_t count, const EasyMidiLibDevice* dev, uint64_t timestamp, std::vector<EasyMidiLibEvent>& events );
+        void                        reset            ( );
+
+    private:
+
+        void                        add              ( std::vector<EasyMidiLibEvent>& events, uint8_t status, uint8_t data1, uint8_t data2 );
+
+        const EasyMidiLibDevice*                 m_device      = 0;
+        uint64_t                                 m_timestamp   = 0;
+        std::vector<uint8_t>                     m_sysex;        // in progress, F0 included
+        std::vector<uint8_t>                     m_complete;     // finished in the current call
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_UMP_H
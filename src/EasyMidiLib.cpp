@@ -1,5 +1,723 @@
 #include "EasyMidiLib.h"
+#include "EasyMidiLibInternal.h"
+#include "EasyMidiLibUmp.h"
 #include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static thread_local const EasyMidiLibDevice* inDevice    = 0;
+static thread_local uint64_t                 inTimestamp = 0;
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLib_getTimestamp ( )
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_waitUntil ( uint64_t deadline, uint64_t spinTime, const std::atomic<bool>& running, uint64_t& now )
+{
+    now = EasyMidiLib_getTimestamp();
+    if ( deadline > now+spinTime )
+        std::this_thread::sleep_for(std::chrono::nanoseconds(deadline-spinTime-now));
+
+    while ( running && (now=EasyMidiLib_getTimestamp())<deadline )
+        ;
+
+    return running;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Input taps. Deliveries read the current list without locking; adding or removing a tap publishes a new copy and
+// retires the old one. Each delivery counts itself on one of two counters, picked by the epoch. A removal flips the epoch
+// and waits for each counter to drain, leaving out its own thread's deliveries when called from a tap, then frees what
+// was retired before it. While its thread is still delivering, that is left to a later removal.
+
+typedef std::vector<EasyMidiLibInputTap*> TapList;
+
+static std::mutex                                 tapsMutex;                // writers
+static std::atomic<TapList*>                      taps             {0};
+static std::atomic<size_t>                        tapsCount        {0};
+static std::atomic<size_t>                        tapsEpoch        {0};
+static std::atomic<size_t>                        tapsReaders[2];
+static thread_local size_t                        tapsHeld[2]      = {};    // this thread's share of tapsReaders
+static std::vector<std::pair<uint64_t,TapList*>>  tapsRetired;              // with their retire order
+static uint64_t                                   tapsRetiredCount = 0;
+
+// Work queued by the taps for after the delivery, run by the same thread once the taps returned
+static thread_local size_t                             tapsDepth        = 0;
+static thread_local bool                               afterTapsRunning = false;
+static thread_local std::vector<std::function<void()>> afterTaps;
+
+// Recursive so hooks can unregister themselves (or others) from inside their callbacks
+static std::recursive_mutex                updateHooksMutex;
+static std::vector<EasyMidiLibUpdateHook*> updateHooks;
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Makes 'list' current (tapsMutex held), returns the retire order of the previous one
+
+static uint64_t publishTaps ( TapList* list )
+{
+    TapList* old = taps.exchange ( list );
+    tapsCount = list ? list->size() : 0;
+
+    if ( old )
+        tapsRetired.push_back ( { ++tapsRetiredCount, old } );
+    return tapsRetiredCount;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_addInputTap ( EasyMidiLibInputTap* tap )
+{
+    std::lock_guard<std::mutex> lock(tapsMutex);
+
+    TapList* current = taps.load();
+    if ( current && std::find(current->begin(), current->end(), tap)!=current->end() )
+        return;
+
+    TapList* list = current ? new TapList(*current) : new TapList;
+    list->push_back ( tap );
+    publishTaps ( list );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_removeInputTap ( EasyMidiLibInputTap* tap )
+{
+    uint64_t retired;
+    {
+        std::lock_guard<std::mutex> lock(tapsMutex);
+
+        TapList* current = taps.load();
+        if ( !current || std::find(current->begin(), current->end(), tap)==current->end() )
+            return;
+
+        TapList* list = new TapList(*current);
+        list->erase ( std::remove(list->begin(), list->end(), tap), list->end() );
+        if ( list->empty() )
+        {
+            delete list;
+            list = 0;
+        }
+        retired = publishTaps ( list );
+    }
+
+    // Waits for any delivery in progress on other threads, the tap is not called once this returns. New deliveries
+    // count on the other counter, so each one drains.
+    for ( size_t parity=0; parity!=2; parity++ )
+    {
+        tapsEpoch = parity+1;
+        while ( tapsReaders[parity]>tapsHeld[parity] )
+            std::this_thread::yield();
+    }
+
+    if ( tapsHeld[0] || tapsHeld[1] )
+        return;
+
+    std::lock_guard<std::mutex> lock(tapsMutex);
+    auto free = std::partition ( tapsRetired.begin(), tapsRetired.end(), [retired]( const std::pair<uint64_t,TapList*>& r ) { return r.first>retired; } );
+    for ( auto it=free; it!=tapsRetired.end(); ++it )
+        delete it->second;
+    tapsRetired.erase ( free, tapsRetired.end() );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void runAfterTaps ( )
+{
+    // Work queued meanwhile (a nested delivery) is picked up by this loop
+    if ( afterTapsRunning )
+        return;
+
+    afterTapsRunning = true;
+    for ( size_t i=0; i<afterTaps.size(); i++ )
+    {
+        std::function<void()> work = std::move(afterTaps[i]);
+        work();
+    }
+    afterTaps.clear();
+    afterTapsRunning = false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_afterInputTaps ( std::function<void()> work )
+{
+    if ( !tapsDepth )
+    {
+        work();
+        return;
+    }
+
+    afterTaps.push_back ( std::move(work) );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_addUpdateHook ( EasyMidiLibUpdateHook* hook )
+{
+    std::lock_guard<std::recursive_mutex> lock(updateHooksMutex);
+
+    if ( std::find(updateHooks.begin(), updateHooks.end(), hook)==updateHooks.end() )
+        updateHooks.push_back(hook);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_removeUpdateHook ( EasyMidiLibUpdateHook* hook )
+{
+    std::lock_guard<std::recursive_mutex> lock(updateHooksMutex);
+
+    updateHooks.erase(std::remove(updateHooks.begin(), updateHooks.end(), hook), updateHooks.end());
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_runUpdateHooks ( )
+{
+    std::lock_guard<std::recursive_mutex> lock(updateHooksMutex);
+
+    for ( size_t i=0; i<updateHooks.size(); i++ )
+        updateHooks[i]->update();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static std::atomic<size_t>   defaultQueueCapacity     {1<<20};
+static std::atomic<uint8_t>  defaultQueuePolicy       {(uint8_t)EasyMidiLibOverflowPolicy::DropOldest};
+static std::atomic<uint64_t> defaultQueueBlockTimeout {100000000};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibDeviceState::EasyMidiLibDeviceState ( )
+    : queueCapacity(defaultQueueCapacity.load()), queuePolicy(defaultQueuePolicy.load()), queueBlockTimeout(defaultQueueBlockTimeout.load())
+{
+    inputQueue.reserve(10240);
+    EasyMidiLib_prefaultDeviceState ( this );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void resetProcessing ( EasyMidiLibDeviceState* state )
+{
+    state->inputQueue.clear();
+    state->queueSize     = 0;
+    state->queueResync   = false;
+    state->runningStatus = 0;
+    state->pendingSize   = 0;
+    state->pendingNeeded = 0;
+    state->inSysex       = false;
+    state->parser        = {};
+    state->sysex.clear();
+    state->events.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_resetDeviceState ( const EasyMidiLibDevice* dev )
+{
+    EasyMidiLibDeviceState* state = EasyMidiLib_getDeviceState(dev);
+
+    {
+        std::lock_guard<std::mutex> lock(state->pendingMutex);
+        state->pendingData  .clear();
+        state->pendingChunks.clear();
+        state->pendingResync = false;
+        state->resetPending  = true;
+    }
+
+    // A dispatch thread blocked on the full queue gives up
+    EasyMidiLib_inputQueueReady ( dev );
+
+    // The processing state belongs to the dispatchMutex holder. Waiting for it here could deadlock with a callback
+    // taking the backend lock this thread holds, so a busy device is reset by its processing thread instead.
+    std::unique_lock<std::mutex> processLock(state->dispatchMutex, std::try_to_lock);
+    if ( processLock.owns_lock() && state->resetPending.exchange(false) )
+        resetProcessing ( state );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void flushEvents ( EasyMidiLibDeviceState* state, const EasyMidiLibDevice* dev, EasyMidiLibListener* umpListener )
+{
+    if ( state->events.empty() )
+        return;
+
+    if ( tapsCount )
+    {
+        size_t parity = tapsEpoch & 1;
+        tapsReaders[parity]++;
+        tapsHeld   [parity]++;
+        tapsDepth++;
+
+        const TapList* list = taps;
+        for ( size_t i=0; list && i!=list->size(); i++ )
+        {
+            // Removed by an earlier tap of this delivery: not called anymore
+            const TapList* current = taps;
+            if ( current!=list && (!current || std::find(current->begin(), current->end(), (*list)[i])==current->end()) )
+                continue;
+
+            (*list)[i]->inputEvents ( dev, state->events.data(), state->events.size() );
+        }
+
+        tapsDepth--;
+        tapsHeld   [parity]--;
+        tapsReaders[parity]--;
+
+        if ( !tapsDepth )
+            runAfterTaps();
+    }
+
+    if ( umpListener )
+    {
+        state->ump.clear();
+        EasyMidiLib_eventsToUmp ( state->events.data(), state->events.size(), umpListener->getUmpProtocol(), state->ump );
+
+        inDevice    = dev;
+        inTimestamp = state->events[0].timestamp;
+
+        uint64_t statsBegin  = EasyMidiLib_statsBegin();
+        uint64_t traceBegin  = EasyMidiLib_traceBegin();
+        uint64_t budgetBegin = EasyMidiLib_budgetBegin ( dev, "deviceInUmp" );
+        umpListener->deviceInUmp ( dev, state->ump.data(), state->ump.size() );
+        EasyMidiLib_budgetEnd     ( umpListener, dev, "deviceInUmp", budgetBegin, true );
+        EasyMidiLib_traceEnd      ( "callback", dev, traceBegin, state->ump.size()*4 );
+        EasyMidiLib_statsCallback ( dev, inTimestamp, statsBegin );
+
+        inDevice    = 0;
+        inTimestamp = 0;
+    }
+
+    state->events.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void addEvent ( EasyMidiLibDeviceState* state, const EasyMidiLibDevice* dev, uint64_t timestamp, const uint8_t* data, size_t size )
+{
+    EasyMidiLibEvent e = {};
+    e.timestamp = timestamp;
+    e.device    = dev;
+    e.size      = (uint32_t)size;
+    if ( size<=sizeof(e.msg) )
+        memcpy(e.msg, data, size);
+    else
+        e.sysex = data;
+
+    state->events.push_back(e);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void frameEvents ( EasyMidiLibDeviceState* state, const EasyMidiLibDevice* dev, const uint8_t* data, size_t dataSize, uint64_t timestamp, EasyMidiLibListener* umpListener )
+{
+    // Same message layout rules as processInData, but incremental over the freshly received bytes only
+    for ( size_t i=0; i!=dataSize; i++ )
+    {
+        uint8_t byte = data[i];
+
+        // Real-time, allowed anywhere
+        if ( byte>=0xF8 )
+        {
+            addEvent ( state, dev, timestamp, &byte, 1 );
+            continue;
+        }
+
+        if ( state->inSysex )
+        {
+            if ( byte==0xF7 )
+            {
+                state->sysex.push_back(byte);
+                state->inSysex = false;
+                addEvent ( state, dev, timestamp, state->sysex.data(), state->sysex.size() );
+                flushEvents ( state, dev, umpListener ); // the SysEx buffer is reused
+                continue;
+            }
+            if ( !(byte & 0x80) )
+            {
+                state->sysex.push_back(byte);
+                continue;
+            }
+            state->inSysex = false; // unterminated SysEx, dropped
+        }
+
+        if ( byte & 0x80 )
+        {
+            state->pendingSize = 0;
+
+            if ( byte==0xF0 )
+            {
+                state->inSysex       = true;
+                state->runningStatus = 0;
+                state->sysex.clear();
+                state->sysex.push_back(byte);
+            }
+            else if ( byte>=0xF0 )
+            {
+                size_t needed = (byte==0xF2) ? 2 : (byte==0xF1 || byte==0xF3) ? 1 : 0;
+                state->runningStatus = 0;
+                if ( needed==0 )
+                {
+                    if ( byte!=0xF7 )
+                        addEvent ( state, dev, timestamp, &byte, 1 );
+                }
+                else
+                {
+                    state->pending[0]    = byte;
+                    state->pendingSize   = 1;
+                    state->pendingNeeded = (uint8_t)(needed+1);
+                }
+            }
+            else
+            {
+                uint8_t msgType = byte & 0xF0;
+                state->runningStatus = byte;
+                state->pending[0]    = byte;
+                state->pendingSize   = 1;
+                state->pendingNeeded = (msgType==0xC0 || msgType==0xD0) ? 2 : 3;
+            }
+            continue;
+        }
+
+        // Data byte
+        if ( state->pendingSize==0 )
+        {
+            if ( !state->runningStatus )
+                continue;
+
+            uint8_t msgType = state->runningStatus & 0xF0;
+            state->pending[0]    = state->runningStatus;
+            state->pendingSize   = 1;
+            state->pendingNeeded = (msgType==0xC0 || msgType==0xD0) ? 2 : 3;
+        }
+
+        state->pending[state->pendingSize++] = byte;
+        if ( state->pendingSize==state->pendingNeeded )
+        {
+            addEvent ( state, dev, timestamp, state->pending, state->pendingSize );
+            state->pendingSize = 0;
+        }
+    }
+
+    flushEvents ( state, dev, umpListener );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// End of the queued message starting at 'pos', 0 if it is not complete yet
+
+static size_t queuedMessageEnd ( const std::vector<uint8_t>& queue, size_t pos, uint8_t& runningStatus )
+{
+    uint8_t byte = queue[pos];
+    size_t  length;
+
+    if ( byte>=0xF8 )
+        return pos+1;
+
+    if ( byte==0xF0 )
+    {
+        runningStatus = 0;
+        for ( size_t i=pos+1; i<queue.size(); i++ )
+            if ( queue[i]==0xF7 )
+                return i+1;
+        return 0;
+    }
+
+    if ( byte>=0xF0 )
+    {
+        runningStatus = 0;
+        length        = (byte==0xF2) ? 3 : (byte==0xF1 || byte==0xF3) ? 2 : 1;
+    }
+    else if ( byte & 0x80 )
+    {
+        runningStatus = byte;
+        length        = ((byte & 0xF0)==0xC0 || (byte & 0xF0)==0xD0) ? 2 : 3;
+    }
+    else if ( runningStatus )
+        length = ((runningStatus & 0xF0)==0xC0 || (runningStatus & 0xF0)==0xD0) ? 1 : 2;
+    else
+        return pos+1; // stray data byte
+
+    return pos+length<=queue.size() ? pos+length : 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Brings the queue back under its capacity removing whole messages. A message left incomplete at the end of the dropped
+// range has its remaining bytes discarded as they arrive (queueResync).
+
+static void limitInputQueue ( EasyMidiLibDeviceState* state, size_t capacity, bool dropOldest )
+{
+    std::vector<uint8_t>& queue         = state->inputQueue;
+    uint8_t               runningStatus = 0;
+    size_t                pos           = 0;
+    size_t                end           = 0;
+
+    state->queueOverflows++;
+
+    if ( dropOldest )
+    {
+        size_t excess = queue.size()-capacity;
+        while ( pos<excess && (end=queuedMessageEnd(queue, pos, runningStatus))!=0 )
+            pos = end;
+
+        if ( pos<excess )
+        {
+            pos                = queue.size();
+            state->queueResync = true;
+        }
+
+        queue.erase ( queue.begin(), queue.begin()+pos );
+        state->queueDroppedBytes += pos;
+    }
+    else
+    {
+        while ( pos<queue.size() && (end=queuedMessageEnd(queue, pos, runningStatus))!=0 && end<=capacity )
+            pos = end;
+
+        size_t keep = pos;
+        while ( pos<queue.size() && (end=queuedMessageEnd(queue, pos, runningStatus))!=0 )
+            pos = end;
+        if ( pos<queue.size() )
+            state->queueResync = true;
+
+        state->queueDroppedBytes += queue.size()-keep;
+        queue.resize ( keep );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_inputGap ( EasyMidiLibDeviceState* state )
+{
+    std::vector<uint8_t>& queue         = state->inputQueue;
+    uint8_t               runningStatus = 0;
+    size_t                pos           = 0;
+    size_t                end           = 0;
+
+    while ( pos<queue.size() && (end=queuedMessageEnd(queue, pos, runningStatus))!=0 )
+        pos = end;
+
+    state->queueDroppedBytes += queue.size()-pos;
+    queue.resize ( pos );
+
+    state->queueResync   = true;
+    state->runningStatus = 0;
+    state->pendingSize   = 0;
+    state->inSysex       = false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void offerInputQueue ( EasyMidiLibListener* listener, const EasyMidiLibDevice* dev, std::vector<uint8_t>& inputQueue, uint64_t timestamp )
+{
+    inDevice    = dev;
+    inTimestamp = timestamp;
+
+    uint64_t statsBegin    = EasyMidiLib_statsBegin();
+    uint64_t traceBegin    = EasyMidiLib_traceBegin();
+    uint64_t budgetBegin   = EasyMidiLib_budgetBegin ( dev, "deviceInData" );
+    size_t   consumedBytes = listener->deviceInData(dev, inputQueue.data(), inputQueue.size());
+    EasyMidiLib_budgetEnd     ( listener, dev, "deviceInData", budgetBegin, true );
+    EasyMidiLib_traceEnd      ( "callback", dev, traceBegin, inputQueue.size() );
+    EasyMidiLib_statsCallback ( dev, timestamp, statsBegin );
+
+    if (consumedBytes > 0)
+    {
+        if (consumedBytes > inputQueue.size())
+            consumedBytes = inputQueue.size();
+
+        inputQueue.erase(inputQueue.begin(), inputQueue.begin() + consumedBytes);
+    }
+
+    inDevice    = 0;
+    inTimestamp = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_processInData ( EasyMidiLibListener* listener, const EasyMidiLibDevice* dev, const uint8_t* data, size_t dataSize, uint64_t timestamp )
+{
+    EasyMidiLibDeviceState*   state      = EasyMidiLib_getDeviceState(dev);
+    std::vector<uint8_t>&     inputQueue = state->inputQueue;
+    size_t                    capacity   = state->queueCapacity;
+    EasyMidiLibOverflowPolicy policy     = (EasyMidiLibOverflowPolicy)state->queuePolicy.load();
+
+    if ( state->resetPending.load(std::memory_order_relaxed) && state->resetPending.exchange(false) )
+        resetProcessing ( state );
+
+    uint64_t traceBegin = EasyMidiLib_traceBegin();
+    EasyMidiLib_statsData ( dev, data, dataSize );
+    EasyMidiLib_captureData ( dev, data, dataSize, timestamp );
+
+    // UMP listeners get the framed events translated instead of the byte queue
+    EasyMidiLibListener* umpListener = listener && listener->getUmpInput() ? listener : 0;
+
+    if ( tapsCount || umpListener )
+        frameEvents ( state, dev, data, dataSize, timestamp, umpListener );
+
+    if ( umpListener )
+    {
+        EasyMidiLib_traceEnd ( "process", dev, traceBegin, dataSize );
+        return;
+    }
+
+    // Real-time bytes the listener doesn't subscribe to never reach the queue
+    if ( listener )
+        data = listener->filterRealtime ( dev, data, dataSize, state->filtered );
+
+    // Skip the rest of a message cut by an overflow (real-time bytes still go through)
+    while ( state->queueResync && dataSize )
+    {
+        if ( data[0]>=0xF8 )
+            inputQueue.push_back(data[0]);
+        else if ( !(data[0] & 0x80) || data[0]==0xF7 )
+            state->queueDroppedBytes++;
+        else
+        {
+            state->queueResync = false;
+            break;
+        }
+        data++;
+        dataSize--;
+    }
+
+    // Block: wait for the listener to make room and offer it the queue again until the new bytes fit (dispatch threads
+    // only, the input thread must keep reading)
+    if ( policy==EasyMidiLibOverflowPolicy::Block && capacity && listener && inputQueue.size()+dataSize>capacity && EasyMidiLib_onDispatchThread() )
+    {
+        uint64_t start    = EasyMidiLib_getTimestamp();
+        uint64_t deadline = start+state->queueBlockTimeout;
+        uint64_t now      = start;
+
+        std::unique_lock<std::mutex> lock(state->queueReadyMutex);
+        for ( ;; )
+        {
+            uint64_t signals = state->queueReadySignals;
+            lock.unlock();
+            offerInputQueue ( listener, dev, inputQueue, timestamp );
+            lock.lock();
+
+            now = EasyMidiLib_getTimestamp();
+            if ( inputQueue.size()+dataSize<=capacity || now>=deadline || state->resetPending )
+                break;
+
+            state->queueReady.wait_for ( lock, std::chrono::nanoseconds(deadline-now), [&] { return state->queueReadySignals!=signals; } );
+        }
+
+        state->queueBlockedNs += now-start;
+    }
+
+    size_t prevSize = inputQueue.size();
+    inputQueue.resize(prevSize + dataSize);
+    memcpy(inputQueue.data() + prevSize, data, dataSize);
+
+    if ( inputQueue.size()>state->queueHighWater )
+        state->queueHighWater = inputQueue.size();
+
+    if (listener)
+        offerInputQueue ( listener, dev, inputQueue, timestamp );
+
+    // The bound applies to what the listener leaves behind
+    if ( capacity && inputQueue.size()>capacity )
+        limitInputQueue ( state, capacity, policy==EasyMidiLibOverflowPolicy::DropOldest );
+
+    state->queueSize = inputQueue.size();
+    EasyMidiLib_traceEnd ( "process", dev, traceBegin, dataSize );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_setDefaultInputQueueLimit ( size_t capacity, EasyMidiLibOverflowPolicy policy, uint64_t blockTimeout )
+{
+    defaultQueueCapacity     = capacity;
+    defaultQueuePolicy       = (uint8_t)policy;
+    defaultQueueBlockTimeout = blockTimeout;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_setInputQueueLimit ( const EasyMidiLibDevice* dev, size_t capacity, EasyMidiLibOverflowPolicy policy, uint64_t blockTimeout )
+{
+    EasyMidiLibDeviceState* state = EasyMidiLib_getDeviceState(dev);
+
+    state->queueCapacity     = capacity;
+    state->queuePolicy       = (uint8_t)policy;
+    state->queueBlockTimeout = blockTimeout;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_getInputQueueStats ( const EasyMidiLibDevice* dev, EasyMidiLibQueueStats& stats )
+{
+    EasyMidiLibDeviceState* state = dev ? EasyMidiLib_getDeviceState(dev) : 0;
+    if ( !state )
+    {
+        stats = {};
+        return false;
+    }
+
+    stats.capacity     = state->queueCapacity;
+    stats.size         = state->queueSize;
+    stats.highWater    = state->queueHighWater;
+    stats.overflows    = state->queueOverflows;
+    stats.droppedBytes = state->queueDroppedBytes;
+    stats.blockedNs    = state->queueBlockedNs;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_resetInputQueueStats ( const EasyMidiLibDevice* dev )
+{
+    EasyMidiLibDeviceState* state = EasyMidiLib_getDeviceState(dev);
+
+    state->queueHighWater    = state->queueSize.load();
+    state->queueOverflows    = 0;
+    state->queueDroppedBytes = 0;
+    state->queueBlockedNs    = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_inputQueueReady ( const EasyMidiLibDevice* dev )
+{
+    EasyMidiLibDeviceState* state = dev ? EasyMidiLib_getDeviceState(dev) : 0;
+    if ( !state )
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(state->queueReadyMutex);
+        state->queueReadySignals++;
+    }
+    state->queueReady.notify_all();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+const EasyMidiLibDevice* EasyMidiLibListener::getInDevice ( ) const
+{
+    return inDevice;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLibListener::getInTimestamp ( ) const
+{
+    return inTimestamp;
+}
 
 //--------------------------------------------------------------------------------------------------------------------------
 
@@ -39,11 +757,190 @@ const EasyMidiLibDevice* EasyMidiLib_getOutputDevice ( const char* name )
     return foundDev;
 }
 
+//--------------------------------------------------------------------------------------------------------------------------
+// Worker pool for the Begin open/close requests. Devices with queued requests wait in 'workersReady'; a worker takes one
+// request of a device at a time, so requests for the same device never overlap and keep their order.
+//--------------------------------------------------------------------------------------------------------------------------
+
+static std::mutex                          workersMutex;
+static std::condition_variable             workersCondition;
+static std::vector<std::thread>            workers;
+static std::deque<EasyMidiLibDeviceState*> workersReady;
+static size_t                              workersWanted   = 4;
+static bool                                workersStopping = false;
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void workerFunc ( )
+{
+    std::unique_lock<std::mutex> lock(workersMutex);
+
+    for ( ;; )
+    {
+        workersCondition.wait ( lock, [] { return workersStopping || !workersReady.empty(); } );
+        if ( workersReady.empty() )
+            return;
+
+        EasyMidiLibDeviceState* state = workersReady.front();
+        workersReady.pop_front();
+        std::function<void()> job = std::move(state->jobs.front());
+        state->jobs.pop_front();
+
+        lock.unlock();
+        job();
+        lock.lock();
+
+        if ( state->jobs.empty() )
+            state->jobsScheduled = false;
+        else
+        {
+            workersReady.push_back(state);
+            workersCondition.notify_one();
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void addDeviceJob ( const EasyMidiLibDevice* dev, std::function<void()> job )
+{
+    EasyMidiLibDeviceState* state = EasyMidiLib_getDeviceState(dev);
+
+    std::lock_guard<std::mutex> lock(workersMutex);
+
+    if ( workers.empty() )
+        for ( size_t i=0; i!=workersWanted; i++ )
+        {
+            workers.push_back ( std::thread(workerFunc) );
+            EasyMidiLib_configureThread ( workers.back(), EasyMidiLibThreadRole::Worker );
+        }
+
+    state->jobs.push_back ( std::move(job) );
+    if ( !state->jobsScheduled )
+    {
+        state->jobsScheduled = true;
+        workersReady.push_back(state);
+        workersCondition.notify_one();
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_setWorkerThreads ( size_t count )
+{
+    std::lock_guard<std::mutex> lock(workersMutex);
+    workersWanted = count ? count : 1;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_stopWorkers ( )
+{
+    std::vector<std::thread> stopping;
+    {
+        std::lock_guard<std::mutex> lock(workersMutex);
+        workersStopping = true;
+        stopping.swap(workers);
+    }
+    workersCondition.notify_all();
+
+    // Workers leave once the ready list is empty
+    for ( std::thread& worker : stopping )
+        worker.join();
+
+    std::lock_guard<std::mutex> lock(workersMutex);
+    workersStopping = false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static std::future<bool> beginOpen ( const EasyMidiLibDevice* dev, bool isInput, std::function<void(const EasyMidiLibDevice*,bool,const std::string&)> done, void* userPtrParam, int64_t userIntParam )
+{
+    std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+    std::future<bool>                   future  = promise->get_future();
+
+    addDeviceJob ( dev, [=]
+    {
+        bool        ok    = isInput ? EasyMidiLib_inputOpen  ( dev, userPtrParam, userIntParam )
+                                    : EasyMidiLib_outputOpen ( dev, userPtrParam, userIntParam );
+        std::string error = ok ? "" : EasyMidiLib_getLastError();
+
+        if ( done )
+            done ( dev, ok, error );
+        promise->set_value ( ok );
+    } );
+
+    return future;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static std::future<void> beginClose ( const EasyMidiLibDevice* dev, bool isInput, std::function<void(const EasyMidiLibDevice*)> done )
+{
+    std::shared_ptr<std::promise<void>> promise = std::make_shared<std::promise<void>>();
+    std::future<void>                   future  = promise->get_future();
+
+    addDeviceJob ( dev, [=]
+    {
+        if ( isInput )
+            EasyMidiLib_inputClose ( dev );
+        else
+            EasyMidiLib_outputClose ( dev );
+
+        if ( done )
+            done ( dev );
+        promise->set_value ( );
+    } );
+
+    return future;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+std::future<bool> EasyMidiLib_inputBeginOpen ( const EasyMidiLibDevice* dev, std::function<void(const EasyMidiLibDevice*,bool,const std::string&)> done, void* userPtrParam, int64_t userIntParam )
+{
+    return beginOpen ( dev, true, done, userPtrParam, userIntParam );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+std::future<void> EasyMidiLib_inputBeginClose ( const EasyMidiLibDevice* dev, std::function<void(const EasyMidiLibDevice*)> done )
+{
+    return beginClose ( dev, true, done );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+std::future<bool> EasyMidiLib_outputBeginOpen ( const EasyMidiLibDevice* dev, std::function<void(const EasyMidiLibDevice*,bool,const std::string&)> done, void* userPtrParam, int64_t userIntParam )
+{
+    return beginOpen ( dev, false, done, userPtrParam, userIntParam );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+std::future<void> EasyMidiLib_outputBeginClose ( const EasyMidiLibDevice* dev, std::function<void(const EasyMidiLibDevice*)> done )
+{
+    return beginClose ( dev, false, done );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibListener::ParserState& EasyMidiLibListener::parserState ( )
+{
+    return inDevice ? EasyMidiLib_getDeviceState(inDevice)->parser : m_parser;
+}
+
 //--------------------------------------------------------------------------------------------------------------------------
 
 size_t EasyMidiLibListener::processInData(const uint8_t* data, size_t dataSize)
 {
-    size_t consumed = 0;
+    ParserState& parser           = parserState();
+    size_t       consumed         = 0;
+    uint64_t     mask             = subscriptionMask ( inDevice );
+    uint32_t     types            = (uint32_t)mask;
+    uint16_t     channels         = (uint16_t)(mask>>32);
+    uint64_t     filteredMessages = 0;
+    uint64_t     filteredBytes    = 0;
     
     for (size_t i = 0; i < dataSize; ++i)
     {
@@ -52,15 +949,24 @@ size_t EasyMidiLibListener::processInData(const uint8_t* data, size_t dataSize)
         // Status byte (MSB set)
         if (byte & 0x80)
         {
-            m_status = byte;
-            
-            // System Real-Time messages (single byte)
+            // System Real-Time messages (single byte, they don't interrupt running status)
             if (byte >= 0xF8)
             {
-                systemRealtime(static_cast<EasyMidiLibSysRealtimeMsg>(byte));
                 consumed = i + 1;
+                if ( !(types & EasyMidiLib_subscriptionBit(byte)) )
+                {
+                    filteredMessages++;
+                    filteredBytes++;
+                    continue;
+                }
+
+                uint64_t budgetBegin = EasyMidiLib_budgetBegin();
+                systemRealtime(static_cast<EasyMidiLibSysRealtimeMsg>(byte));
+                EasyMidiLib_budgetEnd ( this, inDevice, "systemRealtime", budgetBegin );
                 continue;
             }
+
+            parser.status = byte;
             
             // System Common messages
             if (byte >= 0xF0)
@@ -76,7 +982,17 @@ size_t EasyMidiLibListener::processInData(const uint8_t* data, size_t dataSize)
                     if (sysexEnd < dataSize && data[sysexEnd] == 0xF7)
                     {
                         // Complete SysEx message
-                        systemExclusive(&data[i], sysexEnd - i + 1);
+                        if ( types & EasyMidiLib_subscriptionBit(byte) )
+                        {
+                            uint64_t budgetBegin = EasyMidiLib_budgetBegin();
+                            systemExclusive(&data[i], sysexEnd - i + 1);
+                            EasyMidiLib_budgetEnd ( this, inDevice, "systemExclusive", budgetBegin );
+                        }
+                        else
+                        {
+                            filteredMessages++;
+                            filteredBytes += sysexEnd-i+1;
+                        }
                         consumed = sysexEnd + 1;
                         i = sysexEnd;
                     }
@@ -88,19 +1004,35 @@ size_t EasyMidiLibListener::processInData(const uint8_t* data, size_t dataSize)
                 }
                 else
                 {
-                    // Other system common messages
-                    systemCommon(static_cast<EasyMidiLibSysCommonMsg>(byte), &data[i + 1], 0);
-                    consumed = i + 1;
+                    // Other system common messages (MTC quarter frame and song select carry one data byte, song
+                    // position two)
+                    size_t bytesNeeded = (byte == 0xF2) ? 2 : (byte == 0xF1 || byte == 0xF3) ? 1 : 0;
+                    if (dataSize - (i + 1) < bytesNeeded)
+                        break;
+
+                    if ( types & EasyMidiLib_subscriptionBit(byte) )
+                    {
+                        uint64_t budgetBegin = EasyMidiLib_budgetBegin();
+                        systemCommon(static_cast<EasyMidiLibSysCommonMsg>(byte), &data[i + 1], bytesNeeded);
+                        EasyMidiLib_budgetEnd ( this, inDevice, "systemCommon", budgetBegin );
+                    }
+                    else
+                    {
+                        filteredMessages++;
+                        filteredBytes += 1+bytesNeeded;
+                    }
+                    consumed = i + 1 + bytesNeeded;
+                    i = consumed - 1;
                 }
                 continue;
             }
         }
         
         // Channel messages - need status + data bytes
-        if (m_status >= 0x80 && m_status <= 0xEF)
+        if (parser.status >= 0x80 && parser.status <= 0xEF)
         {
-            uint8_t msgType = m_status & 0xF0;
-            uint8_t channel = m_status & 0x0F;
+            uint8_t msgType = parser.status & 0xF0;
+            uint8_t channel = parser.status & 0x0F;
             
             // Determine how many data bytes we need
             size_t bytesNeeded = 2; // Most messages need 2 bytes
@@ -120,8 +1052,20 @@ size_t EasyMidiLibListener::processInData(const uint8_t* data, size_t dataSize)
             // Extract data bytes
             uint8_t data1 = data[dataStart];
             uint8_t data2 = (bytesNeeded > 1) ? data[dataStart + 1] : 0;
+
+            // Unsubscribed: consumed without a call
+            if ( !(types & EasyMidiLib_subscriptionBit(parser.status)) || !(channels & (1<<channel)) )
+            {
+                filteredMessages++;
+                filteredBytes += dataStart-i+bytesNeeded;
+                consumed = dataStart + bytesNeeded;
+                i = consumed - 1;
+                continue;
+            }
             
             // Process the message
+            static const char* const handlers[8] = { "noteOff", "noteOn", "polyPressure", "controlChange", "programChange", "channelPressure", "pitchBend", "" };
+            uint64_t budgetBegin = EasyMidiLib_budgetBegin();
             switch (msgType)
             {
                 case 0x80: // Note Off
@@ -140,7 +1084,7 @@ size_t EasyMidiLibListener::processInData(const uint8_t* data, size_t dataSize)
                     break;
                     
                 case 0xB0: // Control Change
-                    controlChange(channel, static_cast<EasyMidiLibCC>(data1), data2);
+                    processControlChange(parser, channel, data1, data2);
                     break;
                     
                 case 0xC0: // Program Change
@@ -158,6 +1102,7 @@ size_t EasyMidiLibListener::processInData(const uint8_t* data, size_t dataSize)
                     }
                     break;
             }
+            EasyMidiLib_budgetEnd ( this, inDevice, msgType==0x90 && data2==0 ? "noteOff" : handlers[(msgType>>4) & 7], budgetBegin );
             
             consumed = dataStart + bytesNeeded;
             i = consumed - 1; // -1 because loop will increment
@@ -168,8 +1113,297 @@ size_t EasyMidiLibListener::processInData(const uint8_t* data, size_t dataSize)
             consumed = i + 1;
         }
     }
+
+    if ( filteredMessages )
+    {
+        m_filteredMessages.fetch_add ( filteredMessages, std::memory_order_relaxed );
+        m_filteredBytes   .fetch_add ( filteredBytes   , std::memory_order_relaxed );
+    }
     
     return consumed;
 }
 
-//--------------------------------------------------------------------------------------------------------------------------
\ No newline at end of file
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibListener::setSubscription ( uint32_t types, uint16_t channels, const EasyMidiLibDevice* dev )
+{
+    uint64_t mask = (uint64_t)channels<<32 | types;
+    if ( !dev )
+    {
+        m_defaultSubscription = mask;
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(m_subscriptionsMutex);
+
+    size_t count = m_subscriptionCount;
+    for ( size_t i=0; i!=count; i++ )
+    {
+        if ( m_subscriptions[i].device.load(std::memory_order_relaxed)==dev )
+        {
+            m_subscriptions[i].mask = mask;
+            return true;
+        }
+    }
+
+    if ( count==MAX_SUBSCRIPTIONS )
+        return false;
+
+    // The mask is in place before the device can be found
+    m_subscriptions[count].mask  .store ( mask, std::memory_order_relaxed );
+    m_subscriptions[count].device.store ( dev , std::memory_order_release );
+    m_subscriptionCount          .store ( count+1, std::memory_order_release );
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLibListener::subscriptionMask ( const EasyMidiLibDevice* dev ) const
+{
+    size_t count = dev ? m_subscriptionCount.load(std::memory_order_acquire) : 0;
+    for ( size_t i=0; i!=count; i++ )
+    {
+        if ( m_subscriptions[i].device.load(std::memory_order_acquire)==dev )
+            return m_subscriptions[i].mask.load(std::memory_order_relaxed);
+    }
+
+    return m_defaultSubscription.load(std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+const uint8_t* EasyMidiLibListener::filterRealtime ( const EasyMidiLibDevice* dev, const uint8_t* data, size_t& dataSize, std::vector<uint8_t>& filtered )
+{
+    uint32_t types = (uint32_t)subscriptionMask(dev);
+    if ( (types & EASYMIDILIB_SUBSCRIBE_REALTIME)==EASYMIDILIB_SUBSCRIBE_REALTIME )
+        return data;
+
+    // Eight bytes at a time: the top bit of a byte survives the shifted ANDs only for 0xF8-0xFF
+    size_t i = 0;
+    for ( ; i+8<=dataSize; i+=8 )
+    {
+        uint64_t w;
+        memcpy ( &w, data+i, 8 );
+        if ( w & w<<1 & w<<2 & w<<3 & w<<4 & 0x8080808080808080ull )
+            break;
+    }
+    while ( i<dataSize && data[i]<0xF8 )
+        i++;
+    if ( i==dataSize )
+        return data;
+
+    filtered.assign ( data, data+i );
+    for ( ; i!=dataSize; i++ )
+    {
+        if ( data[i]<0xF8 || (types & EasyMidiLib_subscriptionBit(data[i])) )
+            filtered.push_back ( data[i] );
+    }
+
+    size_t stripped = dataSize-filtered.size();
+    if ( stripped )
+    {
+        m_filteredMessages.fetch_add ( stripped, std::memory_order_relaxed );
+        m_filteredBytes   .fetch_add ( stripped, std::memory_order_relaxed );
+    }
+
+    dataSize = filtered.size();
+    return filtered.data();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibListener::processControlChange ( ParserState& parser, uint8_t channel, uint8_t controller, uint8_t value )
+{
+    ChannelControllers& c = parser.channels[channel];
+
+    // RPN / NRPN: parameter selection is swallowed, data entry and increment/decrement report the parameter value
+    if ( m_aggregateRpn )
+    {
+        switch ( controller )
+        {
+            case 101: c.paramType = 1; c.paramMsb = value; break;
+            case 100: c.paramType = 1; c.paramLsb = value; break;
+            case 99 : c.paramType = 2; c.paramMsb = value; break;
+            case 98 : c.paramType = 2; c.paramLsb = value; break;
+        }
+
+        if ( controller>=98 && controller<=101 )
+        {
+            // A new parameter starts from zero and is reported on its MSB until it gets an LSB
+            c.dataMsb     = 0;
+            c.dataLsb     = 0;
+            c.dataLsbSeen = false;
+
+            if ( c.paramType==1 && c.paramMsb==127 && c.paramLsb==127 )
+                c.paramType = 0;
+            return;
+        }
+
+        if ( c.paramType!=0 && ( controller==6 || controller==38 || controller==96 || controller==97 ) )
+        {
+            bool emit = true;
+            switch ( controller )
+            {
+                case 6 : // Data entry MSB (resets the LSB)
+                    c.dataMsb = value;
+                    c.dataLsb = 0;
+                    emit      = !c.dataLsbSeen;
+                    break;
+
+                case 38: // Data entry LSB
+                    c.dataLsb     = value;
+                    c.dataLsbSeen = true;
+                    break;
+
+                default: // Data increment / decrement
+                    {
+                        int v = (c.dataMsb<<7) | c.dataLsb;
+                        v = (controller==96) ? std::min(v+1, 16383) : std::max(v-1, 0);
+                        c.dataMsb = (uint8_t)(v >> 7);
+                        c.dataLsb = (uint8_t)(v & 0x7F);
+                    }
+                    break;
+            }
+
+            if ( emit )
+            {
+                uint16_t parameter = (uint16_t)((c.paramMsb<<7) | c.paramLsb);
+                uint16_t data      = (uint16_t)((c.dataMsb <<7) | c.dataLsb );
+                if ( c.paramType==1 )
+                    rpnChange  ( channel, parameter, data );
+                else
+                    nrpnChange ( channel, parameter, data );
+            }
+            return;
+        }
+    }
+
+    // 14 bit controllers: MSB 0-31, LSB 32-63
+    if ( m_aggregateCC14 && controller<64 )
+    {
+        if ( controller<32 )
+        {
+            c.msb[controller] = value;
+            if ( !(c.lsbSeen & (1u<<controller)) )
+                controlChange14 ( channel, controller, (uint16_t)(value<<7) );
+        }
+        else
+        {
+            uint8_t msbController = controller - 32;
+            c.lsbSeen |= 1u<<msbController;
+            controlChange14 ( channel, msbController, (uint16_t)((c.msb[msbController]<<7) | value) );
+        }
+        return;
+    }
+
+    controlChange ( channel, static_cast<EasyMidiLibCC>(controller), value );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibOutputBatch
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibOutputBatch::addMessage ( uint8_t status, uint8_t data1 )
+{
+    // Running status for channel messages
+    if ( status!=m_status || status>=0xF0 )
+    {
+        m_data.push_back(status);
+        m_status = status<0xF0 ? status : 0;
+    }
+    m_data.push_back(data1 & 0x7F);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibOutputBatch::addMessage ( uint8_t status, uint8_t data1, uint8_t data2 )
+{
+    addMessage ( status, data1 );
+    m_data.push_back(data2 & 0x7F);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibOutputBatch::addControlChange ( uint8_t channel, uint8_t controller, uint8_t value )
+{
+    addMessage ( (uint8_t)(0xB0 | (channel&0x0F)), controller, value );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibOutputBatch::addControlChange14 ( uint8_t channel, uint8_t controller, uint16_t value )
+{
+    addControlChange ( channel, controller&0x1F     , (uint8_t)(value>>7) );
+    addControlChange ( channel, (controller&0x1F)+32, (uint8_t)(value   ) );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibOutputBatch::addRpn ( uint8_t channel, uint16_t parameter, uint16_t value, bool sendNull )
+{
+    addControlChange ( channel, 101, (uint8_t)(parameter>>7) );
+    addControlChange ( channel, 100, (uint8_t)(parameter   ) );
+    addControlChange ( channel, 6  , (uint8_t)(value>>7    ) );
+    addControlChange ( channel, 38 , (uint8_t)(value       ) );
+
+    if ( sendNull )
+    {
+        addControlChange ( channel, 101, 127 );
+        addControlChange ( channel, 100, 127 );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibOutputBatch::addNrpn ( uint8_t channel, uint16_t parameter, uint16_t value, bool sendNull )
+{
+    addControlChange ( channel, 99 , (uint8_t)(parameter>>7) );
+    addControlChange ( channel, 98 , (uint8_t)(parameter   ) );
+    addControlChange ( channel, 6  , (uint8_t)(value>>7    ) );
+    addControlChange ( channel, 38 , (uint8_t)(value       ) );
+
+    if ( sendNull )
+    {
+        addControlChange ( channel, 101, 127 );
+        addControlChange ( channel, 100, 127 );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibOutputBatch::send ( const EasyMidiLibDevice* dev )
+{
+    if ( m_data.empty() )
+        return true;
+
+    return EasyMidiLib_outputSend ( dev, m_data.data(), m_data.size() );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_outputSendControlChange14 ( const EasyMidiLibDevice* dev, uint8_t channel, uint8_t controller, uint16_t value )
+{
+    EasyMidiLibOutputBatch batch;
+    batch.addControlChange14 ( channel, controller, value );
+    return batch.send ( dev );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_outputSendRpn ( const EasyMidiLibDevice* dev, uint8_t channel, uint16_t parameter, uint16_t value )
+{
+    EasyMidiLibOutputBatch batch;
+    batch.addRpn ( channel, parameter, value );
+    return batch.send ( dev );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_outputSendNrpn ( const EasyMidiLibDevice* dev, uint8_t channel, uint16_t parameter, uint16_t value )
+{
+    EasyMidiLibOutputBatch batch;
+    batch.addNrpn ( channel, parameter, value );
+    return batch.send ( dev );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
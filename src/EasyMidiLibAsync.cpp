@@ -0,0 +1,223 @@
+// Built as C++20, see LIB_SOURCES_CXX20 in the build scripts
+#include "EasyMidiLibAsync.h"
+#include "EasyMidiLibInternal.h"
+#include <cassert>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+class EasyMidiLibInlineExecutor : public EasyMidiLibExecutor
+{
+    public:
+
+        void execute ( std::coroutine_handle<> handle ) override { handle.resume(); }
+};
+
+EasyMidiLibExecutor* EasyMidiLib_getInlineExecutor ( )
+{
+    static EasyMidiLibInlineExecutor executor;
+    return &executor;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibEventBatch
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibEventBatch& EasyMidiLibEventBatch::operator= ( EasyMidiLibEventBatch&& other ) noexcept
+{
+    if ( this!=&other )
+    {
+        clear();
+        m_events = std::move(other.m_events);
+    }
+    return *this;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibEventBatch::clear ( )
+{
+    for ( const EasyMidiLibEvent& event : m_events )
+        EasyMidiLibPool::release ( event );
+    m_events.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibAsyncInput
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibAsyncInput::EasyMidiLibAsyncInput ( const EasyMidiLibDevice* dev, EasyMidiLibExecutor* executor )
+    : m_dev(dev), m_executor(executor ? executor : EasyMidiLib_getInlineExecutor())
+{
+    EasyMidiLib_addInputTap ( this );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibAsyncInput::~EasyMidiLibAsyncInput ( )
+{
+    EasyMidiLib_removeInputTap ( this );
+
+    // A coroutine still waiting is a precondition violation: resuming it here would let it use the object being
+    // destroyed, so it is left suspended
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        assert ( !m_waiter && "EasyMidiLibAsyncInput destroyed while a coroutine waits on it, close() it first" );
+        m_closed = true;
+        m_waiter = 0;
+    }
+
+    for ( size_t i=m_queueHead; i<m_queue.size(); i++ )
+        EasyMidiLibPool::release ( m_queue[i] );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibAsyncInput::close ( )
+{
+    std::coroutine_handle<> handle;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_closed = true;
+        if ( m_waiter )
+        {
+            handle   = m_waiterHandle;
+            m_waiter = 0;
+        }
+    }
+
+    if ( handle )
+        m_executor->execute ( handle );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibAsyncInput::isClosed ( ) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_closed;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibAsyncInput::take ( EasyMidiLibEventBatch& batch, size_t maxEvents )
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    size_t available = m_queue.size()-m_queueHead;
+    if ( !available )
+        return m_closed;
+
+    size_t count = maxEvents && maxEvents<available ? maxEvents : available;
+    batch.m_events.assign ( m_queue.begin()+m_queueHead, m_queue.begin()+m_queueHead+count );
+
+    m_queueHead += count;
+    if ( m_queueHead==m_queue.size() )
+    {
+        m_queue.clear();
+        m_queueHead = 0;
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibAsyncInput::wait ( NextEvents* awaiter, std::coroutine_handle<> handle )
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // Something may have arrived since await_ready
+    if ( m_closed || m_queueHead!=m_queue.size() )
+        return false;
+
+    m_waiter       = awaiter;
+    m_waiterHandle = handle;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibAsyncInput::inputEvents ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count )
+{
+    if ( dev!=m_dev )
+        return;
+
+    EasyMidiLibPool*        pool = EasyMidiLib_getInputPool ( dev );
+    std::coroutine_handle<> handle;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if ( m_closed )
+            return;
+
+        for ( size_t i=0; i!=count; i++ )
+        {
+            EasyMidiLibEvent event = events[i];
+            if ( event.sysex )
+            {
+                event = pool->retain ( event );
+                if ( !event.sysex )
+                    continue;
+            }
+            m_queue.push_back ( event );
+        }
+
+        // Hand the batch to the waiting coroutine directly
+        if ( m_waiter && m_queueHead!=m_queue.size() )
+        {
+            NextEvents* awaiter = m_waiter;
+            m_waiter = 0;
+            handle   = m_waiterHandle;
+
+            size_t available = m_queue.size()-m_queueHead;
+            size_t taken     = awaiter->m_maxEvents && awaiter->m_maxEvents<available ? awaiter->m_maxEvents : available;
+            awaiter->m_batch.m_events.assign ( m_queue.begin()+m_queueHead, m_queue.begin()+m_queueHead+taken );
+            m_queueHead += taken;
+            if ( m_queueHead==m_queue.size() )
+            {
+                m_queue.clear();
+                m_queueHead = 0;
+            }
+        }
+    }
+
+    // Last use of this object, the resumed coroutine may destroy it. Handed over once the taps have returned, so the
+    // coroutine doesn't run inside the delivery, which removing a tap waits for.
+    if ( handle )
+    {
+        EasyMidiLibExecutor* executor = m_executor;
+        EasyMidiLib_afterInputTaps ( [executor, handle] { executor->execute ( handle ); } );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibOpenAwaitable
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibOpenAwaitable::await_ready ( )
+{
+    // An open device goes through the open too, which fails like EasyMidiLib_inputOpen()
+    m_result = false;
+    return !m_dev;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibOpenAwaitable::await_suspend ( std::coroutine_handle<> handle )
+{
+    EasyMidiLibExecutor* executor = m_executor ? m_executor : EasyMidiLib_getInlineExecutor();
+
+    // The awaitable lives in the suspended coroutine frame until the executor resumes it
+    EasyMidiLib_inputBeginOpen ( m_dev, [this, executor, handle] ( const EasyMidiLibDevice*, bool ok, const std::string& )
+    {
+        m_result = ok;
+        executor->execute ( handle );
+    }, m_userPtrParam, m_userIntParam );
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif
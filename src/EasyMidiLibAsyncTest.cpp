@@ -0,0 +1,260 @@
+// Built as C++20, see TEST_SOURCES_CXX20 in the build scripts. Needs no MIDI hardware: the input comes from a capture
+// file replayed on a stand-in device.
+#include "EasyMidiLibAsync.h"
+#include "EasyMidiLibCapture.h"
+#include <cstdio>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <filesystem>
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static int failures = 0;
+
+#define CHECK(cond) do { if ( !(cond) ) { printf ( "  FAILED line %d: %s\n", __LINE__, #cond ); failures++; } } while ( 0 )
+
+// Fire and forget coroutine
+
+struct Task
+{
+    struct promise_type
+    {
+        Task                get_return_object   ( )          { return {}; }
+        std::suspend_never  initial_suspend     ( ) noexcept { return {}; }
+        std::suspend_never  final_suspend       ( ) noexcept { return {}; }
+        void                return_void         ( )          { }
+        void                unhandled_exception ( )          { std::terminate(); }
+    };
+};
+
+// Keeps the resumptions for later, on the thread calling runAll()
+
+class QueueExecutor : public EasyMidiLibExecutor
+{
+    public:
+
+        void   execute ( std::coroutine_handle<> handle ) override { m_handles.push_back(handle); }
+        size_t size    ( ) const                                    { return m_handles.size(); }
+
+        void runAll ( )
+        {
+            std::vector<std::coroutine_handle<>> handles;
+            handles.swap(m_handles);
+            for ( std::coroutine_handle<> handle : handles )
+                handle.resume();
+        }
+
+    private:
+
+        std::vector<std::coroutine_handle<>> m_handles;
+};
+
+class DummyTap : public EasyMidiLibInputTap
+{
+    public:
+
+        void inputEvents ( const EasyMidiLibDevice*, const EasyMidiLibEvent*, size_t ) override { }
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct Received
+{
+    std::vector<EasyMidiLibEvent>     events;
+    std::vector<std::vector<uint8_t>> sysex;
+    size_t                            batches       = 0;
+    size_t                            largestBatch  = 0;
+    bool                              ended         = false;
+    bool                              tapsFree      = false;   // another thread could remove a tap while resumed
+    bool                              tapsChecked   = false;
+};
+
+static Task readAll ( EasyMidiLibAsyncInput& input, Received& received, size_t maxEvents, bool checkTaps )
+{
+    for ( ;; )
+    {
+        EasyMidiLibEventBatch batch = co_await input.nextEvents ( maxEvents );
+        if ( batch.empty() )
+            break;
+
+        received.batches++;
+        received.largestBatch = std::max ( received.largestBatch, batch.size() );
+        for ( const EasyMidiLibEvent& event : batch )
+        {
+            received.events.push_back ( event );
+            received.sysex .push_back ( event.sysex ? std::vector<uint8_t>(event.sysex, event.sysex+event.size) : std::vector<uint8_t>() );
+        }
+
+        if ( checkTaps && !received.tapsChecked )
+        {
+            // The coroutine runs on the replay thread; removing a tap from another thread waits for its delivery
+            static DummyTap               tap;
+            std::shared_ptr<std::atomic<bool>> done = std::make_shared<std::atomic<bool>>(false);
+            std::thread ( [done] { EasyMidiLib_addInputTap(&tap); EasyMidiLib_removeInputTap(&tap); *done = true; } ).detach();
+
+            for ( int i=0; i!=1000 && !*done; i++ )
+                std::this_thread::sleep_for ( std::chrono::milliseconds(1) );
+
+            received.tapsChecked = true;
+            received.tapsFree    = *done;
+        }
+    }
+
+    received.ended = true;
+}
+
+static Task openNull ( bool& result, bool& done )
+{
+    result = co_await EasyMidiLib_inputOpenAsync ( 0 );
+    done   = true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Notes with running status friendly patterns and a SysEx every 10 events, one capture record per event
+
+static std::vector<EasyMidiLibEvent> makeEvents ( const EasyMidiLibDevice* dev, std::vector<std::vector<uint8_t>>& sysex, size_t count )
+{
+    std::vector<EasyMidiLibEvent> events;
+    sysex.resize ( count );
+
+    for ( size_t i=0; i!=count; i++ )
+    {
+        EasyMidiLibEvent event = {};
+        event.timestamp = 1000000+i*1000;
+        event.device    = dev;
+
+        if ( i%10==9 )
+        {
+            sysex[i] = { 0xF0, 0x7D, (uint8_t)(i & 0x7F), 0x01, 0x02, 0x03, 0xF7 };
+            event.sysex = sysex[i].data();
+            event.size  = (uint32_t)sysex[i].size();
+        }
+        else
+        {
+            event.size   = 3;
+            event.msg[0] = (uint8_t)(0x90 | (i%3));
+            event.msg[1] = (uint8_t)(i & 0x7F);
+            event.msg[2] = 100;
+        }
+        events.push_back ( event );
+    }
+
+    return events;
+}
+
+static bool sameEvents ( const Received& received, const std::vector<EasyMidiLibEvent>& events )
+{
+    if ( received.events.size()!=events.size() )
+        return false;
+
+    for ( size_t i=0; i!=events.size(); i++ )
+    {
+        const EasyMidiLibEvent& a = received.events[i];
+        const EasyMidiLibEvent& b = events[i];
+        if ( a.size!=b.size || (b.sysex ? received.sysex[i]!=std::vector<uint8_t>(b.sysex, b.sysex+b.size) : memcmp(a.msg, b.msg, b.size)!=0) )
+            return false;
+    }
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+int main ( )
+{
+    EasyMidiLibDevice captured = {};
+    captured.isInput = true;
+    captured.name    = "Async test";
+    captured.id      = "async:0";
+
+    std::vector<std::vector<uint8_t>> sysex;
+    std::vector<EasyMidiLibEvent>     events = makeEvents ( &captured, sysex, 1000 );
+    std::string                       path   = (std::filesystem::temp_directory_path()/"EasyMidiLibAsyncTest.emlcap").string();
+
+    EasyMidiLibCaptureFile   file;
+    EasyMidiLibCaptureReplay replay;
+    if ( !EasyMidiLib_captureWrite(path.c_str(), events.data(), events.size()) || !file.open(path.c_str()) || !replay.load(&file) )
+    {
+        printf ( "Can't prepare the capture %s\n", path.c_str() );
+        return 1;
+    }
+    const EasyMidiLibDevice* dev = replay.getDevice ( 0 );
+
+    printf ( "inline executor: every event in order, resumed outside the tap delivery\n" );
+    {
+        EasyMidiLibAsyncInput input ( dev );
+        Received              received;
+        readAll ( input, received, 0, true );
+        replay.run ( 0, EasyMidiLibCaptureReplayMode::AsFastAsPossible );
+
+        CHECK ( sameEvents(received, events) );
+        CHECK ( received.tapsChecked && received.tapsFree );
+        CHECK ( !received.ended );
+        input.close();
+        CHECK ( received.ended );
+    }
+
+    printf ( "batch size limit\n" );
+    {
+        EasyMidiLibAsyncInput input ( dev );
+        Received              received;
+        readAll ( input, received, 3, false );
+        replay.run ( 0, EasyMidiLibCaptureReplayMode::AsFastAsPossible );
+
+        CHECK ( sameEvents(received, events) );
+        CHECK ( received.largestBatch<=3 );
+        input.close();
+    }
+
+    printf ( "caller executor: resumed only when the executor runs it\n" );
+    {
+        QueueExecutor         executor;
+        EasyMidiLibAsyncInput input ( dev, &executor );
+        Received              received;
+        readAll ( input, received, 0, false );
+        replay.run ( 0, EasyMidiLibCaptureReplayMode::AsFastAsPossible );
+
+        CHECK ( received.events.empty() );
+        CHECK ( executor.size()==1 );
+
+        // The first resumption gets the first record, the rest is queued for the next await
+        while ( executor.size() )
+            executor.runAll();
+        CHECK ( sameEvents(received, events) );
+
+        input.close();
+        executor.runAll();
+        CHECK ( received.ended );
+    }
+
+    printf ( "closing before destroying the input resumes its waiter\n" );
+    {
+        EasyMidiLibAsyncInput* input = new EasyMidiLibAsyncInput ( dev );
+        Received               received;
+        readAll ( *input, received, 0, false );
+        CHECK ( !received.ended );
+        input->close();
+        CHECK ( received.ended );
+        delete input;
+    }
+
+    printf ( "open of no device completes without suspending\n" );
+    {
+        bool result = true, done = false;
+        openNull ( result, done );
+        CHECK ( done && !result );
+    }
+
+    replay.unload();
+    file.close();
+    std::filesystem::remove ( path );
+
+    printf ( failures ? "%d check(s) FAILED\n" : "All checks passed\n", failures );
+    return failures ? 1 : 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
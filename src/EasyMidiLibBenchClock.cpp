@@ -0,0 +1,144 @@
+#include "EasyMidiLibClock.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cmath>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Clock follower benchmark: feeds a synthetic 24 ppqn clock with timestamp jitter and reports how far the estimated
+// tempo and beat position are from the true ones once the loop has settled, next to the tempo a naive estimator (last
+// tick interval) would report. The loop is given 10/bandwidth seconds to lock, a case needs twice that to be measured.
+//
+//     EasyMidiLibBenchClock [simulated seconds per case, default 120] [bandwidths Hz, default 0.25 0.5 1]
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct Jitter
+{
+    const char* name;
+    double      sigmaNs;   // gaussian jitter of each timestamp
+    double      frameNs;   // timestamps quantized to this frame (USB), 0 for none
+};
+
+struct Result
+{
+    double tempoRms;
+    double tempoMax;
+    double positionRmsMs;
+    double positionMaxMs;
+    double naiveTempoRms;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static double settleSeconds ( double bandwidth )
+{
+    return std::max ( 10.0/bandwidth, 2.0 );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static Result run ( double bpm, const Jitter& jitter, double bandwidth, double seconds )
+{
+    EasyMidiLibClockFollower follower ( bandwidth );
+    std::mt19937_64          random   ( 1234 );
+    std::normal_distribution<double> noise ( 0.0, 1.0 );
+
+    double   tickNs   = 60e9/(bpm*24.0);
+    double   beatNs   = tickNs*24.0;
+    uint64_t start    = 1000000000;
+    uint64_t ticks    = (uint64_t)(seconds*1e9/tickNs);
+    uint64_t settle   = (uint64_t)(settleSeconds(bandwidth)*1e9/tickNs);   // ignored while the loop locks
+    uint64_t last     = 0;
+    double   sumTempo = 0, maxTempo = 0, sumPos = 0, maxPos = 0, sumNaive = 0;
+    uint64_t samples  = 0;
+
+    follower.process ( EasyMidiLibSysRealtimeMsg::Start, start );
+
+    for ( uint64_t i=0; i!=ticks; i++ )
+    {
+        double exact = start + i*tickNs;
+        double t     = exact + noise(random)*jitter.sigmaNs;
+        if ( jitter.frameNs>0 )
+            t = std::ceil(t/jitter.frameNs)*jitter.frameNs;
+
+        uint64_t timestamp = std::max<uint64_t> ( (uint64_t)t, last+1 );
+        follower.process ( EasyMidiLibSysRealtimeMsg::TimingClock, timestamp );
+
+        if ( i>=settle )
+        {
+            // Halfway to the next tick the position is interpolated, the worst case for the reader
+            double now       = exact + tickNs*0.5;
+            double tempoErr  = follower.getTempo()-bpm;
+            double posErrMs  = (follower.getBeatPosition((uint64_t)now) - (now-start)/beatNs)*beatNs*1e-6;
+            double naive     = 60e9/((double)(timestamp-last)*24.0)-bpm;
+
+            sumTempo += tempoErr*tempoErr;
+            sumPos   += posErrMs*posErrMs;
+            sumNaive += naive*naive;
+            maxTempo  = std::max(maxTempo, std::fabs(tempoErr));
+            maxPos    = std::max(maxPos  , std::fabs(posErrMs));
+            samples++;
+        }
+        last = timestamp;
+    }
+
+    Result r = {};
+    if ( samples )
+    {
+        r.tempoRms      = std::sqrt(sumTempo/samples);
+        r.tempoMax      = maxTempo;
+        r.positionRmsMs = std::sqrt(sumPos/samples);
+        r.positionMaxMs = maxPos;
+        r.naiveTempoRms = std::sqrt(sumNaive/samples);
+    }
+    return r;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+int main ( int argc, char* argv[] )
+{
+    double              seconds = argc>1 ? atof(argv[1]) : 120.0;
+    std::vector<double> bandwidths;
+
+    // Wider bandwidths follow tempo changes faster but pass more jitter, past 2 Hz worse than the naive estimator
+    for ( int i=2; i<argc; i++ )
+        bandwidths.push_back ( atof(argv[i]) );
+    if ( bandwidths.empty() )
+        bandwidths = { 0.25, 0.5, 1.0 };
+
+    static const Jitter jitters[] =
+    {
+        { "none"      , 0      , 0       },
+        { "gauss 0.25", 250000 , 0       },
+        { "gauss 1ms" , 1000000, 0       },
+        { "gauss 2ms" , 2000000, 0       },
+        { "usb 1ms"   , 0      , 1000000 },
+    };
+    static const double tempos[] = { 60.0, 120.0, 174.0 };
+
+    printf ( "Clock follower estimation error, %.0f s simulated per case (position error at mid tick)\n\n", seconds );
+    printf ( "  bpm  jitter      bw Hz | tempo rms  tempo max | pos rms ms  pos max ms | naive tempo rms\n" );
+
+    for ( double bpm : tempos )
+        for ( const Jitter& jitter : jitters )
+            for ( double bandwidth : bandwidths )
+            {
+                if ( bandwidth<=0 || seconds<settleSeconds(bandwidth)*2 )
+                {
+                    printf ( "%5.0f  %-10s  %5.2f | run too short, needs %.0f s for this bandwidth\n", bpm, jitter.name, bandwidth,
+                             bandwidth>0 ? settleSeconds(bandwidth)*2 : 0.0 );
+                    continue;
+                }
+
+                Result r = run ( bpm, jitter, bandwidth, seconds );
+                printf ( "%5.0f  %-10s  %5.2f | %9.4f  %9.4f | %10.4f  %10.4f | %9.4f\n",
+                         bpm, jitter.name, bandwidth, r.tempoRms, r.tempoMax, r.positionRmsMs, r.positionMaxMs, r.naiveTempoRms );
+            }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,144 @@
+#include "EasyMidiLibEventIndex.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Event index benchmark: builds the index over a synthetic recording (16 channels, mostly notes and controllers, with a
+// rare channel, rare high notes and rare system messages) and runs a set of queries through it and through a linear
+// scan of every event with the same filter, checking both find the same events. Each query keeps its best of 3 runs.
+//
+//     EasyMidiLibBenchIndex [events in millions, default 100]
+//--------------------------------------------------------------------------------------------------------------------------
+
+static std::vector<EasyMidiLibEvent> generate ( size_t count, const EasyMidiLibDevice* devices )
+{
+    std::vector<EasyMidiLibEvent> events ( count );
+    std::mt19937_64               random ( 42 );
+    uint64_t                      timestamp = 1000000000;
+
+    for ( size_t i=0; i!=count; i++ )
+    {
+        EasyMidiLibEvent& event = events[i];
+        uint64_t          r     = random();
+
+        timestamp      += r%2000000;   // 1 ms apart on average
+        event           = {};
+        event.timestamp = timestamp;
+        event.device    = &devices[(r>>21)%8==0 ? 1 : 0];
+        event.size      = 3;
+
+        uint64_t kind = (r>>24)%1000000;
+        if ( kind<10 )
+        {
+            event.msg[0] = 0xF8;   // system, rare
+            event.size   = 1;
+            continue;
+        }
+
+        uint8_t channel = kind<20 ? 15 : (uint8_t)((r>>44)%15);   // channel 15 is rare
+        uint8_t note    = kind<30 ? (uint8_t)(120+(r>>50)%8) : (uint8_t)(24+(r>>50)%80);
+        switch ( (r>>56)%10 )
+        {
+            case 0: case 1: case 2: case 3: event.msg[0] = (uint8_t)(0x90|channel); event.msg[1] = note; event.msg[2] = 100; break;
+            case 4: case 5: case 6:         event.msg[0] = (uint8_t)(0x80|channel); event.msg[1] = note; event.msg[2] = 0;   break;
+            case 7: case 8:                 event.msg[0] = (uint8_t)(0xB0|channel); event.msg[1] = 1;    event.msg[2] = (uint8_t)(r & 0x7F); break;
+            default:                        event.msg[0] = (uint8_t)(0xE0|channel); event.msg[1] = 0;    event.msg[2] = (uint8_t)(r & 0x7F); break;
+        }
+    }
+
+    return events;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static double bestMs ( uint64_t& begin, double best )
+{
+    double ms = (EasyMidiLib_getTimestamp()-begin)/1e6;
+    return std::min ( ms, best );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+int main ( int argc, char* argv[] )
+{
+    double            millions = argc>1 ? atof(argv[1]) : 100.0;
+    size_t            count    = (size_t)(millions*1e6);
+    EasyMidiLibDevice devices[2] = {};
+
+    printf ( "Generating %zu events (%.1f GB)\n", count, count*sizeof(EasyMidiLibEvent)/1e9 );
+    std::vector<EasyMidiLibEvent> events = generate ( count, devices );
+    if ( events.empty() )
+        return 1;
+
+    uint64_t first = events.front().timestamp;
+    uint64_t span  = events.back().timestamp-first;
+
+    EasyMidiLibEventIndex index;
+    uint64_t              begin = EasyMidiLib_getTimestamp();
+    index.build ( events.data(), events.size() );
+    printf ( "Index built in %.1f ms, %zu blocks\n\n", (EasyMidiLib_getTimestamp()-begin)/1e6, index.getBlockCount() );
+
+    struct Case
+    {
+        const char*           name;
+        EasyMidiLibEventQuery query;
+    };
+    std::vector<Case> cases ( 7 );
+
+    cases[0].name         = "1 s window, all";
+    cases[0].query.from   = first+span/2;
+    cases[0].query.to     = cases[0].query.from+1000000000;
+    cases[1].name         = "10% window, ch 0 notes";
+    cases[1].query.from   = first+span/3;
+    cases[1].query.to     = cases[1].query.from+span/10;
+    cases[1].query.channels = 0x0001;
+    cases[1].query.types  = EASYMIDILIB_EVENT_NOTES;
+    cases[2].name         = "rare channel 15";
+    cases[2].query.channels = 0x8000;
+    cases[3].name         = "rare notes 120-127";
+    cases[3].query.types  = EASYMIDILIB_EVENT_NOTES;
+    cases[3].query.noteMin = 120;
+    cases[4].name         = "system messages";
+    cases[4].query.types  = EASYMIDILIB_EVENT_SYSTEM;
+    cases[5].name         = "second device, ch 3 CC";
+    cases[5].query.device = &devices[1];
+    cases[5].query.channels = 0x0008;
+    cases[5].query.types  = EasyMidiLib_eventTypeBit(EasyMidiLibMsg::ControlChange);
+    cases[6].name         = "everything, ch 0-14";
+    cases[6].query.channels = 0x7FFF;
+
+    printf ( "query                    |   matches  | index ms  | linear ms | speedup\n" );
+
+    std::vector<EasyMidiLibEventSpan> spans;
+    for ( const Case& c : cases )
+    {
+        double indexMs  = 1e30;
+        double linearMs = 1e30;
+        size_t indexed  = 0;
+        size_t scanned  = 0;
+
+        for ( int run=0; run!=3; run++ )
+        {
+            spans.clear();
+            begin   = EasyMidiLib_getTimestamp();
+            indexed = index.query ( c.query, spans );
+            indexMs = bestMs ( begin, indexMs );
+
+            scanned = 0;
+            begin   = EasyMidiLib_getTimestamp();
+            for ( const EasyMidiLibEvent& event : events )
+                scanned += index.matches(c.query, event) ? 1 : 0;
+            linearMs = bestMs ( begin, linearMs );
+        }
+
+        printf ( "%-24s | %10zu | %9.3f | %9.1f | %7.1fx%s\n", c.name, indexed, indexMs, linearMs, linearMs/std::max(indexMs, 1e-6),
+                 indexed==scanned ? "" : "  MISMATCH" );
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,183 @@
+#include "EasyMidiLib.h"
+#include "EasyMidiLibCapture.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <filesystem>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Input timing jitter under load: replays a capture with one message per period in real time through the Thread dispatch
+// mode while other threads keep every core busy and thrash the cache, and reports how far each deviceInData call is from
+// its ideal time (the replay thread has the Timing role, the dispatcher the Dispatch role). The same run is made with
+// the default scheduling and then with SCHED_FIFO for both roles and EasyMidiLib_lockMemory; the real-time case needs
+// CAP_SYS_NICE or an rtprio limit ('ulimit -r'), otherwise it reports why and runs with the default scheduling.
+//
+//     EasyMidiLibBenchJitter [seconds per case, default 10] [load threads, default one per core] [priority, default 80]
+//                            [period us, default 1000]
+//--------------------------------------------------------------------------------------------------------------------------
+
+class ArrivalListener : public EasyMidiLibListener
+{
+    public:
+
+        ArrivalListener ( size_t count ) : EasyMidiLibListener(false), m_arrivals(count) { }
+
+        size_t deviceInData ( const EasyMidiLibDevice* d, const uint8_t* data, size_t dataSize ) override
+        {
+            size_t index = m_count.load(std::memory_order_relaxed);
+            if ( index<m_arrivals.size() )
+            {
+                m_arrivals[index] = EasyMidiLib_getTimestamp();
+                m_count.store ( index+1, std::memory_order_release );
+            }
+            return dataSize;
+        }
+
+        size_t          count   ( ) const           { return m_count.load(std::memory_order_acquire); }
+        uint64_t        arrival ( size_t i ) const  { return m_arrivals[i]; }
+
+    private:
+
+        std::vector<uint64_t> m_arrivals;
+        std::atomic<size_t>   m_count {0};
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Arithmetic plus a walk over a buffer larger than the caches
+
+static void loadThread ( std::atomic<bool>& running )
+{
+    std::vector<uint8_t> buffer ( 16*1024*1024 );
+    uint64_t             x = 88172645463325252ull;
+
+    while ( running.load(std::memory_order_relaxed) )
+    {
+        for ( size_t i=0; i<buffer.size(); i+=64 )
+        {
+            x ^= x<<13; x ^= x>>7; x ^= x<<17;
+            buffer[i] += (uint8_t)x;
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void runCase ( const char* name, EasyMidiLibCaptureReplay& replay, size_t count, uint64_t periodNs, size_t loadThreads )
+{
+    ArrivalListener          listener ( count );
+    std::atomic<bool>        running  {true};
+    std::vector<std::thread> load;
+
+    for ( size_t i=0; i!=loadThreads; i++ )
+        load.emplace_back ( loadThread, std::ref(running) );
+
+    replay.resetJitterStats();
+    replay.run ( &listener, EasyMidiLibCaptureReplayMode::RealTime );
+
+    // The dispatcher may still be behind
+    for ( int i=0; i!=1000 && listener.count()<count; i++ )
+        std::this_thread::sleep_for ( std::chrono::milliseconds(1) );
+
+    running = false;
+    for ( std::thread& t : load )
+        t.join();
+
+    // Offset of each call from its ideal time, relative to the earliest one
+    size_t               received = listener.count();
+    std::vector<int64_t> offsets  ( received );
+    for ( size_t i=0; i!=received; i++ )
+        offsets[i] = (int64_t)(listener.arrival(i)-listener.arrival(0)) - (int64_t)(i*periodNs);
+
+    if ( offsets.empty() )
+    {
+        printf ( "%-9s | no data received\n", name );
+        return;
+    }
+
+    int64_t base = *std::min_element ( offsets.begin(), offsets.end() );
+    for ( int64_t& offset : offsets )
+        offset -= base;
+    std::sort ( offsets.begin(), offsets.end() );
+
+    auto percentileUs = [&] ( double p ) { return offsets[std::min(offsets.size()-1, (size_t)(p*offsets.size()))]/1000.0; };
+
+    EasyMidiLibClockJitterStats replayJitter = replay.getJitterStats();
+    printf ( "%-9s | %8.1f %8.1f %8.1f %9.1f | %8.1f %9.1f | %zu/%zu\n", name, percentileUs(0.5), percentileUs(0.99),
+             percentileUs(0.999), offsets.back()/1000.0, replayJitter.meanLate/1000.0, replayJitter.maxLate/1000.0, received, count );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+int main ( int argc, char* argv[] )
+{
+    double   seconds     = argc>1 ? atof(argv[1]) : 10.0;
+    size_t   loadThreads = argc>2 ? (size_t)atoi(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+    int      priority    = argc>3 ? atoi(argv[3]) : 80;
+    uint64_t periodNs    = (argc>4 ? (uint64_t)atoi(argv[4]) : 1000)*1000;
+    size_t   count       = (size_t)(seconds*1e9/periodNs);
+
+    // One note per period on a stand-in device
+    EasyMidiLibDevice captured = {};
+    captured.isInput = true;
+    captured.name    = "Jitter bench";
+    captured.id      = "jitter:0";
+
+    std::vector<EasyMidiLibEvent> events ( count );
+    for ( size_t i=0; i!=count; i++ )
+    {
+        EasyMidiLibEvent& event = events[i];
+        event           = {};
+        event.timestamp = 1000000000+i*periodNs;
+        event.device    = &captured;
+        event.size      = 3;
+        event.msg[0]    = 0x90;
+        event.msg[1]    = (uint8_t)(i & 0x7F);
+        event.msg[2]    = 100;
+    }
+
+    std::string              path = (std::filesystem::temp_directory_path()/"EasyMidiLibBenchJitter.emlcap").string();
+    EasyMidiLibCaptureFile   file;
+    EasyMidiLibCaptureReplay replay;
+    if ( !EasyMidiLib_captureWrite(path.c_str(), events.data(), events.size()) || !file.open(path.c_str()) || !replay.load(&file) )
+    {
+        printf ( "Can't prepare the capture %s\n", path.c_str() );
+        return 1;
+    }
+
+    printf ( "Input jitter, %zu messages every %.0f us, %zu load threads, Thread dispatch mode\n\n", count, periodNs/1000.0, loadThreads );
+    printf ( "          | deviceInData lateness us            | replay late us     |\n" );
+    printf ( "case      |      p50      p99    p99.9       max |     mean       max | received\n" );
+
+    EasyMidiLib_setDispatchMode ( EasyMidiLibDispatchMode::Thread );
+    runCase ( "default", replay, count, periodNs, loadThreads );
+
+    // The dispatcher starts again with the new settings
+    EasyMidiLib_done();
+
+    EasyMidiLibThreadConfig config;
+    config.policy   = EasyMidiLibSchedPolicy::Fifo;
+    config.priority = priority;
+    EasyMidiLib_setThreadConfig ( EasyMidiLibThreadRole::Timing  , config );
+    EasyMidiLib_setThreadConfig ( EasyMidiLibThreadRole::Dispatch, config );
+    EasyMidiLib_lockMemory();
+
+    runCase ( "realtime", replay, count, periodNs, loadThreads );
+
+    if ( *EasyMidiLib_getRealtimeError() )
+        printf ( "\nNot every real-time setting applied, the realtime case ran without them: %s\n", EasyMidiLib_getRealtimeError() );
+
+    EasyMidiLib_done();
+    replay.unload();
+    file.close();
+    std::filesystem::remove ( path );
+    return 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,133 @@
+#include "EasyMidiLib.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <future>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Port bring-up benchmark: opens and closes every MIDI port found, one after the other with EasyMidiLib_inputOpen /
+// outputOpen, then all at once with the Begin variants on the worker pool, and reports the time of each. Needs ports:
+// on Linux 'modprobe snd-virmidi midi_devs=8' gives virtual ones (more cards with index=...).
+//
+//     EasyMidiLibBenchOpen [rounds, default 5] [worker threads, default 4]
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct Timing
+{
+    double open ;
+    double close;
+};
+
+static double elapsedMs ( uint64_t begin )
+{
+    return (EasyMidiLib_getTimestamp()-begin)/1e6;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static Timing serial ( const std::vector<const EasyMidiLibDevice*>& devices, size_t& failed )
+{
+    Timing   timing;
+    uint64_t begin = EasyMidiLib_getTimestamp();
+
+    for ( const EasyMidiLibDevice* dev : devices )
+    {
+        bool ok = dev->isInput ? EasyMidiLib_inputOpen(dev) : EasyMidiLib_outputOpen(dev);
+        failed += ok ? 0 : 1;
+    }
+    timing.open = elapsedMs ( begin );
+
+    begin = EasyMidiLib_getTimestamp();
+    for ( const EasyMidiLibDevice* dev : devices )
+    {
+        if ( dev->isInput )
+            EasyMidiLib_inputClose ( dev );
+        else
+            EasyMidiLib_outputClose ( dev );
+    }
+    timing.close = elapsedMs ( begin );
+
+    return timing;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static Timing parallel ( const std::vector<const EasyMidiLibDevice*>& devices, size_t& failed )
+{
+    Timing                         timing;
+    std::vector<std::future<bool>> opens;
+    std::vector<std::future<void>> closes;
+    uint64_t                       begin = EasyMidiLib_getTimestamp();
+
+    for ( const EasyMidiLibDevice* dev : devices )
+        opens.push_back ( dev->isInput ? EasyMidiLib_inputBeginOpen(dev) : EasyMidiLib_outputBeginOpen(dev) );
+    for ( std::future<bool>& open : opens )
+        failed += open.get() ? 0 : 1;
+    timing.open = elapsedMs ( begin );
+
+    begin = EasyMidiLib_getTimestamp();
+    for ( const EasyMidiLibDevice* dev : devices )
+        closes.push_back ( dev->isInput ? EasyMidiLib_inputBeginClose(dev) : EasyMidiLib_outputBeginClose(dev) );
+    for ( std::future<void>& close : closes )
+        close.get();
+    timing.close = elapsedMs ( begin );
+
+    return timing;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+int main ( int argc, char* argv[] )
+{
+    int    rounds  = argc>1 ? atoi(argv[1]) : 5;
+    size_t workers = argc>2 ? (size_t)atoi(argv[2]) : 4;
+
+    EasyMidiLib_setWorkerThreads ( workers );
+    if ( !EasyMidiLib_init() )
+    {
+        printf ( "EasyMidiLib_init failed: %s\n", EasyMidiLib_getLastError() );
+        return 1;
+    }
+
+    std::vector<const EasyMidiLibDevice*> devices;
+    for ( size_t i=0; i!=EasyMidiLib_getInputDevicesNum(); i++ )
+        devices.push_back ( EasyMidiLib_getInputDevice(i) );
+    for ( size_t i=0; i!=EasyMidiLib_getOutputDevicesNum(); i++ )
+        devices.push_back ( EasyMidiLib_getOutputDevice(i) );
+
+    if ( devices.empty() )
+    {
+        printf ( "No MIDI ports found\n" );
+        EasyMidiLib_done();
+        return 0;
+    }
+
+    printf ( "Bring-up of %zu ports (%zu inputs, %zu outputs), %d rounds, %zu worker threads\n\n", devices.size(),
+             EasyMidiLib_getInputDevicesNum(), EasyMidiLib_getOutputDevicesNum(), rounds, workers );
+    printf ( "round | serial open ms  close ms | pool open ms  close ms | failed\n" );
+
+    Timing serialSum   = {};
+    Timing parallelSum = {};
+    for ( int round=0; round<rounds; round++ )
+    {
+        size_t failed = 0;
+        Timing s      = serial   ( devices, failed );
+        Timing p      = parallel ( devices, failed );
+
+        printf ( "%5d | %14.2f  %8.2f | %12.2f  %8.2f | %zu\n", round, s.open, s.close, p.open, p.close, failed );
+        serialSum  .open  += s.open;
+        serialSum  .close += s.close;
+        parallelSum.open  += p.open;
+        parallelSum.close += p.close;
+    }
+
+    if ( rounds>0 )
+        printf ( "\nmean  | %14.2f  %8.2f | %12.2f  %8.2f | speedup open %.2fx close %.2fx\n",
+                 serialSum.open/rounds, serialSum.close/rounds, parallelSum.open/rounds, parallelSum.close/rounds,
+                 parallelSum.open>0 ? serialSum.open/parallelSum.open : 0.0, parallelSum.close>0 ? serialSum.close/parallelSum.close : 0.0 );
+
+    EasyMidiLib_done();
+    return 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,114 @@
+#include "EasyMidiLib.h"
+#include "EasyMidiLibInternal.h"
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Subscription benchmark: feeds a clock heavy stream (timing clock bytes interleaved with notes and controllers, in
+// 32 byte reads like the ALSA input thread gets) through the library input processing to a listener subscribed to
+// everything and to one ignoring the timing clock, whose bytes are then stripped before the queue and the parser.
+// Reports MB/s, the listener calls per second and the share of the stream that reaches the listener.
+//
+//     EasyMidiLibBenchRealtime [MB per case, default 64]
+//--------------------------------------------------------------------------------------------------------------------------
+
+class CountingListener : public EasyMidiLibListener
+{
+    public:
+
+        CountingListener ( ) : EasyMidiLibListener(false) { }
+
+        void noteOn         ( uint8_t, EasyMidiLibNote, uint8_t ) override  { m_calls++; }
+        void noteOff        ( uint8_t, EasyMidiLibNote, uint8_t ) override  { m_calls++; }
+        void controlChange  ( uint8_t, EasyMidiLibCC, uint8_t ) override    { m_calls++; }
+        void systemRealtime ( EasyMidiLibSysRealtimeMsg ) override          { m_calls++; }
+
+        uint64_t m_calls = 0;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// 'clockShare' of the messages are timing clocks, the rest note and controller messages
+
+static std::vector<uint8_t> generate ( size_t size, double clockShare )
+{
+    std::vector<uint8_t> stream;
+    std::mt19937         random ( 3 );
+    std::uniform_real_distribution<double> uniform ( 0.0, 1.0 );
+
+    stream.reserve ( size+3 );
+    while ( stream.size()<size )
+    {
+        if ( uniform(random)<clockShare )
+        {
+            stream.push_back ( 0xF8 );
+            continue;
+        }
+
+        uint32_t r = random();
+        stream.push_back ( r%4 ? 0x90 : 0xB0 );
+        stream.push_back ( (uint8_t)((r>>8) & 0x7F) );
+        stream.push_back ( (uint8_t)((r>>16) & 0x7F) );
+    }
+
+    return stream;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void runCase ( const char* name, const std::vector<uint8_t>& stream, double clockShare, bool ignoreClock )
+{
+    EasyMidiLibDevice      dev   = {};
+    EasyMidiLibDeviceState state;
+    dev.isInput       = true;
+    dev.name          = "Realtime bench";
+    dev.id            = "realtime:0";
+    dev.internalState = &state;
+
+    CountingListener listener;
+    if ( ignoreClock )
+        listener.setSubscription ( EASYMIDILIB_SUBSCRIBE_ALL & ~EasyMidiLib_subscriptionBit(0xF8), 0xFFFF );
+
+    const size_t chunk    = 32;
+    double       best     = 1e30;
+    uint64_t     calls    = 0;
+    uint64_t     filtered = 0;
+    for ( int run=0; run!=3; run++ )
+    {
+        uint64_t filteredBefore = listener.getFilteredBytes();
+        uint64_t begin          = EasyMidiLib_getTimestamp();
+        listener.m_calls        = 0;
+        for ( size_t pos=0; pos<stream.size(); pos+=chunk )
+            EasyMidiLib_processInData ( &listener, &dev, stream.data()+pos, std::min(chunk, stream.size()-pos), begin );
+        best     = std::min ( best, (EasyMidiLib_getTimestamp()-begin)/1e9 );
+        calls    = listener.m_calls;
+        filtered = listener.getFilteredBytes()-filteredBefore;
+    }
+
+    printf ( "%3.0f%% clocks %-16s | %8.1f | %10.1f | %13.1f%%\n", clockShare*100, name, stream.size()/best/1e6, calls/best/1e6,
+             100.0-100.0*filtered/stream.size() );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+int main ( int argc, char* argv[] )
+{
+    size_t size = (size_t)((argc>1 ? atof(argv[1]) : 64.0)*1e6);
+
+    printf ( "Clock heavy input, %.0f MB per case in 32 byte reads, best of 3 runs\n\n", size/1e6 );
+    printf ( "messages    listener         |   MB/s   | Mcalls/s   | bytes to listener\n" );
+
+    for ( double clockShare : { 0.5, 0.9, 0.99 } )
+    {
+        std::vector<uint8_t> stream = generate ( size, clockShare );
+        runCase ( "subscribed", stream, clockShare, false );
+        runCase ( "clock ignored", stream, clockShare, true );
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
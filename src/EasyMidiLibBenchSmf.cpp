@@ -0,0 +1,271 @@
+#include "EasyMidiLibSmf.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <string>
+#include <random>
+#include <algorithm>
+#include <filesystem>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Standard MIDI File reader throughput: opens every file of a corpus (open() validates each track and builds the tempo
+// map), then walks it with the merged iterator and track by track, and reports MB/s and events/s for each. Files and
+// directories (searched recursively for .mid, .midi, .smf and .kar) given as arguments are read through the memory
+// mapping, the best of the rounds is kept so the page cache is warm. Without arguments a synthetic corpus of format 1
+// files (notes with running status, controllers, pitch bends, SysEx and tempo changes) is generated in memory.
+//
+//     EasyMidiLibBenchSmf [-r rounds, default 5] [files or directories...]
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct Phase
+{
+    double   seconds = 1e30;   // best round
+    uint64_t events  = 0;
+};
+
+struct SmfSource
+{
+    std::string          path;   // read from disk when set
+    std::vector<uint8_t> data;   // generated otherwise
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void putVarLen ( std::vector<uint8_t>& out, uint32_t value )
+{
+    uint8_t bytes[5];
+    int     count = 0;
+    do
+    {
+        bytes[count++] = value & 0x7F;
+        value >>= 7;
+    }
+    while ( value );
+
+    while ( count-- )
+        out.push_back ( (uint8_t)(bytes[count] | (count ? 0x80 : 0)) );
+}
+
+static void putBigEndian ( std::vector<uint8_t>& out, uint32_t value, int bytes )
+{
+    while ( bytes-- )
+        out.push_back ( (uint8_t)(value >> (bytes*8)) );
+}
+
+static void endChunk ( std::vector<uint8_t>& out, size_t lengthAt )
+{
+    uint32_t length = (uint32_t)(out.size()-lengthAt-4);
+    for ( int i=0; i!=4; i++ )
+        out[lengthAt+i] = (uint8_t)(length >> ((3-i)*8));
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Format 1: a tempo track and 'tracks' channel tracks of about 'eventsPerTrack' events each
+
+static std::vector<uint8_t> generateFile ( uint32_t seed, int tracks, int eventsPerTrack )
+{
+    std::mt19937         random ( seed );
+    std::vector<uint8_t> out;
+
+    out.insert ( out.end(), { 'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1 } );
+    putBigEndian ( out, (uint32_t)tracks+1, 2 );
+    putBigEndian ( out, 480, 2 );
+
+    // Tempo track: a change every 4 beats
+    out.insert ( out.end(), { 'M', 'T', 'r', 'k', 0, 0, 0, 0 } );
+    size_t lengthAt = out.size()-4;
+    for ( int i=0; i!=eventsPerTrack/16; i++ )
+    {
+        uint32_t microsPerBeat = 400000+random()%300000;
+        putVarLen ( out, i ? 1920 : 0 );
+        out.insert ( out.end(), { 0xFF, 0x51, 0x03 } );
+        putBigEndian ( out, microsPerBeat, 3 );
+    }
+    out.insert ( out.end(), { 0x00, 0xFF, 0x2F, 0x00 } );
+    endChunk ( out, lengthAt );
+
+    for ( int track=0; track!=tracks; track++ )
+    {
+        out.insert ( out.end(), { 'M', 'T', 'r', 'k', 0, 0, 0, 0 } );
+        lengthAt = out.size()-4;
+
+        uint8_t channel = (uint8_t)(track & 0x0F);
+        uint8_t running = 0;
+        for ( int i=0; i<eventsPerTrack; )
+        {
+            uint32_t kind = random()%100;
+            putVarLen ( out, random()%(kind<50 ? 60 : 480) );
+
+            if ( kind<2 )
+            {
+                // SysEx, ends running status
+                out.insert ( out.end(), { 0xF0, 0x08, 0x7D, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0xF7 } );
+                running = 0;
+                i++;
+                continue;
+            }
+
+            uint8_t status = kind<80 ? (uint8_t)(0x90|channel) : kind<92 ? (uint8_t)(0xB0|channel) : (uint8_t)(0xE0|channel);
+            if ( status!=running )
+                out.push_back ( running = status );
+            out.push_back ( (uint8_t)(random() & 0x7F) );
+            out.push_back ( (uint8_t)(status<0xA0 ? random()%2*100 : random() & 0x7F) );   // note on, velocity 0 as note off
+            i++;
+        }
+        out.insert ( out.end(), { 0x00, 0xFF, 0x2F, 0x00 } );
+        endChunk ( out, lengthAt );
+    }
+
+    return out;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static bool isSmfPath ( const std::filesystem::path& path )
+{
+    std::string extension = path.extension().string();
+    std::transform ( extension.begin(), extension.end(), extension.begin(), [] ( char c ) { return (char)tolower(c); } );
+    return extension==".mid" || extension==".midi" || extension==".smf" || extension==".kar";
+}
+
+static bool openSource ( EasyMidiLibSmfFile& file, const SmfSource& source )
+{
+    return source.path.empty() ? file.openMemory(source.data.data(), source.data.size()) : file.open(source.path.c_str());
+}
+
+static double seconds ( uint64_t begin )
+{
+    return (EasyMidiLib_getTimestamp()-begin)/1e9;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+int main ( int argc, char* argv[] )
+{
+    int                    rounds  = 5;
+    std::vector<SmfSource> sources;
+
+    for ( int i=1; i<argc; i++ )
+    {
+        if ( !strcmp(argv[i], "-r") && i+1<argc )
+        {
+            rounds = std::max ( 1, atoi(argv[++i]) );
+            continue;
+        }
+
+        std::error_code error;
+        if ( std::filesystem::is_directory(argv[i], error) )
+        {
+            for ( const auto& entry : std::filesystem::recursive_directory_iterator(argv[i], error) )
+                if ( entry.is_regular_file() && isSmfPath(entry.path()) )
+                    sources.push_back ( { entry.path().string(), {} } );
+        }
+        else
+            sources.push_back ( { argv[i], {} } );
+    }
+
+    bool synthetic = sources.empty();
+    if ( synthetic )
+        for ( uint32_t i=0; i!=20; i++ )
+            sources.push_back ( { "", generateFile(i+1, 16, 20000) } );
+
+    // Size, events and the files that don't open (left out of the timings)
+    uint64_t               bytes  = 0;
+    uint64_t               events = 0;
+    std::vector<SmfSource> valid;
+    for ( SmfSource& source : sources )
+    {
+        EasyMidiLibSmfFile file;
+        if ( !openSource(file, source) )
+        {
+            printf ( "Skipped %s: %s\n", source.path.c_str(), file.getLastError() );
+            continue;
+        }
+
+        EasyMidiLibSmfIterator it = file.events();
+        EasyMidiLibSmfEvent    event;
+        while ( it.next(event) )
+            events++;
+
+        bytes += source.path.empty() ? source.data.size() : std::filesystem::file_size(source.path);
+        valid.push_back ( std::move(source) );
+    }
+
+    if ( valid.empty() )
+    {
+        printf ( "No Standard MIDI File to read\n" );
+        return 1;
+    }
+
+    Phase    open, merged, tracks;
+    uint64_t checksum = 0;   // keeps the loops from being optimized out
+    for ( int round=0; round!=rounds; round++ )
+    {
+        uint64_t begin = EasyMidiLib_getTimestamp();
+        for ( const SmfSource& source : valid )
+        {
+            EasyMidiLibSmfFile file;
+            openSource ( file, source );
+            checksum += file.getLengthTicks();
+        }
+        open.seconds = std::min ( open.seconds, seconds(begin) );
+
+        std::vector<EasyMidiLibSmfFile> files ( valid.size() );
+        for ( size_t i=0; i!=valid.size(); i++ )
+            openSource ( files[i], valid[i] );
+
+        uint64_t count = 0;
+        begin = EasyMidiLib_getTimestamp();
+        for ( const EasyMidiLibSmfFile& file : files )
+        {
+            EasyMidiLibSmfIterator it = file.events();
+            EasyMidiLibSmfEvent    event;
+            while ( it.next(event) )
+            {
+                checksum += event.tick+event.status;
+                count++;
+            }
+        }
+        merged.seconds = std::min ( merged.seconds, seconds(begin) );
+        merged.events  = count;
+
+        count = 0;
+        begin = EasyMidiLib_getTimestamp();
+        for ( const EasyMidiLibSmfFile& file : files )
+        {
+            for ( size_t t=0; t!=file.getTrackCount(); t++ )
+            {
+                EasyMidiLibSmfTrackIterator it = file.track ( t );
+                EasyMidiLibSmfEvent         event;
+                while ( it.next(event) )
+                {
+                    checksum += event.tick+event.status;
+                    count++;
+                }
+            }
+        }
+        tracks.seconds = std::min ( tracks.seconds, seconds(begin) );
+        tracks.events  = count;
+    }
+    open.events = events;
+
+    printf ( "%s corpus: %zu files, %.1f MB, %llu events, best of %d rounds\n\n", synthetic ? "Synthetic" : "File", valid.size(),
+             bytes/1e6, (unsigned long long)events, rounds );
+    printf ( "phase                 |    ms     |    MB/s   | Mevents/s\n" );
+
+    const struct { const char* name; const Phase& phase; } phases[] =
+    {
+        { "open + validate"     , open   },
+        { "merged iteration"    , merged },
+        { "per track iteration" , tracks },
+    };
+    for ( const auto& p : phases )
+        printf ( "%-21s | %9.2f | %9.1f | %9.2f\n", p.name, p.phase.seconds*1e3, bytes/1e6/p.phase.seconds, p.phase.events/1e6/p.phase.seconds );
+
+    printf ( "\n(checksum %llx)\n", (unsigned long long)checksum );
+    return 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,228 @@
+#include "EasyMidiLibUmp.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <random>
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// UMP translation throughput: EasyMidiLib_eventsToUmp and EasyMidiLibUmpDecoder over batches of events the size the
+// input path hands them over (64) and large ones (4096), for a note only stream and a mixed one (controllers, pitch
+// bends, pressure, program changes, system and SysEx messages), next to two references:
+//
+//   - per event: the same translation calling EasyMidiLib_umpScaleUp for every value and growing the output one word at
+//     a time, what the tables and the presized output avoid
+//   - vector bound: a branch free loop over note on events only, written to let the compiler vectorize it, roughly what
+//     a SIMD path could reach on the easiest stream; eventsToUmp has to handle every message kind and running SysEx, so
+//     it can't be faster, the ratio shows how much an explicit SIMD path could still gain
+//
+//     EasyMidiLibBenchUmp [events in millions, default 20]
+//--------------------------------------------------------------------------------------------------------------------------
+
+static std::vector<EasyMidiLibEvent> generate ( size_t count, bool mixed, std::vector<uint8_t>& sysex )
+{
+    std::vector<EasyMidiLibEvent> events ( count );
+    std::mt19937_64               random ( 7 );
+
+    sysex = { 0xF0, 0x7E, 0x7F, 0x06, 0x02, 0x41, 0x10, 0x42, 0x12, 0x40, 0x00, 0x7F, 0x00, 0x41, 0xF7 };
+
+    for ( size_t i=0; i!=count; i++ )
+    {
+        EasyMidiLibEvent& event = events[i];
+        uint64_t          r     = random();
+
+        event           = {};
+        event.timestamp = i*1000;
+        event.size      = 3;
+
+        uint8_t channel = (uint8_t)(r & 0x0F);
+        uint8_t kind    = mixed ? (uint8_t)((r>>8)%100) : (uint8_t)((r>>8)%2*50);
+        uint8_t d1      = (uint8_t)((r>>16) & 0x7F);
+        uint8_t d2      = (uint8_t)((r>>24) & 0x7F);
+
+        if ( kind<50 )      { event.msg[0] = 0x90|channel; event.msg[1] = d1; event.msg[2] = d2|1; }
+        else if ( kind<65 ) { event.msg[0] = 0x80|channel; event.msg[1] = d1; event.msg[2] = d2;   }
+        else if ( kind<80 ) { event.msg[0] = 0xB0|channel; event.msg[1] = d1; event.msg[2] = d2;   }
+        else if ( kind<90 ) { event.msg[0] = 0xE0|channel; event.msg[1] = d1; event.msg[2] = d2;   }
+        else if ( kind<94 ) { event.msg[0] = 0xD0|channel; event.msg[1] = d1; event.size   = 2;    }
+        else if ( kind<96 ) { event.msg[0] = 0xC0|channel; event.msg[1] = d1; event.size   = 2;    }
+        else if ( kind<99 ) { event.msg[0] = 0xF8;                            event.size   = 1;    }
+        else
+        {
+            event.sysex = sysex.data();
+            event.size  = (uint32_t)sysex.size();
+        }
+    }
+
+    return events;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// The translation as a straightforward implementation would write it
+
+static void perEventToUmp ( const EasyMidiLibEvent* events, size_t count, EasyMidiLibUmpProtocol protocol, std::vector<uint32_t>& words )
+{
+    for ( size_t i=0; i!=count; i++ )
+    {
+        const EasyMidiLibEvent& event  = events[i];
+        const uint8_t*          data   = event.data();
+        uint8_t                 status = data[0];
+
+        if ( status==0xF0 )
+        {
+            size_t size = event.size-2;
+            for ( size_t pos=0; pos==0 || pos<size; pos+=6 )
+            {
+                size_t  chunk = std::min<size_t> ( 6, size-pos );
+                uint8_t b[6]  = {};
+                memcpy ( b, data+1+pos, chunk );
+                uint32_t form = size<=6 ? 0 : pos==0 ? 1 : pos+6>=size ? 3 : 2;
+                words.push_back ( 0x30000000 | form<<20 | (uint32_t)chunk<<16 | b[0]<<8 | b[1] );
+                words.push_back ( (uint32_t)b[2]<<24 | b[3]<<16 | b[4]<<8 | b[5] );
+            }
+            continue;
+        }
+
+        uint32_t d1 = event.size>1 ? data[1] : 0;
+        uint32_t d2 = event.size>2 ? data[2] : 0;
+        if ( status>=0xF0 || protocol==EasyMidiLibUmpProtocol::Midi1 )
+        {
+            words.push_back ( (status>=0xF0 ? 0x10000000 : 0x20000000) | (uint32_t)status<<16 | d1<<8 | d2 );
+            continue;
+        }
+
+        uint32_t word1 = 0;
+        switch ( status & 0xF0 )
+        {
+            case 0x80: case 0x90: word1 = EasyMidiLib_umpScaleUp(d2, 7, 16)<<16;         break;
+            case 0xA0: case 0xB0: word1 = EasyMidiLib_umpScaleUp(d2, 7, 32);             break;
+            case 0xC0:            word1 = d1<<24; d1 = 0;                                 break;
+            case 0xD0:            word1 = EasyMidiLib_umpScaleUp(d1, 7, 32); d1 = 0;     break;
+            case 0xE0:            word1 = EasyMidiLib_umpScaleUp(d1 | d2<<7, 14, 32); d1 = 0; break;
+        }
+        words.push_back ( 0x40000000 | (uint32_t)status<<16 | d1<<8 );
+        words.push_back ( word1 );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Note on events only, MIDI 2.0 protocol, no branch: the shape an explicit SIMD path would have
+
+static uint16_t velocityTable[128];
+
+static void vectorBoundToUmp ( const EasyMidiLibEvent* events, size_t count, uint32_t* words )
+{
+    for ( size_t i=0; i!=count; i++ )
+    {
+        uint32_t m        = (uint32_t)events[i].msg[0] | (uint32_t)events[i].msg[1]<<8 | (uint32_t)events[i].msg[2]<<16;
+        words[i*2]        = 0x40000000 | (m & 0xFF)<<16 | (m & 0x7F00);
+        words[i*2+1]      = (uint32_t)velocityTable[(m>>16) & 0x7F]<<16;
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct Result
+{
+    double   mEventsPerSecond;
+    uint64_t words;
+};
+
+template <class Translate>
+static Result measure ( const std::vector<EasyMidiLibEvent>& events, size_t batch, Translate translate )
+{
+    std::vector<uint32_t> words;
+    uint64_t              total = 0;
+    double                best  = 1e30;
+
+    for ( int run=0; run!=3; run++ )
+    {
+        total = 0;
+        uint64_t begin = EasyMidiLib_getTimestamp();
+        for ( size_t i=0; i<events.size(); i+=batch )
+        {
+            words.clear();
+            translate ( events.data()+i, std::min(batch, events.size()-i), words );
+            total += words.size();
+        }
+        best = std::min ( best, (EasyMidiLib_getTimestamp()-begin)/1e9 );
+    }
+
+    return { events.size()/best/1e6, total };
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+int main ( int argc, char* argv[] )
+{
+    double millions = argc>1 ? atof(argv[1]) : 20.0;
+    size_t count    = (size_t)(millions*1e6);
+
+    for ( uint32_t i=0; i!=128; i++ )
+        velocityTable[i] = (uint16_t)EasyMidiLib_umpScaleUp ( i, 7, 16 );
+
+    std::vector<uint8_t>          sysex;
+    std::vector<EasyMidiLibEvent> notes = generate ( count, false, sysex );
+    std::vector<EasyMidiLibEvent> mixed = generate ( count, true , sysex );
+
+    printf ( "UMP translation, %zu events per stream, best of 3 runs, Mevents/s\n\n", count );
+    printf ( "stream  batch  protocol | eventsToUmp | per event | vector bound | decode\n" );
+
+    for ( const std::vector<EasyMidiLibEvent>* stream : { &notes, &mixed } )
+    {
+        for ( size_t batch : { (size_t)64, (size_t)4096 } )
+        {
+            for ( EasyMidiLibUmpProtocol protocol : { EasyMidiLibUmpProtocol::Midi1, EasyMidiLibUmpProtocol::Midi2 } )
+            {
+                Result library = measure ( *stream, batch, [protocol] ( const EasyMidiLibEvent* e, size_t n, std::vector<uint32_t>& w )
+                                           { EasyMidiLib_eventsToUmp ( e, n, protocol, w ); } );
+                Result simple  = measure ( *stream, batch, [protocol] ( const EasyMidiLibEvent* e, size_t n, std::vector<uint32_t>& w )
+                                           { perEventToUmp ( e, n, protocol, w ); } );
+
+                // Only meaningful on the note stream with the MIDI 2.0 protocol
+                bool   bounded = stream==&notes && protocol==EasyMidiLibUmpProtocol::Midi2;
+                Result bound   = {};
+                if ( bounded )
+                {
+                    // Note offs of the note stream count as note ons here, same work
+                    bound = measure ( *stream, batch, [] ( const EasyMidiLibEvent* e, size_t n, std::vector<uint32_t>& w )
+                                      { w.resize ( n*2 ); vectorBoundToUmp ( e, n, w.data() ); } );
+                }
+
+                // Decoding the library output back, in the same batches
+                std::vector<uint32_t> words;
+                EasyMidiLib_eventsToUmp ( stream->data(), stream->size(), protocol, words );
+
+                EasyMidiLibUmpDecoder         decoder;
+                std::vector<EasyMidiLibEvent> decoded;
+                double                        best = 1e30;
+                for ( int run=0; run!=3; run++ )
+                {
+                    uint64_t begin = EasyMidiLib_getTimestamp();
+                    for ( size_t pos=0; pos<words.size(); )
+                    {
+                        decoded.clear();
+                        pos += decoder.decode ( words.data()+pos, std::min(batch*2, words.size()-pos), 0, 0, decoded );
+                    }
+                    best = std::min ( best, (EasyMidiLib_getTimestamp()-begin)/1e9 );
+                }
+
+                char boundText[32] = "           -";
+                if ( bounded )
+                    snprintf ( boundText, sizeof(boundText), "%7.1f %3.0f%%", bound.mEventsPerSecond, 100.0*library.mEventsPerSecond/bound.mEventsPerSecond );
+
+                printf ( "%-6s  %5zu  %-8s | %11.1f | %9.1f | %s | %6.1f%s\n", stream==&notes ? "notes" : "mixed", batch,
+                         protocol==EasyMidiLibUmpProtocol::Midi1 ? "MIDI 1.0" : "MIDI 2.0", library.mEventsPerSecond,
+                         simple.mEventsPerSecond, boundText, stream->size()/best/1e6, library.words==simple.words ? "" : "  (word count differs)" );
+            }
+        }
+    }
+
+    printf ( "\nvector bound %%: eventsToUmp throughput relative to the branch free note on loop\n" );
+    return 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,187 @@
+#include "EasyMidiLibBroadcast.h"
+#include "EasyMidiLibEventRing.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <chrono>
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibBroadcastRing::EasyMidiLibBroadcastRing ( size_t events, size_t sysexBytes )
+    : m_slotCount(EasyMidiLib_ringCapacity(events, 64)), m_wordCount(EasyMidiLib_ringCapacity(sysexBytes/8, 64))
+{
+    m_slots.reset ( new Slot[m_slotCount] );
+    m_words.reset ( new std::atomic<uint64_t>[m_wordCount] );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibBroadcastRing::~EasyMidiLibBroadcastRing ( )
+{
+    stop();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibBroadcastRing::start ( const EasyMidiLibDevice* dev )
+{
+    if ( m_started )
+        return;
+
+    m_device  = dev;
+    m_started = true;
+    EasyMidiLib_addInputTap ( this );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibBroadcastRing::stop ( )
+{
+    if ( !m_started )
+        return;
+
+    EasyMidiLib_removeInputTap ( this );
+    m_started = false;
+    wake();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibBroadcastRing::inputEvents ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count )
+{
+    if ( !m_device || dev==m_device )
+        publish ( events, count );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibBroadcastRing::publish ( const EasyMidiLibEvent* events, size_t count )
+{
+    EasyMidiLibEventRing<Slot> ring     = { m_slots.get(), m_words.get(), m_slotCount, m_wordCount, &m_claimed, &m_sysexClaimed };
+    uint64_t                   sequence = m_published.load(std::memory_order_relaxed);
+
+    for ( size_t i=0; i!=count; i++ )
+    {
+        const EasyMidiLibEvent& event = events[i];
+
+        if ( ring.write(sequence, m_sysexHead, event, [&] ( Slot& slot ) { slot.device.store ( event.device, std::memory_order_relaxed ); }) )
+            sequence++;
+        else
+            m_dropped.fetch_add ( 1, std::memory_order_relaxed );
+    }
+
+    // The whole batch becomes visible at once; blocked readers are woken only when there are some
+    m_published.store ( sequence, std::memory_order_seq_cst );
+    if ( m_waiters.load(std::memory_order_seq_cst) )
+    {
+        std::lock_guard<std::mutex> lock(m_waitMutex);
+        m_waitCondition.notify_all();
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibBroadcastRing::wake ( )
+{
+    std::lock_guard<std::mutex> lock(m_waitMutex);
+    m_wakeups++;
+    m_waitCondition.notify_all();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibBroadcastReader
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibBroadcastReader::EasyMidiLibBroadcastReader ( EasyMidiLibBroadcastRing& ring, EasyMidiLibWaitStrategy wait, size_t batchSize )
+    : m_ring(ring), m_wait(wait), m_batchSize(std::max<size_t>(batchSize, 1)), m_cursor(ring.m_published)
+{
+    m_positions.resize ( m_batchSize );
+    m_offsets  .resize ( m_batchSize );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibBroadcastReader::wait ( uint64_t timeoutNs )
+{
+    if ( !timeoutNs )
+        return false;
+
+    uint64_t deadline = EasyMidiLib_getTimestamp()+timeoutNs;
+    uint64_t wakeups  = m_ring.m_wakeups;
+
+    if ( m_wait==EasyMidiLibWaitStrategy::Block )
+    {
+        std::unique_lock<std::mutex> lock(m_ring.m_waitMutex);
+        m_ring.m_waiters.fetch_add ( 1, std::memory_order_seq_cst );
+
+        while ( m_ring.m_published.load(std::memory_order_seq_cst)==m_cursor && m_ring.m_wakeups==wakeups )
+        {
+            uint64_t now = EasyMidiLib_getTimestamp();
+            if ( now>=deadline )
+                break;
+            m_ring.m_waitCondition.wait_for ( lock, std::chrono::nanoseconds(deadline-now) );
+        }
+
+        m_ring.m_waiters.fetch_sub ( 1, std::memory_order_relaxed );
+        return m_ring.m_published.load(std::memory_order_acquire)!=m_cursor;
+    }
+
+    while ( m_ring.m_published.load(std::memory_order_acquire)==m_cursor )
+    {
+        if ( m_ring.m_wakeups!=wakeups || EasyMidiLib_getTimestamp()>=deadline )
+            return false;
+
+        if ( m_wait==EasyMidiLibWaitStrategy::Yield )
+            std::this_thread::yield();
+        else if ( m_wait==EasyMidiLibWaitStrategy::Sleep )
+            std::this_thread::sleep_for ( std::chrono::nanoseconds(m_sleepNs) );
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+size_t EasyMidiLibBroadcastReader::read ( EasyMidiLibBroadcastBatch& batch, uint64_t timeoutNs )
+{
+    batch.events.clear();
+    batch.data  .clear();
+    batch.first = m_cursor;
+    batch.lost  = 0;
+
+    uint64_t published = m_ring.m_published.load(std::memory_order_acquire);
+    if ( published==m_cursor )
+    {
+        if ( !wait(timeoutNs) )
+            return 0;
+        published = m_ring.m_published.load(std::memory_order_acquire);
+    }
+
+    // A batch overwritten entirely while it was copied is retried further on
+    size_t count = 0;
+    while ( !count && published!=m_cursor )
+    {
+        count     = copy ( batch, published );
+        published = m_ring.m_published.load(std::memory_order_acquire);
+    }
+
+    m_lost += batch.lost;
+    return count;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+size_t EasyMidiLibBroadcastReader::copy ( EasyMidiLibBroadcastBatch& batch, uint64_t published )
+{
+    typedef EasyMidiLibBroadcastRing::Slot                                Slot;
+    typedef EasyMidiLibEventRing<const Slot, const std::atomic<uint64_t>> Ring;
+
+    const EasyMidiLibBroadcastRing& owner = m_ring;
+    Ring                            ring  = { owner.m_slots.get(), owner.m_words.get(), owner.m_slotCount, owner.m_wordCount,
+                                              &owner.m_claimed, &owner.m_sysexClaimed };
+
+    return ring.copy ( m_cursor, published, m_batchSize, batch, m_positions, m_offsets,
+                       [] ( const Slot& slot ) { return slot.device.load(std::memory_order_relaxed); } );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
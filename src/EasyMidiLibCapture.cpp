@@ -0,0 +1,958 @@
+#include "EasyMidiLibCapture.h"
+#include "EasyMidiLibInternal.h"
+#include <cstring>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static const uint8_t  MAGIC[8]       = { 'E','M','L','C','A','P','1',0 };
+static const uint32_t VERSION        = 1;
+static const size_t   HEADER_SIZE    = 32;
+static const size_t   INDEX_SIZE     = 17;
+static const size_t   MIN_SEGMENT    = 65536;      // also the Windows mapping granularity
+static const uint8_t  RECORD_PADDING = 0x00;
+static const uint8_t  RECORD_DEVICE  = 0x01;
+static const uint8_t  RECORD_DATA    = 0x02;
+static const uint8_t  RECORD_INDEX   = 0x03;
+static const size_t   MAX_STRING     = 255;        // device name and id
+static const size_t   MAX_DATA_EXTRA = 21;         // data record bytes besides the MIDI bytes
+
+static uint64_t readLE ( const uint8_t* p, size_t bytes )
+{
+    uint64_t value = 0;
+    for ( size_t i=bytes; i!=0; i-- )
+        value = value<<8 | p[i-1];
+    return value;
+}
+
+static uint8_t* writeLE ( uint8_t* p, uint64_t value, size_t bytes )
+{
+    for ( size_t i=0; i!=bytes; i++, value>>=8 )
+        *p++ = (uint8_t)value;
+    return p;
+}
+
+static uint8_t* writeVarInt ( uint8_t* p, uint64_t value )
+{
+    for ( ; value>=0x80; value>>=7 )
+        *p++ = (uint8_t)(value | 0x80);
+    *p++ = (uint8_t)value;
+    return p;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Record encoding (the caller makes room)
+//--------------------------------------------------------------------------------------------------------------------------
+
+static size_t segmentSizeFor ( size_t requested )
+{
+    return std::max ( (requested+MIN_SEGMENT-1)/MIN_SEGMENT*MIN_SEGMENT, MIN_SEGMENT );
+}
+
+static uint8_t* writeHeader ( uint8_t* p, size_t segmentSize, uint64_t startTime )
+{
+    memcpy ( p, MAGIC, sizeof(MAGIC) );
+    writeLE ( p+8 , VERSION    , 4 );
+    writeLE ( p+12, segmentSize, 4 );
+    writeLE ( p+16, startTime  , 8 );
+    memset  ( p+24, 0, 8 );
+    return p+HEADER_SIZE;
+}
+
+static uint8_t* writeIndex ( uint8_t* p, uint64_t timestamp, uint64_t records )
+{
+    *p++ = RECORD_INDEX;
+    p = writeLE ( p, timestamp, 8 );
+    return writeLE ( p, records, 8 );
+}
+
+static size_t deviceRecordSize ( const EasyMidiLibDevice* dev )
+{
+    return 1+10+1+2+std::min(dev->name.size(), MAX_STRING)+2+std::min(dev->id.size(), MAX_STRING);
+}
+
+static uint8_t* writeDevice ( uint8_t* p, uint64_t number, const EasyMidiLibDevice* dev )
+{
+    size_t nameSize = std::min ( dev->name.size(), MAX_STRING );
+    size_t idSize   = std::min ( dev->id  .size(), MAX_STRING );
+
+    *p++ = RECORD_DEVICE;
+    p = writeVarInt ( p, number );
+    *p++ = dev->isInput ? 1 : 0;
+    p = writeVarInt ( p, nameSize );
+    memcpy ( p, dev->name.data(), nameSize );
+    p = writeVarInt ( p+nameSize, idSize );
+    memcpy ( p, dev->id.data(), idSize );
+    return p+idSize;
+}
+
+static uint8_t* writeData ( uint8_t* p, uint64_t number, int64_t delta, const uint8_t* data, size_t size )
+{
+    *p++ = RECORD_DATA;
+    p = writeVarInt ( p, number );
+    p = writeVarInt ( p, ((uint64_t)delta<<1) ^ (uint64_t)(delta>>63) );
+    p = writeVarInt ( p, size );
+    memcpy ( p, data, size );
+    return p+size;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Capture writer
+//--------------------------------------------------------------------------------------------------------------------------
+
+#if EASYMIDILIB_CAPTURE
+
+static const size_t   RING_SEGMENTS  = 4;          // mapped ahead of the current one
+
+std::atomic<bool> EasyMidiLib_captureEnabled {false};
+
+struct CaptureSegment
+{
+    uint8_t* data;
+    size_t   index;
+};
+
+static std::mutex                            captureMutex;       // guards everything below
+static std::condition_variable               captureCondition;
+static bool                                  captureOpen      = false;
+static bool                                  captureRunning   = false;
+static std::thread                           captureThread;
+static size_t                                captureSize      = 0;  // segment size
+static CaptureSegment                        captureCurrent   = {};
+static size_t                                capturePos       = 0;
+static std::deque<CaptureSegment>            captureReady;
+static std::vector<CaptureSegment>           captureRetired;
+static size_t                                captureMapped    = 0;  // segments mapped so far
+static uint64_t                              captureLast      = 0;  // timestamp of the last record
+static uint64_t                              captureRecords   = 0;
+static std::vector<const EasyMidiLibDevice*> captureDevices;        // by device number
+static std::atomic<uint64_t>                 captureDropped   {0};
+
+#if defined(_WIN32)
+static HANDLE                                captureFile      = INVALID_HANDLE_VALUE;
+#else
+static int                                   captureFile      = -1;
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Grows the file to hold segment 'index' and maps it (zero filled, which reads as padding)
+
+static bool mapSegment ( size_t index, CaptureSegment& segment )
+{
+    uint64_t offset = (uint64_t)index*captureSize;
+    uint64_t end    = offset+captureSize;
+    void*    view   = 0;
+
+#if defined(_WIN32)
+    HANDLE mapping = CreateFileMappingA ( captureFile, 0, PAGE_READWRITE, (DWORD)(end>>32), (DWORD)end, 0 );
+    if ( !mapping )
+        return false;
+
+    // The view keeps the mapping alive
+    view = MapViewOfFile ( mapping, FILE_MAP_WRITE, (DWORD)(offset>>32), (DWORD)offset, captureSize );
+    CloseHandle ( mapping );
+    if ( !view )
+        return false;
+#else
+    if ( ftruncate(captureFile, (off_t)end)!=0 )
+        return false;
+
+    view = mmap ( 0, captureSize, PROT_READ|PROT_WRITE, MAP_SHARED, captureFile, (off_t)offset );
+    if ( view==MAP_FAILED )
+        return false;
+#endif
+
+    segment.data  = (uint8_t*)view;
+    segment.index = index;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void unmapSegment ( const CaptureSegment& segment )
+{
+#if defined(_WIN32)
+    UnmapViewOfFile ( segment.data );
+#else
+    munmap ( segment.data, captureSize );
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void captureThreadFunc ( )
+{
+    std::unique_lock<std::mutex> lock(captureMutex);
+
+    while ( captureRunning )
+    {
+        std::vector<CaptureSegment> retired;
+        retired.swap ( captureRetired );
+        size_t missing = RING_SEGMENTS-captureReady.size();
+        size_t next    = captureMapped;
+
+        // Map and unmap without holding up the input path
+        lock.unlock();
+
+        for ( const CaptureSegment& segment : retired )
+            unmapSegment ( segment );
+
+        std::vector<CaptureSegment> mapped;
+        for ( size_t i=0; i!=missing; i++ )
+        {
+            CaptureSegment segment;
+            if ( !mapSegment(next+i, segment) )
+                break;
+            mapped.push_back ( segment );
+        }
+
+        lock.lock();
+
+        captureMapped += mapped.size();
+        captureReady.insert ( captureReady.end(), mapped.begin(), mapped.end() );
+
+        if ( captureRunning && captureRetired.empty() )
+            captureCondition.wait_for ( lock, std::chrono::milliseconds(10) );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void beginSegment ( )
+{
+    uint8_t* p = writeIndex ( captureCurrent.data+capturePos, captureLast, captureRecords );
+    capturePos = p-captureCurrent.data;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Makes room for 'size' bytes, moving to the next mapped segment if needed (the rest of the current one stays padding)
+
+static bool reserve ( size_t size )
+{
+    if ( capturePos+size<=captureSize )
+        return true;
+
+    if ( captureReady.empty() )
+        return false;
+
+    captureRetired.push_back ( captureCurrent );
+    captureCurrent = captureReady.front();
+    captureReady.pop_front();
+    capturePos     = 0;
+    beginSegment();
+    captureCondition.notify_one();
+
+    return capturePos+size<=captureSize;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static bool deviceNumber ( const EasyMidiLibDevice* dev, uint64_t& number )
+{
+    auto it = std::find ( captureDevices.begin(), captureDevices.end(), dev );
+    number  = it-captureDevices.begin();
+    if ( it!=captureDevices.end() )
+        return true;
+
+    if ( !reserve(deviceRecordSize(dev)) )
+        return false;
+
+    uint8_t* p = writeDevice ( captureCurrent.data+capturePos, number, dev );
+    capturePos = p-captureCurrent.data;
+
+    captureDevices.push_back ( dev );
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_captureRecord ( const EasyMidiLibDevice* dev, const uint8_t* data, size_t size, uint64_t timestamp )
+{
+    std::lock_guard<std::mutex> lock(captureMutex);
+
+    // Stopped after the hook checked the flag
+    uint64_t number;
+    if ( !captureOpen || !deviceNumber(dev, number) )
+    {
+        captureDropped += size;
+        return;
+    }
+
+    // Chunks bigger than a quarter segment (long SysEx) are split in records with the same timestamp
+    size_t maxChunk = captureSize/4;
+    while ( size )
+    {
+        size_t chunk = std::min ( size, maxChunk );
+        if ( !reserve(chunk+MAX_DATA_EXTRA) )
+        {
+            captureDropped += size;
+            return;
+        }
+
+        uint8_t* p = writeData ( captureCurrent.data+capturePos, number, (int64_t)(timestamp-captureLast), data, chunk );
+        capturePos = p-captureCurrent.data;
+
+        captureLast = timestamp;
+        captureRecords++;
+        data += chunk;
+        size -= chunk;
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_captureStart ( const char* path, size_t segmentSize )
+{
+    EasyMidiLib_captureStop();
+
+    std::lock_guard<std::mutex> lock(captureMutex);
+
+#if defined(_WIN32)
+    captureFile = CreateFileA ( path, GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ, 0, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, 0 );
+    if ( captureFile==INVALID_HANDLE_VALUE )
+        return false;
+#else
+    captureFile = ::open ( path, O_RDWR|O_CREAT|O_TRUNC, 0644 );
+    if ( captureFile<0 )
+        return false;
+#endif
+
+    captureSize    = segmentSizeFor ( segmentSize );
+    captureMapped  = 1;
+    captureLast    = EasyMidiLib_getTimestamp();
+    captureRecords = 0;
+    captureDropped = 0;
+    captureDevices.clear();
+
+    if ( !mapSegment(0, captureCurrent) )
+    {
+#if defined(_WIN32)
+        CloseHandle ( captureFile );
+        captureFile = INVALID_HANDLE_VALUE;
+#else
+        ::close ( captureFile );
+        captureFile = -1;
+#endif
+        return false;
+    }
+
+    writeHeader ( captureCurrent.data, captureSize, captureLast );
+    capturePos = HEADER_SIZE;
+    beginSegment();
+
+    captureOpen                = true;
+    captureRunning             = true;
+    captureThread              = std::thread(captureThreadFunc);
+    EasyMidiLib_captureEnabled = true;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_captureStop ( )
+{
+    {
+        std::lock_guard<std::mutex> lock(captureMutex);
+        if ( !captureOpen )
+            return;
+
+        EasyMidiLib_captureEnabled = false;
+        captureOpen                = false;
+        captureRunning             = false;
+    }
+
+    captureCondition.notify_one();
+    captureThread.join();
+
+    std::lock_guard<std::mutex> lock(captureMutex);
+
+    // Trim the file after the last record
+    uint64_t end = (uint64_t)captureCurrent.index*captureSize+capturePos;
+
+    unmapSegment ( captureCurrent );
+    for ( const CaptureSegment& segment : captureReady )
+        unmapSegment ( segment );
+    for ( const CaptureSegment& segment : captureRetired )
+        unmapSegment ( segment );
+    captureReady  .clear();
+    captureRetired.clear();
+    captureCurrent = {};
+
+#if defined(_WIN32)
+    LARGE_INTEGER size;
+    size.QuadPart = (LONGLONG)end;
+    SetFilePointerEx ( captureFile, size, 0, FILE_BEGIN );
+    SetEndOfFile ( captureFile );
+    CloseHandle ( captureFile );
+    captureFile = INVALID_HANDLE_VALUE;
+#else
+    if ( ftruncate(captureFile, (off_t)end)!=0 )
+        EasyMidiLib_log ( EasyMidiLibLogLevel::Warning, EasyMidiLibLogCategory::Library, "Capture file not trimmed" );
+    ::close ( captureFile );
+    captureFile = -1;
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_isCapturing ( )
+{
+    return EasyMidiLib_captureEnabled;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLib_captureDropped ( )
+{
+    return captureDropped;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#else
+
+bool     EasyMidiLib_captureStart   ( const char* path, size_t segmentSize ) { return false; }
+void     EasyMidiLib_captureStop    ( )                                      { }
+bool     EasyMidiLib_isCapturing    ( )                                      { return false; }
+uint64_t EasyMidiLib_captureDropped ( )                                      { return 0; }
+
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Event list writer
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_captureWrite ( const char* path, const EasyMidiLibEvent* events, size_t count, size_t segmentSize )
+{
+    FILE* file = fopen ( path, "wb" );
+    if ( !file )
+        return false;
+
+    // Same segments as a live capture, built in memory and written one by one
+    size_t                                size      = segmentSizeFor ( segmentSize );
+    std::vector<uint8_t>                  segment   ( size, 0 );
+    std::vector<const EasyMidiLibDevice*> devices;
+    uint64_t                              last      = count ? events[0].timestamp : EasyMidiLib_getTimestamp();
+    uint64_t                              records   = 0;
+    bool                                  failed    = false;
+
+    uint8_t* p = writeHeader ( segment.data(), size, last );
+    p = writeIndex ( p, last, records );
+
+    auto reserve = [&]( size_t bytes )
+    {
+        if ( (size_t)(p-segment.data())+bytes<=size )
+            return;
+
+        failed |= fwrite ( segment.data(), 1, size, file )!=size;
+        std::fill ( segment.begin(), segment.end(), 0 );
+        p = writeIndex ( segment.data(), last, records );
+    };
+
+    for ( size_t i=0; i!=count; i++ )
+    {
+        const EasyMidiLibEvent& event = events[i];
+        if ( !event.device )
+            continue;
+
+        auto     it     = std::find ( devices.begin(), devices.end(), event.device );
+        uint64_t number = it-devices.begin();
+        if ( it==devices.end() )
+        {
+            reserve ( deviceRecordSize(event.device) );
+            p = writeDevice ( p, number, event.device );
+            devices.push_back ( event.device );
+        }
+
+        const uint8_t* data = event.data();
+        size_t         left = event.size;
+        while ( left )
+        {
+            size_t chunk = std::min ( left, size/4 );
+            reserve ( chunk+MAX_DATA_EXTRA );
+            p = writeData ( p, number, (int64_t)(event.timestamp-last), data, chunk );
+
+            last = event.timestamp;
+            records++;
+            data += chunk;
+            left -= chunk;
+        }
+    }
+
+    size_t used = p-segment.data();
+    failed |= fwrite ( segment.data(), 1, used, file )!=used;
+    failed |= fclose ( file )!=0;
+    return !failed;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibCaptureIterator
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibCaptureIterator::readVarInt ( uint64_t& value )
+{
+    value = 0;
+    for ( int shift=0; shift<64 && m_pos<m_end; shift+=7 )
+    {
+        uint8_t byte = *m_pos++;
+        value |= (uint64_t)(byte & 0x7F)<<shift;
+        if ( !(byte & 0x80) )
+            return true;
+    }
+
+    return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibCaptureIterator::startSegment ( size_t segment )
+{
+    if ( !m_file || segment>=m_file->m_segments.size() )
+    {
+        m_pos = m_end = 0;
+        return false;
+    }
+
+    size_t start = segment*m_file->m_segmentSize;
+
+    m_segment   = segment;
+    m_pos       = m_file->m_data+start+(segment ? 0 : HEADER_SIZE)+INDEX_SIZE;
+    m_end       = m_file->m_data+std::min(start+m_file->m_segmentSize, m_file->m_size);
+    m_timestamp = m_file->m_segments[segment].timestamp;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibCaptureIterator::next ( EasyMidiLibCaptureRecord& record )
+{
+    for ( ;; )
+    {
+        if ( m_pos>=m_end || *m_pos==RECORD_PADDING )
+        {
+            if ( !startSegment(m_segment+1) )
+                return false;
+            continue;
+        }
+
+        uint8_t  type = *m_pos++;
+        uint64_t number, value, size;
+
+        // The file was checked when opened
+        if ( type==RECORD_DEVICE )
+        {
+            readVarInt ( number );
+            m_pos++;
+            readVarInt ( size );
+            m_pos += size;
+            readVarInt ( size );
+            m_pos += size;
+            continue;
+        }
+
+        readVarInt ( number );
+        readVarInt ( value );
+        readVarInt ( size );
+
+        m_timestamp     += (uint64_t)((int64_t)(value>>1) ^ -(int64_t)(value & 1));
+        record.timestamp = m_timestamp;
+        record.device    = (uint32_t)number;
+        record.data      = m_pos;
+        record.size      = (size_t)size;
+        m_pos           += size;
+        return true;
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibCaptureFile
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibCaptureFile::open ( const char* path )
+{
+    close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA ( path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0 );
+    if ( file==INVALID_HANDLE_VALUE )
+        return fail ( "Can't open the file" );
+
+    LARGE_INTEGER size;
+    HANDLE        mapping = 0;
+    if ( GetFileSizeEx(file, &size) && size.QuadPart>0 )
+        mapping = CreateFileMappingA ( file, 0, PAGE_READONLY, 0, 0, 0 );
+    CloseHandle ( file );
+    if ( !mapping )
+        return fail ( "Can't map the file" );
+
+    // The view keeps the mapping alive
+    void* view = MapViewOfFile ( mapping, FILE_MAP_READ, 0, 0, 0 );
+    CloseHandle ( mapping );
+    if ( !view )
+        return fail ( "Can't map the file" );
+
+    m_size = (size_t)size.QuadPart;
+#else
+    int file = ::open ( path, O_RDONLY );
+    if ( file<0 )
+        return fail ( "Can't open the file" );
+
+    struct stat info;
+    void*       view = MAP_FAILED;
+    if ( fstat(file, &info)==0 && info.st_size>0 )
+        view = mmap ( 0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0 );
+    ::close ( file );
+    if ( view==MAP_FAILED )
+        return fail ( "Can't map the file" );
+
+    m_size = (size_t)info.st_size;
+    madvise ( view, m_size, MADV_SEQUENTIAL );
+#endif
+
+    m_data = (const uint8_t*)view;
+
+    if ( !parse() )
+    {
+        std::string error = m_lastError;
+        close();
+        m_lastError = error;
+        return false;
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibCaptureFile::close ( )
+{
+    if ( m_data )
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile ( m_data );
+#else
+        munmap ( (void*)m_data, m_size );
+#endif
+    }
+
+    m_data        = 0;
+    m_size        = 0;
+    m_segmentSize = 0;
+    m_startTime   = 0;
+    m_endTime     = 0;
+    m_records     = 0;
+    m_bytes       = 0;
+    m_devices .clear();
+    m_segments.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// One pass over the whole file: checks every record, collects the devices and the segment index
+
+bool EasyMidiLibCaptureFile::parse ( )
+{
+    if ( m_size<HEADER_SIZE+INDEX_SIZE || memcmp(m_data, MAGIC, sizeof(MAGIC))!=0 )
+        return fail ( "Not a capture file" );
+    if ( readLE(m_data+8, 4)!=VERSION )
+        return fail ( "Unsupported capture version" );
+
+    m_segmentSize = (size_t)readLE ( m_data+12, 4 );
+    m_startTime   = readLE ( m_data+16, 8 );
+    m_endTime     = m_startTime;
+
+    if ( m_segmentSize<HEADER_SIZE+INDEX_SIZE )
+        return fail ( "Bad segment size" );
+
+    for ( size_t start=0; start<m_size; start+=m_segmentSize )
+    {
+        EasyMidiLibCaptureIterator it;
+        it.m_pos = m_data+start+(start ? 0 : HEADER_SIZE);
+        it.m_end = m_data+std::min(start+m_segmentSize, m_size);
+
+        if ( it.m_end-it.m_pos<(ptrdiff_t)INDEX_SIZE || it.m_pos[0]!=RECORD_INDEX )
+            return fail ( "Missing segment index" );
+
+        Segment segment = { readLE(it.m_pos+1, 8), readLE(it.m_pos+9, 8) };
+        if ( segment.records!=m_records )
+            return fail ( "Bad segment index" );
+        m_segments.push_back ( segment );
+        it.m_pos += INDEX_SIZE;
+
+        uint64_t timestamp = segment.timestamp;
+        while ( it.m_pos<it.m_end && *it.m_pos!=RECORD_PADDING )
+        {
+            uint8_t  type = *it.m_pos++;
+            uint64_t number, value, size;
+
+            if ( type==RECORD_DEVICE )
+            {
+                EasyMidiLibCaptureDevice device;
+                if ( !it.readVarInt(number) || number!=m_devices.size() || it.m_pos>=it.m_end )
+                    return fail ( "Bad device record" );
+                device.isInput = *it.m_pos++!=0;
+
+                if ( !it.readVarInt(size) || size>(uint64_t)(it.m_end-it.m_pos) )
+                    return fail ( "Bad device record" );
+                device.name.assign ( (const char*)it.m_pos, (size_t)size );
+                it.m_pos += size;
+
+                if ( !it.readVarInt(size) || size>(uint64_t)(it.m_end-it.m_pos) )
+                    return fail ( "Bad device record" );
+                device.id.assign ( (const char*)it.m_pos, (size_t)size );
+                it.m_pos += size;
+
+                m_devices.push_back ( device );
+            }
+            else if ( type==RECORD_DATA )
+            {
+                if ( !it.readVarInt(number) || number>=m_devices.size() || !it.readVarInt(value) || !it.readVarInt(size) || size>(uint64_t)(it.m_end-it.m_pos) )
+                    return fail ( "Bad data record" );
+
+                timestamp += (uint64_t)((int64_t)(value>>1) ^ -(int64_t)(value & 1));
+                it.m_pos  += size;
+                m_records++;
+                m_bytes   += size;
+                m_endTime  = std::max ( m_endTime, timestamp );
+            }
+            else
+                return fail ( "Bad record" );
+        }
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibCaptureIterator EasyMidiLibCaptureFile::records ( ) const
+{
+    EasyMidiLibCaptureIterator it;
+    it.m_file = this;
+    it.startSegment ( 0 );
+    return it;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibCaptureIterator EasyMidiLibCaptureFile::recordsFrom ( uint64_t timestamp ) const
+{
+    // Last segment whose base isn't after the timestamp
+    auto segment = std::upper_bound ( m_segments.begin(), m_segments.end(), timestamp, []( uint64_t t, const Segment& s ) { return t<s.timestamp; } );
+    if ( segment!=m_segments.begin() )
+        segment--;
+
+    EasyMidiLibCaptureIterator it;
+    it.m_file = this;
+    it.startSegment ( segment-m_segments.begin() );
+    return it;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibCaptureReplay
+//--------------------------------------------------------------------------------------------------------------------------
+
+static const uint64_t MAX_SLEEP_NS = 20000000; // longest sleep between stop() checks
+
+struct EasyMidiLibCaptureReplay::StandIn
+{
+    EasyMidiLibDevice      device;
+    EasyMidiLibDeviceState state;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibCaptureReplay::EasyMidiLibCaptureReplay ( )
+{
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibCaptureReplay::~EasyMidiLibCaptureReplay ( )
+{
+    unload();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibCaptureReplay::load ( const EasyMidiLibCaptureFile* file )
+{
+    unload();
+
+    if ( !file || !file->isOpen() )
+        return false;
+
+    for ( const EasyMidiLibCaptureDevice& captured : file->getDevices() )
+    {
+        std::unique_ptr<StandIn> standIn ( new StandIn );
+        EasyMidiLibDevice&       device = standIn->device;
+
+        device.isInput         = true;
+        device.name            = captured.name;
+        device.id              = captured.id;
+        device.connected       = true;
+        device.opened          = true;
+        device.userPtrParam    = 0;
+        device.userIntParam    = 0;
+        device.internalHandler = 0;
+        device.internalState   = &standIn->state;
+
+        m_targets .push_back ( &device );
+        m_standIns.push_back ( std::move(standIn) );
+    }
+
+    m_file = file;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibCaptureReplay::unload ( )
+{
+    stop();
+
+    // The dispatch threads may still hold stand-in data
+    for ( const std::unique_ptr<StandIn>& standIn : m_standIns )
+        EasyMidiLib_waitDeviceDispatch ( &standIn->device );
+
+    m_file = 0;
+    m_standIns.clear();
+    m_targets .clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibCaptureReplay::mapDevice ( uint32_t device, const EasyMidiLibDevice* dev )
+{
+    if ( device<m_targets.size() && !m_running )
+        m_targets[device] = dev ? dev : &m_standIns[device]->device;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+const EasyMidiLibDevice* EasyMidiLibCaptureReplay::getDevice ( uint32_t device ) const
+{
+    return device<m_targets.size() ? m_targets[device] : 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibCaptureReplay::run ( EasyMidiLibListener* listener, EasyMidiLibCaptureReplayMode mode, uint64_t from )
+{
+    if ( !m_file || m_running )
+        return false;
+
+    if ( m_thread.joinable() )
+        m_thread.join();
+
+    m_running = true;
+    replay ( listener, mode, from );
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibCaptureReplay::start ( EasyMidiLibListener* listener, EasyMidiLibCaptureReplayMode mode, uint64_t from )
+{
+    if ( !m_file || m_running )
+        return false;
+
+    if ( m_thread.joinable() )
+        m_thread.join();
+
+    m_running = true;
+    m_thread  = std::thread(&EasyMidiLibCaptureReplay::replay, this, listener, mode, from);
+    EasyMidiLib_configureThread ( m_thread, EasyMidiLibThreadRole::Timing );
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibCaptureReplay::stop ( )
+{
+    m_running = false;
+
+    if ( m_thread.joinable() )
+        m_thread.join();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibCaptureReplayStats EasyMidiLibCaptureReplay::getStats ( ) const
+{
+    EasyMidiLibCaptureReplayStats stats;
+    stats.records   = m_records;
+    stats.bytes     = m_bytes;
+    stats.elapsedNs = m_elapsedNs;
+    return stats;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibCaptureReplay::replay ( EasyMidiLibListener* listener, EasyMidiLibCaptureReplayMode mode, uint64_t from )
+{
+    EasyMidiLibCaptureIterator it    = m_file->recordsFrom ( from );
+    EasyMidiLibCaptureRecord   record;
+    bool                       ready = false;   // 'record' waits for its time
+    uint64_t                   begin = EasyMidiLib_getTimestamp();
+    uint64_t                   origin = 0;     // capture time matching 'begin'
+
+    m_records = 0;
+    m_bytes   = 0;
+
+    while ( m_running )
+    {
+        if ( !ready )
+        {
+            if ( !it.next(record) )
+                break;
+            if ( record.timestamp<from )
+                continue;
+            if ( !origin )
+                origin = record.timestamp;
+            ready = true;
+        }
+
+        uint64_t now = EasyMidiLib_getTimestamp();
+
+        if ( mode==EasyMidiLibCaptureReplayMode::RealTime )
+        {
+            // Records of another device may come slightly out of order, they go right away
+            uint64_t deadline = begin + ( record.timestamp>origin ? record.timestamp-origin : 0 );
+
+            if ( deadline > now+MAX_SLEEP_NS )
+            {
+                EasyMidiLib_waitUntil ( now+MAX_SLEEP_NS, 0, m_running, now );
+                continue;
+            }
+
+            if ( !EasyMidiLib_waitUntil ( deadline, m_spinTime, m_running, now ) )
+                break;
+
+            m_jitter.add ( (int64_t)(now-deadline) );
+        }
+
+        EasyMidiLib_deliverInData ( listener, m_targets[record.device], record.data, record.size, now );
+
+        m_records++;
+        m_bytes += record.size;
+        ready    = false;
+    }
+
+    m_elapsedNs = EasyMidiLib_getTimestamp()-begin;
+    m_running   = false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,374 @@
+#include "EasyMidiLibClock.h"
+#include "EasyMidiLibInternal.h"
+#include <cmath>
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static const double   TICKS_PER_BEAT    = 24.0;
+static const double   DROPOUT_PERIODS   = 4.0;      // a gap longer than this (in ticks) restarts the loop
+static const double   PI                = 3.14159265358979323846;
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibClockFollower
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibClockFollower::EasyMidiLibClockFollower ( double bandwidthHz )
+{
+    setBandwidth ( bandwidthHz );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibClockFollower::setBandwidth ( double bandwidthHz )
+{
+    m_bandwidth = bandwidthHz > 0.0 ? bandwidthHz : 1.0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibClockFollower::reset ( )
+{
+    m_running   = false;
+    m_locked    = false;
+    m_ticks     = -1;
+    m_lastTick  = 0;
+    m_seenTicks = 0;
+    m_t0        = 0.0;
+    m_t1        = 0.0;
+    m_period    = 0.0;
+    publish();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibClockFollower::process ( EasyMidiLibSysRealtimeMsg msg, uint64_t timestamp )
+{
+    switch ( msg )
+    {
+        case EasyMidiLibSysRealtimeMsg::TimingClock:
+            {
+                double t = (double)timestamp;
+
+                // Clock dropout, relock from scratch
+                if ( m_seenTicks>0 && m_period>0.0 && t-(double)m_lastTick > DROPOUT_PERIODS*m_period )
+                {
+                    m_locked    = false;
+                    m_seenTicks = 0;
+                }
+
+                if ( m_seenTicks==0 )
+                {
+                    m_t0 = t;
+                    m_t1 = t;
+                }
+                else if ( m_seenTicks==1 )
+                {
+                    // Second tick gives the first period estimate
+                    m_period = t - (double)m_lastTick;
+                    m_t0     = t;
+                    m_t1     = t + m_period;
+                    m_locked = m_period>0.0;
+                }
+                else
+                {
+                    // Delay locked loop (critically damped), bandwidth relative to the tick rate
+                    double omega = 2.0 * PI * m_bandwidth * m_period * 1e-9;
+                    double b     = std::sqrt(2.0) * omega;
+                    double c     = omega * omega;
+                    double e     = t - m_t1;
+
+                    m_t0      = m_t1;
+                    m_t1     += b*e + m_period;
+                    m_period += c*e;
+                }
+
+                m_lastTick = timestamp;
+                m_seenTicks++;
+
+                if ( m_running )
+                    m_ticks++;
+            }
+            break;
+
+        case EasyMidiLibSysRealtimeMsg::Start:
+            m_running = true;
+            m_ticks   = -1;
+            break;
+
+        case EasyMidiLibSysRealtimeMsg::Continue:
+            m_running = true;
+            break;
+
+        case EasyMidiLibSysRealtimeMsg::Stop:
+            m_running = false;
+            break;
+
+        default:
+            return;
+    }
+
+    publish();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibClockFollower::setSongPosition ( uint16_t sixteenths )
+{
+    // The next tick after Continue is the song position itself
+    m_ticks = (int64_t)sixteenths * 6 - 1;
+    publish();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibClockFollower::publish ( )
+{
+    uint32_t seq = m_seq.load(std::memory_order_relaxed);
+    m_seq.store(seq+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_pubRunning.store(m_running, std::memory_order_relaxed);
+    m_pubLocked .store(m_locked , std::memory_order_relaxed);
+    m_pubTicks  .store(m_ticks  , std::memory_order_relaxed);
+    m_pubT0     .store(m_t0     , std::memory_order_relaxed);
+    m_pubT1     .store(m_t1     , std::memory_order_relaxed);
+    m_pubPeriod .store(m_period , std::memory_order_relaxed);
+
+    m_seq.store(seq+2, std::memory_order_release);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibClockState EasyMidiLibClockFollower::getState ( uint64_t now ) const
+{
+    bool    running, locked;
+    int64_t ticks;
+    double  t0, t1, period;
+
+    for (;;)
+    {
+        uint32_t seq0 = m_seq.load(std::memory_order_acquire);
+        if ( seq0 & 1 )
+            continue;
+
+        running = m_pubRunning.load(std::memory_order_relaxed);
+        locked  = m_pubLocked .load(std::memory_order_relaxed);
+        ticks   = m_pubTicks  .load(std::memory_order_relaxed);
+        t0      = m_pubT0     .load(std::memory_order_relaxed);
+        t1      = m_pubT1     .load(std::memory_order_relaxed);
+        period  = m_pubPeriod .load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ( m_seq.load(std::memory_order_relaxed)==seq0 )
+            break;
+    }
+
+    EasyMidiLibClockState state;
+    state.running = running;
+    state.locked  = locked;
+    state.tempo   = ( locked && period>0.0 ) ? 60e9 / (period*TICKS_PER_BEAT) : 0.0;
+
+    double position;
+    if ( !running )
+        position = (double)(ticks+1);
+    else
+    {
+        // Interpolate between the filtered tick times, never past the next expected tick
+        double frac = 0.0;
+        if ( locked && t1>t0 )
+            frac = std::min(1.0, std::max(0.0, ((double)now-t0) / (t1-t0)));
+        position = (double)ticks + frac;
+    }
+    state.beatPosition = std::max(0.0, position) / TICKS_PER_BEAT;
+
+    return state;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+double EasyMidiLibClockFollower::getBeatPosition ( uint64_t now ) const
+{
+    return getState(now).beatPosition;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+double EasyMidiLibClockFollower::getTempo ( ) const
+{
+    return getState(0).tempo;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibClockFollower::isRunning ( ) const
+{
+    return m_pubRunning.load(std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibClockFollower::isLocked ( ) const
+{
+    return m_pubLocked.load(std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibClockGenerator
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibClockGenerator::EasyMidiLibClockGenerator ( )
+{
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibClockGenerator::~EasyMidiLibClockGenerator ( )
+{
+    stop ( false );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibClockGenerator::start ( const EasyMidiLibDevice* dev, double bpm, bool sendStart )
+{
+    if ( m_running || !dev || dev->isInput || !dev->opened || bpm<=0.0 )
+        return false;
+
+    m_dev   = dev;
+    m_tempo = bpm;
+    resetJitterStats();
+
+    if ( sendStart )
+    {
+        uint8_t msg = (uint8_t)EasyMidiLibSysRealtimeMsg::Start;
+        EasyMidiLib_outputSend ( m_dev, &msg, 1 );
+    }
+
+    m_running = true;
+    m_thread  = std::thread(&EasyMidiLibClockGenerator::threadFunc, this);
+    EasyMidiLib_configureThread ( m_thread, EasyMidiLibThreadRole::Timing );
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibClockGenerator::stop ( bool sendStop )
+{
+    if ( !m_running )
+        return;
+
+    m_running = false;
+    if ( m_thread.joinable() )
+        m_thread.join();
+
+    if ( sendStop && m_dev->opened )
+    {
+        uint8_t msg = (uint8_t)EasyMidiLibSysRealtimeMsg::Stop;
+        EasyMidiLib_outputSend ( m_dev, &msg, 1 );
+    }
+
+    m_dev = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibClockGenerator::setTempo ( double bpm )
+{
+    if ( bpm>0.0 )
+        m_tempo = bpm;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibClockGenerator::threadFunc ( )
+{
+    const uint8_t tick = (uint8_t)EasyMidiLibSysRealtimeMsg::TimingClock;
+
+    double   bpm    = m_tempo;
+    double   period = 60e9 / (bpm*TICKS_PER_BEAT);
+    uint64_t anchor = EasyMidiLib_getTimestamp();
+    uint64_t n      = 0;
+
+    while ( m_running )
+    {
+        // Tempo change, re-anchor on the next deadline of the old tempo
+        double newBpm = m_tempo;
+        if ( newBpm!=bpm )
+        {
+            anchor += (uint64_t)(n*period);
+            n       = 0;
+            bpm     = newBpm;
+            period  = 60e9 / (bpm*TICKS_PER_BEAT);
+        }
+
+        uint64_t deadline = anchor + (uint64_t)(n*period);
+        uint64_t now      = 0;
+
+        if ( !EasyMidiLib_waitUntil ( deadline, m_spinTime, m_running, now ) )
+            break;
+
+        EasyMidiLib_outputSend ( m_dev, &tick, 1 );
+        m_jitter.add ( (int64_t)(now-deadline) );
+        n++;
+
+        // Far behind (suspend, debugger...), don't burst the missed ticks
+        if ( (double)(now-deadline) > DROPOUT_PERIODS*period )
+        {
+            anchor = now;
+            n      = 1;
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibJitterMeter::add ( int64_t late )
+{
+    uint64_t ticks = m_ticks.load(std::memory_order_relaxed);
+
+    if ( ticks==0 || late<m_min.load(std::memory_order_relaxed) )
+        m_min.store(late, std::memory_order_relaxed);
+    if ( ticks==0 || late>m_max.load(std::memory_order_relaxed) )
+        m_max.store(late, std::memory_order_relaxed);
+
+    m_sum  .store(m_sum  .load(std::memory_order_relaxed) + (double)late            , std::memory_order_relaxed);
+    m_sumSq.store(m_sumSq.load(std::memory_order_relaxed) + (double)late*(double)late, std::memory_order_relaxed);
+    m_ticks.store(ticks+1, std::memory_order_release);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibClockJitterStats EasyMidiLibJitterMeter::get ( ) const
+{
+    EasyMidiLibClockJitterStats stats = {};
+
+    stats.ticks = m_ticks.load(std::memory_order_acquire);
+    if ( stats.ticks )
+    {
+        double n  = (double)stats.ticks;
+        double m  = m_sum.load(std::memory_order_relaxed) / n;
+        double v  = m_sumSq.load(std::memory_order_relaxed) / n - m*m;
+
+        stats.minLate    = m_min.load(std::memory_order_relaxed);
+        stats.maxLate    = m_max.load(std::memory_order_relaxed);
+        stats.meanLate   = m;
+        stats.stdDevLate = std::sqrt(std::max(0.0, v));
+    }
+
+    return stats;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibJitterMeter::reset ( )
+{
+    m_ticks = 0;
+    m_min   = 0;
+    m_max   = 0;
+    m_sum   = 0.0;
+    m_sumSq = 0.0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
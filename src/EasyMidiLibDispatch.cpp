@@ -0,0 +1,553 @@
+#include "EasyMidiLib.h"
+#include "EasyMidiLibInternal.h"
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <deque>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Dispatch threads. Each thread has its own queue of devices with pending data and steals from the others when it runs
+// dry. A device is in at most one queue and processed by one thread at a time (dispatchScheduled), which keeps its data
+// in order; a thread that finds more data for the device it just processed queues it again on its own queue.
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct DispatchThread
+{
+    std::mutex                          mutex;
+    std::deque<EasyMidiLibDeviceState*> queue;
+    std::thread                         thread;
+};
+
+static std::atomic<uint8_t>                         dispatchMode      {(uint8_t)EasyMidiLibDispatchMode::Inline};
+static size_t                                       dispatchWanted    = 0;
+static std::mutex                                   dispatchMutex;
+static std::condition_variable                      dispatchCondition;
+static std::vector<std::unique_ptr<DispatchThread>> dispatchThreads;
+static std::atomic<size_t>                          dispatchQueued    {0};       // devices waiting in the queues
+static std::atomic<size_t>                          dispatchSleeping  {0};
+static size_t                                       dispatchNextHome  = 0;
+static bool                                         dispatchStopping  = false;
+static thread_local EasyMidiLibDeviceState*         dispatchCurrent   = 0;       // device being processed by this thread
+
+std::atomic<uint64_t>                               EasyMidiLib_callbackBudget {0};
+static std::atomic<bool>                            budgetOffload     {false};
+static thread_local bool                            budgetReported    = false;   // a helper inside deviceInData went over
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Budget watchdog. A thread running a watched callback publishes its device and when the call began (0: none) in a slot
+// of its own; the watchdog thread checks the slots every half budget and flags the calls still running past it, so the
+// device is deferred without waiting for them to return. It's stopped with the dispatch threads, before the backends
+// free the devices.
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct BudgetWatch
+{
+    std::atomic<bool>                     used    {false};
+    std::atomic<const EasyMidiLibDevice*> device  {0};
+    std::atomic<const char*>              handler {0};
+    std::atomic<uint64_t>                 begin   {0};
+};
+
+struct BudgetWatchOwner
+{
+    BudgetWatch* watch = 0;
+    ~BudgetWatchOwner() { if ( watch ) watch->used = false; }
+};
+
+static const size_t                                 EASYMIDILIB_BUDGET_WATCHES = 64;   // threads watched at once
+static BudgetWatch                                  budgetWatches[EASYMIDILIB_BUDGET_WATCHES];
+static thread_local BudgetWatchOwner                budgetWatchOwner;
+static std::mutex                                   watchdogMutex;
+static std::condition_variable                      watchdogCondition;
+static std::thread                                  watchdogThread;
+static std::atomic<bool>                            watchdogRunning   {false};
+static bool                                         watchdogStopping  = false;
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void watchdogThreadFunc ( )
+{
+    uint64_t flagged[EASYMIDILIB_BUDGET_WATCHES] = {};   // begin of the call last flagged, per slot
+
+    std::unique_lock<std::mutex> lock(watchdogMutex);
+    while ( !watchdogStopping )
+    {
+        uint64_t budget = EasyMidiLib_callbackBudget.load(std::memory_order_relaxed);
+        watchdogCondition.wait_for ( lock, std::chrono::nanoseconds(std::min<uint64_t>(std::max<uint64_t>(budget/2, 1000000), 100000000)) );
+
+        budget = EasyMidiLib_callbackBudget.load(std::memory_order_relaxed);
+        if ( !budget || watchdogStopping )
+            continue;
+
+        uint64_t now = EasyMidiLib_getTimestamp();
+        for ( size_t i=0; i!=EASYMIDILIB_BUDGET_WATCHES; i++ )
+        {
+            BudgetWatch& watch = budgetWatches[i];
+            uint64_t     begin = watch.begin.load(std::memory_order_acquire);
+            if ( !begin || begin==flagged[i] || now<begin+budget )
+                continue;
+
+            const EasyMidiLibDevice* dev     = watch.device .load(std::memory_order_relaxed);
+            const char*              handler = watch.handler.load(std::memory_order_relaxed);
+
+            // Still the same call: the slot wasn't reused while reading it
+            std::atomic_thread_fence ( std::memory_order_acquire );
+            if ( watch.begin.load(std::memory_order_relaxed)!=begin )
+                continue;
+            flagged[i] = begin;
+
+            if ( budgetOffload )
+                EasyMidiLib_getDeviceState(dev)->dispatchDeferred = true;
+
+            EasyMidiLib_log ( EasyMidiLibLogLevel::Warning, EasyMidiLibLogCategory::Library, "%s %s (%s) %s still running after %.3f ms, over budget",
+                              dev->isInput?"in":"out", dev->name, dev->id, handler, (now-begin)/1e6 );
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void startWatchdog ( )
+{
+    std::lock_guard<std::mutex> lock(watchdogMutex);
+    if ( watchdogRunning || watchdogStopping )
+        return;
+
+    watchdogThread  = std::thread(watchdogThreadFunc);
+    watchdogRunning = true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void stopWatchdog ( )
+{
+    {
+        std::lock_guard<std::mutex> lock(watchdogMutex);
+        watchdogStopping = true;
+    }
+    watchdogCondition.notify_all();
+
+    if ( watchdogThread.joinable() )
+        watchdogThread.join();
+
+    std::lock_guard<std::mutex> lock(watchdogMutex);
+    watchdogRunning  = false;
+    watchdogStopping = false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Processes what is pending for a device (its dispatchMutex held)
+
+static void processPending ( EasyMidiLibDeviceState* state )
+{
+    EasyMidiLibListener*     listener;
+    const EasyMidiLibDevice* dev;
+    bool                     resetBefore;
+    {
+        std::lock_guard<std::mutex> lock(state->pendingMutex);
+        state->dispatchData  .swap(state->pendingData);
+        state->dispatchChunks.swap(state->pendingChunks);
+        listener    = state->pendingListener;
+        dev         = state->device;
+        resetBefore = state->resetPending;
+    }
+
+    // A reset after the swap drops the rest, it was received before the reset
+    size_t start = 0;
+    for ( const EasyMidiLibDeviceState::PendingChunk& chunk : state->dispatchChunks )
+    {
+        if ( !resetBefore && state->resetPending )
+            break;
+        if ( chunk.resync )
+            EasyMidiLib_inputGap ( state );
+        EasyMidiLib_processInData ( listener, dev, state->dispatchData.data()+start, chunk.end-start, chunk.timestamp );
+        start = chunk.end;
+    }
+
+    state->dispatchData  .clear();
+    state->dispatchChunks.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static EasyMidiLibDeviceState* takeDevice ( size_t self )
+{
+    // Own queue first (front), then steal from the others (back)
+    for ( size_t i=0; i!=dispatchThreads.size(); i++ )
+    {
+        DispatchThread& t = *dispatchThreads[(self+i)%dispatchThreads.size()];
+
+        std::lock_guard<std::mutex> lock(t.mutex);
+        if ( !t.queue.empty() )
+        {
+            EasyMidiLibDeviceState* state;
+            if ( i==0 )
+            {
+                state = t.queue.front();
+                t.queue.pop_front();
+            }
+            else
+            {
+                state = t.queue.back();
+                t.queue.pop_back();
+            }
+            return state;
+        }
+    }
+
+    return 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void queueDevice ( EasyMidiLibDeviceState* state, size_t thread )
+{
+    // Counted before it can be taken
+    dispatchQueued++;
+    {
+        DispatchThread& t = *dispatchThreads[thread];
+        std::lock_guard<std::mutex> lock(t.mutex);
+        t.queue.push_back(state);
+    }
+
+    // Sleeping threads check dispatchQueued holding dispatchMutex, taking it here avoids a lost wake up
+    if ( dispatchSleeping )
+    {
+        { std::lock_guard<std::mutex> lock(dispatchMutex); }
+        dispatchCondition.notify_one();
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void dispatchThreadFunc ( size_t self )
+{
+    for ( ;; )
+    {
+        EasyMidiLibDeviceState* state = takeDevice ( self );
+        if ( !state )
+        {
+            std::unique_lock<std::mutex> lock(dispatchMutex);
+            dispatchSleeping++;
+            dispatchCondition.wait ( lock, [] { return dispatchStopping || dispatchQueued; } );
+            dispatchSleeping--;
+            if ( dispatchStopping && !dispatchQueued )
+                return;
+            continue;
+        }
+        dispatchQueued--;
+
+        {
+            std::lock_guard<std::mutex> processLock(state->dispatchMutex);
+            dispatchCurrent = state;
+            processPending ( state );
+            dispatchCurrent = 0;
+        }
+
+        bool again;
+        {
+            std::lock_guard<std::mutex> pendingLock(state->pendingMutex);
+            again = !state->pendingData.empty();
+            if ( !again )
+                state->dispatchScheduled = false;
+        }
+
+        if ( again )
+            queueDevice ( state, self );
+        else
+            state->dispatchIdle.notify_all();
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Queues a device on a dispatch thread, starting them if needed; false if the threads are stopping
+
+static bool scheduleDevice ( EasyMidiLibDeviceState* state )
+{
+    std::lock_guard<std::mutex> lock(dispatchMutex);
+
+    if ( dispatchStopping )
+        return false;
+
+    if ( dispatchThreads.empty() )
+    {
+        size_t count = dispatchWanted;
+        if ( (EasyMidiLibDispatchMode)dispatchMode.load()==EasyMidiLibDispatchMode::Thread )
+            count = 1;
+        else if ( !count )
+            count = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 4;
+
+        for ( size_t i=0; i!=count; i++ )
+            dispatchThreads.emplace_back ( new DispatchThread );
+        for ( size_t i=0; i!=count; i++ )
+        {
+            dispatchThreads[i]->thread = std::thread(dispatchThreadFunc, i);
+            EasyMidiLib_configureThread ( dispatchThreads[i]->thread, EasyMidiLibThreadRole::Dispatch );
+        }
+    }
+
+    if ( !state->dispatchHome )
+        state->dispatchHome = ++dispatchNextHome;
+
+    dispatchQueued++;
+    {
+        DispatchThread& t = *dispatchThreads[state->dispatchHome%dispatchThreads.size()];
+        std::lock_guard<std::mutex> queueLock(t.mutex);
+        t.queue.push_back(state);
+    }
+    dispatchCondition.notify_one();
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Keeps the bytes waiting for a dispatch thread within the queue capacity (pendingMutex held). DropOldest drops the
+// oldest chunks, the other policies the new data: the input thread can't wait, so Block drops like DropNewest here.
+// false when the new data is dropped.
+
+static bool limitPending ( EasyMidiLibDeviceState* state, size_t dataSize, size_t capacity )
+{
+    typedef EasyMidiLibDeviceState::PendingChunk PendingChunk;
+
+    std::vector<uint8_t>&      data   = state->pendingData;
+    std::vector<PendingChunk>& chunks = state->pendingChunks;
+
+    state->queueOverflows++;
+
+    if ( (EasyMidiLibOverflowPolicy)state->queuePolicy.load()!=EasyMidiLibOverflowPolicy::DropOldest || dataSize>capacity )
+    {
+        state->queueDroppedBytes += dataSize;
+        state->pendingResync      = true;
+        return false;
+    }
+
+    size_t dropped = 0;
+    size_t count   = 0;
+    while ( data.size()-dropped+dataSize>capacity )
+        dropped = chunks[count++].end;
+
+    data  .erase ( data.begin(), data.begin()+dropped );
+    chunks.erase ( chunks.begin(), chunks.begin()+count );
+    for ( PendingChunk& chunk : chunks )
+        chunk.end -= dropped;
+
+    if ( chunks.empty() )
+        state->pendingResync = true;
+    else
+        chunks.front().resync = true;
+
+    state->queueDroppedBytes += dropped;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_deliverInData ( EasyMidiLibListener* listener, const EasyMidiLibDevice* dev, const uint8_t* data, size_t dataSize, uint64_t timestamp )
+{
+    EasyMidiLibDeviceState* state = EasyMidiLib_getDeviceState(dev);
+
+    if ( (EasyMidiLibDispatchMode)dispatchMode.load(std::memory_order_relaxed)!=EasyMidiLibDispatchMode::Inline || state->dispatchDeferred )
+    {
+        bool schedule;
+        {
+            std::lock_guard<std::mutex> lock(state->pendingMutex);
+
+            // A slow listener doesn't make it grow without bound
+            size_t capacity = state->queueCapacity;
+            if ( capacity && state->pendingData.size()+dataSize>capacity && !limitPending(state, dataSize, capacity) )
+                return;
+
+            state->pendingData.insert ( state->pendingData.end(), data, data+dataSize );
+            state->pendingChunks.push_back ( { state->pendingData.size(), timestamp, state->pendingResync } );
+            state->pendingResync   = false;
+            state->pendingListener = listener;
+            state->device          = dev;
+
+            schedule = !state->dispatchScheduled;
+            state->dispatchScheduled = true;
+        }
+
+        if ( !schedule || scheduleDevice(state) )
+            return;
+
+        // Dispatch threads stopping, process here
+        {
+            std::lock_guard<std::mutex> processLock(state->dispatchMutex);
+            processPending ( state );
+        }
+        {
+            std::lock_guard<std::mutex> pendingLock(state->pendingMutex);
+            state->dispatchScheduled = false;
+        }
+        state->dispatchIdle.notify_all();
+        return;
+    }
+
+    std::lock_guard<std::mutex> processLock(state->dispatchMutex);
+
+    // Data queued before a switch to inline goes first
+    if ( state->dispatchScheduled )
+        processPending ( state );
+
+    EasyMidiLib_processInData ( listener, dev, data, dataSize, timestamp );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_waitDeviceDispatch ( const EasyMidiLibDevice* dev )
+{
+    EasyMidiLibDeviceState* state = EasyMidiLib_getDeviceState(dev);
+
+    // Closing from a callback of the same device
+    if ( state==dispatchCurrent )
+        return;
+
+    std::unique_lock<std::mutex> lock(state->pendingMutex);
+    state->dispatchIdle.wait ( lock, [state] { return !state->dispatchScheduled; } );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_onDispatchThread ( )
+{
+    return dispatchCurrent!=0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_stopDispatch ( )
+{
+    {
+        std::lock_guard<std::mutex> lock(dispatchMutex);
+        dispatchStopping = true;
+    }
+    dispatchCondition.notify_all();
+
+    // Threads leave once every queued device is processed
+    for ( std::unique_ptr<DispatchThread>& t : dispatchThreads )
+        if ( t->thread.joinable() )
+            t->thread.join();
+
+    {
+        std::lock_guard<std::mutex> lock(dispatchMutex);
+        dispatchThreads.clear();
+        dispatchStopping = false;
+    }
+
+    stopWatchdog();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_setDispatchMode ( EasyMidiLibDispatchMode mode, size_t poolThreads )
+{
+    // Running threads finish their work and the new ones start with the next data
+    EasyMidiLib_stopDispatch();
+
+    std::lock_guard<std::mutex> lock(dispatchMutex);
+    dispatchMode   = (uint8_t)mode;
+    dispatchWanted = poolThreads;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibDispatchMode EasyMidiLib_getDispatchMode ( )
+{
+    return (EasyMidiLibDispatchMode)dispatchMode.load();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_watchBudget ( const EasyMidiLibDevice* dev, const char* handler, uint64_t begin )
+{
+    BudgetWatch* watch = budgetWatchOwner.watch;
+    if ( !watch )
+    {
+        for ( BudgetWatch& w : budgetWatches )
+        {
+            bool used = false;
+            if ( w.used.compare_exchange_strong(used, true) )
+            {
+                watch = &w;
+                break;
+            }
+        }
+
+        // More threads than slots: checked once they return only
+        if ( !watch )
+            return;
+        budgetWatchOwner.watch = watch;
+    }
+
+    // A nested call is covered by the outer one
+    if ( watch->begin.load(std::memory_order_relaxed) )
+        return;
+
+    if ( !watchdogRunning.load(std::memory_order_relaxed) )
+        startWatchdog();
+
+    // Published as a seqlock, 'begin' last
+    std::atomic_thread_fence ( std::memory_order_release );
+    watch->device .store ( dev, std::memory_order_relaxed );
+    watch->handler.store ( handler, std::memory_order_relaxed );
+    watch->begin  .store ( begin, std::memory_order_release );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_checkBudget ( EasyMidiLibListener* listener, const EasyMidiLibDevice* dev, const char* handler, uint64_t begin, bool whole )
+{
+    BudgetWatch* watch = budgetWatchOwner.watch;
+    if ( whole && watch && watch->begin.load(std::memory_order_relaxed)==begin )
+        watch->begin.store ( 0, std::memory_order_release );
+
+    uint64_t duration = EasyMidiLib_getTimestamp()-begin;
+    bool     over     = duration>EasyMidiLib_callbackBudget.load(std::memory_order_relaxed);
+
+    if ( whole )
+    {
+        over           = over && !budgetReported;
+        budgetReported = false;
+    }
+    else if ( over )
+        budgetReported = true;
+
+    if ( !over )
+        return;
+
+    // Data arriving from now on goes to the pool, what is being processed finishes here
+    if ( budgetOffload )
+        EasyMidiLib_getDeviceState(dev)->dispatchDeferred = true;
+
+    if ( listener )
+        listener->callbackOverBudget ( dev, handler, duration );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_setCallbackBudget ( uint64_t budgetNs, bool offload )
+{
+    budgetOffload              = offload;
+    EasyMidiLib_callbackBudget = budgetNs;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_setDispatchDeferred ( const EasyMidiLibDevice* dev, bool deferred )
+{
+    EasyMidiLib_getDeviceState(dev)->dispatchDeferred = deferred;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_isDispatchDeferred ( const EasyMidiLibDevice* dev )
+{
+    return EasyMidiLib_getDeviceState(dev)->dispatchDeferred;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
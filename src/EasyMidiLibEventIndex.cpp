@@ -0,0 +1,178 @@
+#include "EasyMidiLibEventIndex.h"
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static const uint8_t NOTE_TYPES    = 0x07;   // note off, note on, poly pressure
+static const uint8_t CHANNEL_TYPES = 0x7F;
+
+static uint8_t typeBit ( uint8_t status )
+{
+    return status>=0x80 ? (uint8_t)(1<<((status>>4)-8)) : 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibEventIndex::add ( Summary& summary, const EasyMidiLibEvent& event )
+{
+    const uint8_t* data = event.data();
+    uint8_t        type = event.size ? typeBit(data[0]) : 0;
+
+    summary.first  = std::min ( summary.first, event.timestamp );
+    summary.last   = std::max ( summary.last , event.timestamp );
+    summary.types |= type;
+
+    if ( type & CHANNEL_TYPES )
+        summary.channels |= 1<<(data[0] & 0x0F);
+
+    if ( (type & NOTE_TYPES) && event.size>1 )
+    {
+        summary.noteMin = std::min ( summary.noteMin, data[1] );
+        summary.noteMax = std::max ( summary.noteMax, data[1] );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibEventIndex::merge ( Summary& summary, const Summary& other )
+{
+    summary.first     = std::min ( summary.first  , other.first   );
+    summary.last      = std::max ( summary.last   , other.last    );
+    summary.noteMin   = std::min ( summary.noteMin, other.noteMin );
+    summary.noteMax   = std::max ( summary.noteMax, other.noteMax );
+    summary.channels |= other.channels;
+    summary.types    |= other.types;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibEventIndex::mayMatch ( const EasyMidiLibEventQuery& query, const Summary& summary )
+{
+    if ( summary.last<query.from || summary.first>=query.to )
+        return false;
+
+    uint8_t types = summary.types & query.types;
+    if ( types & EASYMIDILIB_EVENT_SYSTEM )
+        return true;
+    if ( !(types & CHANNEL_TYPES) || !(summary.channels & query.channels) )
+        return false;
+
+    // Only note messages can match: their range must meet the query's
+    if ( !(types & ~NOTE_TYPES) )
+        return summary.noteMax>=query.noteMin && summary.noteMin<=query.noteMax;
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibEventIndex::build ( const EasyMidiLibEvent* events, size_t count )
+{
+    clear();
+
+    const Summary empty = { UINT64_MAX, 0, 0, 0, 127, 0 };
+
+    m_events = events;
+    m_count  = count;
+    m_blocks.reserve ( (count+BLOCK_EVENTS-1)/BLOCK_EVENTS );
+
+    for ( size_t i=0; i<count; i+=BLOCK_EVENTS )
+    {
+        Summary block = empty;
+        size_t  end   = std::min ( i+BLOCK_EVENTS, count );
+        for ( size_t e=i; e!=end; e++ )
+            add ( block, events[e] );
+
+        if ( m_blocks.size()%GROUP_BLOCKS==0 )
+            m_groups.push_back ( empty );
+        merge ( m_groups.back(), block );
+        m_blocks.push_back ( block );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibEventIndex::clear ( )
+{
+    m_events = 0;
+    m_count  = 0;
+    m_blocks.clear();
+    m_groups.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibEventIndex::matches ( const EasyMidiLibEventQuery& query, const EasyMidiLibEvent& event ) const
+{
+    if ( event.timestamp<query.from || event.timestamp>=query.to || !event.size )
+        return false;
+    if ( query.device && event.device!=query.device )
+        return false;
+
+    const uint8_t* data = event.data();
+    uint8_t        type = typeBit ( data[0] );
+
+    if ( !(type & query.types) )
+        return false;
+    if ( (type & CHANNEL_TYPES) && !(query.channels & (1<<(data[0] & 0x0F))) )
+        return false;
+    if ( (type & NOTE_TYPES) && event.size>1 && (data[1]<query.noteMin || data[1]>query.noteMax) )
+        return false;
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+size_t EasyMidiLibEventIndex::query ( const EasyMidiLibEventQuery& query, std::vector<EasyMidiLibEventSpan>& spans ) const
+{
+    // First block that ends at or after 'from' (the blocks are in time order)
+    auto   first   = std::lower_bound ( m_blocks.begin(), m_blocks.end(), query.from, []( const Summary& s, uint64_t t ) { return s.last<t; } );
+    size_t block   = first-m_blocks.begin();
+    size_t matched = 0;
+    bool   open    = false;   // the last span may still grow
+
+    while ( block<m_blocks.size() && m_blocks[block].first<query.to )
+    {
+        size_t group = block/GROUP_BLOCKS;
+        if ( block%GROUP_BLOCKS==0 && !mayMatch(query, m_groups[group]) )
+        {
+            block += GROUP_BLOCKS;
+            open   = false;
+            continue;
+        }
+
+        if ( !mayMatch(query, m_blocks[block]) )
+        {
+            block++;
+            open = false;
+            continue;
+        }
+
+        const EasyMidiLibEvent* event = m_events+block*BLOCK_EVENTS;
+        const EasyMidiLibEvent* end   = m_events+std::min((block+1)*BLOCK_EVENTS, m_count);
+
+        for ( ; event!=end; event++ )
+        {
+            if ( !matches(query, *event) )
+            {
+                open = false;
+                continue;
+            }
+
+            if ( open )
+                spans.back().end++;
+            else
+                spans.push_back ( { event, event+1 } );
+
+            open = true;
+            matched++;
+        }
+
+        block++;
+    }
+
+    return matched;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,169 @@
+#ifndef _EASYMIDILIB_EVENTRING_H
+#define _EASYMIDILIB_EVENTRING_H
+
+#include "EasyMidiLib.h"
+#include "EasyMidiLibBroadcast.h"
+#include <atomic>
+#include <vector>
+#include <cstring>
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Overwriting event ring of EasyMidiLibBroadcastRing, EasyMidiLibShmPublisher and EasyMidiLibRetroBuffer (not part of
+// the public API)
+//
+// One producer writes the events in place, into slots and a ring of 64 bit SysEx words, after announcing in 'claimed'
+// and 'sysexClaimed' what it is about to overwrite. Readers copy without locking, then drop whatever was announced while
+// they were copying. The slots are the owner's: they have the timestamp, packed and sysex atomics, the device is stored
+// and loaded by the owner's callbacks. A reader instantiates it with const slots and words.
+//--------------------------------------------------------------------------------------------------------------------------
+
+static const uint64_t EASYMIDILIB_RING_SYSEX = 1ull<<63;   // packed: SysEx flag, size in the high half, message in the low one
+
+inline size_t EasyMidiLib_ringCapacity ( size_t value, size_t minimum )
+{
+    size_t size = minimum;
+    while ( size<value )
+        size *= 2;
+    return size;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+template <class Slot, class Word=std::atomic<uint64_t>>
+struct EasyMidiLibEventRing
+{
+    Slot*    slots;
+    Word*    words;
+    uint64_t slotCount;      // power of two
+    uint64_t wordCount;      // power of two
+    Word*    claimed;        // slots written or being written
+    Word*    sysexClaimed;   // SysEx bytes written or being written
+
+    // Producer: writes 'event' into the slot of 'sequence' and its SysEx at 'sysexHead', which moves past it. false, with
+    // nothing written, when the SysEx is bigger than the ring.
+
+    template <class StoreDevice>
+    bool write ( uint64_t sequence, uint64_t& sysexHead, const EasyMidiLibEvent& event, StoreDevice storeDevice ) const
+    {
+        size_t size = event.sysex ? (event.size+7)/8 : 0;
+        if ( size>wordCount )
+            return false;
+
+        // Announce what gets overwritten before touching it
+        claimed     ->store ( sequence+1, std::memory_order_relaxed );
+        sysexClaimed->store ( sysexHead+size*8, std::memory_order_relaxed );
+        std::atomic_thread_fence ( std::memory_order_release );
+
+        uint32_t msg;
+        memcpy ( &msg, event.msg, 4 );
+
+        Slot& slot = slots[sequence & (slotCount-1)];
+        slot.timestamp.store ( event.timestamp, std::memory_order_relaxed );
+        slot.packed   .store ( (event.sysex ? EASYMIDILIB_RING_SYSEX : 0) | (uint64_t)event.size<<32 | msg, std::memory_order_relaxed );
+        slot.sysex    .store ( sysexHead, std::memory_order_relaxed );
+        storeDevice ( slot );
+
+        for ( size_t w=0; w!=size; w++ )
+        {
+            uint64_t word = 0;
+            memcpy ( &word, event.sysex+w*8, std::min<size_t>(8, event.size-w*8) );
+            words[(sysexHead/8+w) & (wordCount-1)].store ( word, std::memory_order_relaxed );
+        }
+
+        sysexHead += size*8;
+        return true;
+    }
+
+    // Reader: copies the slot of 'sequence' into 'event' and its SysEx to the end of 'data', at 'offset'. Returns the SysEx
+    // position in the ring, UINT64_MAX for none; event.sysex stays 0 since 'data' may still grow.
+
+    template <class LoadDevice>
+    uint64_t read ( uint64_t sequence, EasyMidiLibEvent& event, std::vector<uint8_t>& data, size_t& offset, LoadDevice loadDevice ) const
+    {
+        const Slot& slot   = slots[sequence & (slotCount-1)];
+        uint64_t    packed = slot.packed.load(std::memory_order_relaxed);
+        uint32_t    msg    = (uint32_t)packed;
+
+        event.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+        event.device    = loadDevice ( slot );
+        event.size      = (uint32_t)(packed>>32) & 0x7FFFFFFF;
+        event.sysex     = 0;
+        memcpy ( event.msg, &msg, 4 );
+
+        if ( !(packed & EASYMIDILIB_RING_SYSEX) )
+            return UINT64_MAX;
+
+        // The size of a torn slot can be anything
+        size_t   size     = (size_t)std::min<uint64_t> ( (event.size+7)/8, wordCount );
+        uint64_t position = slot.sysex.load(std::memory_order_relaxed);
+
+        offset = data.size();
+        data.resize ( offset+size*8 );
+        for ( size_t w=0; w!=size; w++ )
+        {
+            uint64_t word = words[(position/8+w) & (wordCount-1)].load(std::memory_order_relaxed);
+            memcpy ( &data[offset+w*8], &word, 8 );
+        }
+
+        return position;
+    }
+
+    // Reader, once done copying: the oldest sequence and SysEx position not overwritten meanwhile
+
+    void valid ( uint64_t& slot, uint64_t& sysex ) const
+    {
+        std::atomic_thread_fence ( std::memory_order_acquire );
+        uint64_t claimedSlots = claimed     ->load(std::memory_order_relaxed);
+        uint64_t claimedBytes = sysexClaimed->load(std::memory_order_relaxed);
+
+        slot  = claimedSlots>slotCount ? claimedSlots-slotCount : 0;
+        sysex = claimedBytes>wordCount*8 ? claimedBytes-wordCount*8 : 0;
+    }
+
+    // Reader of EasyMidiLibBroadcastBatch: copies up to 'batchSize' events from 'cursor' (skipping ahead when lapped) and
+    // drops the torn ones, the oldest, so a prefix of the batch. 'positions' and 'offsets' hold 'batchSize' entries.
+    // Returns the events kept, 0 when the whole batch was overwritten; 'cursor' moves past the batch either way.
+
+    template <class LoadDevice>
+    size_t copy ( uint64_t& cursor, uint64_t published, size_t batchSize, EasyMidiLibBroadcastBatch& batch, std::vector<uint64_t>& positions,
+                  std::vector<size_t>& offsets, LoadDevice loadDevice ) const
+    {
+        if ( published-cursor>slotCount )
+        {
+            batch.lost += published-slotCount-cursor;
+            cursor      = published-slotCount;
+        }
+
+        size_t count = (size_t)std::min<uint64_t> ( published-cursor, batchSize );
+        batch.events.resize ( count );
+        batch.data  .clear();
+
+        for ( size_t i=0; i!=count; i++ )
+            positions[i] = read ( cursor+i, batch.events[i], batch.data, offsets[i], loadDevice );
+
+        uint64_t validSlot, validSysex;
+        valid ( validSlot, validSysex );
+
+        size_t torn = 0;
+        while ( torn!=count && (cursor+torn<validSlot || (positions[torn]!=UINT64_MAX && positions[torn]<validSysex)) )
+            torn++;
+
+        for ( size_t i=torn; i!=count; i++ )
+        {
+            if ( positions[i]!=UINT64_MAX )
+                batch.events[i].sysex = &batch.data[offsets[i]];
+        }
+
+        batch.events.erase ( batch.events.begin(), batch.events.begin()+torn );
+        batch.first  = cursor+torn;
+        batch.lost  += torn;
+        cursor      += count;
+
+        return count-torn;
+    }
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_EVENTRING_H
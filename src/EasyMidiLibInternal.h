@@ -0,0 +1,281 @@
+#ifndef _EASYMIDILIB_INTERNAL_H
+#define _EASYMIDILIB_INTERNAL_H
+
+#include "EasyMidiLib.h"
+#include "EasyMidiLibPool.h"
+#include "EasyMidiLibStats.h"
+#include "EasyMidiLibTrace.h"
+#include "EasyMidiLibCapture.h"
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Platform independent helpers shared by the backends (not part of the public API)
+//--------------------------------------------------------------------------------------------------------------------------
+
+#if EASYMIDILIB_STATS
+
+// Histogram filled from the library threads with relaxed atomics
+
+struct EasyMidiLibHistogramRecorder
+{
+    std::atomic<uint64_t> buckets[EasyMidiLibHistogram::BUCKETS] = {};
+    std::atomic<uint64_t> count {0};
+    std::atomic<uint64_t> sum   {0};
+    std::atomic<uint64_t> min   {UINT64_MAX};
+    std::atomic<uint64_t> max   {0};
+
+    void record   ( uint64_t value );
+    void snapshot ( EasyMidiLibHistogram& histogram ) const;
+    void reset    ( );
+};
+
+struct EasyMidiLibDeviceStats
+{
+    std::atomic<uint64_t>        start    {0};
+    std::atomic<uint64_t>        bytes    {0};
+    std::atomic<uint64_t>        messages {0};
+
+    // Message counting across calls (status bytes and running status)
+    std::atomic<uint8_t>         dataLength {0};
+    std::atomic<uint8_t>         dataSeen   {0};
+    std::atomic<bool>            inSysex    {false};
+
+    EasyMidiLibHistogramRecorder latency;
+    EasyMidiLibHistogramRecorder callback;
+    EasyMidiLibHistogramRecorder write;
+};
+
+#endif
+
+// Platform independent per device state, owned by the backend device and reachable through EasyMidiLibDevice::internalState
+
+struct EasyMidiLibDeviceState
+{
+    std::vector<uint8_t>          inputQueue;
+
+    // Input queue bound and counters (configured and read from any thread)
+    std::atomic<size_t>           queueCapacity;
+    std::atomic<uint8_t>          queuePolicy;
+    std::atomic<uint64_t>         queueBlockTimeout;
+    std::atomic<uint64_t>         queueSize         {0};
+    std::atomic<uint64_t>         queueHighWater    {0};
+    std::atomic<uint64_t>         queueOverflows    {0};
+    std::atomic<uint64_t>         queueDroppedBytes {0};
+    std::atomic<uint64_t>         queueBlockedNs    {0};
+    std::mutex                    queueReadyMutex;                // Block policy wait for EasyMidiLib_inputQueueReady
+    std::condition_variable       queueReady;
+    uint64_t                      queueReadySignals = 0;
+    bool                          queueResync       = false;   // dropping the rest of a message cut by an overflow
+    std::vector<uint8_t>          filtered;                       // the input without the unsubscribed real-time bytes
+
+    // Event framing for the input taps
+    uint8_t                       runningStatus = 0;
+    uint8_t                       pending[3]    = {};
+    uint8_t                       pendingSize   = 0;
+    uint8_t                       pendingNeeded = 0;
+    bool                          inSysex       = false;
+    std::vector<uint8_t>          sysex;
+    std::vector<EasyMidiLibEvent> events;
+    std::vector<uint32_t>         ump;                            // the events translated for a UMP listener
+
+    // Listener processInData state for this device (running status, controller aggregation)
+    EasyMidiLibListener::ParserState parser = {};
+
+    // Set by EasyMidiLib_resetDeviceState while the device is being processed, applied by the processing thread
+    std::atomic<bool>             resetPending      {false};
+
+    // Dispatch: bytes received while the dispatch threads are busy with this device wait in 'pending', bounded by the
+    // queue capacity. A chunk following dropped bytes starts with a resync, like the queue after an overflow.
+    struct PendingChunk { size_t end; uint64_t timestamp; bool resync; };
+
+    std::mutex                    dispatchMutex;                  // held while the data is processed
+    std::mutex                    pendingMutex;
+    std::vector<uint8_t>          pendingData;
+    std::vector<PendingChunk>     pendingChunks;
+    bool                          pendingResync     = false;      // the next chunk follows dropped bytes
+    std::vector<uint8_t>          dispatchData;                   // swapped with pending by the dispatcher
+    std::vector<PendingChunk>     dispatchChunks;
+    EasyMidiLibListener*          pendingListener   = 0;
+    const EasyMidiLibDevice*      device            = 0;
+    std::atomic<bool>             dispatchScheduled {false};      // queued or being processed by a dispatch thread
+    std::condition_variable       dispatchIdle;                   // dispatchScheduled cleared (with pendingMutex)
+    size_t                        dispatchHome      = 0;          // preferred dispatch thread
+    std::atomic<bool>             dispatchDeferred  {false};      // dispatch pool even in Inline mode (watchdog)
+
+    // Storage for payloads kept past the callbacks (allocated from the input thread)
+    EasyMidiLibPool               pool;
+
+    // Begin open/close requests waiting for the worker pool (guarded by the pool mutex)
+    std::deque<std::function<void()>> jobs;
+    bool                          jobsScheduled = false;
+
+#if EASYMIDILIB_STATS
+    EasyMidiLibDeviceStats        stats;
+#endif
+
+    EasyMidiLibDeviceState ( );
+};
+
+inline EasyMidiLibDeviceState* EasyMidiLib_getDeviceState ( const EasyMidiLibDevice* dev ) { return (EasyMidiLibDeviceState*)dev->internalState; }
+
+// Clears the queued input and the framing and parser state (device connected, reconnected or disconnected). Doesn't
+// wait for a thread processing the device: that thread applies the reset before it processes more data.
+
+void EasyMidiLib_resetDeviceState ( const EasyMidiLibDevice* dev );
+
+// Called by the backends with freshly received bytes; 'timestamp' is the EasyMidiLib_getTimestamp() value taken when the
+// data arrived. Depending on the dispatch mode the bytes are processed right away or queued for the dispatch threads.
+
+void EasyMidiLib_deliverInData ( EasyMidiLibListener* listener, const EasyMidiLibDevice* dev, const uint8_t* data, size_t dataSize, uint64_t timestamp );
+
+// Appends the bytes to the device input queue, hands the complete messages to the input taps, delivers the queue to the
+// listener, removes the consumed bytes and applies the queue bound to the rest (one thread at a time per device).
+
+void EasyMidiLib_processInData ( EasyMidiLibListener* listener, const EasyMidiLibDevice* dev, const uint8_t* data, size_t dataSize, uint64_t timestamp );
+
+// Bytes were dropped ahead of the next processInData call: the message they cut is dropped from the queue and the
+// framing, and the data bytes left of it are skipped (processing thread)
+
+void EasyMidiLib_inputGap ( EasyMidiLibDeviceState* state );
+
+// Waits until the dispatch threads are done with a device (input close), and drains and stops them (EasyMidiLib_done)
+
+void EasyMidiLib_waitDeviceDispatch ( const EasyMidiLibDevice* dev );
+void EasyMidiLib_stopDispatch       ( );
+
+// True on a dispatch thread processing a device (not on the device input thread)
+
+bool EasyMidiLib_onDispatchThread ( );
+
+// Waits for the queued Begin open/close requests and stops the worker pool (first thing in EasyMidiLib_done)
+
+void EasyMidiLib_stopWorkers ( );
+
+// Runs 'work' on the calling thread once the input taps being called have returned and the delivery is over (right away
+// outside a delivery), so a tap can hand off long work without holding up the other taps, devices and tap removals
+
+void EasyMidiLib_afterInputTaps ( std::function<void()> work );
+
+// Work run from EasyMidiLib_update() by the library modules that deliver on the user thread
+
+class EasyMidiLibUpdateHook
+{
+    public:
+
+        virtual ~EasyMidiLibUpdateHook ( ) { }
+        virtual void update ( ) = 0;
+};
+
+void EasyMidiLib_addUpdateHook    ( EasyMidiLibUpdateHook* hook );
+void EasyMidiLib_removeUpdateHook ( EasyMidiLibUpdateHook* hook );
+void EasyMidiLib_runUpdateHooks   ( );
+
+// Instrumentation hooks, EasyMidiLib_statsBegin() returns 0 while the stats are disabled and the others do nothing then
+
+#if EASYMIDILIB_STATS
+
+extern std::atomic<bool> EasyMidiLib_statsEnabled;
+
+void EasyMidiLib_recordData        ( const EasyMidiLibDevice* dev, const uint8_t* data, size_t size );
+void EasyMidiLib_recordCallback    ( const EasyMidiLibDevice* dev, uint64_t timestamp, uint64_t begin );
+void EasyMidiLib_recordWrite       ( const EasyMidiLibDevice* dev, uint64_t begin );
+void EasyMidiLib_recordEnumeration ( uint64_t begin );
+
+inline uint64_t EasyMidiLib_statsBegin       ( ) { return EasyMidiLib_statsEnabled.load(std::memory_order_relaxed) ? EasyMidiLib_getTimestamp() : 0; }
+inline void     EasyMidiLib_statsData        ( const EasyMidiLibDevice* dev, const uint8_t* data, size_t size ) { if ( EasyMidiLib_statsEnabled.load(std::memory_order_relaxed) ) EasyMidiLib_recordData ( dev, data, size ); }
+inline void     EasyMidiLib_statsCallback    ( const EasyMidiLibDevice* dev, uint64_t timestamp, uint64_t begin ) { if ( begin ) EasyMidiLib_recordCallback ( dev, timestamp, begin ); }
+inline void     EasyMidiLib_statsWrite       ( const EasyMidiLibDevice* dev, uint64_t begin ) { if ( begin ) EasyMidiLib_recordWrite ( dev, begin ); }
+inline void     EasyMidiLib_statsEnumeration ( uint64_t begin ) { if ( begin ) EasyMidiLib_recordEnumeration ( begin ); }
+
+#else
+
+inline uint64_t EasyMidiLib_statsBegin       ( ) { return 0; }
+inline void     EasyMidiLib_statsData        ( const EasyMidiLibDevice*, const uint8_t*, size_t ) { }
+inline void     EasyMidiLib_statsCallback    ( const EasyMidiLibDevice*, uint64_t, uint64_t ) { }
+inline void     EasyMidiLib_statsWrite       ( const EasyMidiLibDevice*, uint64_t ) { }
+inline void     EasyMidiLib_statsEnumeration ( uint64_t ) { }
+
+#endif
+
+// Callback watchdog: EasyMidiLib_budgetBegin() returns 0 while no budget is set; given a device (the deviceInData and
+// deviceInUmp calls) the call is also watched by the watchdog thread while it runs. EasyMidiLib_budgetEnd() reports a
+// callback over budget; 'whole' marks the deviceInData call, skipped when one of the helpers it ran was already reported.
+
+extern std::atomic<uint64_t> EasyMidiLib_callbackBudget;
+
+void EasyMidiLib_watchBudget ( const EasyMidiLibDevice* dev, const char* handler, uint64_t begin );
+void EasyMidiLib_checkBudget ( EasyMidiLibListener* listener, const EasyMidiLibDevice* dev, const char* handler, uint64_t begin, bool whole );
+
+inline uint64_t EasyMidiLib_budgetBegin ( const EasyMidiLibDevice* watched=0, const char* handler=0 )
+{
+    if ( !EasyMidiLib_callbackBudget.load(std::memory_order_relaxed) )
+        return 0;
+    uint64_t begin = EasyMidiLib_getTimestamp();
+    if ( watched )
+        EasyMidiLib_watchBudget ( watched, handler, begin );
+    return begin;
+}
+
+inline void     EasyMidiLib_budgetEnd   ( EasyMidiLibListener* listener, const EasyMidiLibDevice* dev, const char* handler, uint64_t begin, bool whole=false ) { if ( begin && dev ) EasyMidiLib_checkBudget ( listener, dev, handler, begin, whole ); }
+
+// Tracing hooks: EasyMidiLib_traceBegin() returns 0 while not tracing, EasyMidiLib_traceEnd() records a span from it.
+// 'name' must be a string literal, it's written out later by the flush thread.
+
+#if EASYMIDILIB_TRACE
+
+extern std::atomic<bool> EasyMidiLib_traceEnabled;
+
+void EasyMidiLib_traceRecord ( const char* name, const EasyMidiLibDevice* dev, uint64_t begin, uint64_t end, uint64_t value );
+
+inline uint64_t EasyMidiLib_traceBegin   ( ) { return EasyMidiLib_traceEnabled.load(std::memory_order_relaxed) ? EasyMidiLib_getTimestamp() : 0; }
+inline void     EasyMidiLib_traceEnd     ( const char* name, const EasyMidiLibDevice* dev, uint64_t begin, uint64_t value=0 ) { if ( begin ) EasyMidiLib_traceRecord ( name, dev, begin, EasyMidiLib_getTimestamp(), value ); }
+inline void     EasyMidiLib_traceInstant ( const char* name, const EasyMidiLibDevice* dev, uint64_t time, uint64_t value=0 ) { if ( EasyMidiLib_traceEnabled.load(std::memory_order_relaxed) ) EasyMidiLib_traceRecord ( name, dev, time, 0, value ); }
+
+#else
+
+inline uint64_t EasyMidiLib_traceBegin   ( ) { return 0; }
+inline void     EasyMidiLib_traceEnd     ( const char*, const EasyMidiLibDevice*, uint64_t, uint64_t=0 ) { }
+inline void     EasyMidiLib_traceInstant ( const char*, const EasyMidiLibDevice*, uint64_t, uint64_t=0 ) { }
+
+#endif
+
+// Capture hook: appends the bytes as received to the capture file while one is being written
+
+#if EASYMIDILIB_CAPTURE
+
+extern std::atomic<bool> EasyMidiLib_captureEnabled;
+
+void EasyMidiLib_captureRecord ( const EasyMidiLibDevice* dev, const uint8_t* data, size_t size, uint64_t timestamp );
+
+inline void EasyMidiLib_captureData ( const EasyMidiLibDevice* dev, const uint8_t* data, size_t size, uint64_t timestamp ) { if ( EasyMidiLib_captureEnabled.load(std::memory_order_relaxed) ) EasyMidiLib_captureRecord ( dev, data, size, timestamp ); }
+
+#else
+
+inline void EasyMidiLib_captureData ( const EasyMidiLibDevice*, const uint8_t*, size_t, uint64_t ) { }
+
+#endif
+
+// Applies the EasyMidiLib_setThreadConfig settings of 'role' to a thread the library just started; failures are kept for
+// EasyMidiLib_getRealtimeError()
+
+void EasyMidiLib_configureThread ( std::thread& thread, EasyMidiLibThreadRole role );
+
+// Touches the device buffers after EasyMidiLib_lockMemory so the input path doesn't page fault (device state constructor)
+
+void EasyMidiLib_prefaultDeviceState ( EasyMidiLibDeviceState* state );
+
+// Waits for an absolute EasyMidiLib_getTimestamp() deadline: sleeps until 'spinTime' ns before it and busy waits the rest.
+// Returns false if 'running' was cleared meanwhile; 'now' receives the wake up time.
+
+bool EasyMidiLib_waitUntil ( uint64_t deadline, uint64_t spinTime, const std::atomic<bool>& running, uint64_t& now );
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#endif //_EASYMIDILIB_INTERNAL_H
@@ -0,0 +1,329 @@
+#include "EasyMidiLibLog.h"
+#include <cstdio>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Bounded multi producer ring (a sequence per slot), the writer thread is the only consumer
+//--------------------------------------------------------------------------------------------------------------------------
+
+static const size_t LOG_SLOTS = 2048; // power of two
+
+struct LogSlot
+{
+    std::atomic<uint64_t> sequence;
+    EasyMidiLibLogRecord  record;
+};
+
+std::atomic<uint32_t>          EasyMidiLib_logMasks[5] = { {0}, {0xFFFFFFFF}, {0xFFFFFFFF}, {0xFFFFFFFF}, {0} };
+
+static std::atomic<uint8_t>    logLevel      {(uint8_t)EasyMidiLibLogLevel::Info};
+static std::atomic<uint32_t>   logCategories {0xFFFFFFFF};
+static std::atomic<uint64_t>   logDropped    {0};
+static std::atomic<uint64_t>   logEnqueue    {0};
+static std::atomic<uint64_t>   logWritten    {0};
+static LogSlot*                logSlots      = 0;
+static std::once_flag          logOnce;
+static std::mutex              logMutex;      // sink, writer wake up and flush
+static std::condition_variable logWake;
+static std::condition_variable logDone;
+static EasyMidiLibLogSink      logSink;
+static bool                    logStop       = false;
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void writeArg ( std::string& out, const char* spec, size_t specSize, const EasyMidiLibLogRecord& record, size_t arg )
+{
+    char conversion = spec[specSize-1];
+    char format[32];
+    char buffer[128];
+
+    // Keep flags, width and precision, replace the length modifiers with the stored width
+    size_t length = 0;
+    for ( size_t i=0; i!=specSize-1 && length<sizeof(format)-4; i++ )
+        if ( !strchr("hlLqjzt", spec[i]) )
+            format[length++] = spec[i];
+
+    uint64_t value = record.values[arg];
+
+    switch ( record.types[arg] )
+    {
+        case EasyMidiLibLogRecord::String:
+            out.append ( record.text+(value>>8), value & 0xFF );
+            return;
+
+        case EasyMidiLibLogRecord::Bytes:
+            for ( size_t i=0; i!=(value & 0xFF); i++ )
+            {
+                snprintf ( buffer, sizeof(buffer), "%02X ", (uint8_t)record.text[(value>>8)+i] );
+                out += buffer;
+            }
+            return;
+
+        case EasyMidiLibLogRecord::Double:
+        {
+            double d;
+            memcpy ( &d, &value, sizeof(d) );
+            if ( !strchr("eEfFgGaA", conversion) )
+                conversion = 'g';
+            format[length++] = conversion;
+            format[length]   = 0;
+            snprintf ( buffer, sizeof(buffer), format, d );
+            break;
+        }
+
+        case EasyMidiLibLogRecord::Pointer:
+            format[length++] = 'p';
+            format[length]   = 0;
+            snprintf ( buffer, sizeof(buffer), format, (void*)(uintptr_t)value );
+            break;
+
+        default:
+            if ( strchr("eEfFgGaA", conversion) )
+            {
+                format[length++] = conversion;
+                format[length]   = 0;
+                snprintf ( buffer, sizeof(buffer), format, record.types[arg]==EasyMidiLibLogRecord::Signed ? (double)(int64_t)value : (double)value );
+                break;
+            }
+
+            if ( !strchr("diouxXc", conversion) )
+                conversion = record.types[arg]==EasyMidiLibLogRecord::Signed ? 'd' : 'u';
+            format[length++] = 'l';
+            format[length++] = 'l';
+            format[length++] = conversion;
+            format[length]   = 0;
+            if ( conversion=='c' )
+                snprintf ( buffer, sizeof(buffer), "%c", (int)value );
+            else
+                snprintf ( buffer, sizeof(buffer), format, (long long)value );
+            break;
+    }
+
+    out += buffer;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void formatRecord ( std::string& out, const EasyMidiLibLogRecord& record )
+{
+    size_t arg = 0;
+    out.clear();
+
+    for ( const char* c=record.format; *c; c++ )
+    {
+        if ( *c!='%' )
+        {
+            out += *c;
+            continue;
+        }
+
+        if ( c[1]=='%' )
+        {
+            out += '%';
+            c++;
+            continue;
+        }
+
+        const char* spec = c;
+        while ( c[1] && !strchr("diouxXcseEfFgGaAp", c[1]) )
+            c++;
+        if ( !c[1] )
+            break;
+        c++;
+
+        if ( arg<record.count )
+            writeArg ( out, spec, c-spec+1, record, arg++ );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void writerThreadFunc ( )
+{
+    std::string text;
+    uint64_t    position = 0;
+
+    std::unique_lock<std::mutex> lock(logMutex);
+    for ( ;; )
+    {
+        // Producers don't signal (that would need a lock), the writer polls
+        logWake.wait_for ( lock, std::chrono::milliseconds(5) );
+
+        for ( ;; )
+        {
+            LogSlot& slot = logSlots[position & (LOG_SLOTS-1)];
+            if ( slot.sequence.load(std::memory_order_acquire)!=position+1 )
+                break;
+
+            formatRecord ( text, slot.record );
+            EasyMidiLibLogLevel    level    = slot.record.level;
+            EasyMidiLibLogCategory category = slot.record.category;
+            slot.sequence.store ( position+LOG_SLOTS, std::memory_order_release );
+            position++;
+
+            if ( logSink )
+                logSink ( level, category, text.c_str() );
+            else
+            {
+                fputs ( text.c_str(), stdout );
+                fputc ( '\n', stdout );
+            }
+        }
+
+        if ( !logSink )
+            fflush ( stdout );
+
+        logWritten.store ( position, std::memory_order_release );
+        logDone.notify_all();
+
+        if ( logStop )
+            break;
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct LogWriter
+{
+    std::thread thread;
+
+    ~LogWriter ( )
+    {
+        if ( !thread.joinable() )
+            return;
+
+        {
+            std::lock_guard<std::mutex> lock(logMutex);
+            logStop = true;
+        }
+        logWake.notify_all();
+        thread.join();
+    }
+};
+
+static LogWriter logWriter;
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void startWriter ( )
+{
+    logSlots = new LogSlot[LOG_SLOTS];
+    for ( size_t i=0; i!=LOG_SLOTS; i++ )
+        logSlots[i].sequence.store ( i, std::memory_order_relaxed );
+
+    logWriter.thread = std::thread(writerThreadFunc);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_logPush ( const EasyMidiLibLogRecord& record )
+{
+    std::call_once ( logOnce, startWriter );
+
+    uint64_t position = logEnqueue.load(std::memory_order_relaxed);
+    LogSlot* slot;
+
+    for ( ;; )
+    {
+        slot = &logSlots[position & (LOG_SLOTS-1)];
+        int64_t diff = (int64_t)(slot->sequence.load(std::memory_order_acquire)-position);
+
+        if ( diff==0 )
+        {
+            if ( logEnqueue.compare_exchange_weak(position, position+1, std::memory_order_relaxed) )
+                break;
+        }
+        else if ( diff<0 )
+        {
+            logDropped.fetch_add ( 1, std::memory_order_relaxed );
+            return;
+        }
+        else
+            position = logEnqueue.load(std::memory_order_relaxed);
+    }
+
+    // Only the used part of the text is copied
+    memcpy ( &slot->record, &record, offsetof(EasyMidiLibLogRecord, text)+record.textUsed );
+    slot->sequence.store ( position+1, std::memory_order_release );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// API
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void updateMasks ( )
+{
+    uint8_t  level      = logLevel;
+    uint32_t categories = logCategories;
+
+    for ( uint8_t i=1; i!=5; i++ )
+        EasyMidiLib_logMasks[i].store ( i<=level ? categories : 0, std::memory_order_relaxed );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_setLogLevel ( EasyMidiLibLogLevel level )
+{
+    logLevel = (uint8_t)level;
+    updateMasks();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibLogLevel EasyMidiLib_getLogLevel ( )
+{
+    return (EasyMidiLibLogLevel)logLevel.load();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_setLogCategories ( uint32_t mask )
+{
+    logCategories = mask;
+    updateMasks();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint32_t EasyMidiLib_getLogCategories ( )
+{
+    return logCategories;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_setLogSink ( EasyMidiLibLogSink sink )
+{
+    std::lock_guard<std::mutex> lock(logMutex);
+    logSink = sink;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_logFlush ( )
+{
+    if ( !logSlots || std::this_thread::get_id()==logWriter.thread.get_id() )
+        return;
+
+    // Slots claimed but not yet filled hold the writer back, so waiting for the claimed position is enough
+    uint64_t target = logEnqueue.load(std::memory_order_acquire);
+
+    std::unique_lock<std::mutex> lock(logMutex);
+    while ( logWritten.load(std::memory_order_acquire)<target && !logStop )
+    {
+        logWake.notify_all();
+        logDone.wait_for ( lock, std::chrono::milliseconds(5) );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLib_logDropped ( )
+{
+    return logDropped;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,267 @@
+#include "EasyMidiLibMerge.h"
+#include "EasyMidiLibPool.h"
+#include "EasyMidiLibInternal.h"
+#include <deque>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <cassert>
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibMergedStream::Source
+{
+    std::mutex                    mutex;
+    std::vector<EasyMidiLibEvent> incoming;   // filled by the input thread, SysEx payloads in the device pool
+    std::deque<EasyMidiLibEvent>  pending;    // consumer side, ordered by timestamp
+
+    ~Source ( )
+    {
+        for ( const EasyMidiLibEvent& event : incoming )
+            EasyMidiLibPool::release ( event );
+        for ( const EasyMidiLibEvent& event : pending )
+            EasyMidiLibPool::release ( event );
+    }
+};
+
+struct EasyMidiLibMergedStream::UpdateHook : public EasyMidiLibUpdateHook
+{
+    EasyMidiLibMergedStream* stream;
+
+    UpdateHook ( EasyMidiLibMergedStream* s ) : stream(s) { }
+    void update ( ) override { stream->poll(); }
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibMergedStream::EasyMidiLibMergedStream ( )
+{
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibMergedStream::~EasyMidiLibMergedStream ( )
+{
+    // The derived consumer is already destroyed here: a delivery thread or update hook still running could call
+    // mergedEvents() on it. Without the assert, stop them anyway and skip the final delivery.
+    assert ( !m_started && "EasyMidiLibMergedStream: call stop() in the derived destructor" );
+    if ( m_started )
+    {
+        EasyMidiLib_removeInputTap ( this );
+        if ( m_updateHook )
+            EasyMidiLib_removeUpdateHook ( m_updateHook.get() );
+        m_threadRunning = false;
+        if ( m_thread.joinable() )
+            m_thread.join();
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibMergedStream::start ( EasyMidiLibMergeDelivery delivery, uint64_t reorderWindow, size_t batchSize )
+{
+    if ( m_started )
+        return false;
+
+    m_delivery      = delivery;
+    m_reorderWindow = reorderWindow;
+    m_batchSize     = batchSize ? batchSize : 1;
+    m_lastTimestamp = 0;
+    m_merged        = 0;
+    m_late          = 0;
+    m_batch.reserve(m_batchSize);
+    m_started       = true;
+
+    EasyMidiLib_addInputTap ( this );
+
+    if ( delivery==EasyMidiLibMergeDelivery::Update )
+    {
+        m_updateHook.reset ( new UpdateHook(this) );
+        EasyMidiLib_addUpdateHook ( m_updateHook.get() );
+    }
+    else if ( delivery==EasyMidiLibMergeDelivery::Thread )
+    {
+        m_threadRunning = true;
+        m_thread = std::thread(&EasyMidiLibMergedStream::threadFunc, this);
+        EasyMidiLib_configureThread ( m_thread, EasyMidiLibThreadRole::Timing );
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMergedStream::stop ( )
+{
+    if ( !m_started )
+        return;
+
+    EasyMidiLib_removeInputTap ( this );
+
+    if ( m_updateHook )
+    {
+        EasyMidiLib_removeUpdateHook ( m_updateHook.get() );
+        m_updateHook.reset();
+    }
+
+    if ( m_threadRunning )
+    {
+        m_threadRunning = false;
+        if ( m_thread.joinable() )
+            m_thread.join();
+    }
+
+    poll ( true );
+
+    std::lock_guard<std::mutex> lock(m_sourcesMutex);
+    m_sources.clear();
+    m_started = false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMergedStream::inputEvents ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count )
+{
+    EasyMidiLibPool* pool = EasyMidiLib_getInputPool ( dev );
+    Source*          source;
+    {
+        std::lock_guard<std::mutex> lock(m_sourcesMutex);
+        std::unique_ptr<Source>& s = m_sources[dev];
+        if ( !s )
+            s.reset ( new Source );
+        source = s.get();
+    }
+
+    std::lock_guard<std::mutex> lock(source->mutex);
+    for ( size_t i=0; i!=count; i++ )
+    {
+        // SysEx payloads only live during the tap callback
+        EasyMidiLibEvent event = events[i];
+        if ( event.sysex && pool )
+        {
+            event = pool->retain ( event );
+            if ( !event.sysex )
+                continue;
+        }
+        source->incoming.push_back ( event );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+size_t EasyMidiLibMergedStream::poll ( bool flushAll )
+{
+    std::lock_guard<std::mutex> pollLock(m_pollMutex);
+
+    uint64_t now   = EasyMidiLib_getTimestamp();
+    uint64_t limit = flushAll ? UINT64_MAX : ( now>m_reorderWindow ? now-m_reorderWindow : 0 );
+
+    // Collect what the input threads queued
+    std::vector<Source*> sources;
+    {
+        std::lock_guard<std::mutex> lock(m_sourcesMutex);
+        for ( auto& it : m_sources )
+        {
+            Source* source = it.second.get();
+            std::lock_guard<std::mutex> sourceLock(source->mutex);
+            source->pending.insert ( source->pending.end(), source->incoming.begin(), source->incoming.end() );
+            source->incoming.clear();
+            sources.push_back(source);
+        }
+    }
+
+    // K-way merge of the per device queues (each one already in timestamp order)
+    typedef std::pair<uint64_t,size_t> HeapItem;
+    std::vector<HeapItem> heap;
+    for ( size_t i=0; i!=sources.size(); i++ )
+        if ( !sources[i]->pending.empty() )
+            heap.push_back ( HeapItem(sources[i]->pending.front().timestamp, i) );
+    std::make_heap ( heap.begin(), heap.end(), std::greater<HeapItem>() );
+
+    size_t delivered = 0;
+    m_batch.clear();
+
+    while ( !heap.empty() && heap.front().first<=limit )
+    {
+        std::pop_heap ( heap.begin(), heap.end(), std::greater<HeapItem>() );
+        size_t  index  = heap.back().second;
+        Source* source = sources[index];
+        heap.pop_back();
+
+        m_batch.push_back ( source->pending.front() );
+        source->pending.pop_front();
+
+        if ( !source->pending.empty() )
+        {
+            heap.push_back ( HeapItem(source->pending.front().timestamp, index) );
+            std::push_heap ( heap.begin(), heap.end(), std::greater<HeapItem>() );
+        }
+
+        if ( m_batch.size()==m_batchSize )
+        {
+            delivered += m_batch.size();
+            deliver();
+        }
+    }
+
+    delivered += m_batch.size();
+    deliver();
+
+    return delivered;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMergedStream::deliver ( )
+{
+    if ( m_batch.empty() )
+        return;
+
+    for ( const EasyMidiLibEvent& event : m_batch )
+    {
+        if ( event.timestamp<m_lastTimestamp )
+            m_late++;
+        else
+            m_lastTimestamp = event.timestamp;
+    }
+
+    m_merged += m_batch.size();
+    mergedEvents ( m_batch.data(), m_batch.size() );
+
+    for ( const EasyMidiLibEvent& event : m_batch )
+        EasyMidiLibPool::release ( event );
+    m_batch.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibMergeStats EasyMidiLibMergedStream::getStats ( ) const
+{
+    EasyMidiLibMergeStats stats = {};
+    stats.merged = m_merged;
+    stats.late   = m_late;
+
+    std::lock_guard<std::mutex> lock(m_sourcesMutex);
+    for ( auto& it : m_sources )
+    {
+        std::lock_guard<std::mutex> sourceLock(it.second->mutex);
+        stats.pending += it.second->incoming.size() + it.second->pending.size();
+    }
+
+    return stats;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMergedStream::threadFunc ( )
+{
+    uint64_t interval = std::max<uint64_t>(100000, std::min<uint64_t>(1000000, m_reorderWindow/4));
+
+    while ( m_threadRunning )
+    {
+        poll();
+        std::this_thread::sleep_for(std::chrono::nanoseconds(interval));
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,406 @@
+#include "EasyMidiLibMpe.h"
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static const float MEMBER_BEND_RANGE  = 48.0f;
+static const float MANAGER_BEND_RANGE = 2.0f;
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibMpe::EasyMidiLibMpe ( )
+    : m_channels(), m_voices(), m_active(), m_activePos(), m_changed(), m_dirty()
+{
+    configureZones ( 0, 0 );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibMpe::~EasyMidiLibMpe ( )
+{
+    stop();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::configureZones ( uint8_t lowerMembers, uint8_t upperMembers )
+{
+    m_lowerMembers = std::min<uint8_t> ( lowerMembers, 15 );
+    m_upperMembers = std::min<uint8_t> ( upperMembers, 15 );
+
+    for ( uint8_t ch=0; ch!=16; ch++ )
+    {
+        Channel& c = m_channels[ch];
+        c.manager  = false;
+        c.paramMsb = 127;
+        c.paramLsb = 127;
+
+        if ( m_lowerMembers && ch<=m_lowerMembers )
+        {
+            c.zone    = EasyMidiLibMpeZone::Lower;
+            c.manager = ch==0;
+        }
+        else if ( m_upperMembers && ch>=15-m_upperMembers )
+        {
+            c.zone    = EasyMidiLibMpeZone::Upper;
+            c.manager = ch==15;
+        }
+        else
+            c.zone    = EasyMidiLibMpeZone::None;
+
+        c.bendRange = c.zone!=EasyMidiLibMpeZone::None && !c.manager ? MEMBER_BEND_RANGE : MANAGER_BEND_RANGE;
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::setZones ( uint8_t lowerMembers, uint8_t upperMembers )
+{
+    lowerMembers = std::min<uint8_t> ( lowerMembers, 15 );
+    upperMembers = std::min<uint8_t> ( upperMembers, lowerMembers>=14 ? 0 : 14-lowerMembers );
+
+    configureZones ( lowerMembers, upperMembers );
+    zonesChanged   ( m_lowerMembers, m_upperMembers );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint8_t EasyMidiLibMpe::getZoneMembers ( EasyMidiLibMpeZone zone ) const
+{
+    return zone==EasyMidiLibMpeZone::Lower ? m_lowerMembers : zone==EasyMidiLibMpeZone::Upper ? m_upperMembers : 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::reset ( )
+{
+    for ( size_t i=0; i!=m_activeCount; i++ )
+        m_voices[m_active[i]].active = false;
+
+    for ( Channel& c : m_channels )
+    {
+        c.bend     = 0;
+        c.pressure = 0;
+        c.timbre   = 0;
+        c.voices   = 0;
+    }
+
+    for ( size_t i=0; i!=m_changedCount; i++ )
+        m_dirty[m_changed[i]] = false;
+
+    m_activeCount  = 0;
+    m_changedCount = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::start ( const EasyMidiLibDevice* dev )
+{
+    m_device = dev;
+    if ( m_started )
+        return;
+
+    m_started = true;
+    EasyMidiLib_addInputTap ( this );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::stop ( )
+{
+    if ( !m_started )
+        return;
+
+    EasyMidiLib_removeInputTap ( this );
+    m_started = false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::inputEvents ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count )
+{
+    if ( dev==m_device )
+        process ( events, count );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::process ( const EasyMidiLibEvent* events, size_t count )
+{
+    for ( size_t i=0; i!=count; i++ )
+    {
+        const EasyMidiLibEvent& event = events[i];
+        const uint8_t*          data  = event.data();
+
+        if ( event.size<2 || data[0]<0x80 || data[0]>=0xF0 )
+            continue;
+
+        uint8_t  ch = data[0] & 0x0F;
+        uint8_t  d1 = data[1] & 0x7F;
+        uint8_t  d2 = event.size>2 ? data[2] & 0x7F : 0;
+        uint64_t ts = event.timestamp;
+
+        switch ( data[0] & 0xF0 )
+        {
+            case 0x80: noteOff ( ch, d1, d2, ts ); break;
+            case 0x90: d2 ? noteOn ( ch, d1, d2, ts ) : noteOff ( ch, d1, 64, ts ); break;
+            case 0xB0: controlChange ( ch, d1, d2, ts ); break;
+
+            case 0xA0:
+            {
+                // Poly pressure only moves its own note
+                EasyMidiLibMpeVoice& voice = m_voices[ch*128+d1];
+                if ( voice.active )
+                {
+                    voice.pressure  = d2/127.0f;
+                    voice.timestamp = ts;
+                    noteExpression ( voice, EasyMidiLibMpeExpression::Pressure );
+                    touch ( ch*128+d1 );
+                }
+                break;
+            }
+
+            case 0xD0:
+                m_channels[ch].pressure = d1/127.0f;
+                channelExpression ( ch, EasyMidiLibMpeExpression::Pressure, ts );
+                break;
+
+            case 0xE0:
+                m_channels[ch].bend = ((d1 | d2<<7)-8192)/8192.0f;
+                channelExpression ( ch, EasyMidiLibMpeExpression::Pitch, ts );
+                break;
+        }
+    }
+
+    // One snapshot of the voices the block changed
+    if ( m_changedCount )
+    {
+        for ( size_t i=0; i!=m_changedCount; i++ )
+        {
+            m_block[i] = m_voices[m_changed[i]];
+            m_dirty[m_changed[i]] = false;
+        }
+
+        size_t changed = m_changedCount;
+        m_changedCount = 0;
+        voicesBlock ( m_block, changed );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::controlChange ( uint8_t channel, uint8_t controller, uint8_t value, uint64_t timestamp )
+{
+    Channel& c = m_channels[channel];
+
+    switch ( controller )
+    {
+        case 101: c.paramMsb = value; break;
+        case 100: c.paramLsb = value; break;
+        case 99 :
+        case 98 : c.paramMsb = 127;   break;   // NRPN, no RPN selected
+
+        case 74:
+            c.timbre = value/127.0f;
+            channelExpression ( channel, EasyMidiLibMpeExpression::Timbre, timestamp );
+            break;
+
+        case 120:
+        case 123:
+            allNotesOff ( channel, timestamp );
+            break;
+
+        case 6 :
+        case 38:
+        {
+            if ( c.paramMsb!=0 )
+                break;
+
+            // MPE Configuration Message, on the manager channels only
+            if ( c.paramLsb==6 && controller==6 && (channel==0 || channel==15) )
+            {
+                uint8_t lower = m_lowerMembers;
+                uint8_t upper = m_upperMembers;
+                if ( channel==0 )
+                {
+                    lower = std::min<uint8_t> ( value, 15 );
+                    upper = std::min<uint8_t> ( upper, lower>=14 ? 0 : 14-lower );
+                }
+                else
+                {
+                    upper = std::min<uint8_t> ( value, 15 );
+                    lower = std::min<uint8_t> ( lower, upper>=14 ? 0 : 14-upper );
+                }
+
+                configureZones ( lower, upper );
+                zonesChanged   ( m_lowerMembers, m_upperMembers );
+                break;
+            }
+
+            // Pitch bend sensitivity: semitones on the MSB (cents reset), cents on the LSB
+            if ( c.paramLsb==0 )
+            {
+                float range = controller==6 ? value : (int)c.bendRange+std::min<uint8_t>(value, 99)/100.0f;
+
+                // On a member channel it applies to all the members of the zone
+                bool zoneWide = c.zone!=EasyMidiLibMpeZone::None && !c.manager;
+                for ( uint8_t ch=0; ch!=16; ch++ )
+                {
+                    Channel& other = m_channels[ch];
+                    if ( ch==channel || (zoneWide && other.zone==c.zone && !other.manager) )
+                    {
+                        other.bendRange = range;
+                        channelExpression ( ch, EasyMidiLibMpeExpression::Pitch, timestamp );
+                    }
+                }
+            }
+            break;
+        }
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::noteOn ( uint8_t channel, uint8_t note, uint8_t velocity, uint64_t timestamp )
+{
+    size_t               index = channel*128+note;
+    EasyMidiLibMpeVoice& voice = m_voices[index];
+    const Channel&       c     = m_channels[channel];
+
+    // Retriggered without a note off
+    if ( voice.active )
+        noteOff ( channel, note, 64, timestamp );
+
+    voice.id              = m_nextId++;
+    voice.timestamp       = timestamp;
+    voice.zone            = c.zone;
+    voice.channel         = channel;
+    voice.note            = note;
+    voice.velocity        = velocity;
+    voice.releaseVelocity = 0;
+    voice.active          = true;
+    voice.bend            = c.bend*c.bendRange;
+    voice.pitch           = note+voice.bend+zoneBend(channel);
+    voice.pressure        = c.pressure;
+    voice.timbre          = c.timbre;
+
+    m_activePos[index]          = (uint16_t)m_activeCount;
+    m_active[m_activeCount++]   = (uint16_t)index;
+    m_channels[channel].voices++;
+
+    noteStart ( voice );
+    touch     ( index );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::noteOff ( uint8_t channel, uint8_t note, uint8_t velocity, uint64_t timestamp )
+{
+    size_t               index = channel*128+note;
+    EasyMidiLibMpeVoice& voice = m_voices[index];
+    if ( !voice.active )
+        return;
+
+    voice.active          = false;
+    voice.releaseVelocity = velocity;
+    voice.timestamp       = timestamp;
+
+    // Swap the last active voice into the hole
+    uint16_t last = m_active[--m_activeCount];
+    m_active   [m_activePos[index]] = last;
+    m_activePos[last]               = m_activePos[index];
+    m_channels[channel].voices--;
+
+    noteEnd ( voice );
+    touch   ( index );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::allNotesOff ( uint8_t channel, uint64_t timestamp )
+{
+    const Channel& c = m_channels[channel];
+
+    // Backwards, the removal only moves voices already visited
+    for ( size_t i=m_activeCount; i--; )
+    {
+        const EasyMidiLibMpeVoice& voice = m_voices[m_active[i]];
+        if ( voice.channel==channel || (c.manager && m_channels[voice.channel].zone==c.zone) )
+            noteOff ( voice.channel, voice.note, 64, timestamp );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::channelExpression ( uint8_t channel, EasyMidiLibMpeExpression expression, uint64_t timestamp )
+{
+    const Channel& c = m_channels[channel];
+
+    // The manager's bend moves the whole zone, its pressure and timbre aren't per note
+    if ( c.manager && expression==EasyMidiLibMpeExpression::Pitch )
+    {
+        for ( size_t i=0; i!=m_activeCount; i++ )
+        {
+            EasyMidiLibMpeVoice& voice = m_voices[m_active[i]];
+            if ( m_channels[voice.channel].zone==c.zone )
+                updateVoice ( voice, expression, timestamp );
+        }
+        return;
+    }
+
+    if ( !c.voices || c.manager )
+        return;
+
+    for ( size_t i=0; i!=m_activeCount; i++ )
+    {
+        EasyMidiLibMpeVoice& voice = m_voices[m_active[i]];
+        if ( voice.channel==channel )
+            updateVoice ( voice, expression, timestamp );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::updateVoice ( EasyMidiLibMpeVoice& voice, EasyMidiLibMpeExpression expression, uint64_t timestamp )
+{
+    const Channel& c = m_channels[voice.channel];
+
+    switch ( expression )
+    {
+        case EasyMidiLibMpeExpression::Pitch:
+            voice.bend  = c.bend*c.bendRange;
+            voice.pitch = voice.note+voice.bend+zoneBend(voice.channel);
+            break;
+        case EasyMidiLibMpeExpression::Pressure: voice.pressure = c.pressure; break;
+        case EasyMidiLibMpeExpression::Timbre  : voice.timbre   = c.timbre;   break;
+    }
+
+    voice.timestamp = timestamp;
+    noteExpression ( voice, expression );
+    touch ( voice.channel*128+voice.note );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMpe::touch ( size_t index )
+{
+    if ( m_dirty[index] )
+        return;
+
+    m_dirty  [index]            = true;
+    m_changed[m_changedCount++] = (uint16_t)index;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+float EasyMidiLibMpe::zoneBend ( uint8_t channel ) const
+{
+    const Channel& c = m_channels[channel];
+    if ( c.zone==EasyMidiLibMpeZone::None || c.manager )
+        return 0;
+
+    const Channel& manager = m_channels[c.zone==EasyMidiLibMpeZone::Lower ? 0 : 15];
+    return manager.bend*manager.bendRange;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
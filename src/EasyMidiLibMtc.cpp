@@ -0,0 +1,397 @@
+#include "EasyMidiLibMtc.h"
+#include "EasyMidiLibInternal.h"
+#include <cmath>
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static const double FRAMES_PER_QF   = 0.25;
+static const double MAX_EXTRAPOLATE = 1.5;     // quarter frames extrapolated past the last one received
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static int nominalFps ( EasyMidiLibMtcRate rate )
+{
+    switch ( rate )
+    {
+        case EasyMidiLibMtcRate::Fps24      : return 24;
+        case EasyMidiLibMtcRate::Fps25      : return 25;
+        case EasyMidiLibMtcRate::Fps2997Drop: return 30;
+        case EasyMidiLibMtcRate::Fps30      : return 30;
+    }
+    return 25;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static int64_t framesPerDay ( EasyMidiLibMtcRate rate )
+{
+    if ( rate==EasyMidiLibMtcRate::Fps2997Drop )
+        return 24 * 6 * 17982;
+
+    return (int64_t)24 * 3600 * nominalFps(rate);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+double EasyMidiLibMtc_getFrameRate ( EasyMidiLibMtcRate rate )
+{
+    if ( rate==EasyMidiLibMtcRate::Fps2997Drop )
+        return 30000.0 / 1001.0;
+
+    return nominalFps(rate);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+int64_t EasyMidiLibMtc_timecodeToFrames ( const EasyMidiLibTimecode& tc )
+{
+    int64_t fps     = nominalFps(tc.rate);
+    int64_t frames  = ((int64_t)tc.hours*3600 + tc.minutes*60 + tc.seconds) * fps + tc.frames;
+
+    // Drop frame skips frame numbers 0 and 1 every minute except every tenth minute
+    if ( tc.rate==EasyMidiLibMtcRate::Fps2997Drop )
+    {
+        int64_t totalMinutes = (int64_t)tc.hours*60 + tc.minutes;
+        frames -= 2 * (totalMinutes - totalMinutes/10);
+    }
+
+    return frames;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibTimecode EasyMidiLibMtc_framesToTimecode ( int64_t frames, EasyMidiLibMtcRate rate )
+{
+    int64_t day = framesPerDay(rate);
+    frames %= day;
+    if ( frames<0 )
+        frames += day;
+
+    if ( rate==EasyMidiLibMtcRate::Fps2997Drop )
+    {
+        int64_t tenMinutes = frames / 17982;
+        int64_t rest       = frames % 17982;
+        frames += 18*tenMinutes;
+        if ( rest>=2 )
+            frames += 2 * ((rest-2) / 1798);
+    }
+
+    int64_t fps = nominalFps(rate);
+
+    EasyMidiLibTimecode tc;
+    tc.frames  = (uint8_t)( frames % fps );
+    tc.seconds = (uint8_t)( frames / fps % 60 );
+    tc.minutes = (uint8_t)( frames / (fps*60) % 60 );
+    tc.hours   = (uint8_t)( frames / (fps*3600) % 24 );
+    tc.rate    = rate;
+
+    return tc;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibMtcDecoder
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibMtcDecoder::EasyMidiLibMtcDecoder ( )
+{
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMtcDecoder::reset ( )
+{
+    std::fill ( m_pieces, m_pieces+8, 0 );
+    m_lastPiece    = -1;
+    m_seqDirection = 0;
+    m_seqCount     = 0;
+    m_locked       = false;
+    m_synced       = false;
+    m_anchorFrames = 0.0;
+    m_anchorTime   = 0;
+    m_lastQfTime   = 0;
+    m_qfPeriod     = 0.0;
+    publish();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMtcDecoder::processQuarterFrame ( uint8_t data, uint64_t timestamp )
+{
+    int     piece  = (data>>4) & 7;
+    uint8_t nibble = data & 0x0F;
+
+    // Dropout, the running position is no longer trusted until the next complete sequence
+    bool dropout = m_lastQfTime && timestamp-m_lastQfTime > m_dropoutTimeout;
+    if ( dropout )
+    {
+        m_synced    = false;
+        m_lastPiece = -1;
+        m_qfPeriod  = 0.0;
+    }
+
+    // Direction from the piece order
+    int direction = 0;
+    if ( m_lastPiece>=0 )
+    {
+        if ( piece==((m_lastPiece+1)&7) )
+            direction = 1;
+        else if ( piece==((m_lastPiece+7)&7) )
+            direction = -1;
+    }
+
+    if ( direction!=m_seqDirection )
+    {
+        // The previous piece already belongs to the new run
+        m_seqCount     = direction!=0 ? 1 : 0;
+        m_seqDirection = direction;
+        if ( direction==0 )
+            m_synced = false;
+    }
+
+    // Quarter frame period (smoothed)
+    if ( direction!=0 )
+    {
+        double dt = (double)(timestamp - m_lastQfTime);
+        m_qfPeriod = m_qfPeriod>0.0 ? m_qfPeriod + (dt-m_qfPeriod)*0.125 : dt;
+    }
+
+    m_pieces[piece] = nibble;
+    m_lastPiece     = piece;
+    m_lastQfTime    = timestamp;
+    m_seqCount++;
+
+    // Every quarter frame moves the position a quarter of a frame
+    if ( m_synced )
+    {
+        m_anchorFrames += direction * FRAMES_PER_QF;
+        m_anchorTime    = timestamp;
+    }
+
+    // Complete sequence (0..7 forward, 7..0 reverse)
+    bool complete = m_seqCount>=8 && ( (direction>0 && piece==7) || (direction<0 && piece==0) );
+    if ( complete )
+    {
+        EasyMidiLibTimecode tc;
+        tc.frames  = (uint8_t)( m_pieces[0] | ((m_pieces[1]&0x1)<<4) );
+        tc.seconds = (uint8_t)( m_pieces[2] | ((m_pieces[3]&0x3)<<4) );
+        tc.minutes = (uint8_t)( m_pieces[4] | ((m_pieces[5]&0x3)<<4) );
+        tc.hours   = (uint8_t)( m_pieces[6] | ((m_pieces[7]&0x1)<<4) );
+        tc.rate    = (EasyMidiLibMtcRate)( (m_pieces[7]>>1) & 0x3 );
+
+        // The encoded time is the one of piece 0, each later piece is a quarter frame after it
+        m_rate         = tc.rate;
+        m_anchorFrames = (double)EasyMidiLibMtc_timecodeToFrames(tc) + piece*FRAMES_PER_QF;
+        m_anchorTime   = timestamp;
+        m_locked       = true;
+        m_synced       = true;
+    }
+
+    publish();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibMtcDecoder::processSysEx ( const uint8_t* data, size_t size, uint64_t timestamp )
+{
+    // Full frame: F0 7F <device> 01 01 hh mm ss ff F7
+    if ( size<10 || data[0]!=0xF0 || data[1]!=0x7F || data[3]!=0x01 || data[4]!=0x01 || data[9]!=0xF7 )
+        return false;
+
+    EasyMidiLibTimecode tc;
+    tc.hours   = data[5] & 0x1F;
+    tc.rate    = (EasyMidiLibMtcRate)( (data[5]>>5) & 0x3 );
+    tc.minutes = data[6] & 0x3F;
+    tc.seconds = data[7] & 0x3F;
+    tc.frames  = data[8] & 0x1F;
+
+    // Locate, the transport is not running until quarter frames arrive again
+    m_rate         = tc.rate;
+    m_anchorFrames = (double)EasyMidiLibMtc_timecodeToFrames(tc);
+    m_anchorTime   = timestamp;
+    m_locked       = true;
+    m_synced       = false;
+    m_lastPiece    = -1;
+    m_seqCount     = 0;
+    m_seqDirection = 0;
+
+    publish();
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMtcDecoder::publish ( )
+{
+    uint32_t seq = m_seq.load(std::memory_order_relaxed);
+    m_seq.store(seq+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    m_pubLocked    .store(m_locked                            , std::memory_order_relaxed);
+    m_pubSynced    .store(m_synced                            , std::memory_order_relaxed);
+    m_pubDirection .store(m_synced ? m_seqDirection : 0       , std::memory_order_relaxed);
+    m_pubRate      .store((uint8_t)m_rate                     , std::memory_order_relaxed);
+    m_pubFrames    .store(m_anchorFrames                      , std::memory_order_relaxed);
+    m_pubAnchorTime.store(m_anchorTime                        , std::memory_order_relaxed);
+    m_pubQfPeriod  .store(m_qfPeriod                          , std::memory_order_relaxed);
+
+    m_seq.store(seq+2, std::memory_order_release);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibMtcState EasyMidiLibMtcDecoder::getState ( uint64_t now ) const
+{
+    bool               locked, synced;
+    int                direction;
+    EasyMidiLibMtcRate rate;
+    double             frames, qfPeriod;
+    uint64_t           anchorTime;
+
+    for (;;)
+    {
+        uint32_t seq0 = m_seq.load(std::memory_order_acquire);
+        if ( seq0 & 1 )
+            continue;
+
+        locked     = m_pubLocked    .load(std::memory_order_relaxed);
+        synced     = m_pubSynced    .load(std::memory_order_relaxed);
+        direction  = m_pubDirection .load(std::memory_order_relaxed);
+        rate       = (EasyMidiLibMtcRate)m_pubRate.load(std::memory_order_relaxed);
+        frames     = m_pubFrames    .load(std::memory_order_relaxed);
+        anchorTime = m_pubAnchorTime.load(std::memory_order_relaxed);
+        qfPeriod   = m_pubQfPeriod  .load(std::memory_order_relaxed);
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if ( m_seq.load(std::memory_order_relaxed)==seq0 )
+            break;
+    }
+
+    double fps = EasyMidiLibMtc_getFrameRate(rate);
+
+    EasyMidiLibMtcState state;
+    state.locked    = locked;
+    state.running   = synced && direction!=0 && qfPeriod>0.0 && now>=anchorTime && now-anchorTime<=m_dropoutTimeout;
+    state.direction = state.running ? direction : 0;
+    state.speed     = state.running ? 1e9 / (4.0*fps*qfPeriod) : 0.0;
+
+    // Extrapolate from the last quarter frame at the measured rate
+    if ( state.running )
+    {
+        double elapsed = std::min((double)(now-anchorTime), MAX_EXTRAPOLATE*qfPeriod);
+        frames += direction * FRAMES_PER_QF * elapsed / qfPeriod;
+    }
+
+    state.frames   = frames;
+    state.seconds  = frames / fps;
+    state.timecode = EasyMidiLibMtc_framesToTimecode((int64_t)std::floor(frames), rate);
+
+    return state;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+double EasyMidiLibMtcDecoder::getPosition ( uint64_t now ) const
+{
+    return getState(now).seconds;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibMtcGenerator
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibMtcGenerator::EasyMidiLibMtcGenerator ( )
+{
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibMtcGenerator::~EasyMidiLibMtcGenerator ( )
+{
+    stop();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibMtcGenerator::start ( const EasyMidiLibDevice* dev, const EasyMidiLibTimecode& from, bool sendFullFrame )
+{
+    if ( m_running || !dev || dev->isInput || !dev->opened )
+        return false;
+
+    m_dev   = dev;
+    m_rate  = from.rate;
+    m_frame = EasyMidiLibMtc_timecodeToFrames(from);
+    resetJitterStats();
+
+    if ( sendFullFrame )
+    {
+        uint8_t msg[10] = { 0xF0, 0x7F, 0x7F, 0x01, 0x01, (uint8_t)(((uint8_t)from.rate<<5) | from.hours), from.minutes, from.seconds, from.frames, 0xF7 };
+        EasyMidiLib_outputSend ( m_dev, msg, sizeof(msg) );
+    }
+
+    m_running = true;
+    m_thread  = std::thread(&EasyMidiLibMtcGenerator::threadFunc, this);
+    EasyMidiLib_configureThread ( m_thread, EasyMidiLibThreadRole::Timing );
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMtcGenerator::stop ( )
+{
+    if ( !m_running )
+        return;
+
+    m_running = false;
+    if ( m_thread.joinable() )
+        m_thread.join();
+
+    m_dev = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibTimecode EasyMidiLibMtcGenerator::getTimecode ( ) const
+{
+    return EasyMidiLibMtc_framesToTimecode(m_frame, m_rate);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibMtcGenerator::threadFunc ( )
+{
+    double   spacing = 1e9 / (4.0*EasyMidiLibMtc_getFrameRate(m_rate));
+    uint64_t anchor  = EasyMidiLib_getTimestamp();
+    int64_t  first   = m_frame;
+    uint8_t  pieces[8];
+
+    for ( uint64_t n=0; m_running; n++ )
+    {
+        int piece = (int)(n & 7);
+
+        // New sequence every two frames, encoding the frame at piece 0
+        if ( piece==0 )
+        {
+            EasyMidiLibTimecode tc = EasyMidiLibMtc_framesToTimecode(first + 2*(int64_t)(n/8), m_rate);
+            pieces[0] = tc.frames  & 0x0F;  pieces[1] = tc.frames  >> 4;
+            pieces[2] = tc.seconds & 0x0F;  pieces[3] = tc.seconds >> 4;
+            pieces[4] = tc.minutes & 0x0F;  pieces[5] = tc.minutes >> 4;
+            pieces[6] = tc.hours   & 0x0F;  pieces[7] = (uint8_t)((tc.hours >> 4) | ((uint8_t)m_rate << 1));
+        }
+
+        uint64_t deadline = anchor + (uint64_t)(n*spacing);
+        uint64_t now      = 0;
+
+        if ( !EasyMidiLib_waitUntil ( deadline, m_spinTime, m_running, now ) )
+            break;
+
+        uint8_t msg[2] = { (uint8_t)EasyMidiLibSysCommonMsg::TimeCodeQuarter, (uint8_t)((piece<<4) | pieces[piece]) };
+        EasyMidiLib_outputSend ( m_dev, msg, sizeof(msg) );
+        m_jitter.add ( (int64_t)(now-deadline) );
+
+        m_frame = first + (int64_t)(n/4);
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
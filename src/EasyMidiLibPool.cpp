@@ -0,0 +1,191 @@
+#include "EasyMidiLibPool.h"
+#include "EasyMidiLibInternal.h"
+#include <cstdlib>
+#include <cstring>
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static const size_t MIN_CLASS_SIZE = 32;      // payload bytes of the smallest class, doubling up to 64 KB
+static const size_t SLAB_SIZE      = 65536;   // slabs hold at least 4 blocks
+
+struct EasyMidiLibPool::Block
+{
+    Block*     next;     // free list link while the block is free
+    SizeClass* owner;
+};
+
+struct EasyMidiLibPool::SizeClass
+{
+    std::atomic<Block*> freeList {nullptr};   // pushed by release() from any thread
+    Block*              cache    = nullptr;   // popped by alloc(), allocating thread only
+    size_t              capacity = 0;         // payload bytes, 0 for the heap fallback
+    EasyMidiLibPool*    pool     = nullptr;
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibPool::EasyMidiLibPool ( )
+{
+    m_classes.reset ( new SizeClass[CLASSES+1] );
+    for ( int i=0; i<=CLASSES; i++ )
+    {
+        m_classes[i].capacity = i<CLASSES ? MIN_CLASS_SIZE<<i : 0;
+        m_classes[i].pool     = this;
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibPool::~EasyMidiLibPool ( )
+{
+    for ( void* slab : m_slabs )
+        free ( slab );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void* EasyMidiLibPool::alloc ( size_t size )
+{
+    int index = 0;
+    while ( index<CLASSES && m_classes[index].capacity<size )
+        index++;
+
+    SizeClass& sc = m_classes[index];
+    Block*     block;
+
+    if ( index==CLASSES )
+    {
+        block = (Block*)malloc ( sizeof(Block)+size );
+        if ( !block )
+            return 0;
+        m_heapAllocs.fetch_add ( 1, std::memory_order_relaxed );
+    }
+    else
+    {
+        // Only this thread pops, so taking the whole released list at once is free of ABA
+        if ( !sc.cache )
+            sc.cache = sc.freeList.exchange ( nullptr, std::memory_order_acquire );
+
+        if ( !sc.cache )
+        {
+            size_t blockSize = sizeof(Block)+sc.capacity;
+            size_t count     = SLAB_SIZE/blockSize<4 ? 4 : SLAB_SIZE/blockSize;
+            uint8_t* slab    = (uint8_t*)malloc ( blockSize*count );
+            if ( !slab )
+                return 0;
+
+            m_slabs.push_back ( slab );
+            m_slabCount.fetch_add ( 1, std::memory_order_relaxed );
+            m_slabBytes.fetch_add ( blockSize*count, std::memory_order_relaxed );
+
+            for ( size_t i=0; i!=count; i++ )
+            {
+                Block* b = (Block*)(slab+blockSize*i);
+                b->next  = sc.cache;
+                sc.cache = b;
+            }
+        }
+
+        block    = sc.cache;
+        sc.cache = block->next;
+    }
+
+    block->owner = &sc;
+    m_allocs.fetch_add ( 1, std::memory_order_relaxed );
+    return block+1;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibPool::release ( const void* ptr )
+{
+    if ( !ptr )
+        return;
+
+    Block*     block = (Block*)ptr-1;
+    SizeClass* sc    = block->owner;
+    sc->pool->m_releases.fetch_add ( 1, std::memory_order_relaxed );
+
+    if ( !sc->capacity )
+    {
+        free ( block );
+        return;
+    }
+
+    Block* head = sc->freeList.load ( std::memory_order_relaxed );
+    do
+        block->next = head;
+    while ( !sc->freeList.compare_exchange_weak ( head, block, std::memory_order_release, std::memory_order_relaxed ) );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint8_t* EasyMidiLibPool::copy ( const void* data, size_t size )
+{
+    uint8_t* ptr = (uint8_t*)alloc ( size );
+    if ( ptr && size )
+        memcpy ( ptr, data, size );
+    return ptr;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibEvent EasyMidiLibPool::retain ( const EasyMidiLibEvent& event )
+{
+    EasyMidiLibEvent result = event;
+    if ( event.sysex )
+        result.sysex = copy ( event.sysex, event.size );
+    return result;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibEvent* EasyMidiLibPool::retainEvents ( const EasyMidiLibEvent* events, size_t count )
+{
+    size_t bytes = count*sizeof(EasyMidiLibEvent);
+    for ( size_t i=0; i!=count; i++ )
+        if ( events[i].sysex )
+            bytes += events[i].size;
+
+    EasyMidiLibEvent* result = (EasyMidiLibEvent*)alloc ( bytes );
+    if ( !result )
+        return 0;
+
+    uint8_t* payload = (uint8_t*)(result+count);
+    for ( size_t i=0; i!=count; i++ )
+    {
+        result[i] = events[i];
+        if ( events[i].sysex )
+        {
+            memcpy ( payload, events[i].sysex, events[i].size );
+            result[i].sysex = payload;
+            payload += events[i].size;
+        }
+    }
+
+    return result;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibPoolStats EasyMidiLibPool::getStats ( ) const
+{
+    EasyMidiLibPoolStats stats;
+    stats.allocs     = m_allocs    .load ( std::memory_order_relaxed );
+    stats.releases   = m_releases  .load ( std::memory_order_relaxed );
+    stats.inUse      = stats.allocs>stats.releases ? stats.allocs-stats.releases : 0;
+    stats.slabs      = m_slabCount .load ( std::memory_order_relaxed );
+    stats.slabBytes  = m_slabBytes .load ( std::memory_order_relaxed );
+    stats.heapAllocs = m_heapAllocs.load ( std::memory_order_relaxed );
+    return stats;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibPool* EasyMidiLib_getInputPool ( const EasyMidiLibDevice* dev )
+{
+    EasyMidiLibDeviceState* state = dev ? EasyMidiLib_getDeviceState(dev) : 0;
+    return state ? &state->pool : 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
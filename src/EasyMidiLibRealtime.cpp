@@ -0,0 +1,156 @@
+#include "EasyMidiLib.h"
+#include "EasyMidiLibInternal.h"
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <cerrno>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static std::mutex              realtimeMutex;
+static EasyMidiLibThreadConfig threadConfigs[5];
+static std::string             realtimeError;
+static std::atomic<size_t>     prefaultBytes {0};
+
+static const char* const       roleNames[5] = { "input", "enumeration", "dispatch", "worker", "timing" };
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void setRealtimeErrorf ( const char* textf, ... )
+{
+    char text[512];
+
+    va_list args;
+    va_start(args, textf);
+    vsnprintf(text, sizeof(text), textf, args);
+    va_end(args);
+
+    std::lock_guard<std::mutex> lock(realtimeMutex);
+    realtimeError = text;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_setThreadConfig ( EasyMidiLibThreadRole role, const EasyMidiLibThreadConfig& config )
+{
+    std::lock_guard<std::mutex> lock(realtimeMutex);
+    threadConfigs[(size_t)role] = config;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+const char* EasyMidiLib_getRealtimeError ( )
+{
+    static thread_local std::string error;
+
+    std::lock_guard<std::mutex> lock(realtimeMutex);
+    error = realtimeError;
+    return error.c_str();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_configureThread ( std::thread& thread, EasyMidiLibThreadRole role )
+{
+    EasyMidiLibThreadConfig config;
+    {
+        std::lock_guard<std::mutex> lock(realtimeMutex);
+        config = threadConfigs[(size_t)role];
+    }
+
+    const char* roleName = roleNames[(size_t)role];
+
+#if defined(_WIN32)
+    HANDLE handle = (HANDLE)thread.native_handle();
+
+    if ( config.policy!=EasyMidiLibSchedPolicy::Default )
+    {
+        int priority = config.priority>=90 ? THREAD_PRIORITY_TIME_CRITICAL : config.priority>=50 ? THREAD_PRIORITY_HIGHEST : THREAD_PRIORITY_ABOVE_NORMAL;
+        if ( !SetThreadPriority(handle, priority) )
+            setRealtimeErrorf ( "%s thread: SetThreadPriority failed (error %lu)", roleName, GetLastError() );
+    }
+
+    if ( config.affinity && !SetThreadAffinityMask(handle, (DWORD_PTR)config.affinity) )
+        setRealtimeErrorf ( "%s thread: SetThreadAffinityMask 0x%llx failed (error %lu)", roleName, (unsigned long long)config.affinity, GetLastError() );
+#else
+    pthread_t handle = thread.native_handle();
+
+    if ( config.policy!=EasyMidiLibSchedPolicy::Default )
+    {
+        int         policy = config.policy==EasyMidiLibSchedPolicy::Fifo ? SCHED_FIFO : SCHED_RR;
+        sched_param param  = {};
+        param.sched_priority = config.priority;
+
+        int result = pthread_setschedparam ( handle, policy, &param );
+        if ( result )
+            setRealtimeErrorf ( "%s thread: %s priority %d failed: %s%s", roleName, policy==SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR", config.priority,
+                                strerror(result), result==EPERM ? " (needs CAP_SYS_NICE or an rtprio limit)" : "" );
+    }
+
+    if ( config.affinity )
+    {
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for ( int cpu=0; cpu!=64; cpu++ )
+            if ( config.affinity & (1ull<<cpu) )
+                CPU_SET(cpu, &set);
+
+        int result = pthread_setaffinity_np ( handle, sizeof(set), &set );
+        if ( result )
+            setRealtimeErrorf ( "%s thread: CPU affinity 0x%llx failed: %s", roleName, (unsigned long long)config.affinity, strerror(result) );
+#else
+        setRealtimeErrorf ( "%s thread: CPU affinity is not supported on this platform", roleName );
+#endif
+    }
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_lockMemory ( size_t bytes )
+{
+    prefaultBytes = bytes;
+
+#if defined(_WIN32)
+    setRealtimeErrorf ( "lockMemory: mlockall is not available on Windows" );
+    return false;
+#else
+    if ( mlockall(MCL_CURRENT | MCL_FUTURE)!=0 )
+    {
+        int error = errno;
+        setRealtimeErrorf ( "lockMemory: mlockall failed: %s%s", strerror(error),
+                            error==EPERM || error==ENOMEM ? " (check RLIMIT_MEMLOCK or CAP_IPC_LOCK)" : "" );
+        return false;
+    }
+    return true;
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_prefaultDeviceState ( EasyMidiLibDeviceState* state )
+{
+    size_t bytes = prefaultBytes;
+    if ( !bytes )
+        return;
+
+    // resize writes every page, clear keeps the capacity
+    for ( std::vector<uint8_t>* buffer : { &state->inputQueue, &state->pendingData, &state->dispatchData, &state->sysex } )
+    {
+        buffer->resize ( bytes );
+        buffer->clear();
+    }
+
+    state->events.resize ( bytes/sizeof(EasyMidiLibEvent) );
+    state->events.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,278 @@
+#include "EasyMidiLibRetroBuffer.h"
+#include "EasyMidiLibSmfRecorder.h"
+#include "EasyMidiLibCapture.h"
+#include "EasyMidiLibEventRing.h"
+#include <algorithm>
+#include <cstring>
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Slots and SysEx words are atomics so the snapshots can read them while they are overwritten; only the values read
+// before the claimed counters moved past them are kept.
+
+struct EasyMidiLibRetroBuffer::Ring
+{
+    struct Slot
+    {
+        std::atomic<uint64_t> timestamp;
+        std::atomic<uint64_t> packed;     // SysEx flag and size in the high half, short message bytes in the low half
+        std::atomic<uint64_t> sysex;      // byte position of the SysEx data
+    };
+
+    std::unique_ptr<Slot[]>                  slots;
+    std::unique_ptr<std::atomic<uint64_t>[]> words;
+    size_t                                   slotCount;      // power of two
+    size_t                                   wordCount;      // power of two
+
+    std::atomic<uint64_t>                    head         {0};   // slots written
+    std::atomic<uint64_t>                    claimed      {0};   // slots written or being written
+    std::atomic<uint64_t>                    sysexHead    {0};   // bytes, multiple of 8
+    std::atomic<uint64_t>                    sysexClaimed {0};
+
+    Ring ( size_t slotCount, size_t wordCount )
+        : slots(new Slot[slotCount]), words(new std::atomic<uint64_t>[wordCount]), slotCount(slotCount), wordCount(wordCount)
+    {
+    }
+
+    EasyMidiLibEventRing<Slot> view ( )
+    {
+        return { slots.get(), words.get(), slotCount, wordCount, &claimed, &sysexClaimed };
+    }
+
+    EasyMidiLibEventRing<const Slot, const std::atomic<uint64_t>> view ( ) const
+    {
+        return { slots.get(), words.get(), slotCount, wordCount, &claimed, &sysexClaimed };
+    }
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibRetroBuffer::EasyMidiLibRetroBuffer ( )
+{
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibRetroBuffer::~EasyMidiLibRetroBuffer ( )
+{
+    stop();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibRetroBuffer::setCapacity ( size_t events, size_t sysexBytes )
+{
+    std::lock_guard<std::mutex> lock(m_devicesMutex);
+
+    m_events     = events;
+    m_sysexBytes = sysexBytes;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibRetroBuffer::addDevice ( const EasyMidiLibDevice* dev )
+{
+    std::lock_guard<std::mutex> lock(m_devicesMutex);
+
+    size_t count = m_deviceCount;
+    for ( size_t i=0; i!=count; i++ )
+    {
+        if ( m_devices[i]==dev )
+            return true;
+    }
+
+    if ( !dev || !dev->isInput || count==MAX_DEVICES )
+        return false;
+
+    // The ring is in place before the device can be found
+    m_rings  [count].reset ( new Ring(EasyMidiLib_ringCapacity(m_events, 64), EasyMidiLib_ringCapacity(m_sysexBytes/8, 64)) );
+    m_devices[count].store ( dev, std::memory_order_release );
+    m_deviceCount   .store ( count+1, std::memory_order_release );
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibRetroBuffer::start ( )
+{
+    if ( m_running )
+        return;
+
+    for ( size_t i=0; i!=EasyMidiLib_getInputDevicesNum(); i++ )
+    {
+        const EasyMidiLibDevice* dev = EasyMidiLib_getInputDevice ( i );
+        if ( dev->opened )
+            addDevice ( dev );
+    }
+
+    m_running = true;
+    EasyMidiLib_addInputTap ( this );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibRetroBuffer::stop ( )
+{
+    if ( !m_running )
+        return;
+
+    EasyMidiLib_removeInputTap ( this );
+    m_running = false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibRetroBuffer::clear ( )
+{
+    if ( m_running )
+        return;
+
+    size_t count = m_deviceCount;
+    for ( size_t i=0; i!=count; i++ )
+    {
+        Ring& ring = *m_rings[i];
+        ring.head         = 0;
+        ring.claimed      = 0;
+        ring.sysexHead    = 0;
+        ring.sysexClaimed = 0;
+    }
+
+    m_overwritten = 0;
+    m_dropped     = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibRetroBuffer::inputEvents ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count )
+{
+    Ring*  ring  = 0;
+    size_t found = m_deviceCount.load(std::memory_order_acquire);
+
+    for ( size_t i=0; i!=found; i++ )
+    {
+        if ( m_devices[i].load(std::memory_order_relaxed)==dev )
+        {
+            ring = m_rings[i].get();
+            break;
+        }
+    }
+
+    if ( !ring )
+    {
+        m_dropped.fetch_add ( count, std::memory_order_relaxed );
+        return;
+    }
+
+    EasyMidiLibEventRing<Ring::Slot> view      = ring->view();
+    uint64_t                         head      = ring->head     .load(std::memory_order_relaxed);
+    uint64_t                         sysexHead = ring->sysexHead.load(std::memory_order_relaxed);
+
+    for ( size_t i=0; i!=count; i++ )
+    {
+        if ( !view.write(head, sysexHead, events[i], [] ( Ring::Slot& ) { }) )
+        {
+            m_dropped.fetch_add ( 1, std::memory_order_relaxed );
+            continue;
+        }
+
+        if ( head>=ring->slotCount )
+            m_overwritten.fetch_add ( 1, std::memory_order_relaxed );
+
+        head += 1;
+        ring->sysexHead.store ( sysexHead, std::memory_order_relaxed );
+        ring->head     .store ( head, std::memory_order_release );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibRetroBuffer::snapshot ( EasyMidiLibRetroSnapshot& snapshot, uint64_t ns, const EasyMidiLibDevice* dev ) const
+{
+    struct Item
+    {
+        EasyMidiLibEvent event;     // 'sysex' set once 'data' is complete
+        uint64_t         index;     // slot
+        uint64_t         position;  // SysEx bytes in the ring, UINT64_MAX for none
+        size_t           offset;    // SysEx bytes in 'data'
+    };
+
+    std::vector<Item> items;
+    uint64_t          now   = EasyMidiLib_getTimestamp();
+    uint64_t          since = now>ns ? now-ns : 0;
+
+    snapshot.events.clear();
+    snapshot.data  .clear();
+
+    size_t count = m_deviceCount.load(std::memory_order_acquire);
+    for ( size_t d=0; d!=count; d++ )
+    {
+        const EasyMidiLibDevice* device = m_devices[d].load(std::memory_order_relaxed);
+        if ( dev && device!=dev )
+            continue;
+
+        const Ring& ring  = *m_rings[d];
+        auto        view  = ring.view();
+        size_t      first = items.size();
+        uint64_t    head  = ring.head.load(std::memory_order_acquire);
+        uint64_t    end   = head>ring.slotCount ? head-ring.slotCount : 0;
+
+        // Newest first until the time limit
+        for ( uint64_t i=head; i!=end; i-- )
+        {
+            Item   item = { {}, i-1, 0, 0 };
+            size_t size = snapshot.data.size();
+
+            item.position = view.read ( i-1, item.event, snapshot.data, item.offset, [device] ( const Ring::Slot& ) { return device; } );
+            if ( item.event.timestamp<since )
+            {
+                snapshot.data.resize ( size );
+                break;
+            }
+
+            items.push_back ( item );
+        }
+
+        // Drop what the input thread claimed meanwhile
+        uint64_t validSlot, validSysex;
+        view.valid ( validSlot, validSysex );
+
+        auto torn = [&]( const Item& item ) { return item.index<validSlot || (item.position!=UINT64_MAX && item.position<validSysex); };
+        items.erase ( std::remove_if(items.begin()+first, items.end(), torn), items.end() );
+        std::reverse ( items.begin()+first, items.end() );
+    }
+
+    std::stable_sort ( items.begin(), items.end(), []( const Item& a, const Item& b ) { return a.event.timestamp<b.event.timestamp; } );
+
+    snapshot.events.resize ( items.size() );
+    for ( size_t i=0; i!=items.size(); i++ )
+    {
+        const Item& item = items[i];
+
+        snapshot.events[i] = item.event;
+        if ( item.position!=UINT64_MAX )
+            snapshot.events[i].sysex = &snapshot.data[item.offset];
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibRetroBuffer::saveSmf ( const char* path, uint64_t ns, uint16_t ticksPerQuarter ) const
+{
+    EasyMidiLibRetroSnapshot content;
+    snapshot ( content, ns );
+
+    EasyMidiLibSmfRecorder writer;
+    return writer.write ( path, content.events.data(), content.events.size(), ticksPerQuarter );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibRetroBuffer::saveCapture ( const char* path, uint64_t ns ) const
+{
+    EasyMidiLibRetroSnapshot content;
+    snapshot ( content, ns );
+
+    return EasyMidiLib_captureWrite ( path, content.events.data(), content.events.size() );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
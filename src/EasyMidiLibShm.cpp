@@ -0,0 +1,512 @@
+#include "EasyMidiLibShm.h"
+#include "EasyMidiLibEventRing.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <chrono>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static const char     SHM_MAGIC[8]   = { 'E','M','L','S','H','M','1',0 };
+static const uint32_t SHM_VERSION    = 1;
+static const size_t   HEADER_SIZE    = 128;
+
+static const uint32_t STATE_STARTING = 0;
+static const uint32_t STATE_RUNNING  = 1;
+static const uint32_t STATE_CLOSED   = 2;
+
+struct ShmDevice
+{
+    char     name[120];
+    char     id  [128];
+    uint64_t isInput;
+};
+
+struct ShmSlot
+{
+    std::atomic<uint64_t> timestamp;
+    std::atomic<uint64_t> packed;     // SysEx flag and size in the high half, short message in the low half
+    std::atomic<uint64_t> sysex;      // byte position of the SysEx data
+    std::atomic<uint64_t> device;     // number in the device table
+};
+
+struct EasyMidiLibShmPublisher::Shared
+{
+    char                  magic[8];
+    uint32_t              version;
+    std::atomic<uint32_t> state;
+    uint64_t              slotCount;      // power of two
+    uint64_t              wordCount;      // power of two
+    uint64_t              maxDevices;
+    uint64_t              size;           // whole mapping
+    std::atomic<uint64_t> published;
+    std::atomic<uint64_t> claimed;
+    std::atomic<uint64_t> sysexClaimed;
+    std::atomic<uint64_t> deviceCount;
+    uint64_t              process;        // publisher process id
+
+    ShmDevice*             devices ( )       { return (ShmDevice*)((uint8_t*)this+HEADER_SIZE); }
+    const ShmDevice*       devices ( ) const { return (const ShmDevice*)((const uint8_t*)this+HEADER_SIZE); }
+    ShmSlot*               slots   ( )       { return (ShmSlot*)(devices()+maxDevices); }
+    const ShmSlot*         slots   ( ) const { return (const ShmSlot*)(devices()+maxDevices); }
+    std::atomic<uint64_t>* words   ( )       { return (std::atomic<uint64_t>*)(slots()+slotCount); }
+    const std::atomic<uint64_t>* words ( ) const { return (const std::atomic<uint64_t>*)(slots()+slotCount); }
+
+    // The layout described fits in the mapping, with power of two rings
+
+    bool fits ( size_t mapped ) const
+    {
+        auto powerOfTwo = [] ( uint64_t value ) { return value && !(value & (value-1)); };
+
+        // Every count bounded first, so the sum can't overflow
+        if ( size>mapped || !powerOfTwo(slotCount) || !powerOfTwo(wordCount) || maxDevices>size/sizeof(ShmDevice) ||
+             slotCount>size/sizeof(ShmSlot) || wordCount>size/8 )
+            return false;
+
+        return HEADER_SIZE+maxDevices*sizeof(ShmDevice)+slotCount*sizeof(ShmSlot)+wordCount*8<=size;
+    }
+
+#if !defined(_WIN32)
+    // A publisher still running in a live process, or a shared memory that isn't ours; all zero when its publisher died
+    // while starting
+
+    bool inUse ( ) const
+    {
+        static const char none[8] = {};
+
+        if ( memcmp(magic, SHM_MAGIC, sizeof(SHM_MAGIC))!=0 )
+            return memcmp(magic, none, sizeof(none))!=0;
+        if ( state.load(std::memory_order_acquire)==STATE_CLOSED )
+            return false;
+        return kill((pid_t)process, 0)==0 || errno==EPERM;
+    }
+#endif
+
+    EasyMidiLibEventRing<ShmSlot> ring ( )
+    {
+        return { slots(), words(), slotCount, wordCount, &claimed, &sysexClaimed };
+    }
+
+    EasyMidiLibEventRing<const ShmSlot, const std::atomic<uint64_t>> ring ( ) const
+    {
+        return { slots(), words(), slotCount, wordCount, &claimed, &sysexClaimed };
+    }
+};
+
+static_assert ( sizeof(ShmDevice)==256, "shared memory device entry size" );
+static_assert ( std::atomic<uint64_t>::is_always_lock_free, "the shared memory ring needs lock free 64 bit atomics" );
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static std::string shmName ( const char* name )
+{
+#if defined(_WIN32)
+    return name;
+#else
+    return name[0]=='/' ? std::string(name) : "/"+std::string(name);
+#endif
+}
+
+static void unmap ( const void* view, size_t size )
+{
+#if defined(_WIN32)
+    UnmapViewOfFile ( view );
+#else
+    munmap ( (void*)view, size );
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibShmPublisher
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibShmPublisher::EasyMidiLibShmPublisher ( )
+{
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibShmPublisher::~EasyMidiLibShmPublisher ( )
+{
+    stop();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibShmPublisher::fail ( const char* error )
+{
+    m_lastError = error;
+    return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibShmPublisher::start ( const char* name, const EasyMidiLibDevice* dev, size_t events, size_t sysexBytes )
+{
+    static_assert ( sizeof(Shared)<=HEADER_SIZE, "shared memory header too big" );
+
+    stop();
+    m_lastError.clear();
+
+    size_t      slotCount = EasyMidiLib_ringCapacity ( events, 64 );
+    size_t      wordCount = EasyMidiLib_ringCapacity ( sysexBytes/8, 64 );
+    size_t      size      = HEADER_SIZE+MAX_DEVICES*sizeof(ShmDevice)+slotCount*sizeof(ShmSlot)+wordCount*8;
+    std::string shared    = shmName ( name );
+
+#if defined(_WIN32)
+    HANDLE mapping = CreateFileMappingA ( INVALID_HANDLE_VALUE, 0, PAGE_READWRITE, (DWORD)((uint64_t)size>>32), (DWORD)size, shared.c_str() );
+    if ( !mapping )
+        return fail ( "Can't create the shared memory" );
+    if ( GetLastError()==ERROR_ALREADY_EXISTS )
+    {
+        CloseHandle ( mapping );
+        return fail ( "The shared memory is still in use" );
+    }
+
+    // The view keeps the mapping alive
+    void* view = MapViewOfFile ( mapping, FILE_MAP_WRITE, 0, 0, size );
+    CloseHandle ( mapping );
+    if ( !view )
+        return fail ( "Can't map the shared memory" );
+#else
+    // A publisher that died left its name behind (the clients still attached to it keep their mapping); the name of a
+    // live publisher, or of something else, is left alone like on Windows
+    int existing = shm_open ( shared.c_str(), O_RDONLY, 0 );
+    if ( existing>=0 )
+    {
+        struct stat info;
+        void*       old = MAP_FAILED;
+        if ( fstat(existing, &info)==0 && (size_t)info.st_size>=HEADER_SIZE )
+            old = mmap ( 0, HEADER_SIZE, PROT_READ, MAP_SHARED, existing, 0 );
+        ::close ( existing );
+
+        bool inUse = old!=MAP_FAILED && ((const Shared*)old)->inUse();
+        if ( old!=MAP_FAILED )
+            munmap ( old, HEADER_SIZE );
+        if ( inUse )
+            return fail ( "The shared memory is still in use" );
+
+        shm_unlink ( shared.c_str() );
+    }
+
+    int file = shm_open ( shared.c_str(), O_RDWR|O_CREAT|O_EXCL, 0644 );
+    if ( file<0 )
+        return fail ( "Can't create the shared memory" );
+
+    void* view = MAP_FAILED;
+    if ( ftruncate(file, (off_t)size)==0 )
+        view = mmap ( 0, size, PROT_READ|PROT_WRITE, MAP_SHARED, file, 0 );
+    ::close ( file );
+    if ( view==MAP_FAILED )
+    {
+        shm_unlink ( shared.c_str() );
+        return fail ( "Can't map the shared memory" );
+    }
+#endif
+
+    // Zero filled by the system, the clients wait for the running state
+    Shared* header = (Shared*)view;
+#if defined(_WIN32)
+    header->process    = GetCurrentProcessId();
+#else
+    header->process    = (uint64_t)getpid();
+#endif
+    memcpy ( header->magic, SHM_MAGIC, sizeof(SHM_MAGIC) );
+    header->version    = SHM_VERSION;
+    header->slotCount  = slotCount;
+    header->wordCount  = wordCount;
+    header->maxDevices = MAX_DEVICES;
+    header->size       = size;
+    header->state.store ( STATE_RUNNING, std::memory_order_release );
+
+    m_shared      = header;
+    m_name        = shared;
+    m_device      = dev;
+    m_deviceCount = 0;
+    m_sysexHead   = 0;
+    m_dropped     = 0;
+
+    EasyMidiLib_addInputTap ( this );
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibShmPublisher::stop ( )
+{
+    if ( !m_shared )
+        return;
+
+    EasyMidiLib_removeInputTap ( this );
+
+    m_shared->state.store ( STATE_CLOSED, std::memory_order_release );
+#if !defined(_WIN32)
+    shm_unlink ( m_name.c_str() );
+#endif
+    unmap ( m_shared, m_shared->size );
+    m_shared = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLibShmPublisher::getPublished ( ) const
+{
+    return m_shared ? m_shared->published.load(std::memory_order_relaxed) : 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint32_t EasyMidiLibShmPublisher::deviceNumber ( const EasyMidiLibDevice* dev )
+{
+    for ( size_t i=0; i!=m_deviceCount; i++ )
+    {
+        if ( m_devices[i]==dev )
+            return (uint32_t)i;
+    }
+
+    if ( !dev || m_deviceCount==MAX_DEVICES )
+        return UINT32_MAX;
+
+    // The entry is complete before the count shows it
+    ShmDevice& entry = m_shared->devices()[m_deviceCount];
+    snprintf ( entry.name, sizeof(entry.name), "%s", dev->name.c_str() );
+    snprintf ( entry.id  , sizeof(entry.id  ), "%s", dev->id  .c_str() );
+    entry.isInput = dev->isInput;
+
+    m_devices[m_deviceCount] = dev;
+    m_shared->deviceCount.store ( ++m_deviceCount, std::memory_order_release );
+    return (uint32_t)(m_deviceCount-1);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibShmPublisher::inputEvents ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count )
+{
+    if ( m_device && dev!=m_device )
+        return;
+
+    // The taps are called one at a time: single producer
+    EasyMidiLibEventRing<ShmSlot> ring     = m_shared->ring();
+    uint64_t                      sequence = m_shared->published.load(std::memory_order_relaxed);
+    uint32_t                      number   = deviceNumber ( dev );
+
+    if ( number==UINT32_MAX )
+    {
+        m_dropped.fetch_add ( count, std::memory_order_relaxed );
+        return;
+    }
+
+    auto storeDevice = [number] ( ShmSlot& slot ) { slot.device.store ( number, std::memory_order_relaxed ); };
+    for ( size_t i=0; i!=count; i++ )
+    {
+        if ( ring.write(sequence, m_sysexHead, events[i], storeDevice) )
+            sequence++;
+        else
+            m_dropped.fetch_add ( 1, std::memory_order_relaxed );
+    }
+
+    m_shared->published.store ( sequence, std::memory_order_release );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibShmClient
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibShmClient::EasyMidiLibShmClient ( )
+{
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibShmClient::~EasyMidiLibShmClient ( )
+{
+    close();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibShmClient::fail ( const char* error )
+{
+    m_lastError = error;
+    return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibShmClient::open ( const char* name, EasyMidiLibWaitStrategy wait, size_t batchSize )
+{
+    close();
+    m_lastError.clear();
+
+    std::string shared = shmName ( name );
+    size_t      size   = 0;
+
+#if defined(_WIN32)
+    HANDLE mapping = OpenFileMappingA ( FILE_MAP_READ, FALSE, shared.c_str() );
+    if ( !mapping )
+        return fail ( "Can't open the shared memory" );
+
+    void* view = MapViewOfFile ( mapping, FILE_MAP_READ, 0, 0, 0 );
+    CloseHandle ( mapping );
+    if ( !view )
+        return fail ( "Can't map the shared memory" );
+
+    MEMORY_BASIC_INFORMATION info;
+    if ( VirtualQuery(view, &info, sizeof(info)) )
+        size = info.RegionSize;
+#else
+    int file = shm_open ( shared.c_str(), O_RDONLY, 0 );
+    if ( file<0 )
+        return fail ( "Can't open the shared memory" );
+
+    struct stat info;
+    void*       view = MAP_FAILED;
+    if ( fstat(file, &info)==0 && (size_t)info.st_size>=HEADER_SIZE )
+    {
+        size = (size_t)info.st_size;
+        view = mmap ( 0, size, PROT_READ, MAP_SHARED, file, 0 );
+    }
+    ::close ( file );
+    if ( view==MAP_FAILED )
+        return fail ( "Can't map the shared memory" );
+#endif
+
+    const EasyMidiLibShmPublisher::Shared* header = (const EasyMidiLibShmPublisher::Shared*)view;
+    if ( header->state.load(std::memory_order_acquire)!=STATE_RUNNING || memcmp(header->magic, SHM_MAGIC, sizeof(SHM_MAGIC))!=0 ||
+         header->version!=SHM_VERSION )
+    {
+        unmap ( view, size );
+        return fail ( "Not a running EasyMidiLib shared memory" );
+    }
+
+    // Everything read afterwards is indexed from these
+    if ( !header->fits(size) )
+    {
+        unmap ( view, size );
+        return fail ( "Invalid shared memory layout" );
+    }
+
+    m_shared     = header;
+    m_mappedSize = size;
+    m_wait       = wait;
+    m_batchSize  = std::max<size_t> ( batchSize, 1 );
+    m_cursor     = header->published.load(std::memory_order_acquire);
+    m_lost       = 0;
+    m_positions.resize ( m_batchSize );
+    m_offsets  .resize ( m_batchSize );
+    updateDevices();
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibShmClient::close ( )
+{
+    if ( m_shared )
+        unmap ( m_shared, m_mappedSize );
+
+    m_shared     = 0;
+    m_mappedSize = 0;
+    m_devices.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibShmClient::isClosed ( ) const
+{
+    return !m_shared || m_shared->state.load(std::memory_order_acquire)==STATE_CLOSED;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLibShmClient::getLag ( ) const
+{
+    return m_shared ? m_shared->published.load(std::memory_order_relaxed)-m_cursor : 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibShmClient::updateDevices ( )
+{
+    size_t count = (size_t)std::min<uint64_t> ( m_shared->deviceCount.load(std::memory_order_acquire), m_shared->maxDevices );
+
+    while ( m_devices.size()<count )
+    {
+        const ShmDevice& entry = m_shared->devices()[m_devices.size()];
+
+        std::unique_ptr<EasyMidiLibDevice> device ( new EasyMidiLibDevice() );
+        device->isInput   = entry.isInput!=0;
+        device->name      = std::string ( entry.name, strnlen(entry.name, sizeof(entry.name)) );
+        device->id        = std::string ( entry.id  , strnlen(entry.id  , sizeof(entry.id  )) );
+        device->connected = true;
+        m_devices.push_back ( std::move(device) );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+size_t EasyMidiLibShmClient::read ( EasyMidiLibBroadcastBatch& batch, uint64_t timeoutNs )
+{
+    batch.events.clear();
+    batch.data  .clear();
+    batch.first = m_cursor;
+    batch.lost  = 0;
+
+    if ( !m_shared )
+        return 0;
+
+    // Polling only, the publisher never makes a system call for the clients
+    uint64_t published = m_shared->published.load(std::memory_order_acquire);
+    if ( published==m_cursor && timeoutNs )
+    {
+        uint64_t deadline = EasyMidiLib_getTimestamp()+timeoutNs;
+        while ( (published=m_shared->published.load(std::memory_order_acquire))==m_cursor )
+        {
+            if ( isClosed() || EasyMidiLib_getTimestamp()>=deadline )
+                break;
+
+            if ( m_wait==EasyMidiLibWaitStrategy::Yield )
+                std::this_thread::yield();
+            else if ( m_wait==EasyMidiLibWaitStrategy::Sleep || m_wait==EasyMidiLibWaitStrategy::Block )
+                std::this_thread::sleep_for ( std::chrono::nanoseconds(m_sleepNs) );
+        }
+    }
+
+    // A batch overwritten entirely while it was copied is retried further on
+    size_t count = 0;
+    while ( !count && published!=m_cursor )
+    {
+        count     = copy ( batch, published );
+        published = m_shared->published.load(std::memory_order_acquire);
+    }
+
+    m_lost += batch.lost;
+    return count;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+size_t EasyMidiLibShmClient::copy ( EasyMidiLibBroadcastBatch& batch, uint64_t published )
+{
+    // Device numbers past the table seen so far were added meanwhile
+    return m_shared->ring().copy ( m_cursor, published, m_batchSize, batch, m_positions, m_offsets, [this] ( const ShmSlot& slot )
+    {
+        uint64_t number = slot.device.load(std::memory_order_relaxed);
+        if ( number>=m_devices.size() )
+            updateDevices();
+        return number<m_devices.size() ? (const EasyMidiLibDevice*)m_devices[number].get() : 0;
+    } );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
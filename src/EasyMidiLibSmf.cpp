@@ -0,0 +1,466 @@
+#include "EasyMidiLibSmf.h"
+#include <cstring>
+#include <algorithm>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static const uint32_t DEFAULT_TEMPO = 500000; // 120 bpm
+
+static uint32_t readBE ( const uint8_t* p, size_t bytes )
+{
+    uint32_t value = 0;
+    for ( size_t i=0; i!=bytes; i++ )
+        value = value<<8 | p[i];
+    return value;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibSmfTrackIterator
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfTrackIterator::readVarLen ( uint32_t& value )
+{
+    value = 0;
+    for ( int i=0; i!=4 && m_pos<m_end; i++ )
+    {
+        uint8_t byte = *m_pos++;
+        value = value<<7 | (byte & 0x7F);
+        if ( !(byte & 0x80) )
+            return true;
+    }
+
+    return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfTrackIterator::fail ( )
+{
+    m_failed = true;
+    return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfTrackIterator::next ( EasyMidiLibSmfEvent& event )
+{
+    if ( m_pos>=m_end || m_failed )
+        return false;
+
+    uint32_t delta;
+    if ( !readVarLen(delta) || m_pos>=m_end )
+        return fail();
+
+    m_tick += delta;
+
+    uint8_t status = *m_pos;
+    if ( status & 0x80 )
+        m_pos++;
+    else if ( m_running )
+        status = m_running;
+    else
+        return fail();
+
+    event.tick    = m_tick;
+    event.track   = m_track;
+    event.status  = status;
+    event.meta    = 0;
+    event.payload = 0;
+
+    if ( status<0xF0 )
+    {
+        size_t length = (status & 0xE0)==0xC0 ? 1 : 2; // program change and channel pressure
+        if ( (size_t)(m_end-m_pos)<length )
+            return fail();
+
+        m_running     = status;
+        event.msg[0]  = status;
+        event.msg[1]  = m_pos[0];
+        event.msg[2]  = length==2 ? m_pos[1] : 0;
+        event.size    = (uint32_t)length+1;
+        m_pos        += length;
+        return true;
+    }
+
+    if ( status==0xFF )
+    {
+        if ( m_pos>=m_end )
+            return fail();
+        event.meta = *m_pos++;
+    }
+    else if ( status==0xF0 || status==0xF7 )
+        m_running = 0;
+    else
+        return fail();
+
+    uint32_t length;
+    if ( !readVarLen(length) || (size_t)(m_end-m_pos)<length )
+        return fail();
+
+    event.payload = m_pos;
+    event.size    = length;
+    m_pos        += length;
+
+    // Whatever follows the end of track is padding
+    if ( status==0xFF && event.meta==0x2F )
+        m_pos = m_end;
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibSmfIterator
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfIterator::before ( size_t a, size_t b ) const
+{
+    return m_pending[a].tick<m_pending[b].tick || ( m_pending[a].tick==m_pending[b].tick && a<b );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfIterator::addTrack ( const EasyMidiLibSmfTrackIterator& track )
+{
+    m_tracks .push_back ( track );
+    m_pending.emplace_back();
+
+    size_t index = m_tracks.size()-1;
+    if ( !m_tracks[index].next(m_pending[index]) )
+        return;
+
+    m_heap.push_back ( index );
+    std::push_heap ( m_heap.begin(), m_heap.end(), [this]( size_t a, size_t b ) { return before(b, a); } );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfIterator::next ( EasyMidiLibSmfEvent& event )
+{
+    if ( m_heap.empty() )
+        return false;
+
+    auto later = [this]( size_t a, size_t b ) { return before(b, a); };
+
+    std::pop_heap ( m_heap.begin(), m_heap.end(), later );
+    size_t track = m_heap.back();
+    event = m_pending[track];
+
+    if ( m_tracks[track].next(m_pending[track]) )
+        std::push_heap ( m_heap.begin(), m_heap.end(), later );
+    else
+        m_heap.pop_back();
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibSmfFile
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfFile::fail ( const char* error )
+{
+    m_lastError = error;
+    return false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfFile::open ( const char* path )
+{
+    close();
+
+#if defined(_WIN32)
+    HANDLE file = CreateFileA ( path, GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0 );
+    if ( file==INVALID_HANDLE_VALUE )
+        return fail ( "Can't open the file" );
+
+    LARGE_INTEGER size;
+    HANDLE        mapping = 0;
+    if ( GetFileSizeEx(file, &size) && size.QuadPart>0 )
+        mapping = CreateFileMappingA ( file, 0, PAGE_READONLY, 0, 0, 0 );
+    CloseHandle ( file );
+    if ( !mapping )
+        return fail ( "Can't map the file" );
+
+    // The view keeps the mapping alive
+    void* view = MapViewOfFile ( mapping, FILE_MAP_READ, 0, 0, 0 );
+    CloseHandle ( mapping );
+    if ( !view )
+        return fail ( "Can't map the file" );
+
+    m_size = (size_t)size.QuadPart;
+#else
+    int file = ::open ( path, O_RDONLY );
+    if ( file<0 )
+        return fail ( "Can't open the file" );
+
+    struct stat info;
+    void*       view = MAP_FAILED;
+    if ( fstat(file, &info)==0 && info.st_size>0 )
+        view = mmap ( 0, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, file, 0 );
+    ::close ( file );
+    if ( view==MAP_FAILED )
+        return fail ( "Can't map the file" );
+
+    m_size = (size_t)info.st_size;
+    madvise ( view, m_size, MADV_SEQUENTIAL );
+#endif
+
+    m_mapping = view;
+    m_data    = (const uint8_t*)view;
+
+    if ( !parse() )
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfFile::openMemory ( const uint8_t* data, size_t size )
+{
+    close();
+
+    if ( !data || !size )
+        return fail ( "Not a MIDI file" );
+
+    m_data = data;
+    m_size = size;
+
+    if ( !parse() )
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfFile::close ( )
+{
+    if ( m_mapping )
+    {
+#if defined(_WIN32)
+        UnmapViewOfFile ( m_mapping );
+#else
+        munmap ( m_mapping, m_size );
+#endif
+    }
+
+    m_data        = 0;
+    m_size        = 0;
+    m_mapping     = 0;
+    m_format      = 0;
+    m_division    = 0;
+    m_lengthTicks = 0;
+    m_smpteTick   = 0.0;
+    m_tracks   .clear();
+    m_tempoMaps.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfFile::parse ( )
+{
+    if ( m_size<14 || memcmp(m_data, "MThd", 4)!=0 || readBE(m_data+4, 4)<6 )
+        return fail ( "Not a MIDI file" );
+
+    uint32_t headerSize = readBE ( m_data+4, 4 );
+    if ( headerSize>m_size-8 )
+        return fail ( "Not a MIDI file" );
+
+    m_format   = (uint16_t)readBE ( m_data+8 , 2 );
+    m_division = (uint16_t)readBE ( m_data+12, 2 );
+
+    if ( m_format>2 )
+        return fail ( "Unsupported MIDI file format" );
+
+    if ( m_division & 0x8000 )
+    {
+        int    fps   = -(int8_t)(m_division>>8);
+        double rate  = fps==29 ? 30000.0/1001.0 : fps;
+        int    ticks = m_division & 0xFF;
+        if ( fps<=0 || !ticks )
+            return fail ( "Invalid time division" );
+        m_smpteTick = 1e6/(rate*ticks);
+    }
+    else if ( !m_division )
+        return fail ( "Invalid time division" );
+
+    // Chunks: unknown types are skipped, a last chunk running past the end of the file is cut
+    const uint8_t* pos = m_data+8+headerSize;
+    const uint8_t* end = m_data+m_size;
+
+    while ( pos<end && end-pos>=8 )
+    {
+        size_t         length = readBE ( pos+4, 4 );
+        const uint8_t* begin  = pos+8;
+        const uint8_t* stop   = length<(size_t)(end-begin) ? begin+length : end;
+
+        if ( memcmp(pos, "MTrk", 4)==0 )
+            m_tracks.push_back ( { begin, stop, 0 } );
+        pos = stop;
+    }
+
+    if ( m_tracks.empty() )
+        return fail ( "No tracks" );
+
+    // One pass over every track: validation, length and tempo changes (one list per track in format 2)
+    std::vector<std::vector<EasyMidiLibSmfTempo>> changes ( m_format==2 ? m_tracks.size() : 1 );
+    EasyMidiLibSmfEvent                           event;
+
+    for ( size_t i=0; i!=m_tracks.size(); i++ )
+    {
+        std::vector<EasyMidiLibSmfTempo>& trackChanges = changes[m_format==2 ? i : 0];
+
+        EasyMidiLibSmfTrackIterator it = track ( i );
+        while ( it.next(event) )
+        {
+            if ( event.status==0xFF && event.meta==0x51 && event.size==3 )
+                trackChanges.push_back ( { event.tick, 0, readBE(event.payload, 3) } );
+        }
+
+        if ( it.failed() )
+            return fail ( "Malformed track" );
+
+        m_tracks[i].lengthTicks = it.getTick();
+        m_lengthTicks           = std::max ( m_lengthTicks, it.getTick() );
+    }
+
+    m_tempoMaps.resize ( changes.size() );
+    for ( size_t i=0; i!=changes.size(); i++ )
+    {
+        // The last change on a tick wins
+        std::stable_sort ( changes[i].begin(), changes[i].end(), []( const EasyMidiLibSmfTempo& a, const EasyMidiLibSmfTempo& b ) { return a.tick<b.tick; } );
+
+        std::vector<EasyMidiLibSmfTempo>& tempoMap = m_tempoMaps[i];
+        tempoMap.push_back ( { 0, 0, DEFAULT_TEMPO } );
+        for ( const EasyMidiLibSmfTempo& change : changes[i] )
+        {
+            EasyMidiLibSmfTempo& last = tempoMap.back();
+            if ( change.tick==last.tick )
+                last.microsPerBeat = change.microsPerBeat;
+            else
+                tempoMap.push_back ( { change.tick, last.micros + (change.tick-last.tick)*last.microsPerBeat/m_division, change.microsPerBeat } );
+        }
+    }
+
+    m_lastError.clear();
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+const std::vector<EasyMidiLibSmfTempo>& EasyMidiLibSmfFile::getTempoMap ( size_t track ) const
+{
+    static const std::vector<EasyMidiLibSmfTempo> none;
+
+    if ( m_tempoMaps.empty() )
+        return none;
+    return m_tempoMaps[track<m_tempoMaps.size() ? track : 0];
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLibSmfFile::getLengthMicros ( ) const
+{
+    if ( m_format!=2 )
+        return ticksToMicros ( m_lengthTicks );
+
+    uint64_t length = 0;
+    for ( size_t i=0; i!=m_tracks.size(); i++ )
+        length = std::max ( length, ticksToMicros(m_tracks[i].lengthTicks, i) );
+    return length;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLibSmfFile::ticksToMicros ( uint64_t tick, size_t track ) const
+{
+    const std::vector<EasyMidiLibSmfTempo>& tempoMap = getTempoMap ( track );
+
+    if ( m_smpteTick!=0.0 )
+        return (uint64_t)(tick*m_smpteTick);
+    if ( tempoMap.empty() )
+        return 0;
+
+    auto it = std::upper_bound ( tempoMap.begin(), tempoMap.end(), tick, []( uint64_t t, const EasyMidiLibSmfTempo& e ) { return t<e.tick; } );
+    const EasyMidiLibSmfTempo& tempo = *(it-1);
+    return tempo.micros + (tick-tempo.tick)*tempo.microsPerBeat/m_division;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint32_t EasyMidiLibSmfFile::getMicrosPerBeat ( uint64_t tick, size_t track ) const
+{
+    const std::vector<EasyMidiLibSmfTempo>& tempoMap = getTempoMap ( track );
+
+    if ( tempoMap.empty() )
+        return DEFAULT_TEMPO;
+
+    auto it = std::upper_bound ( tempoMap.begin(), tempoMap.end(), tick, []( uint64_t t, const EasyMidiLibSmfTempo& e ) { return t<e.tick; } );
+    return (it-1)->microsPerBeat;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLibSmfFile::microsToTicks ( uint64_t micros, size_t track ) const
+{
+    const std::vector<EasyMidiLibSmfTempo>& tempoMap = getTempoMap ( track );
+
+    if ( m_smpteTick!=0.0 )
+        return (uint64_t)(micros/m_smpteTick);
+    if ( tempoMap.empty() )
+        return 0;
+
+    auto it = std::upper_bound ( tempoMap.begin(), tempoMap.end(), micros, []( uint64_t t, const EasyMidiLibSmfTempo& e ) { return t<e.micros; } );
+    const EasyMidiLibSmfTempo& tempo = *(it-1);
+    return tempo.tick + (tempo.microsPerBeat ? (micros-tempo.micros)*m_division/tempo.microsPerBeat : 0);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibSmfTrackIterator EasyMidiLibSmfFile::track ( size_t track ) const
+{
+    if ( track>=m_tracks.size() )
+        return EasyMidiLibSmfTrackIterator();
+
+    return EasyMidiLibSmfTrackIterator ( m_tracks[track].begin, m_tracks[track].end, (uint16_t)track );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibSmfIterator EasyMidiLibSmfFile::events ( ) const
+{
+    EasyMidiLibSmfIterator it;
+    for ( size_t i=0; i!=m_tracks.size(); i++ )
+        it.addTrack ( track(i) );
+
+    return it;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibSmfIterator EasyMidiLibSmfFile::events ( size_t track ) const
+{
+    EasyMidiLibSmfIterator it;
+    if ( track<m_tracks.size() )
+        it.addTrack ( this->track(track) );
+
+    return it;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,379 @@
+#include "EasyMidiLibSmfPlayer.h"
+#include "EasyMidiLibInternal.h"
+#include <algorithm>
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static const uint64_t DROPOUT_NS = 100000000; // further behind than this, re-anchor instead of bursting the missed events
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibSmfPlayer::EasyMidiLibSmfPlayer ( )
+{
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibSmfPlayer::~EasyMidiLibSmfPlayer ( )
+{
+    stop ( false );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfPlayer::load ( const EasyMidiLibSmfFile* file )
+{
+    unload();
+
+    // Format 2 tracks are separate sequences with their own tempo maps, not one song
+    if ( !file || !file->isOpen() || file->getFormat()==2 )
+        return false;
+
+    // Index every track: the iterator state every CHECKPOINT_EVENTS events, starting with the track start
+    m_checkpoints.resize ( file->getTrackCount() );
+    for ( size_t i=0; i!=file->getTrackCount(); i++ )
+    {
+        EasyMidiLibSmfTrackIterator it = file->track ( i );
+        EasyMidiLibSmfEvent         event;
+
+        for ( size_t n=0; ; n++ )
+        {
+            if ( n%CHECKPOINT_EVENTS==0 )
+                m_checkpoints[i].push_back ( { it.getTick(), it.getPosition(), it.getRunning() } );
+            if ( !it.next(event) )
+                break;
+        }
+    }
+
+    // Sized once, the player thread reads them while they're set
+    std::vector<Output> outputs ( file->getTrackCount() );
+    m_trackOutputs.swap ( outputs );
+
+    m_file         = file;
+    m_positionTick = 0;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfPlayer::unload ( )
+{
+    stop ( true );
+
+    m_file    = 0;
+    m_hasNext = false;
+    m_events  = EasyMidiLibSmfIterator();
+    m_checkpoints.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfPlayer::setTrackOutput ( size_t track, const EasyMidiLibDevice* dev )
+{
+    if ( track<m_trackOutputs.size() )
+        m_trackOutputs[track] = dev;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+const EasyMidiLibDevice* EasyMidiLibSmfPlayer::outputOf ( uint16_t track ) const
+{
+    const EasyMidiLibDevice* dev = track<m_trackOutputs.size() ? m_trackOutputs[track].load(std::memory_order_relaxed) : 0;
+    return dev ? dev : m_defaultOutput.load(std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfPlayer::play ( )
+{
+    if ( !m_file || m_playing )
+        return false;
+
+    if ( m_thread.joinable() )
+        m_thread.join();
+
+    // Played to the end, start over
+    if ( m_positionTick>=m_file->getLengthTicks() )
+        m_positionTick = 0;
+
+    position ( m_positionTick );
+    setAnchor ( EasyMidiLib_getTimestamp(), m_file->ticksToMicros(m_positionTick) );
+
+    m_playing = true;
+    m_thread  = std::thread(&EasyMidiLibSmfPlayer::threadFunc, this);
+    EasyMidiLib_configureThread ( m_thread, EasyMidiLibThreadRole::Timing );
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfPlayer::stop ( bool silence )
+{
+    if ( m_thread.joinable() )
+    {
+        uint64_t tick = getTransport().tick;
+
+        m_playing = false;
+        m_thread.join();
+
+        // The thread leaves the tick after the last one it sent
+        if ( tick>m_positionTick )
+            m_positionTick = tick;
+    }
+
+    if ( silence && m_file )
+        this->silence();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfPlayer::seekTicks ( uint64_t tick )
+{
+    if ( !m_file )
+        return false;
+
+    bool playing = m_playing;
+    stop ( playing );
+
+    m_positionTick = std::min ( tick, m_file->getLengthTicks() );
+
+    return playing ? play() : true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfPlayer::seekMicros ( uint64_t micros )
+{
+    return m_file ? seekTicks ( m_file->microsToTicks(micros) ) : false;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibSmfTransport EasyMidiLibSmfPlayer::getTransport ( ) const
+{
+    EasyMidiLibSmfTransport transport = {};
+    if ( !m_file )
+        return transport;
+
+    transport.playing      = m_playing;
+    transport.looping      = m_looping;
+    transport.lengthMicros = m_file->getLengthMicros();
+
+    if ( transport.playing )
+    {
+        uint64_t start, startMicros;
+        getAnchor ( start, startMicros );
+        uint64_t now = EasyMidiLib_getTimestamp();
+
+        transport.micros = startMicros + ( now>start ? (now-start)/1000 : 0 );
+        transport.micros = std::min ( transport.micros, transport.lengthMicros );
+        transport.tick   = m_file->microsToTicks ( transport.micros );
+    }
+    else
+    {
+        transport.tick   = m_positionTick;
+        transport.micros = m_file->ticksToMicros ( transport.tick );
+    }
+
+    transport.tempo = 60e6 / m_file->getMicrosPerBeat(transport.tick);
+    return transport;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// The start anchor is a seqlock: one writer at a time (play() before the thread starts, then the thread), getTransport
+// retries until it reads both values of the same write
+
+void EasyMidiLibSmfPlayer::setAnchor ( uint64_t clock, uint64_t micros )
+{
+    uint32_t sequence = m_startSequence.load(std::memory_order_relaxed);
+
+    m_startSequence.store ( sequence+1, std::memory_order_relaxed );
+    std::atomic_thread_fence ( std::memory_order_release );
+    m_startClock .store ( clock , std::memory_order_relaxed );
+    m_startMicros.store ( micros, std::memory_order_relaxed );
+    m_startSequence.store ( sequence+2, std::memory_order_release );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfPlayer::getAnchor ( uint64_t& clock, uint64_t& micros ) const
+{
+    for ( ;; )
+    {
+        uint32_t sequence = m_startSequence.load(std::memory_order_acquire);
+        clock  = m_startClock .load(std::memory_order_relaxed);
+        micros = m_startMicros.load(std::memory_order_relaxed);
+        std::atomic_thread_fence ( std::memory_order_acquire );
+
+        if ( !(sequence & 1) && m_startSequence.load(std::memory_order_relaxed)==sequence )
+            return;
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfPlayer::position ( uint64_t tick )
+{
+    m_events  = EasyMidiLibSmfIterator();
+    m_hasNext = false;
+
+    for ( size_t i=0; i!=m_checkpoints.size(); i++ )
+    {
+        // Last checkpoint before the tick: events on the tick itself may come before a checkpoint taken on it
+        const std::vector<Checkpoint>& checkpoints = m_checkpoints[i];
+        auto checkpoint = std::lower_bound ( checkpoints.begin(), checkpoints.end(), tick, []( const Checkpoint& c, uint64_t t ) { return c.tick<t; } );
+        if ( checkpoint!=checkpoints.begin() )
+            checkpoint--;
+
+        EasyMidiLibSmfTrackIterator track = m_file->track ( i );
+        EasyMidiLibSmfTrackIterator it ( checkpoint->pos, track.getEnd(), (uint16_t)i, checkpoint->tick, checkpoint->running );
+        EasyMidiLibSmfEvent         event;
+
+        for ( ;; )
+        {
+            EasyMidiLibSmfTrackIterator before = it;
+            if ( !it.next(event) )
+                break;
+            if ( event.tick>=tick )
+            {
+                it = before;
+                break;
+            }
+        }
+
+        m_events.addTrack ( it );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfPlayer::gather ( uint64_t& tick )
+{
+    for ( Batch& batch : m_batches )
+        batch.data.clear();
+
+    if ( !m_hasNext )
+        m_hasNext = m_events.next ( m_next );
+    if ( !m_hasNext )
+        return false;
+
+    tick = m_next.tick;
+
+    do
+    {
+        const EasyMidiLibDevice* dev = outputOf ( m_next.track );
+
+        if ( dev && !m_next.isMeta() )
+        {
+            auto batch = std::find_if ( m_batches.begin(), m_batches.end(), [dev]( const Batch& b ) { return b.dev==dev; } );
+            if ( batch==m_batches.end() )
+                batch = m_batches.insert ( m_batches.end(), Batch{ dev, {} } );
+
+            // SysEx events don't store their F0, F7 "escapes" are sent as they are
+            if ( m_next.status==0xF0 )
+                batch->data.push_back ( 0xF0 );
+            batch->data.insert ( batch->data.end(), m_next.data(), m_next.data()+m_next.size );
+        }
+
+        m_hasNext = m_events.next ( m_next );
+    }
+    while ( m_hasNext && m_next.tick==tick );
+
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfPlayer::threadFunc ( )
+{
+    uint64_t tick   = 0;
+    bool     ready  = false; // m_batches hold the events of 'tick'
+    uint64_t length = m_file->getLengthMicros();
+
+    while ( m_playing )
+    {
+        if ( !ready )
+        {
+            if ( !gather(tick) )
+            {
+                if ( m_looping && length )
+                {
+                    setAnchor ( m_startClock + (length-m_startMicros)*1000, 0 );
+                    position ( 0 );
+                    continue;
+                }
+
+                m_positionTick = m_file->getLengthTicks();
+                m_playing      = false;
+                break;
+            }
+
+            ready = true;
+        }
+
+        uint64_t deadline = m_startClock + (m_file->ticksToMicros(tick)-m_startMicros)*1000;
+        uint64_t now      = EasyMidiLib_getTimestamp();
+
+        // Not in the window yet: sleep until it is, at most a window at a time
+        uint64_t lookahead = m_lookahead;
+        if ( deadline > now+lookahead )
+        {
+            EasyMidiLib_waitUntil ( std::min(deadline-lookahead, now+lookahead), 0, m_playing, now );
+            continue;
+        }
+
+        if ( !EasyMidiLib_waitUntil ( deadline, m_spinTime, m_playing, now ) )
+            break;
+
+        bool sent = false;
+        for ( const Batch& batch : m_batches )
+        {
+            if ( !batch.data.empty() )
+            {
+                EasyMidiLib_outputSend ( batch.dev, batch.data.data(), batch.data.size() );
+                sent = true;
+            }
+        }
+
+        if ( sent )
+            m_jitter.add ( (int64_t)(now-deadline) );
+
+        if ( now-deadline > DROPOUT_NS )
+            setAnchor ( m_startClock + (now-deadline), m_startMicros );
+
+        m_positionTick = tick+1;
+        ready          = false;
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfPlayer::silence ( )
+{
+    std::vector<const EasyMidiLibDevice*> devices ( m_trackOutputs.begin(), m_trackOutputs.end() );
+    devices.push_back ( m_defaultOutput );
+    std::sort ( devices.begin(), devices.end() );
+    devices.erase ( std::unique(devices.begin(), devices.end()), devices.end() );
+
+    uint8_t data[16*6];
+    for ( uint8_t channel=0; channel!=16; channel++ )
+    {
+        uint8_t* msg = data+channel*6;
+        msg[0] = (uint8_t)EasyMidiLibMsg::ControlChange | channel;
+        msg[1] = (uint8_t)EasyMidiLibCC::AllNotesOff;
+        msg[2] = 0;
+        msg[3] = (uint8_t)EasyMidiLibMsg::ControlChange | channel;
+        msg[4] = (uint8_t)EasyMidiLibCC::SustainPedal;
+        msg[5] = 0;
+    }
+
+    for ( const EasyMidiLibDevice* dev : devices )
+    {
+        if ( dev && dev->opened )
+            EasyMidiLib_outputSend ( dev, data, sizeof(data) );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,435 @@
+#include "EasyMidiLibSmfRecorder.h"
+#include "EasyMidiLibInternal.h"
+#include <algorithm>
+#include <cstring>
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static const size_t   BLOCK_SIZE    = 256*1024;
+static const size_t   HEADER_SIZE   = 12;        // timestamp and size in front of each event in the rings
+static const uint32_t TEMPO         = 500000;    // 120 bpm
+static const uint64_t WRITER_PERIOD = 10;        // ms
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct EasyMidiLibSmfRecorder::Ring
+{
+    std::vector<uint8_t>  data;      // power of two
+    std::atomic<uint64_t> head {0};  // written by the input thread
+    std::atomic<uint64_t> tail {0};  // written by the writer thread
+
+    Ring ( size_t size ) : data(size) { }
+
+    void copyIn ( uint64_t pos, const void* src, size_t size )
+    {
+        size_t offset = (size_t)(pos & (data.size()-1));
+        size_t first  = std::min ( size, data.size()-offset );
+        memcpy ( &data[offset], src, first );
+        memcpy ( &data[0], (const uint8_t*)src+first, size-first );
+    }
+
+    void copyOut ( uint64_t pos, void* dst, size_t size ) const
+    {
+        size_t offset = (size_t)(pos & (data.size()-1));
+        size_t first  = std::min ( size, data.size()-offset );
+        memcpy ( dst, &data[offset], first );
+        memcpy ( (uint8_t*)dst+first, &data[0], size-first );
+    }
+};
+
+struct EasyMidiLibSmfRecorder::Record
+{
+    uint64_t timestamp;
+    uint32_t port;
+    uint32_t size;
+    size_t   offset;     // in m_pendingData
+};
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibSmfRecorder::EasyMidiLibSmfRecorder ( )
+{
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibSmfRecorder::~EasyMidiLibSmfRecorder ( )
+{
+    stop();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfRecorder::addDevice ( const EasyMidiLibDevice* dev )
+{
+    std::lock_guard<std::mutex> lock(m_devicesMutex);
+
+    size_t count = m_deviceCount;
+    for ( size_t i=0; i!=count; i++ )
+    {
+        if ( m_devices[i]==dev )
+            return true;
+    }
+
+    if ( !dev || !dev->isInput || count==MAX_DEVICES )
+        return false;
+
+    size_t size = 1024;
+    while ( size<m_ringSize )
+        size *= 2;
+
+    // The ring is in place before the device can be found
+    m_rings  [count].reset ( new Ring(size) );
+    m_devices[count].store ( dev, std::memory_order_release );
+    m_deviceCount   .store ( count+1, std::memory_order_release );
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfRecorder::inputEvents ( const EasyMidiLibDevice* dev, const EasyMidiLibEvent* events, size_t count )
+{
+    Ring*  ring  = 0;
+    size_t found = m_deviceCount.load(std::memory_order_acquire);
+
+    for ( size_t i=0; i!=found; i++ )
+    {
+        if ( m_devices[i].load(std::memory_order_relaxed)==dev )
+        {
+            ring = m_rings[i].get();
+            break;
+        }
+    }
+
+    if ( !ring )
+    {
+        m_dropped.fetch_add ( count, std::memory_order_relaxed );
+        return;
+    }
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+
+    for ( size_t i=0; i!=count; i++ )
+    {
+        const EasyMidiLibEvent& event = events[i];
+        size_t                  size  = HEADER_SIZE+event.size;
+
+        if ( ring->data.size()-(head-tail)<size )
+        {
+            m_dropped.fetch_add ( 1, std::memory_order_relaxed );
+            continue;
+        }
+
+        uint8_t header[HEADER_SIZE];
+        memcpy ( header  , &event.timestamp, 8 );
+        memcpy ( header+8, &event.size     , 4 );
+        ring->copyIn ( head  , header      , HEADER_SIZE );
+        ring->copyIn ( head+HEADER_SIZE, event.data(), event.size );
+        head += size;
+    }
+
+    ring->head.store ( head, std::memory_order_release );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfRecorder::start ( const char* path, uint16_t ticksPerQuarter, uint64_t reorderWindow )
+{
+    if ( m_recording || !openFile(path, ticksPerQuarter) )
+        return false;
+
+    m_reorderWindow = reorderWindow;
+    m_dropped       = 0;
+
+    for ( size_t i=0; i!=EasyMidiLib_getInputDevicesNum(); i++ )
+    {
+        const EasyMidiLibDevice* dev = EasyMidiLib_getInputDevice ( i );
+        if ( dev->opened )
+            addDevice ( dev );
+    }
+
+    m_startTime = EasyMidiLib_getTimestamp();
+    m_recording = true;
+    m_thread    = std::thread(&EasyMidiLibSmfRecorder::threadFunc, this);
+
+    EasyMidiLib_addInputTap ( this );
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfRecorder::stop ( )
+{
+    if ( !m_recording )
+        return !m_writeFailed;
+
+    // No producer once the tap is gone, the rest is drained here
+    EasyMidiLib_removeInputTap ( this );
+
+    m_recording = false;
+    m_thread.join();
+
+    drain ( UINT64_MAX );
+    return closeFile();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfRecorder::write ( const char* path, const EasyMidiLibEvent* events, size_t count, uint16_t ticksPerQuarter )
+{
+    if ( m_recording || !openFile(path, ticksPerQuarter) )
+        return false;
+
+    // Ports in order of first appearance, the time starts at the first event
+    std::vector<const EasyMidiLibDevice*> ports;
+    m_startTime = count ? events[0].timestamp : 0;
+
+    for ( size_t i=0; i!=count; i++ )
+    {
+        const EasyMidiLibEvent& event = events[i];
+
+        auto port = std::find ( ports.begin(), ports.end(), event.device );
+        if ( port==ports.end() )
+            port = ports.insert ( ports.end(), event.device );
+
+        Record record;
+        record.timestamp = event.timestamp;
+        record.port      = (uint32_t)(port-ports.begin());
+        record.size      = event.size;
+        record.offset    = 0;
+
+        m_pendingData.assign ( event.data(), event.data()+event.size );
+        encode ( record );
+        if ( m_block.size()>=BLOCK_SIZE )
+            writeBlock();
+    }
+
+    return closeFile();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfRecorder::openFile ( const char* path, uint16_t ticksPerQuarter )
+{
+    if ( !ticksPerQuarter || ticksPerQuarter>0x7FFF )
+    {
+        m_lastError = "Invalid time division";
+        return false;
+    }
+
+    m_file = fopen ( path, "wb" );
+    if ( !m_file )
+    {
+        m_lastError = "Can't create the file";
+        return false;
+    }
+
+    m_block.clear();
+    const uint8_t header[] = { 'M','T','h','d', 0,0,0,6, 0,0, 0,1, (uint8_t)(ticksPerQuarter>>8), (uint8_t)ticksPerQuarter,
+                               'M','T','r','k', 0,0,0,0,
+                               0, 0xFF,0x51,0x03, (uint8_t)(TEMPO>>16), (uint8_t)(TEMPO>>8), (uint8_t)TEMPO };
+    m_block.insert ( m_block.end(), header, header+sizeof(header) );
+
+    m_trackStart    = 18;
+    m_ticksPerNs    = ticksPerQuarter/(TEMPO*1000.0);
+    m_lastTick      = 0;
+    m_running       = 0;
+    m_port          = -1;
+    m_writeFailed   = false;
+    m_events        = 0;
+    m_late          = 0;
+    m_bytesWritten  = 0;
+    m_lastError.clear();
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfRecorder::closeFile ( )
+{
+    const uint8_t endOfTrack[] = { 0, 0xFF, 0x2F, 0x00 };
+    m_block.insert ( m_block.end(), endOfTrack, endOfTrack+sizeof(endOfTrack) );
+    writeBlock();
+
+    long     end    = ftell ( m_file );
+    uint32_t length = (uint32_t)(end-m_trackStart-4);
+    uint8_t  patch[4] = { (uint8_t)(length>>24), (uint8_t)(length>>16), (uint8_t)(length>>8), (uint8_t)length };
+
+    if ( end<0 || fseek(m_file, m_trackStart, SEEK_SET)!=0 || fwrite(patch, 4, 1, m_file)!=1 )
+        m_writeFailed = true;
+    if ( fclose(m_file)!=0 )
+        m_writeFailed = true;
+    m_file = 0;
+
+    if ( m_writeFailed && m_lastError.empty() )
+        m_lastError = "Write error";
+
+    return !m_writeFailed;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+EasyMidiLibSmfRecorderStats EasyMidiLibSmfRecorder::getStats ( ) const
+{
+    EasyMidiLibSmfRecorderStats stats;
+    stats.events       = m_events;
+    stats.dropped      = m_dropped;
+    stats.late         = m_late;
+    stats.bytesWritten = m_bytesWritten;
+    return stats;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfRecorder::threadFunc ( )
+{
+    while ( m_recording )
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(WRITER_PERIOD));
+
+        uint64_t now = EasyMidiLib_getTimestamp();
+        drain ( now>m_reorderWindow ? now-m_reorderWindow : 0 );
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfRecorder::drain ( uint64_t cutoff )
+{
+    m_pending    .clear();
+    m_pendingData.clear();
+
+    size_t count = m_deviceCount.load(std::memory_order_acquire);
+    for ( size_t i=0; i!=count; i++ )
+    {
+        Ring&    ring = *m_rings[i];
+        uint64_t tail = ring.tail.load(std::memory_order_relaxed);
+        uint64_t head = ring.head.load(std::memory_order_acquire);
+
+        while ( head-tail>=HEADER_SIZE )
+        {
+            Record  record;
+            uint8_t header[HEADER_SIZE];
+            ring.copyOut ( tail, header, HEADER_SIZE );
+            memcpy ( &record.timestamp, header  , 8 );
+            memcpy ( &record.size     , header+8, 4 );
+
+            if ( record.timestamp>cutoff )
+                break;
+
+            record.port   = (uint32_t)i;
+            record.offset = m_pendingData.size();
+            m_pendingData.resize ( record.offset+record.size );
+            ring.copyOut ( tail+HEADER_SIZE, &m_pendingData[record.offset], record.size );
+            m_pending.push_back ( record );
+
+            tail += HEADER_SIZE+record.size;
+        }
+
+        ring.tail.store ( tail, std::memory_order_release );
+    }
+
+    std::stable_sort ( m_pending.begin(), m_pending.end(), []( const Record& a, const Record& b ) { return a.timestamp<b.timestamp; } );
+
+    for ( const Record& record : m_pending )
+    {
+        encode ( record );
+        if ( m_block.size()>=BLOCK_SIZE )
+            writeBlock();
+    }
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfRecorder::writeVarLen ( uint32_t value )
+{
+    uint8_t bytes[5];
+    size_t  count = 0;
+
+    do
+    {
+        bytes[count++] = value & 0x7F;
+        value >>= 7;
+    }
+    while ( value );
+
+    while ( count-- )
+        m_block.push_back ( bytes[count] | (count ? 0x80 : 0) );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibSmfRecorder::encode ( const Record& record )
+{
+    const uint8_t* data   = &m_pendingData[record.offset];
+    uint8_t        status = record.size ? data[0] : 0;
+    if ( !(status & 0x80) )
+        return;
+
+    uint64_t tick = record.timestamp>m_startTime ? (uint64_t)((record.timestamp-m_startTime)*m_ticksPerNs) : 0;
+    if ( tick<m_lastTick )
+    {
+        tick = m_lastTick;
+        m_late.fetch_add ( 1, std::memory_order_relaxed );
+    }
+
+    // Delta times are limited to 28 bits (over 4 hours at 960 ppq and 120 bpm)
+    uint32_t delta = (uint32_t)std::min<uint64_t> ( tick-m_lastTick, 0x0FFFFFFF );
+    m_lastTick += delta;
+
+    if ( (int)record.port!=m_port )
+    {
+        const uint8_t port[] = { 0xFF, 0x21, 0x01, (uint8_t)record.port };
+        writeVarLen ( delta );
+        m_block.insert ( m_block.end(), port, port+sizeof(port) );
+        m_port    = (int)record.port;
+        m_running = 0;
+        delta     = 0;
+    }
+
+    writeVarLen ( delta );
+
+    if ( status<0xF0 )
+    {
+        if ( status!=m_running )
+            m_block.push_back ( status );
+        m_block.insert ( m_block.end(), data+1, data+record.size );
+        m_running = status;
+    }
+    else if ( status==0xF0 )
+    {
+        m_block.push_back ( 0xF0 );
+        writeVarLen ( record.size-1 );
+        m_block.insert ( m_block.end(), data+1, data+record.size );
+        m_running = 0;
+    }
+    else
+    {
+        // System common and real time messages go in escapes
+        m_block.push_back ( 0xF7 );
+        writeVarLen ( record.size );
+        m_block.insert ( m_block.end(), data, data+record.size );
+        m_running = 0;
+    }
+
+    m_events.fetch_add ( 1, std::memory_order_relaxed );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLibSmfRecorder::writeBlock ( )
+{
+    if ( m_block.empty() )
+        return true;
+
+    if ( !m_writeFailed && fwrite(m_block.data(), 1, m_block.size(), m_file)!=m_block.size() )
+        m_writeFailed = true;
+    else
+        m_bytesWritten.fetch_add ( m_block.size(), std::memory_order_relaxed );
+
+    m_block.clear();
+    return !m_writeFailed;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
@@ -0,0 +1,279 @@
+#include "EasyMidiLibStats.h"
+#include "EasyMidiLibInternal.h"
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibHistogram
+//--------------------------------------------------------------------------------------------------------------------------
+
+static unsigned highestBit ( uint64_t value )
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanReverse64 ( &index, value );
+    return (unsigned)index;
+#else
+    return 63-(unsigned)__builtin_clzll(value);
+#endif
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+size_t EasyMidiLibHistogram::bucketOf ( uint64_t value )
+{
+    if ( value<8 )
+        return (size_t)value;
+
+    unsigned shift = highestBit(value)-3;
+    return 8 + shift*8 + (size_t)((value>>shift) & 7);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLibHistogram::bucketLowest ( size_t bucket )
+{
+    if ( bucket<8 )
+        return bucket;
+
+    size_t shift = (bucket-8)/8;
+    return (uint64_t)(8 + (bucket-8)%8) << shift;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLibHistogram::bucketHighest ( size_t bucket )
+{
+    return bucket+1<BUCKETS ? bucketLowest(bucket+1)-1 : UINT64_MAX;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLibHistogram::getPercentile ( double percent ) const
+{
+    if ( !m_count )
+        return 0;
+
+    uint64_t target = (uint64_t)(percent*m_count/100.0 + 0.5);
+    if ( target<1 )
+        target = 1;
+
+    uint64_t total = 0;
+    for ( size_t i=0; i!=BUCKETS; i++ )
+    {
+        total += m_buckets[i];
+        if ( total>=target )
+            return bucketHighest(i)<m_max ? bucketHighest(i) : m_max;
+    }
+
+    return m_max;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#if EASYMIDILIB_STATS
+
+std::atomic<bool>                   EasyMidiLib_statsEnabled {false};
+static EasyMidiLibHistogramRecorder enumerationHistogram;
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibHistogramRecorder
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibHistogramRecorder::record ( uint64_t value )
+{
+    buckets[EasyMidiLibHistogram::bucketOf(value)].fetch_add ( 1, std::memory_order_relaxed );
+    count.fetch_add ( 1    , std::memory_order_relaxed );
+    sum  .fetch_add ( value, std::memory_order_relaxed );
+
+    uint64_t current = min.load(std::memory_order_relaxed);
+    while ( value<current && !min.compare_exchange_weak(current, value, std::memory_order_relaxed) )
+        ;
+
+    current = max.load(std::memory_order_relaxed);
+    while ( value>current && !max.compare_exchange_weak(current, value, std::memory_order_relaxed) )
+        ;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibHistogramRecorder::snapshot ( EasyMidiLibHistogram& histogram ) const
+{
+    for ( size_t i=0; i!=EasyMidiLibHistogram::BUCKETS; i++ )
+        histogram.m_buckets[i] = buckets[i].load(std::memory_order_relaxed);
+
+    histogram.m_count = count.load(std::memory_order_relaxed);
+    histogram.m_sum   = sum  .load(std::memory_order_relaxed);
+    histogram.m_min   = histogram.m_count ? min.load(std::memory_order_relaxed) : 0;
+    histogram.m_max   = max.load(std::memory_order_relaxed);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibHistogramRecorder::reset ( )
+{
+    for ( std::atomic<uint64_t>& bucket : buckets )
+        bucket.store ( 0, std::memory_order_relaxed );
+
+    count.store ( 0         , std::memory_order_relaxed );
+    sum  .store ( 0         , std::memory_order_relaxed );
+    min  .store ( UINT64_MAX, std::memory_order_relaxed );
+    max  .store ( 0         , std::memory_order_relaxed );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Hooks
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_recordData ( const EasyMidiLibDevice* dev, const uint8_t* data, size_t size )
+{
+    EasyMidiLibDeviceStats& stats = EasyMidiLib_getDeviceState(dev)->stats;
+
+    if ( !stats.start.load(std::memory_order_relaxed) )
+    {
+        uint64_t unset = 0;
+        stats.start.compare_exchange_strong ( unset, EasyMidiLib_getTimestamp(), std::memory_order_relaxed );
+    }
+
+    // Messages are counted at their status byte, plus one per running status repetition
+    uint8_t  dataLength = stats.dataLength.load(std::memory_order_relaxed);
+    uint8_t  dataSeen   = stats.dataSeen  .load(std::memory_order_relaxed);
+    bool     inSysex    = stats.inSysex   .load(std::memory_order_relaxed);
+    uint64_t messages   = 0;
+
+    for ( size_t i=0; i!=size; i++ )
+    {
+        uint8_t byte = data[i];
+
+        if ( byte>=0xF8 )
+            messages++;
+        else if ( byte==0xF7 )
+            inSysex = false;
+        else if ( byte & 0x80 )
+        {
+            messages++;
+            inSysex    = byte==0xF0;
+            dataLength = byte>=0xF0 ? 0 : ((byte & 0xF0)==0xC0 || (byte & 0xF0)==0xD0) ? 1 : 2;
+            dataSeen   = 0;
+        }
+        else if ( !inSysex && dataLength )
+        {
+            if ( dataSeen==dataLength )
+            {
+                messages++;
+                dataSeen = 0;
+            }
+            dataSeen++;
+        }
+    }
+
+    stats.dataLength.store ( dataLength, std::memory_order_relaxed );
+    stats.dataSeen  .store ( dataSeen  , std::memory_order_relaxed );
+    stats.inSysex   .store ( inSysex   , std::memory_order_relaxed );
+    stats.bytes     .fetch_add ( size    , std::memory_order_relaxed );
+    stats.messages  .fetch_add ( messages, std::memory_order_relaxed );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_recordCallback ( const EasyMidiLibDevice* dev, uint64_t timestamp, uint64_t begin )
+{
+    EasyMidiLibDeviceStats& stats = EasyMidiLib_getDeviceState(dev)->stats;
+    uint64_t                now   = EasyMidiLib_getTimestamp();
+
+    stats.latency .record ( begin>timestamp ? begin-timestamp : 0 );
+    stats.callback.record ( now-begin );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_recordWrite ( const EasyMidiLibDevice* dev, uint64_t begin )
+{
+    EasyMidiLib_getDeviceState(dev)->stats.write.record ( EasyMidiLib_getTimestamp()-begin );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_recordEnumeration ( uint64_t begin )
+{
+    enumerationHistogram.record ( EasyMidiLib_getTimestamp()-begin );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// API
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_setStatsEnabled ( bool enabled )
+{
+    EasyMidiLib_statsEnabled = enabled;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_getStatsEnabled ( )
+{
+    return EasyMidiLib_statsEnabled;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_getStats ( const EasyMidiLibDevice* dev, EasyMidiLibStats& stats )
+{
+    EasyMidiLibDeviceState* state = dev ? EasyMidiLib_getDeviceState(dev) : 0;
+    if ( !state )
+    {
+        stats = EasyMidiLibStats();
+        return false;
+    }
+
+    const EasyMidiLibDeviceStats& device = state->stats;
+    uint64_t                      start  = device.start.load(std::memory_order_relaxed);
+    uint64_t                      now    = EasyMidiLib_getTimestamp();
+
+    stats.elapsedNs         = start && now>start ? now-start : 0;
+    stats.bytes             = device.bytes   .load(std::memory_order_relaxed);
+    stats.messages          = device.messages.load(std::memory_order_relaxed);
+    stats.bytesPerSecond    = stats.elapsedNs ? stats.bytes   *1e9/stats.elapsedNs : 0.0;
+    stats.messagesPerSecond = stats.elapsedNs ? stats.messages*1e9/stats.elapsedNs : 0.0;
+    stats.queueHighWater    = state->queueHighWater;
+
+    device.latency      .snapshot ( stats.latency     );
+    device.callback     .snapshot ( stats.callback    );
+    device.write        .snapshot ( stats.write       );
+    enumerationHistogram.snapshot ( stats.enumeration );
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_resetStats ( const EasyMidiLibDevice* dev )
+{
+    if ( !dev )
+    {
+        enumerationHistogram.reset();
+        return;
+    }
+
+    EasyMidiLibDeviceStats& stats = EasyMidiLib_getDeviceState(dev)->stats;
+
+    stats.start   .store ( EasyMidiLib_getTimestamp(), std::memory_order_relaxed );
+    stats.bytes   .store ( 0, std::memory_order_relaxed );
+    stats.messages.store ( 0, std::memory_order_relaxed );
+    stats.latency .reset();
+    stats.callback.reset();
+    stats.write   .reset();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#else
+
+void EasyMidiLib_setStatsEnabled ( bool enabled )                                       { }
+bool EasyMidiLib_getStatsEnabled ( )                                                    { return false; }
+bool EasyMidiLib_getStats        ( const EasyMidiLibDevice* dev, EasyMidiLibStats& stats ) { stats = EasyMidiLibStats(); return false; }
+void EasyMidiLib_resetStats      ( const EasyMidiLibDevice* dev )                          { }
+
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------
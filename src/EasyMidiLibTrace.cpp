@@ -0,0 +1,253 @@
+#include "EasyMidiLibTrace.h"
+#include "EasyMidiLibInternal.h"
+#include <cstdio>
+#include <cstring>
+#include <thread>
+
+#if EASYMIDILIB_TRACE
+
+//--------------------------------------------------------------------------------------------------------------------------
+// Per thread rings: the owner thread is the only producer and the flush thread the only consumer. A ring outlives its
+// thread until the flush thread has drained it.
+//--------------------------------------------------------------------------------------------------------------------------
+
+struct TraceEvent
+{
+    const char* name;
+    uint64_t    begin;
+    uint64_t    end;          // 0: instant event
+    uint64_t    value;        // bytes
+    char        device[40];
+};
+
+struct TraceRing
+{
+    std::vector<TraceEvent> events;           // power of two
+    std::atomic<uint64_t>   head     {0};     // written by the owner thread
+    std::atomic<uint64_t>   tail     {0};     // written by the flush thread
+    std::atomic<bool>       orphaned {false}; // owner thread gone
+    uint32_t                tid      = 0;
+};
+
+struct TraceThread
+{
+    TraceRing* ring = 0;
+    ~TraceThread ( ) { if ( ring ) ring->orphaned.store ( true, std::memory_order_release ); }
+};
+
+std::atomic<bool>                  EasyMidiLib_traceEnabled {false};
+
+static std::mutex                  traceMutex;                  // rings list and start/stop
+static std::vector<TraceRing*>     traceRings;
+static size_t                      traceRingSize  = 16384;
+static uint32_t                    traceNextTid   = 0;
+static std::atomic<uint64_t>       traceDropped   {0};
+static FILE*                       traceFile      = 0;
+static std::thread                 traceThread;
+static std::atomic<bool>           traceRunning   {false};
+static uint64_t                    traceOrigin    = 0;
+static thread_local TraceThread    traceCurrent;
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_traceRecord ( const char* name, const EasyMidiLibDevice* dev, uint64_t begin, uint64_t end, uint64_t value )
+{
+    TraceRing* ring = traceCurrent.ring;
+    if ( !ring )
+    {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        ring = new TraceRing;
+        ring->events.resize ( traceRingSize );
+        ring->tid = ++traceNextTid;
+        traceRings.push_back ( ring );
+        traceCurrent.ring = ring;
+    }
+
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    if ( head-ring->tail.load(std::memory_order_acquire)>=ring->events.size() )
+    {
+        traceDropped.fetch_add ( 1, std::memory_order_relaxed );
+        return;
+    }
+
+    TraceEvent& event = ring->events[head & (ring->events.size()-1)];
+    event.name  = name;
+    event.begin = begin;
+    event.end   = end;
+    event.value = value;
+
+    size_t length = 0;
+    if ( dev )
+    {
+        length = dev->name.size()<sizeof(event.device)-1 ? dev->name.size() : sizeof(event.device)-1;
+        memcpy ( event.device, dev->name.data(), length );
+    }
+    event.device[length] = 0;
+
+    ring->head.store ( head+1, std::memory_order_release );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void writeString ( const char* text )
+{
+    fputc ( '"', traceFile );
+    for ( const char* c=text; *c; c++ )
+    {
+        if ( *c=='"' || *c=='\\' )
+            fprintf ( traceFile, "\\%c", *c );
+        else if ( (unsigned char)*c<0x20 )
+            fprintf ( traceFile, "\\u%04x", *c );
+        else
+            fputc ( *c, traceFile );
+    }
+    fputc ( '"', traceFile );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void writeEvent ( const TraceEvent& event, uint32_t tid )
+{
+    // Written before the trace started (a hook racing traceStart)
+    if ( event.begin<traceOrigin )
+        return;
+
+    fprintf ( traceFile, ",\n{\"name\":\"%s\",\"cat\":\"midi\",\"pid\":1,\"tid\":%u,\"ts\":%.3f", event.name, tid, (event.begin-traceOrigin)/1000.0 );
+    if ( event.end )
+        fprintf ( traceFile, ",\"ph\":\"X\",\"dur\":%.3f", (event.end-event.begin)/1000.0 );
+    else
+        fputs ( ",\"ph\":\"i\",\"s\":\"t\"", traceFile );
+
+    fprintf ( traceFile, ",\"args\":{\"bytes\":%llu", (unsigned long long)event.value );
+    if ( event.device[0] )
+    {
+        fputs ( ",\"device\":", traceFile );
+        writeString ( event.device );
+    }
+    fputs ( "}}", traceFile );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void flushRings ( )
+{
+    std::vector<TraceRing*> rings;
+    {
+        std::lock_guard<std::mutex> lock(traceMutex);
+        rings = traceRings;
+    }
+
+    for ( TraceRing* ring : rings )
+    {
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+
+        for ( ; tail!=head; tail++ )
+            writeEvent ( ring->events[tail & (ring->events.size()-1)], ring->tid );
+
+        ring->tail.store ( tail, std::memory_order_release );
+    }
+
+    // Rings of finished threads go once drained
+    std::lock_guard<std::mutex> lock(traceMutex);
+    for ( size_t i=0; i<traceRings.size(); )
+    {
+        TraceRing* ring = traceRings[i];
+        if ( ring->orphaned.load(std::memory_order_acquire) && ring->tail==ring->head )
+        {
+            delete ring;
+            traceRings.erase ( traceRings.begin()+i );
+        }
+        else
+            i++;
+    }
+
+    fflush ( traceFile );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static void traceThreadFunc ( )
+{
+    while ( traceRunning )
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        flushRings();
+    }
+
+    flushRings();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_traceStart ( const char* path, size_t eventsPerThread )
+{
+    EasyMidiLib_traceStop();
+
+    FILE* file = fopen ( path, "w" );
+    if ( !file )
+        return false;
+
+    std::lock_guard<std::mutex> lock(traceMutex);
+
+    traceRingSize = 16;
+    while ( traceRingSize<eventsPerThread )
+        traceRingSize *= 2;
+
+    // Whatever the live threads recorded after the last stop is stale
+    for ( TraceRing* ring : traceRings )
+        ring->tail = ring->head.load();
+
+    traceFile    = file;
+    traceOrigin  = EasyMidiLib_getTimestamp();
+    traceDropped = 0;
+    fputs ( "{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"EasyMidiLib\"}}", traceFile );
+
+    traceRunning             = true;
+    traceThread              = std::thread(traceThreadFunc);
+    EasyMidiLib_traceEnabled = true;
+    return true;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLib_traceStop ( )
+{
+    if ( !traceFile )
+        return;
+
+    EasyMidiLib_traceEnabled = false;
+    traceRunning             = false;
+    traceThread.join();
+
+    fputs ( "\n]}\n", traceFile );
+    fclose ( traceFile );
+    traceFile = 0;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+bool EasyMidiLib_isTracing ( )
+{
+    return EasyMidiLib_traceEnabled;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint64_t EasyMidiLib_traceDropped ( )
+{
+    return traceDropped;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+#else
+
+bool     EasyMidiLib_traceStart   ( const char* path, size_t eventsPerThread ) { return false; }
+void     EasyMidiLib_traceStop    ( )                                          { }
+bool     EasyMidiLib_isTracing    ( )                                          { return false; }
+uint64_t EasyMidiLib_traceDropped ( )                                          { return 0; }
+
+#endif
+
+//--------------------------------------------------------------------------------------------------------------------------
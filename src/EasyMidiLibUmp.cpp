@@ -0,0 +1,350 @@
+#include "EasyMidiLibUmp.h"
+#include <algorithm>
+#include <cstring>
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+static size_t messageLength ( uint8_t status )
+{
+    if ( status>=0xF0 )
+        return status==0xF2 ? 3 : (status==0xF1 || status==0xF3) ? 2 : 1;
+
+    return ((status & 0xF0)==0xC0 || (status & 0xF0)==0xD0) ? 2 : 3;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint32_t EasyMidiLib_umpScaleUp ( uint32_t value, uint8_t srcBits, uint8_t dstBits )
+{
+    uint8_t  scaleBits = dstBits-srcBits;
+    uint64_t shifted   = (uint64_t)value<<scaleBits;
+
+    // Up to the center the value is only shifted, above it the low bits repeat so the maximum maps to the maximum
+    if ( value<=(1u<<(srcBits-1)) )
+        return (uint32_t)shifted;
+
+    uint8_t  repeatBits  = srcBits-1;
+    uint64_t repeatValue = value & ((1u<<repeatBits)-1);
+    if ( scaleBits>repeatBits )
+        repeatValue <<= scaleBits-repeatBits;
+    else
+        repeatValue >>= repeatBits-scaleBits;
+
+    while ( repeatValue )
+    {
+        shifted      |= repeatValue;
+        repeatValue >>= repeatBits;
+    }
+
+    return (uint32_t)shifted;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+uint32_t EasyMidiLib_umpScaleDown ( uint32_t value, uint8_t srcBits, uint8_t dstBits )
+{
+    return value>>(srcBits-dstBits);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// 7 bit values upscaled once
+
+struct ScaleTables
+{
+    uint16_t to16[128];
+    uint32_t to32[128];
+
+    ScaleTables ( )
+    {
+        for ( uint32_t i=0; i!=128; i++ )
+        {
+            to16[i] = (uint16_t)EasyMidiLib_umpScaleUp ( i, 7, 16 );
+            to32[i] = EasyMidiLib_umpScaleUp ( i, 7, 32 );
+        }
+    }
+};
+
+static const ScaleTables scale;
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+// Channel voice masks by (status>>4)&7, so a run of channel messages converts without branching on the message type
+
+struct ChannelMasks
+{
+    uint32_t data2  [8]; // second data byte used
+    uint32_t first  [8]; // MIDI 2.0 value from the first data byte instead of the second
+    uint32_t note   [8]; // first data byte goes to the first word (note or controller number)
+    uint32_t to16   [8]; // MIDI 2.0 value: 16 bit velocity
+    uint32_t to32   [8]; //                 32 bit value
+    uint32_t program[8]; //                 program number
+    uint32_t pitch  [8]; //                 14 bit pitch bend upscaled
+};
+
+static const uint32_t     ALL = 0xFFFFFFFF;
+static const ChannelMasks channelMasks =
+{ //  80   90   A0   B0   C0   D0   E0   F0
+    { 0x7F,0x7F,0x7F,0x7F,0   ,0   ,0x7F,0 },
+    { 0   ,0   ,0   ,0   ,ALL ,ALL ,0   ,0 },
+    { ALL ,ALL ,ALL ,ALL ,0   ,0   ,0   ,0 },
+    { ALL ,ALL ,0   ,0   ,0   ,0   ,0   ,0 },
+    { 0   ,0   ,ALL ,ALL ,0   ,ALL ,0   ,0 },
+    { 0   ,0   ,0   ,0   ,ALL ,0   ,0   ,0 },
+    { 0   ,0   ,0   ,0   ,0   ,0   ,ALL ,0 },
+};
+
+static const uint8_t channelLength[8] = { 3, 3, 3, 3, 2, 2, 3, 0 };
+
+static inline bool isChannelVoice ( const EasyMidiLibEvent& event )
+{
+    uint8_t status = event.msg[0];
+    return !event.sysex && status>=0x80 && status<0xF0 && event.size>=channelLength[(status>>4) & 7];
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+size_t EasyMidiLib_eventsToUmp ( const EasyMidiLibEvent* events, size_t count, EasyMidiLibUmpProtocol protocol, std::vector<uint32_t>& words, uint8_t group )
+{
+    size_t   start = words.size();
+    uint32_t g     = (uint32_t)(group & 0x0F)<<24;
+
+    // Sized for the short messages (one word in MIDI 1.0 protocol, two in MIDI 2.0) and written through a pointer, grown
+    // by each SysEx and cut to what was written at the end
+    words.resize ( start+count*(protocol==EasyMidiLibUmpProtocol::Midi1 ? 1 : 2) );
+    uint32_t* out = words.data()+start;
+
+    for ( size_t i=0; i!=count; )
+    {
+        // A run of channel voice messages
+        if ( protocol==EasyMidiLibUmpProtocol::Midi1 )
+        {
+            for ( ; i!=count && isChannelVoice(events[i]); i++ )
+            {
+                const uint8_t* msg  = events[i].msg;
+                uint32_t       type = (msg[0]>>4) & 7;
+                *out++ = 0x20000000 | g | (uint32_t)msg[0]<<16 | (uint32_t)(msg[1] & 0x7F)<<8 | (msg[2] & channelMasks.data2[type]);
+            }
+        }
+        else
+        {
+            for ( ; i!=count && isChannelVoice(events[i]); i++ )
+            {
+                const uint8_t* msg    = events[i].msg;
+                uint32_t       status = msg[0];
+                uint32_t       type   = (status>>4) & 7;
+                uint32_t       d1     = msg[1] & 0x7F;
+                uint32_t       d2     = msg[2] & channelMasks.data2[type];
+
+                // Note on with velocity 0 is a note off with the default release velocity
+                uint32_t noteOff = (uint32_t)(type==1) & (uint32_t)(d2==0);
+                status -= noteOff<<4;
+                d2     |= noteOff<<6;
+
+                // Pitch bend upscaled like EasyMidiLib_umpScaleUp(value, 14, 32): above the center the low 13 bits repeat
+                uint32_t bend   = d1 | d2<<7;
+                uint32_t repeat = ((bend & 0x1FFF)<<5 | (bend & 0x1FFF)>>8) & (0u-(uint32_t)(bend>0x2000));
+                uint32_t value  = d2 ^ ((d1^d2) & channelMasks.first[type]);
+
+                out[0] = 0x40000000 | g | status<<16 | (d1<<8 & channelMasks.note[type]);
+                out[1] = ((uint32_t)scale.to16[value]<<16 & channelMasks.to16   [type])
+                       | (scale.to32[value]             & channelMasks.to32   [type])
+                       | (value<<24                     & channelMasks.program[type])
+                       | ((bend<<18 | repeat)           & channelMasks.pitch  [type]);
+                out += 2;
+            }
+        }
+
+        if ( i==count )
+            break;
+
+        const EasyMidiLibEvent& event  = events[i++];
+        const uint8_t*          data   = event.data();
+        uint8_t                 status = event.size ? data[0] : 0;
+
+        if ( status==0xF0 )
+        {
+            // Payload without F0/F7, 6 bytes per packet
+            const uint8_t* payload = data+1;
+            size_t         size    = event.size-1-(data[event.size-1]==0xF7 ? 1 : 0);
+
+            size_t written = out-words.data();
+            words.resize ( words.size()+std::max<size_t>((size+5)/6, 1)*2 );
+            out = words.data()+written;
+
+            for ( size_t pos=0; pos==0 || pos<size; pos+=6 )
+            {
+                size_t  chunk = std::min<size_t> ( 6, size-pos );
+                uint8_t b[6]  = {};
+                memcpy ( b, payload+pos, chunk );
+
+                uint32_t form = size<=6 ? 0 : pos==0 ? 1 : pos+6>=size ? 3 : 2;
+                out[0] = 0x30000000 | g | form<<20 | (uint32_t)chunk<<16 | b[0]<<8 | b[1];
+                out[1] = (uint32_t)b[2]<<24 | b[3]<<16 | b[4]<<8 | b[5];
+                out += 2;
+            }
+            continue;
+        }
+
+        // System messages; incomplete and unknown ones are skipped
+        if ( status<0xF0 || event.size<messageLength(status) )
+            continue;
+
+        size_t   length = messageLength ( status );
+        uint32_t d1     = length>1 ? data[1] & 0x7F : 0;
+        uint32_t d2     = length>2 ? data[2] & 0x7F : 0;
+        *out++ = 0x10000000 | g | (uint32_t)status<<16 | d1<<8 | d2;
+    }
+
+    words.resize ( out-words.data() );
+    return words.size()-start;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+// EasyMidiLibUmpDecoder
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibUmpDecoder::add ( std::vector<EasyMidiLibEvent>& events, uint8_t status, uint8_t data1, uint8_t data2 )
+{
+    EasyMidiLibEvent event = {};
+    event.timestamp = m_timestamp;
+    event.device    = m_device;
+    event.size      = (uint32_t)messageLength ( status );
+    event.msg[0]    = status;
+    event.msg[1]    = data1 & 0x7F;
+    event.msg[2]    = data2 & 0x7F;
+    events.push_back ( event );
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+size_t EasyMidiLibUmpDecoder::decode ( const uint32_t* words, size_t count, const EasyMidiLibDevice* dev, uint64_t timestamp, std::vector<EasyMidiLibEvent>& events )
+{
+    size_t first = events.size();
+    size_t pos   = 0;
+
+    m_device    = dev;
+    m_timestamp = timestamp;
+    m_complete.clear();
+
+    while ( pos<count )
+    {
+        uint32_t word0 = words[pos];
+        size_t   size  = EasyMidiLib_umpWords ( word0 );
+        if ( pos+size>count )
+            break;
+
+        uint32_t word1  = size>1 ? words[pos+1] : 0;
+        uint8_t  status = (uint8_t)(word0>>16);
+        uint8_t  index1 = (uint8_t)(word0>>8);
+        uint8_t  index2 = (uint8_t)word0;
+        uint8_t  ch     = status & 0x0F;
+
+        switch ( EasyMidiLib_umpType(word0) )
+        {
+            case EasyMidiLibUmpType::System:
+            case EasyMidiLibUmpType::Midi1ChannelVoice:
+                if ( status>=0x80 && status!=0xF0 && status!=0xF7 )
+                    add ( events, status, index1, index2 );
+                break;
+
+            case EasyMidiLibUmpType::Midi2ChannelVoice:
+                switch ( status & 0xF0 )
+                {
+                    case 0x80: add ( events, status, index1, (uint8_t)EasyMidiLib_umpScaleDown(word1>>16, 16, 7) ); break;
+                    case 0x90:
+                    {
+                        // A non zero velocity must not turn into a note off
+                        uint8_t velocity = (uint8_t)EasyMidiLib_umpScaleDown ( word1>>16, 16, 7 );
+                        add ( events, status, index1, velocity ? velocity : 1 );
+                        break;
+                    }
+                    case 0xA0: add ( events, status, index1, (uint8_t)(word1>>25) ); break;
+                    case 0xB0: add ( events, status, index1, (uint8_t)(word1>>25) ); break;
+                    case 0xC0:
+                        if ( index2 & 1 )
+                        {
+                            add ( events, 0xB0 | ch, 0 , (uint8_t)(word1>>8) );
+                            add ( events, 0xB0 | ch, 32, (uint8_t)word1 );
+                        }
+                        add ( events, status, (uint8_t)(word1>>24), 0 );
+                        break;
+                    case 0xD0: add ( events, status, (uint8_t)(word1>>25), 0 ); break;
+                    case 0xE0: add ( events, status, (uint8_t)(word1>>18), (uint8_t)(word1>>25) ); break;
+                    case 0x20: // RPN
+                    case 0x30: // NRPN
+                    {
+                        bool rpn = (status & 0xF0)==0x20;
+                        add ( events, 0xB0 | ch, rpn ? 101 : 99, index1 );
+                        add ( events, 0xB0 | ch, rpn ? 100 : 98, index2 );
+                        add ( events, 0xB0 | ch, 6 , (uint8_t)(word1>>25) );
+                        add ( events, 0xB0 | ch, 38, (uint8_t)(word1>>18) );
+                        break;
+                    }
+                }
+                break;
+
+            case EasyMidiLibUmpType::Data64:
+            {
+                uint8_t form  = (word0>>20) & 0x0F;
+                size_t  bytes = std::min<size_t> ( (word0>>16) & 0x0F, 6 );
+                uint8_t b[6]  = { index1, index2, (uint8_t)(word1>>24), (uint8_t)(word1>>16), (uint8_t)(word1>>8), (uint8_t)word1 };
+
+                if ( form==0 || form==1 )
+                    m_sysex.assign ( 1, 0xF0 );
+                else if ( m_sysex.empty() )
+                    break;  // start lost
+
+                for ( size_t i=0; i!=bytes; i++ )
+                    m_sysex.push_back ( b[i] & 0x7F );
+
+                if ( form==0 || form==3 )
+                {
+                    m_sysex.push_back ( 0xF7 );
+
+                    // Short ones fit in the event like the input framing does, the others are fixed up below
+                    EasyMidiLibEvent event = {};
+                    event.timestamp = m_timestamp;
+                    event.device    = m_device;
+                    event.size      = (uint32_t)m_sysex.size();
+                    if ( m_sysex.size()<=sizeof(event.msg) )
+                        memcpy ( event.msg, m_sysex.data(), m_sysex.size() );
+                    else
+                        m_complete.insert ( m_complete.end(), m_sysex.begin(), m_sysex.end() );
+
+                    events.push_back ( event );
+                    m_sysex.clear();
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        pos += size;
+    }
+
+    // Point the long SysEx events at their bytes, now that m_complete won't move
+    size_t offset = 0;
+    for ( size_t i=first; i!=events.size(); i++ )
+    {
+        if ( events[i].size>sizeof(events[i].msg) )
+        {
+            events[i].sysex = &m_complete[offset];
+            offset += events[i].size;
+        }
+    }
+
+    return pos;
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
+void EasyMidiLibUmpDecoder::reset ( )
+{
+    m_sysex   .clear();
+    m_complete.clear();
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
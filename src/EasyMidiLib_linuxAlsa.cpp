@@ -1,6 +1,7 @@
 #ifdef __linux__
 
 #include "EasyMidiLib.h"
+#include "EasyMidiLibInternal.h"
 #include <alsa/asoundlib.h>
 #include <iostream>
 #include <fstream>
@@ -19,9 +20,11 @@
 //--------------------------------------------------------------------------------------------------------------------------
 
 static bool                 initialized       = false;
-static std::string          lastError         = "";
 static EasyMidiLibListener* mainListener      = 0;
 
+// Per thread, so opens running in parallel on the worker pool don't mix their errors
+static thread_local std::string lastError;
+
 //--------------------------------------------------------------------------------------------------------------------------
 
 struct MidiDeviceInfo 
@@ -30,7 +33,7 @@ struct MidiDeviceInfo
     
     snd_rawmidi_t*                rawmidi   = nullptr;
     std::string                   devicePath;
-    std::vector<uint8_t>          inputQueue;
+    std::unique_ptr<EasyMidiLibDeviceState> state;
     bool                          inputThreadRunning = false;
     std::thread                   inputThread;
     uint64_t                      enumerationStamp = 0;
@@ -58,7 +61,7 @@ static void deviceConnected ( const std::string& id, const std::string& name, bo
         d.enumerationStamp = stamp;
         if ( !d.userDev.connected )
         {
-            d.inputQueue.clear();
+            EasyMidiLib_resetDeviceState ( &d.userDev );
             d.userDev.connected = true;
             d.devicePath = devicePath;
             if ( mainListener )
@@ -76,12 +79,14 @@ static void deviceConnected ( const std::string& id, const std::string& name, bo
         d.userDev.userPtrParam    = 0;
         d.userDev.userIntParam    = 0;
         d.userDev.internalHandler = 0;
+        d.userDev.internalState   = 0;
         d.devicePath              = devicePath;
         d.enumerationStamp        = stamp;
-        d.inputQueue.reserve(10240);
+        d.state                   = std::make_unique<EasyMidiLibDeviceState>();
 
         devices[id] = std::move(d);
         devices[id].userDev.internalHandler = &devices[id];
+        devices[id].userDev.internalState   = devices[id].state.get();
 
         if ( mainListener )
             mainListener->deviceConnected ( &devices[id].userDev );
@@ -90,35 +95,33 @@ static void deviceConnected ( const std::string& id, const std::string& name, bo
 
 //--------------------------------------------------------------------------------------------------------------------------
 
-static void deviceDisconnected ( const std::string& id, bool isInput )
+static void deviceDisconnected ( MidiDeviceInfo& d )
 {
-    std::map<std::string,MidiDeviceInfo>& devices = isInput ? inputs : outputs;
+    EasyMidiLib_resetDeviceState ( &d.userDev );
+    d.userDev.connected = false;
+}
 
-    auto it = devices.find(id);
-    if ( it != devices.end() )
-    {
-        MidiDeviceInfo& d = it->second;
-        d.inputQueue.clear();
-        d.userDev.connected = false;
+// Without devicesMutex: closing an input joins its thread and waits for its dispatch, which may take the lock
 
-        if ( d.userDev.opened )
-        {
-            if ( d.userDev.isInput )
-                EasyMidiLib_inputClose ( &d.userDev );
-            else
-                EasyMidiLib_outputClose ( &d.userDev );
-        }
-        
-        if ( mainListener )
-            mainListener->deviceDisconnected ( &d.userDev );
+static void deviceDisconnectedClose ( MidiDeviceInfo& d )
+{
+    if ( d.userDev.opened )
+    {
+        if ( d.userDev.isInput )
+            EasyMidiLib_inputClose ( &d.userDev );
+        else
+            EasyMidiLib_outputClose ( &d.userDev );
     }
+
+    if ( mainListener )
+        mainListener->deviceDisconnected ( &d.userDev );
 }
 
 //--------------------------------------------------------------------------------------------------------------------------
 
 static void enumerateDevices()
 {
-    std::lock_guard<std::mutex> lock(devicesMutex);
+    std::unique_lock<std::mutex> lock(devicesMutex);
     
     // Get current timestamp for this enumeration
     uint64_t currentStamp = std::chrono::duration_cast<std::chrono::milliseconds>(
@@ -223,14 +226,24 @@ static void enumerateDevices()
         }
     }
     
-    // Check for disconnected devices (those without current stamp)
+    // Check for disconnected devices (those without current stamp), closed once the lock is released. Map entries are
+    // only erased by EasyMidiLib_done, after this thread stopped.
+    std::vector<MidiDeviceInfo*> disconnected;
     for (auto& it : inputs)
         if (it.second.enumerationStamp != currentStamp && it.second.userDev.connected)
-            deviceDisconnected(it.first, true);
+            disconnected.push_back(&it.second);
     
     for (auto& it : outputs)
         if (it.second.enumerationStamp != currentStamp && it.second.userDev.connected)
-            deviceDisconnected(it.first, false);
+            disconnected.push_back(&it.second);
+
+    for ( MidiDeviceInfo* d : disconnected )
+        deviceDisconnected ( *d );
+
+    lock.unlock();
+
+    for ( MidiDeviceInfo* d : disconnected )
+        deviceDisconnectedClose ( *d );
 }
 
 //--------------------------------------------------------------------------------------------------------------------------
@@ -239,7 +252,11 @@ static void enumerationThreadFunc()
 {
     while (enumThreadRunning)
     {
+        uint64_t statsBegin = EasyMidiLib_statsBegin();
+        uint64_t traceBegin = EasyMidiLib_traceBegin();
         enumerateDevices();
+        EasyMidiLib_traceEnd         ( "enumerate", 0, traceBegin );
+        EasyMidiLib_statsEnumeration ( statsBegin );
         std::this_thread::sleep_for(std::chrono::milliseconds(2000));
     }
 }
@@ -331,13 +348,20 @@ bool EasyMidiLib_init( EasyMidiLibListener* listener )
 
     // Initial device enumeration
     if ( ok )
+    {
+        uint64_t statsBegin = EasyMidiLib_statsBegin();
+        uint64_t traceBegin = EasyMidiLib_traceBegin();
         enumerateDevices();
+        EasyMidiLib_traceEnd         ( "enumerate", 0, traceBegin );
+        EasyMidiLib_statsEnumeration ( statsBegin );
+    }
 
     // Start enumeration thread for device monitoring
     if ( ok )
     {
         enumThreadRunning = true;
         enumThread = std::thread(enumerationThreadFunc);
+        EasyMidiLib_configureThread ( enumThread, EasyMidiLibThreadRole::Enumeration );
     }
 
     // Done if errors or set as initialized if ok
@@ -359,6 +383,8 @@ bool EasyMidiLib_init( EasyMidiLibListener* listener )
 
 bool EasyMidiLib_update ( )
 {
+    EasyMidiLib_runUpdateHooks();
+
     return true;
 }
 
@@ -366,6 +392,9 @@ bool EasyMidiLib_update ( )
 
 void EasyMidiLib_done()
 {
+    // Finish the queued Begin open/close requests
+    EasyMidiLib_stopWorkers ( );
+
     // Stop enumeration thread
     if (enumThreadRunning)
     {
@@ -381,6 +410,7 @@ void EasyMidiLib_done()
     // Close inputs
     for ( auto& it : inputs )
         EasyMidiLib_inputClose ( &it.second.userDev );
+    EasyMidiLib_stopDispatch ( ); // idle now, stop it before the devices go away
     inputs.clear();
 
     // Close outputs
@@ -409,23 +439,13 @@ static void inputThreadFunc(MidiDeviceInfo* device)
         
         if (bytes_read > 0)
         {
+            uint64_t timestamp = EasyMidiLib_getTimestamp();
+            EasyMidiLib_traceInstant ( "read", &device->userDev, timestamp, bytes_read );
+
             std::lock_guard<std::mutex> lock(devicesMutex);
-            
-            size_t prevSize = device->inputQueue.size();
-            device->inputQueue.resize(prevSize + bytes_read);
-            memcpy(device->inputQueue.data() + prevSize, buffer, bytes_read);
-            
-            if (mainListener)
-            {
-                size_t consumedBytes = mainListener->deviceInData(&device->userDev, device->inputQueue.data(), device->inputQueue.size());
-                if (consumedBytes > 0)
-                {
-                    if (consumedBytes > device->inputQueue.size())
-                        consumedBytes = device->inputQueue.size();
-                    
-                    device->inputQueue.erase(device->inputQueue.begin(), device->inputQueue.begin() + consumedBytes);
-                }
-            }
+            uint64_t traceBegin = EasyMidiLib_traceBegin();
+            EasyMidiLib_deliverInData(mainListener, &device->userDev, buffer, bytes_read, timestamp);
+            EasyMidiLib_traceEnd ( "deliver", &device->userDev, traceBegin, bytes_read );
         }
         else if (bytes_read < 0 && bytes_read != -EAGAIN)
         {
@@ -500,6 +520,7 @@ bool EasyMidiLib_inputOpen ( const EasyMidiLibDevice* dev, void* userPtrParam, i
 
         device->inputThreadRunning = true;
         device->inputThread = std::thread(inputThreadFunc, device);
+        EasyMidiLib_configureThread ( device->inputThread, EasyMidiLibThreadRole::Input );
     }
 
     // Close if errors
@@ -534,6 +555,9 @@ void EasyMidiLib_inputClose ( const EasyMidiLibDevice* dev )
         device->rawmidi = nullptr;
     }
 
+    // Nothing reaches the listener after deviceClose
+    EasyMidiLib_waitDeviceDispatch ( dev );
+
     device->userDev.opened = false;
 
     if ( wasOpened && mainListener )
@@ -663,8 +687,12 @@ bool EasyMidiLib_outputSend ( const EasyMidiLibDevice* dev, const uint8_t* data,
         if ( mainListener )
             mainListener->deviceOutData(&device->userDev, data, size );
 
+        uint64_t statsBegin = EasyMidiLib_statsBegin();
+        uint64_t traceBegin = EasyMidiLib_traceBegin();
+
         // Send raw MIDI data directly
         ssize_t bytes_written = snd_rawmidi_write(device->rawmidi, data, size);
+        EasyMidiLib_traceEnd ( "send", dev, traceBegin, size );
         
         if (bytes_written < 0)
         {
@@ -679,7 +707,12 @@ bool EasyMidiLib_outputSend ( const EasyMidiLibDevice* dev, const uint8_t* data,
         else
         {
             // Ensure data is sent immediately
+            traceBegin = EasyMidiLib_traceBegin();
             snd_rawmidi_drain(device->rawmidi);
+            EasyMidiLib_traceEnd ( "drain", dev, traceBegin, size );
+
+            EasyMidiLib_statsWrite ( dev, statsBegin );
+            EasyMidiLib_statsData  ( dev, data, size );
         }
     }
 
@@ -1,9 +1,11 @@
 #if defined(__APPLE__)
 
 #include "EasyMidiLib.h"
+#include "EasyMidiLibInternal.h"
 #include <CoreMIDI/CoreMIDI.h>
 #include <CoreFoundation/CoreFoundation.h>
 #include <AudioToolbox/AudioToolbox.h>
+#include <mach/mach_time.h>
 
 #include <stdarg.h>
 #include <iostream>
@@ -16,9 +18,11 @@
 //--------------------------------------------------------------------------------------------------------------------------
 
 static bool                 initialized       = false;
-static std::string          lastError         = "";
 static EasyMidiLibListener* mainListener      = 0;
 
+// Per thread, so opens running in parallel on the worker pool don't mix their errors
+static thread_local std::string lastError;
+
 //--------------------------------------------------------------------------------------------------------------------------
 
 static MIDIClientRef        midiClient         = 0;
@@ -31,7 +35,7 @@ struct MidiDeviceInfo
 
     MIDIEndpointRef               endpoint  = 0;
     bool                          isSource  = false;
-    std::vector<uint8_t>          inputQueue;
+    std::unique_ptr<EasyMidiLibDeviceState> state;
 };
 
 static std::mutex                           devicesMutex;
@@ -40,6 +44,18 @@ static std::map<std::string,MidiDeviceInfo> outputs;
 
 //--------------------------------------------------------------------------------------------------------------------------
 
+static uint64_t HostTimeToNanos(MIDITimeStamp hostTime)
+{
+    // steady_clock and MIDITimeStamp share the mach absolute time base, only the units differ
+    static mach_timebase_info_data_t timebase = {0, 0};
+    if (timebase.denom == 0)
+        mach_timebase_info(&timebase);
+
+    return (uint64_t)((__uint128_t)hostTime * timebase.numer / timebase.denom);
+}
+
+//--------------------------------------------------------------------------------------------------------------------------
+
 static std::string GetEndpointName(MIDIEndpointRef endpoint)
 {
     CFStringRef name = nullptr;
@@ -82,7 +98,7 @@ static void deviceConnected(MIDIEndpointRef endpoint, bool isInput, std::map<std
         MidiDeviceInfo& d = it->second;
         if (!d.userDev.connected)
         {
-            d.inputQueue.clear();
+            EasyMidiLib_resetDeviceState(&d.userDev);
             d.userDev.connected = true;
             d.endpoint = endpoint;
             if (mainListener)
@@ -104,12 +120,14 @@ static void deviceConnected(MIDIEndpointRef endpoint, bool isInput, std::map<std
         d.userDev.userPtrParam    = 0;
         d.userDev.userIntParam    = 0;
         d.userDev.internalHandler = 0;
+        d.userDev.internalState   = 0;
         d.endpoint                = endpoint;
         d.isSource                = isInput;
-        d.inputQueue.reserve(10240);
+        d.state                   = std::make_unique<EasyMidiLibDeviceState>();
 
         devices[id] = std::move(d);
         devices[id].userDev.internalHandler = &devices[id];
+        devices[id].userDev.internalState   = devices[id].state.get();
 
         if (mainListener)
             mainListener->deviceConnected(&devices[id].userDev);
@@ -128,7 +146,7 @@ static void deviceDisconnected(const std::string& deviceId, std::map<std::string
     if (it != devices.end())
     {
         MidiDeviceInfo& d = it->second;
-        d.inputQueue.clear();
+        EasyMidiLib_resetDeviceState(&d.userDev);
         d.userDev.connected = false;
 
         if (d.userDev.opened)
@@ -144,7 +162,7 @@ static void deviceDisconnected(const std::string& deviceId, std::map<std::string
     }
     else
     {
-        printf("EasyMidiLib: Untracked %s disconnected (id:%s) (this shouldn't happen)\n", deviceType, deviceId.c_str());
+        EasyMidiLib_log(EasyMidiLibLogLevel::Warning, EasyMidiLibLogCategory::Backend, "EasyMidiLib: Untracked %s disconnected (id:%s) (this shouldn't happen)", deviceType, deviceId);
     }
 }
 
@@ -226,10 +244,10 @@ const char* EasyMidiLib_getLastError()
 
 static void MIDINotifyCallback(const MIDINotification *message, void *refCon)
 {
-    printf("MIDINotifyCallback: messageID = %d\n", (int)message->messageID);
+    EasyMidiLib_log(EasyMidiLibLogLevel::Debug, EasyMidiLibLogCategory::Backend, "MIDINotifyCallback: messageID = %d", (int)message->messageID);
     switch (message->messageID) {
         case kMIDIMsgObjectAdded: {
-            printf("Device added notification\n");
+            EasyMidiLib_log(EasyMidiLibLogLevel::Debug, EasyMidiLibLogCategory::Backend, "Device added notification");
             const MIDIObjectAddRemoveNotification *addRemoveMsg = (const MIDIObjectAddRemoveNotification *)message;
             MIDIEndpointRef endpoint = (MIDIEndpointRef)addRemoveMsg->child;
             
@@ -250,7 +268,7 @@ static void MIDINotifyCallback(const MIDINotification *message, void *refCon)
             break;
         }
         case kMIDIMsgObjectRemoved: {
-            printf("Device removed notification\n");
+            EasyMidiLib_log(EasyMidiLibLogLevel::Debug, EasyMidiLibLogCategory::Backend, "Device removed notification");
             const MIDIObjectAddRemoveNotification *addRemoveMsg = (const MIDIObjectAddRemoveNotification *)message;
             MIDIEndpointRef endpoint = (MIDIEndpointRef)addRemoveMsg->child;
             std::string id = GetEndpointID(endpoint);
@@ -289,19 +307,16 @@ static void MIDIReadCallback(const MIDIPacketList *packetList, void *readProcRef
 
     std::lock_guard<std::mutex> lock(devicesMutex);
 
+    uint64_t now = EasyMidiLib_getTimestamp();
+
     const MIDIPacket *packet = &packetList->packet[0];
     for (UInt32 i = 0; i < packetList->numPackets; ++i) {
-        size_t prevSize = device->inputQueue.size();
-        device->inputQueue.resize(prevSize + packet->length);
-        memcpy(device->inputQueue.data() + prevSize, packet->data, packet->length);
+        uint64_t timestamp = packet->timeStamp ? HostTimeToNanos(packet->timeStamp) : now;
+        EasyMidiLib_traceInstant("read", &device->userDev, now, packet->length);
 
-        size_t consumedBytes = mainListener->deviceInData(&device->userDev, device->inputQueue.data(), device->inputQueue.size());
-        if (consumedBytes > 0) {
-            if (consumedBytes > device->inputQueue.size())
-                consumedBytes = device->inputQueue.size();
-
-            device->inputQueue.erase(device->inputQueue.begin(), device->inputQueue.begin() + consumedBytes);
-        }
+        uint64_t traceBegin = EasyMidiLib_traceBegin();
+        EasyMidiLib_deliverInData(mainListener, &device->userDev, packet->data, packet->length, timestamp);
+        EasyMidiLib_traceEnd("deliver", &device->userDev, traceBegin, packet->length);
 
         packet = MIDIPacketNext(packet);
     }
@@ -345,6 +360,9 @@ bool EasyMidiLib_init(EasyMidiLibListener* listener)
         }
     }
 
+    uint64_t statsBegin = EasyMidiLib_statsBegin();
+    uint64_t traceBegin = EasyMidiLib_traceBegin();
+
     // Enumerate input sources
     if (ok) {
         ItemCount sourceCount = MIDIGetNumberOfSources();
@@ -361,6 +379,8 @@ bool EasyMidiLib_init(EasyMidiLibListener* listener)
             MIDIEndpointRef dest = MIDIGetDestination(i);
             deviceConnected(dest, false, outputs);
         }
+        EasyMidiLib_traceEnd("enumerate", 0, traceBegin);
+        EasyMidiLib_statsEnumeration(statsBegin);
     }
 
     // Done if errors or set as initialized if ok
@@ -381,6 +401,8 @@ bool EasyMidiLib_init(EasyMidiLibListener* listener)
 
 bool EasyMidiLib_update()
 {
+    EasyMidiLib_runUpdateHooks();
+
     return true;
 }
 
@@ -388,6 +410,9 @@ bool EasyMidiLib_update()
 
 void EasyMidiLib_done()
 {
+    // Finish the queued Begin open/close requests
+    EasyMidiLib_stopWorkers();
+
     // Notify to user using listener 'callback'
     if (initialized && mainListener)
         mainListener->libDone();
@@ -395,6 +420,7 @@ void EasyMidiLib_done()
     // Close inputs
     for (auto& it : inputs)
         EasyMidiLib_inputClose(&it.second.userDev);
+    EasyMidiLib_stopDispatch(); // idle now, stop it before the devices go away
     inputs.clear();
 
     // Close outputs
@@ -491,6 +517,9 @@ void EasyMidiLib_inputClose(const EasyMidiLibDevice* dev)
         MIDIPortDisconnectSource(inputPort, device->endpoint);
     }
 
+    // Nothing reaches the listener after deviceClose
+    EasyMidiLib_waitDeviceDispatch(dev);
+
     device->userDev.opened = false;
 
     if (wasOpened && mainListener)
@@ -593,6 +622,9 @@ bool EasyMidiLib_outputSend(const EasyMidiLibDevice* dev, const uint8_t* data, s
         if (mainListener)
             mainListener->deviceOutData(&device->userDev, data, size);
 
+        uint64_t statsBegin = EasyMidiLib_statsBegin();
+        uint64_t traceBegin = EasyMidiLib_traceBegin();
+
         // Create MIDI packet
         Byte packetBuffer[1024];
         MIDIPacketList *packetList = (MIDIPacketList*)packetBuffer;
@@ -602,9 +634,13 @@ bool EasyMidiLib_outputSend(const EasyMidiLibDevice* dev, const uint8_t* data, s
             packet = MIDIPacketListAdd(packetList, sizeof(packetBuffer), packet, 0, size, data);
             if (packet) {
                 OSStatus result = MIDISend(outputPort, device->endpoint, packetList);
+                EasyMidiLib_traceEnd("send", dev, traceBegin, size);
                 if (result != noErr) {
                     ok = false;
                     setLastErrorf("MIDISend failed: %d", (int)result);
+                } else {
+                    EasyMidiLib_statsWrite(dev, statsBegin);
+                    EasyMidiLib_statsData(dev, data, size);
                 }
             } else {
                 ok = false;
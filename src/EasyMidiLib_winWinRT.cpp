@@ -1,6 +1,7 @@
 #ifdef _WIN32
 
 #include "EasyMidiLib.h"
+#include "EasyMidiLibInternal.h"
 #include <winrt/Windows.Foundation.h>
 #include <winrt/Windows.Foundation.Collections.h>
 #include <winrt/Windows.Devices.Enumeration.h>
@@ -30,9 +31,11 @@ using namespace Windows::Storage::Streams;
 //--------------------------------------------------------------------------------------------------------------------------
 
 static bool                 initialized       = false;
-static std::string          lastError         = "";
 static EasyMidiLibListener* mainListener      = 0;
 
+// Per thread, so opens running in parallel on the worker pool don't mix their errors
+static thread_local std::string lastError;
+
 //--------------------------------------------------------------------------------------------------------------------------
 
 static DeviceWatcher    inputsWatcher  = nullptr;
@@ -47,7 +50,7 @@ struct MidiDeviceInfo
     IAsyncOperation<IMidiOutPort> outPortOp = nullptr;
     MidiInPort                    inPort    = nullptr;
     IAsyncOperation<MidiInPort>   inPortOp  = nullptr;
-    std::vector<uint8_t>          inputQueue;
+    std::unique_ptr<EasyMidiLibDeviceState> state;
 };
 
 static std::mutex                           devicesMutex;
@@ -72,7 +75,7 @@ static void deviceConnected ( DeviceInformation const& info, std::map<std::strin
         MidiDeviceInfo& d = it->second;
         if ( !d.userDev.connected )
         {
-            d.inputQueue.clear();
+            EasyMidiLib_resetDeviceState ( &d.userDev );
             d.userDev.connected=true;
             if ( mainListener )
                 mainListener->deviceReconnected ( &d.userDev );
@@ -93,11 +96,13 @@ static void deviceConnected ( DeviceInformation const& info, std::map<std::strin
         d.userDev.userPtrParam    = 0;
         d.userDev.userIntParam    = 0;
         d.userDev.internalHandler = 0;
+        d.userDev.internalState   = 0;
         d.device                  = info;
-        d.inputQueue.reserve(10240);
+        d.state                   = std::make_unique<EasyMidiLibDeviceState>();
 
         devices[id] = std::move(d);
         devices[id].userDev.internalHandler = &devices[id];
+        devices[id].userDev.internalState   = devices[id].state.get();
 
         if ( mainListener )
             mainListener->deviceConnected ( &devices[id].userDev );
@@ -118,7 +123,7 @@ static void deviceDisconnected ( const DeviceInformationUpdate& info, std::map<s
     if ( it != devices.end() )
     {
         MidiDeviceInfo& d = it->second;
-        d.inputQueue.clear();
+        EasyMidiLib_resetDeviceState ( &d.userDev );
         d.userDev.connected=false;
 
         if ( d.userDev.opened )
@@ -134,7 +139,7 @@ static void deviceDisconnected ( const DeviceInformationUpdate& info, std::map<s
     }
     else
     {
-        printf ( "EasyMidiLib: Untracked %s disconnected (id:%s) (this shouldn't happen)\n", deviceType, id.c_str() );
+        EasyMidiLib_log ( EasyMidiLibLogLevel::Warning, EasyMidiLibLogCategory::Backend, "EasyMidiLib: Untracked %s disconnected (id:%s) (this shouldn't happen)", deviceType, id );
     }
 }
 
@@ -251,6 +256,9 @@ bool EasyMidiLib_init( EasyMidiLibListener* listener )
         }
     }
 
+    uint64_t statsBegin = EasyMidiLib_statsBegin();
+    uint64_t traceBegin = EasyMidiLib_traceBegin();
+
     // Enum inputs
     if ( ok )
     {
@@ -276,6 +284,9 @@ bool EasyMidiLib_init( EasyMidiLibListener* listener )
             deviceConnected ( devices.GetAt(i), outputs );
 
         AVOID_STA_END;
+
+        EasyMidiLib_traceEnd         ( "enumerate", 0, traceBegin );
+        EasyMidiLib_statsEnumeration ( statsBegin );
     }
 
     // Init inputs device watcher
@@ -315,6 +326,8 @@ bool EasyMidiLib_init( EasyMidiLibListener* listener )
 
 bool EasyMidiLib_update ( )
 {
+    EasyMidiLib_runUpdateHooks();
+
     return true;
 }
 
@@ -322,6 +335,9 @@ bool EasyMidiLib_update ( )
 
 void EasyMidiLib_done()
 {
+    // Finish the queued Begin open/close requests
+    EasyMidiLib_stopWorkers ( );
+
     // Stop inputs watcher
     if ( inputsWatcher )
     {
@@ -343,6 +359,7 @@ void EasyMidiLib_done()
     // Close inputs
     for ( auto& it : inputs )
         EasyMidiLib_inputClose ( &it.second.userDev );
+    EasyMidiLib_stopDispatch ( ); // idle now, stop it before the devices go away
     inputs.clear();
 
     // Close outputs
@@ -434,25 +451,22 @@ bool EasyMidiLib_inputOpen ( const EasyMidiLibDevice* dev, void* userPtrParam, i
             {
                 if ( mainListener )
                 {
-                    std::lock_guard<std::mutex> lock(devicesMutex);
+                    uint64_t timestamp = EasyMidiLib_getTimestamp();
 
                     IBuffer raw = args.Message().RawData();
                     size_t incommingDataLen = raw.Length();
                     DataReader reader = DataReader::FromBuffer(raw);
 
-                    size_t prevSize = device->inputQueue.size();
-                    device->inputQueue.resize(prevSize+incommingDataLen);
+                    static thread_local std::vector<uint8_t> incommingData;
+                    incommingData.resize(incommingDataLen);
+                    reader.ReadBytes(winrt::array_view<uint8_t>(incommingData.data(), incommingData.data()+incommingDataLen));
 
-                    reader.ReadBytes(winrt::array_view<uint8_t>(device->inputQueue.data()+prevSize, device->inputQueue.data()+prevSize+incommingDataLen));
+                    EasyMidiLib_traceInstant ( "read", &device->userDev, timestamp, incommingDataLen );
 
-                    size_t consumedBytes = mainListener->deviceInData(&device->userDev, device->inputQueue.data(), device->inputQueue.size());
-                    if ( consumedBytes>0 )
-                    {
-                        if ( consumedBytes > device->inputQueue.size() )
-                            consumedBytes = device->inputQueue.size();
-
-                        device->inputQueue.erase( device->inputQueue.begin(), device->inputQueue.begin()+consumedBytes );
-                    }
+                    std::lock_guard<std::mutex> lock(devicesMutex);
+                    uint64_t traceBegin = EasyMidiLib_traceBegin();
+                    EasyMidiLib_deliverInData ( mainListener, &device->userDev, incommingData.data(), incommingDataLen, timestamp );
+                    EasyMidiLib_traceEnd ( "deliver", &device->userDev, traceBegin, incommingDataLen );
                 }
             }
         );
@@ -482,6 +496,9 @@ void EasyMidiLib_inputClose ( const EasyMidiLibDevice* dev )
     device->inPortOp = nullptr;
     device->inPort   = nullptr;    
 
+    // Nothing reaches the listener after deviceClose
+    EasyMidiLib_waitDeviceDispatch ( dev );
+
     device->userDev.opened = false;
 
     if ( wasOpened && mainListener )
@@ -610,10 +627,18 @@ bool EasyMidiLib_outputSend ( const EasyMidiLibDevice* dev, const uint8_t* data,
         if ( mainListener )
             mainListener->deviceOutData(&device->userDev, data, size );
 
+        uint64_t statsBegin = EasyMidiLib_statsBegin();
+        uint64_t traceBegin = EasyMidiLib_traceBegin();
+
         DataWriter writer;
         writer.WriteBytes(winrt::array_view<uint8_t const>(data, data + size));
         IBuffer raw = writer.DetachBuffer();
         device->outPort.SendBuffer(raw);
+
+        EasyMidiLib_traceEnd ( "send", dev, traceBegin, size );
+
+        EasyMidiLib_statsWrite ( dev, statsBegin );
+        EasyMidiLib_statsData  ( dev, data, size );
     }
 
     return ok;